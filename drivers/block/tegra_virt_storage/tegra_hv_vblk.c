@@ -39,6 +39,9 @@
 #endif
 #include "tegra_vblk.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/tegra_hv_vblk.h>
+
 #define DISCARD_ERASE_SECERASE_MASK	(VS_BLK_DISCARD_OP_F | \
 					VS_BLK_SECURE_ERASE_OP_F | \
 					VS_BLK_ERASE_OP_F)
@@ -62,25 +65,47 @@ static inline uint64_t _arch_counter_get_cntvct(void)
 }
 
 /**
- * vblk_get_req: Get a handle to free vsc request.
+ * vblk_get_req: Get the vsc request embedded in a block request.
+ *
+ * Tags are shared by all hardware queues and never exceed max_requests,
+ * so the tag doubles as the index of the request's mempool slot.
  */
-static struct vsc_request *vblk_get_req(struct vblk_dev *vblkdev)
+static struct vsc_request *vblk_get_req(struct vblk_dev *vblkdev,
+		struct request *rq)
 {
 	struct vsc_request *req = NULL;
-	unsigned long bit;
+	uint32_t slot = rq->tag;
 
 	if (vblkdev->queue_state != VBLK_QUEUE_ACTIVE)
 		goto exit;
 
-	bit = find_first_zero_bit(vblkdev->pending_reqs, vblkdev->max_requests);
-	if (bit < vblkdev->max_requests) {
-		req = &vblkdev->reqs[bit];
-		req->vs_req.req_id = bit;
-		set_bit(bit, vblkdev->pending_reqs);
-		vblkdev->inflight_reqs++;
-		mod_timer(&req->timer, jiffies + 30*HZ);
+	if (slot >= vblkdev->max_requests) {
+		dev_err(vblkdev->device, "Request tag %d out of range!\n",
+				slot);
+		goto exit;
 	}
 
+	req = blk_mq_rq_to_pdu(rq);
+	req->id = (rq->mq_hctx->queue_num << VBLK_REQ_ID_HCTX_SHIFT) | slot;
+	req->vs_req.req_id = req->id;
+	req->req = rq;
+
+	if (vblkdev->config.blk_config.use_vm_address == 0U) {
+		req->mempool_virt = (void *)((uintptr_t)vblkdev->shared_buffer +
+			(uintptr_t)(slot * vblkdev->max_io_bytes));
+		req->mempool_offset = (slot * vblkdev->max_io_bytes);
+	} else if (vblkdev->config.blk_config.req_ops_supported & VS_BLK_IOCTL_OP_F) {
+		req->mempool_virt = (void *)((uintptr_t)vblkdev->shared_buffer +
+			(uintptr_t)((slot % vblkdev->max_ioctl_requests) *
+			UFS_IOCTL_MAX_SIZE_SUPPORTED));
+		req->mempool_offset = (slot % vblkdev->max_ioctl_requests) *
+			UFS_IOCTL_MAX_SIZE_SUPPORTED;
+	}
+	req->mempool_len = vblkdev->max_io_bytes;
+
+	vblkdev->inflight_reqs++;
+	mod_timer(&req->timer, jiffies + 30*HZ);
+
 exit:
 	return req;
 }
@@ -88,23 +113,48 @@ exit:
 static struct vsc_request *vblk_get_req_by_sr_num(struct vblk_dev *vblkdev,
 		uint32_t num)
 {
+	uint32_t hctx_idx = num >> VBLK_REQ_ID_HCTX_SHIFT;
+	uint32_t tag = num & VBLK_REQ_ID_TAG_MASK;
 	struct vsc_request *req;
+	struct request *rq;
+
+	if ((hctx_idx >= vblkdev->nr_hw_queues) ||
+		(tag >= vblkdev->max_requests))
+		return NULL;
 
-	if (num >= vblkdev->max_requests)
+	/* Serial number carries the hardware queue and tag of the request */
+	rq = blk_mq_tag_to_rq(vblkdev->tag_set.tags[hctx_idx], tag);
+	if (rq == NULL)
 		return NULL;
 
-	req = &vblkdev->reqs[num];
-	if (test_bit(req->id, vblkdev->pending_reqs) == 0) {
+	req = blk_mq_rq_to_pdu(rq);
+	if ((req->req == NULL) || (req->id != num)) {
 		dev_err(vblkdev->device,
 			"sr_num: Request index %d is not active!\n",
-			req->id);
+			num);
 		req = NULL;
 	}
 
-	/* Assuming serial number is same as index into request array */
 	return req;
 }
 
+/**
+ * vblk_hwq_complete: Account a request completed by the server against
+ * the hardware queue it was dispatched from.
+ */
+static void vblk_hwq_complete(struct vsc_request *req)
+{
+	struct vblk_hw_queue *hwq = req->hwq;
+	uint64_t lat_ns = ktime_get_ns() - req->start_ns;
+
+	atomic_dec(&hwq->inflight);
+	hwq->completed++;
+	hwq->total_lat_ns += lat_ns;
+	if (lat_ns > hwq->max_lat_ns)
+		hwq->max_lat_ns = lat_ns;
+	req->hwq = NULL;
+}
+
 /**
  * vblk_put_req: Free an active vsc request.
  */
@@ -119,25 +169,13 @@ static void vblk_put_req(struct vsc_request *req)
 		return;
 	}
 
-	if (req->id >= vblkdev->max_requests) {
-		dev_err(vblkdev->device, "Request Index %d out of range!\n",
-				req->id);
-		return;
-	}
-
-	if (req != &vblkdev->reqs[req->id]) {
-		dev_err(vblkdev->device,
-			"Request Index %d does not match with the request!\n",
-				req->id);
-		return;
-	}
-
-	if (test_bit(req->id, vblkdev->pending_reqs) == 0) {
+	if (req->req == NULL) {
 		dev_err(vblkdev->device,
 			"Request index %d is not active!\n",
 			req->id);
 	} else {
-		clear_bit(req->id, vblkdev->pending_reqs);
+		if (req->hwq != NULL)
+			vblk_hwq_complete(req);
 		memset(&req->vs_req, 0, sizeof(struct vs_request));
 		req->req = NULL;
 		memset(&req->iter, 0, sizeof(struct req_iterator));
@@ -279,9 +317,9 @@ static void handle_non_ioctl_resp(struct vblk_dev *vblkdev,
 					total_size;
 			}
 
-			if (!vblkdev->config.blk_config.use_vm_address) {
+			if (vsc_req->bounce_virt != NULL) {
 				memcpy(buffer,
-					vsc_req->mempool_virt +
+					vsc_req->bounce_virt +
 					total_size,
 					size);
 			}
@@ -295,14 +333,15 @@ static void handle_non_ioctl_resp(struct vblk_dev *vblkdev,
 	}
 
 end:
-	if (vblkdev->config.blk_config.use_vm_address) {
+	/* Bounced IOVA requests were unmapped at submission */
+	if (vblkdev->config.blk_config.use_vm_address &&
+		(vsc_req->bounce_virt == NULL)) {
 		if ((req_op(bio_req) == REQ_OP_READ) ||
 			(req_op(bio_req) == REQ_OP_WRITE)) {
 			dma_unmap_sg(vblkdev->device,
 				vsc_req->sg_lst,
 				vsc_req->sg_num_ents,
 				DMA_BIDIRECTIONAL);
-			devm_kfree(vblkdev->device, vsc_req->sg_lst);
 		}
 	}
 
@@ -343,6 +382,7 @@ static bool complete_bio_req(struct vblk_dev *vblkdev)
 		dev_err(vblkdev->device, "IO request error = %d\n",
 				status);
 	}
+	trace_vblk_ivc_complete(vblkdev->devnum, req_resp.req_id, status);
 
 #if (IS_ENABLED(CONFIG_TEGRA_HSIERRRPTINJ))
 	if (req_resp.req_id != HSI_ERROR_MAGIC) {
@@ -473,81 +513,130 @@ static enum blk_cmd_op cleanup_op_supported(struct vblk_dev *vblkdev, uint32_t o
 }
 
 /**
- * submit_bio_req: Fetch a bio request and submit it to
- * server for processing.
+ * vblk_sg_dma_contiguous: Check that mapped segments form one IOVA range.
+ *
+ * The IOMMU may map a request to several segments that are still adjacent
+ * in IOVA space, which the server can take as a single range.
+ */
+static bool vblk_sg_dma_contiguous(struct scatterlist *sgl, int nents,
+		unsigned int len)
+{
+	dma_addr_t next = sg_dma_address(sgl);
+	unsigned int total = 0;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sgl, sg, nents, i) {
+		if (sg_dma_address(sg) != next)
+			return false;
+
+		next += sg_dma_len(sg);
+		total += sg_dma_len(sg);
+	}
+
+	return total == len;
+}
+
+/**
+ * vblk_get_bounce: Get the persistent bounce buffer of a request slot.
+ *
+ * Used in IOVA mode when a request does not map to a single IOVA range.
+ * The buffer is allocated on first use and kept for the device lifetime,
+ * so later fallbacks on the same slot don't allocate or map again.
+ */
+static void *vblk_get_bounce(struct vblk_dev *vblkdev, uint32_t slot,
+		dma_addr_t *dma)
+{
+	if (vblkdev->bounce_virt[slot] == NULL) {
+		vblkdev->bounce_virt[slot] = dmam_alloc_coherent(vblkdev->device,
+				vblkdev->max_io_bytes,
+				&vblkdev->bounce_dma[slot], GFP_NOIO);
+		if (vblkdev->bounce_virt[slot] == NULL)
+			return NULL;
+	}
+
+	*dma = vblkdev->bounce_dma[slot];
+
+	return vblkdev->bounce_virt[slot];
+}
+
+/**
+ * submit_bio_req: Submit a block request to server for processing.
+ *
+ * Must be called with ivc_lock held. Returns BLK_STS_OK once the request
+ * is either sent to the server or failed, and a resource status when
+ * it has to be dispatched again later.
  */
-static bool submit_bio_req(struct vblk_dev *vblkdev)
+static blk_status_t submit_bio_req(struct vblk_dev *vblkdev,
+		struct vblk_hw_queue *hwq, struct request *bio_req)
 {
 	struct vsc_request *vsc_req = NULL;
-	struct request *bio_req = NULL;
 	struct vs_request *vs_req;
 	struct bio_vec bvec;
 	size_t size;
 	size_t total_size = 0;
 	void *buffer;
-	struct req_entry *entry = NULL;
-	size_t sz;
 	uint32_t sg_cnt;
+	int mapped;
 	uint32_t ops_supported = vblkdev->config.blk_config.req_ops_supported;
 	dma_addr_t  sg_dma_addr = 0;
 
 	/* Check if ivc queue is full */
 	if (!tegra_hv_ivc_can_write(vblkdev->ivck))
+		goto bio_busy;
+
+	if ((vblkdev->config.blk_config.req_ops_supported & VS_BLK_IOCTL_OP_F) &&
+			(req_op(bio_req) == REQ_OP_DRV_IN) &&
+			(vblkdev->config.blk_config.use_vm_address) &&
+			(vblkdev->inflight_ioctl_reqs >= vblkdev->max_ioctl_requests))
+		goto bio_busy;
+
+	vsc_req = vblk_get_req(vblkdev, bio_req);
+	if (vsc_req == NULL) {
+		if (vblkdev->queue_state != VBLK_QUEUE_ACTIVE)
+			goto bio_busy;
 		goto bio_exit;
-
-	if (vblkdev->queue == NULL)
-		goto bio_exit;
-
-	vsc_req = vblk_get_req(vblkdev);
-	if (vsc_req == NULL)
-		goto bio_exit;
-
-	spin_lock(&vblkdev->queue_lock);
-	if(!list_empty(&vblkdev->req_list)) {
-		entry = list_first_entry(&vblkdev->req_list, struct req_entry,
-						list_entry);
-		if ((vblkdev->config.blk_config.req_ops_supported & VS_BLK_IOCTL_OP_F) &&
-				(req_op(entry->req) == REQ_OP_DRV_IN) &&
-				(vblkdev->config.blk_config.use_vm_address) &&
-				(vblkdev->inflight_ioctl_reqs >= vblkdev->max_ioctl_requests)) {
-			spin_unlock(&vblkdev->queue_lock);
-			goto bio_exit;
-		}
-		list_del(&entry->list_entry);
-		bio_req = entry->req;
-		kfree(entry);
 	}
-	spin_unlock(&vblkdev->queue_lock);
 
-	if (bio_req == NULL)
-		goto bio_exit;
+	/* Mempool mode always stages data in the request's mempool slot */
+	vsc_req->bounce_virt = vblkdev->config.blk_config.use_vm_address ?
+				NULL : vsc_req->mempool_virt;
 
 	if ((vblkdev->config.blk_config.use_vm_address) &&
 		((req_op(bio_req) == REQ_OP_READ) ||
 		(req_op(bio_req) == REQ_OP_WRITE))) {
-		sz = (sizeof(struct scatterlist)
-			* bio_req->nr_phys_segments);
-		vsc_req->sg_lst =  devm_kzalloc(vblkdev->device, sz,
-					GFP_KERNEL);
-		if (vsc_req->sg_lst == NULL) {
-			dev_err(vblkdev->device,
-				"SG mem allocation failed\n");
-			goto bio_exit;
-		}
 		sg_init_table(vsc_req->sg_lst,
 			bio_req->nr_phys_segments);
 		sg_cnt = blk_rq_map_sg(vblkdev->queue, bio_req,
 				vsc_req->sg_lst);
 		vsc_req->sg_num_ents = sg_nents(vsc_req->sg_lst);
-		if (dma_map_sg(vblkdev->device, vsc_req->sg_lst,
-			vsc_req->sg_num_ents, DMA_BIDIRECTIONAL) == 0) {
+		mapped = dma_map_sg(vblkdev->device, vsc_req->sg_lst,
+			vsc_req->sg_num_ents, DMA_BIDIRECTIONAL);
+		if (mapped == 0) {
 			dev_err(vblkdev->device, "dma_map_sg failed\n");
 			goto bio_exit;
 		}
-		sg_dma_addr = sg_dma_address(vsc_req->sg_lst);
+
+		/* The server takes a single IOVA per request. Segments the
+		 * IOMMU could not map to one range go through a bounce
+		 * buffer instead.
+		 */
+		if (vblk_sg_dma_contiguous(vsc_req->sg_lst, mapped,
+				blk_rq_bytes(bio_req))) {
+			sg_dma_addr = sg_dma_address(vsc_req->sg_lst);
+		} else {
+			dma_unmap_sg(vblkdev->device, vsc_req->sg_lst,
+				vsc_req->sg_num_ents, DMA_BIDIRECTIONAL);
+			vsc_req->bounce_virt = vblk_get_bounce(vblkdev,
+				bio_req->tag, &sg_dma_addr);
+			if (vsc_req->bounce_virt == NULL) {
+				vblk_put_req(vsc_req);
+				goto bio_busy;
+			}
+			vblkdev->bounce_fallbacks++;
+		}
 	}
 
-	vsc_req->req = bio_req;
 	vs_req = &vsc_req->vs_req;
 
 	vs_req->type = VS_DATA_REQ;
@@ -558,6 +647,13 @@ static bool submit_bio_req(struct vblk_dev *vblkdev)
 			vs_req->blkdev_req.req_op = VS_BLK_WRITE;
 		} else if (req_op(bio_req) == REQ_OP_FLUSH) {
 			vs_req->blkdev_req.req_op = VS_BLK_FLUSH;
+		} else if (req_op(bio_req) == REQ_OP_WRITE_ZEROES) {
+			/* Written from the shared zero buffer in IOVA mode
+			 * or a zeroed mempool slot, no data pages involved.
+			 */
+			vs_req->blkdev_req.req_op = VS_BLK_WRITE;
+			if (vblkdev->config.blk_config.use_vm_address)
+				sg_dma_addr = vblkdev->zero_dma;
 		} else if (req_op(bio_req) == REQ_OP_DISCARD) {
 			if (vblkdev->config.phys_dev == VSC_DEV_UFS) {
 				vs_req->blkdev_req.req_op =
@@ -602,6 +698,9 @@ static bool submit_bio_req(struct vblk_dev *vblkdev)
 			if (!vblkdev->config.blk_config.use_vm_address) {
 				vs_req->blkdev_req.blk_req.data_offset =
 							vsc_req->mempool_offset;
+				if (req_op(bio_req) == REQ_OP_WRITE_ZEROES)
+					memset(vsc_req->mempool_virt, 0,
+						blk_rq_bytes(bio_req));
 			} else {
 				vs_req->blkdev_req.blk_req.data_offset = 0;
 				/* Provide IOVA  as part of request */
@@ -625,12 +724,12 @@ static bool submit_bio_req(struct vblk_dev *vblkdev)
 						total_size;
 				}
 
-				/* memcpy to mempool not needed as VM IOVA is
-				 * provided
+				/* memcpy not needed when the VM IOVA of the
+				 * data itself is provided
 				 */
-				if (!vblkdev->config.blk_config.use_vm_address) {
+				if (vsc_req->bounce_virt != NULL) {
 					memcpy(
-					vsc_req->mempool_virt + total_size,
+					vsc_req->bounce_virt + total_size,
 					buffer, size);
 				}
 
@@ -670,74 +769,137 @@ static bool submit_bio_req(struct vblk_dev *vblkdev)
 		goto bio_exit;
 	}
 
-	return true;
+	vsc_req->hwq = hwq;
+	vsc_req->start_ns = ktime_get_ns();
+	atomic_inc(&hwq->inflight);
+	hwq->dispatched++;
+
+	if ((req_op(bio_req) == REQ_OP_READ) ||
+		(req_op(bio_req) == REQ_OP_WRITE)) {
+		if (vsc_req->bounce_virt != NULL)
+			vblkdev->bounce_bytes += blk_rq_bytes(bio_req);
+		else
+			vblkdev->zero_copy_bytes += blk_rq_bytes(bio_req);
+	}
+	/* Messages per MB covers the ops that read or write data, write
+	 * zeroes included, so that zeroout doesn't inflate it.
+	 */
+	if ((req_op(bio_req) == REQ_OP_READ) ||
+		(req_op(bio_req) == REQ_OP_WRITE) ||
+		(req_op(bio_req) == REQ_OP_WRITE_ZEROES)) {
+		vblkdev->ivc_bytes += blk_rq_bytes(bio_req);
+		vblkdev->ivc_msgs++;
+	}
+	trace_vblk_ivc_submit(vblkdev->devnum, vsc_req->id,
+		vs_req->blkdev_req.req_op,
+		vs_req->blkdev_req.blk_req.blk_offset,
+		vs_req->blkdev_req.blk_req.num_blks,
+		vblkdev->ivc_msgs, vblkdev->ivc_bytes);
+
+	return BLK_STS_OK;
 
 bio_exit:
 	if (vsc_req != NULL) {
 		vblk_put_req(vsc_req);
 	}
 
-	if (bio_req != NULL) {
-		req_error_handler(vblkdev, bio_req);
-		return true;
-	}
+	req_error_handler(vblkdev, bio_req);
+	return BLK_STS_OK;
 
-	return false;
+bio_busy:
+	/* The completion work reruns the queues once resources are freed.
+	 * With nothing in flight there is no completion to wait for, so
+	 * let blk-mq retry on its own.
+	 */
+	atomic_set(&vblkdev->need_restart, 1);
+	if (vblkdev->inflight_reqs == 0)
+		return BLK_STS_RESOURCE;
+
+	return BLK_STS_DEV_RESOURCE;
 }
 
 static void vblk_request_work(struct work_struct *ws)
 {
 	struct vblk_dev *vblkdev =
 		container_of(ws, struct vblk_dev, work);
-	bool req_submitted, req_completed;
 
-	/* Taking ivc lock before performing IVC read/write */
+	/* Taking ivc lock before performing IVC read */
 	mutex_lock(&vblkdev->ivc_lock);
 	if (tegra_hv_ivc_channel_notified(vblkdev->ivck) != 0) {
 		mutex_unlock(&vblkdev->ivc_lock);
 		return;
 	}
 
-	req_submitted = true;
-	req_completed = true;
-	while (req_submitted || req_completed) {
-		req_completed = complete_bio_req(vblkdev);
-
-		req_submitted = submit_bio_req(vblkdev);
-	}
+	while (complete_bio_req(vblkdev))
+		;
 	mutex_unlock(&vblkdev->ivc_lock);
+
+	/* Requests turned away for lack of IVC frames or vsc requests */
+	if (atomic_xchg(&vblkdev->need_restart, 0) != 0)
+		blk_mq_run_hw_queues(vblkdev->queue, true);
 }
 
-/* The simple form of the request function. */
+/*
+ * Dispatch a request straight to the server from the submitting context.
+ * Hardware queues share the single IVC channel of the device, so they
+ * serialize on ivc_lock only for the IVC write itself.
+ */
 static blk_status_t vblk_request(struct blk_mq_hw_ctx *hctx,
 			const struct blk_mq_queue_data *bd)
 {
-	struct req_entry *entry;
 	struct request *req = bd->rq;
-	struct vblk_dev *vblkdev = hctx->queue->queuedata;
+	struct vblk_hw_queue *hwq = hctx->driver_data;
+	struct vblk_dev *vblkdev = hwq->vblkdev;
+	blk_status_t status;
 
 	blk_mq_start_request(req);
 
-	/* malloc for req list entry */
-	entry = kmalloc(sizeof(struct req_entry), GFP_ATOMIC);
-	if (entry == NULL) {
-		dev_err(vblkdev->device, "Failed to allocate memory\n");
-		return BLK_STS_IOERR;
+	/* Taking ivc lock before performing IVC write */
+	mutex_lock(&vblkdev->ivc_lock);
+	if (tegra_hv_ivc_channel_notified(vblkdev->ivck) != 0) {
+		/* Completion work restarts the queues after the reset */
+		atomic_set(&vblkdev->need_restart, 1);
+		mutex_unlock(&vblkdev->ivc_lock);
+		return BLK_STS_DEV_RESOURCE;
 	}
 
-	/* Initialise the entry */
-	entry->req = req;
-	INIT_LIST_HEAD(&entry->list_entry);
+	status = submit_bio_req(vblkdev, hwq, req);
+	mutex_unlock(&vblkdev->ivc_lock);
 
-	/* Insert the req to list */
-	spin_lock(&vblkdev->queue_lock);
-	list_add_tail(&entry->list_entry, &vblkdev->req_list);
-	spin_unlock(&vblkdev->queue_lock);
+	return status;
+}
 
-	/* Now invoke the queue to handle data inserted in queue */
-	queue_work_on(WORK_CPU_UNBOUND, vblkdev->wq, &vblkdev->work);
+static void bio_request_timeout_callback(struct timer_list *timer)
+{
+	struct vsc_request *req = from_timer(req, timer, timer);
 
-	return BLK_STS_OK;
+	dev_err(req->vblkdev->device, "Request id %d timed out. curr ctr: %llu sched ctr: %llu\n",
+						req->id, _arch_counter_get_cntvct(), req->time);
+
+}
+
+/* The vsc request lives in the PDU of each block request */
+static int vblk_init_request(struct blk_mq_tag_set *set, struct request *rq,
+			unsigned int hctx_idx, unsigned int numa_node)
+{
+	struct vsc_request *req = blk_mq_rq_to_pdu(rq);
+
+	req->vblkdev = set->driver_data;
+	/* SG table for IOVA requests follows the vsc request */
+	req->sg_lst = (struct scatterlist *)(req + 1);
+	timer_setup(&req->timer, bio_request_timeout_callback, 0);
+
+	return 0;
+}
+
+static int vblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			unsigned int hctx_idx)
+{
+	struct vblk_dev *vblkdev = data;
+
+	hctx->driver_data = &vblkdev->hw_queues[hctx_idx];
+
+	return 0;
 }
 
 /* Open and release */
@@ -876,6 +1038,45 @@ vblk_speed_mode_show(struct device *dev, struct device_attribute *attr,
 	return snprintf(buf, 32, "%s\n", vblk->config.speed_mode);
 }
 
+static ssize_t
+vblk_mq_stats_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct gendisk *disk = dev_to_disk(dev);
+	struct vblk_dev *vblk = disk->private_data;
+	struct vblk_hw_queue *hwq;
+	uint64_t avg_lat_ns;
+	ssize_t len = 0;
+	uint32_t i;
+
+	for (i = 0; i < vblk->nr_hw_queues; i++) {
+		hwq = &vblk->hw_queues[i];
+		avg_lat_ns = (hwq->completed != 0U) ?
+			div64_u64(hwq->total_lat_ns, hwq->completed) : 0U;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+			"hwq%u inflight %d dispatched %llu completed %llu avg_lat_us %llu max_lat_us %llu\n",
+			hwq->index, atomic_read(&hwq->inflight),
+			hwq->dispatched, hwq->completed,
+			div_u64(avg_lat_ns, NSEC_PER_USEC),
+			div_u64(hwq->max_lat_ns, NSEC_PER_USEC));
+	}
+
+	return len;
+}
+
+static ssize_t
+vblk_copy_stats_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct gendisk *disk = dev_to_disk(dev);
+	struct vblk_dev *vblk = disk->private_data;
+
+	return scnprintf(buf, PAGE_SIZE,
+		"zero_copy_bytes %llu\nbounce_bytes %llu\nbounce_fallbacks %llu\n",
+		vblk->zero_copy_bytes, vblk->bounce_bytes,
+		vblk->bounce_fallbacks);
+}
+
 static const struct device_attribute dev_attr_phys_dev_ro =
 	__ATTR(phys_dev, 0444,
 	       vblk_phys_dev_show, NULL);
@@ -892,8 +1093,18 @@ static const struct device_attribute dev_attr_speed_mode_ro =
 	__ATTR(speed_mode, 0444,
 	       vblk_speed_mode_show, NULL);
 
+static const struct device_attribute dev_attr_mq_stats_ro =
+	__ATTR(mq_stats, 0444,
+	       vblk_mq_stats_show, NULL);
+
+static const struct device_attribute dev_attr_copy_stats_ro =
+	__ATTR(copy_stats, 0444,
+	       vblk_copy_stats_show, NULL);
+
 static const struct blk_mq_ops vblk_mq_ops = {
 	.queue_rq	= vblk_request,
+	.init_hctx	= vblk_init_hctx,
+	.init_request	= vblk_init_request,
 };
 
 #if (IS_ENABLED(CONFIG_TEGRA_HSIERRRPTINJ))
@@ -971,10 +1182,10 @@ static int vblk_inject_err_fsi(unsigned int inst_id, struct epl_error_report_fra
 static void setup_device(struct vblk_dev *vblkdev)
 {
 	uint32_t max_io_bytes;
-	uint32_t req_id;
 	uint32_t max_requests;
 	uint32_t max_ioctl_requests = 0U;
-	struct vsc_request *req;
+	unsigned long merge_boundary;
+	uint32_t i;
 	int ret;
 	struct tegra_hv_ivm_cookie *ivmk;
 #if (IS_ENABLED(CONFIG_TEGRA_HSIERRRPTINJ))
@@ -985,36 +1196,6 @@ static void setup_device(struct vblk_dev *vblkdev)
 		vblkdev->config.blk_config.num_blks *
 			vblkdev->config.blk_config.hardblk_size;
 
-	memset(&vblkdev->tag_set, 0, sizeof(vblkdev->tag_set));
-	vblkdev->tag_set.ops = &vblk_mq_ops;
-	vblkdev->tag_set.nr_hw_queues = 1;
-	vblkdev->tag_set.nr_maps = 1;
-	vblkdev->tag_set.queue_depth = 16;
-	vblkdev->tag_set.numa_node = NUMA_NO_NODE;
-	vblkdev->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
-
-	ret = blk_mq_alloc_tag_set(&vblkdev->tag_set);
-	if (ret)
-		return;
-
-	vblkdev->queue = blk_mq_init_queue(&vblkdev->tag_set);
-	if (IS_ERR(vblkdev->queue)) {
-		dev_err(vblkdev->device, "failed to init blk queue\n");
-		blk_mq_free_tag_set(&vblkdev->tag_set);
-		return;
-	}
-
-	vblkdev->queue->queuedata = vblkdev;
-
-	blk_queue_logical_block_size(vblkdev->queue,
-		vblkdev->config.blk_config.hardblk_size);
-	blk_queue_physical_block_size(vblkdev->queue,
-		vblkdev->config.blk_config.hardblk_size);
-
-	if (vblkdev->config.blk_config.req_ops_supported & VS_BLK_FLUSH_OP_F) {
-		blk_queue_write_cache(vblkdev->queue, true, false);
-	}
-
 	if (vblkdev->config.blk_config.max_read_blks_per_io !=
 		vblkdev->config.blk_config.max_write_blks_per_io) {
 		dev_err(vblkdev->device,
@@ -1136,24 +1317,6 @@ static void setup_device(struct vblk_dev *vblkdev)
 		}
 	}
 
-	for (req_id = 0; req_id < max_requests; req_id++){
-		req = &vblkdev->reqs[req_id];
-		if (vblkdev->config.blk_config.use_vm_address == 0U) {
-			req->mempool_virt = (void *)((uintptr_t)vblkdev->shared_buffer +
-				(uintptr_t)(req_id * max_io_bytes));
-			req->mempool_offset = (req_id * max_io_bytes);
-		} else {
-			if (vblkdev->config.blk_config.req_ops_supported & VS_BLK_IOCTL_OP_F) {
-				req->mempool_virt = (void *)((uintptr_t)vblkdev->shared_buffer +
-				(uintptr_t)((req_id % max_ioctl_requests) * UFS_IOCTL_MAX_SIZE_SUPPORTED));
-				req->mempool_offset = (req_id % max_ioctl_requests) * UFS_IOCTL_MAX_SIZE_SUPPORTED;
-			}
-		}
-		req->mempool_len = max_io_bytes;
-		req->id = req_id;
-		req->vblkdev = vblkdev;
-	}
-
 	if (max_requests == 0) {
 		dev_err(vblkdev->device,
 			"maximum requests set to 0!\n");
@@ -1162,7 +1325,93 @@ static void setup_device(struct vblk_dev *vblkdev)
 
 	vblkdev->max_requests = max_requests;
 	vblkdev->max_ioctl_requests = max_ioctl_requests;
+	vblkdev->max_io_bytes = max_io_bytes;
+
+	/* One hardware queue per group of CPUs. All queues feed the same IVC
+	 * channel and vsc request pool, so they share one tag space sized to
+	 * the number of requests the server can hold.
+	 */
+	vblkdev->nr_hw_queues = min_t(uint32_t, num_online_cpus(), max_requests);
+	vblkdev->hw_queues = devm_kcalloc(vblkdev->device, vblkdev->nr_hw_queues,
+			sizeof(struct vblk_hw_queue), GFP_KERNEL);
+	if (vblkdev->hw_queues == NULL) {
+		dev_err(vblkdev->device, "failed to alloc hw queues\n");
+		return;
+	}
+
+	for (i = 0; i < vblkdev->nr_hw_queues; i++) {
+		vblkdev->hw_queues[i].vblkdev = vblkdev;
+		vblkdev->hw_queues[i].index = i;
+		atomic_set(&vblkdev->hw_queues[i].inflight, 0);
+	}
+
+	memset(&vblkdev->tag_set, 0, sizeof(vblkdev->tag_set));
+	vblkdev->tag_set.ops = &vblk_mq_ops;
+	vblkdev->tag_set.nr_hw_queues = vblkdev->nr_hw_queues;
+	vblkdev->tag_set.nr_maps = 1;
+	vblkdev->tag_set.queue_depth = max_requests;
+	vblkdev->tag_set.cmd_size = sizeof(struct vsc_request);
+	if (vblkdev->config.blk_config.use_vm_address == 1U)
+		vblkdev->tag_set.cmd_size +=
+			sizeof(struct scatterlist) * VBLK_MAX_SEGMENTS;
+	vblkdev->tag_set.numa_node = NUMA_NO_NODE;
+	vblkdev->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_BLOCKING |
+		BLK_MQ_F_TAG_HCTX_SHARED;
+	vblkdev->tag_set.driver_data = vblkdev;
+
+	ret = blk_mq_alloc_tag_set(&vblkdev->tag_set);
+	if (ret)
+		return;
+
+	vblkdev->queue = blk_mq_init_queue(&vblkdev->tag_set);
+	if (IS_ERR(vblkdev->queue)) {
+		dev_err(vblkdev->device, "failed to init blk queue\n");
+		blk_mq_free_tag_set(&vblkdev->tag_set);
+		vblkdev->queue = NULL;
+		return;
+	}
+
+	vblkdev->queue->queuedata = vblkdev;
+
+	blk_queue_logical_block_size(vblkdev->queue,
+		vblkdev->config.blk_config.hardblk_size);
+	blk_queue_physical_block_size(vblkdev->queue,
+		vblkdev->config.blk_config.hardblk_size);
+
+	if (vblkdev->config.blk_config.req_ops_supported & VS_BLK_FLUSH_OP_F) {
+		blk_queue_write_cache(vblkdev->queue, true, false);
+	}
+
 	blk_queue_max_hw_sectors(vblkdev->queue, max_io_bytes / SECTOR_SIZE);
+	blk_queue_max_segments(vblkdev->queue, VBLK_MAX_SEGMENTS);
+	/* Every IVC message carries at most max_io_bytes, steer filesystems
+	 * towards extents that fill whole messages.
+	 */
+	blk_queue_io_opt(vblkdev->queue, max_io_bytes);
+
+	if (vblkdev->config.blk_config.req_ops_supported & VS_BLK_WRITE_OP_F) {
+		if (vblkdev->config.blk_config.use_vm_address == 1U)
+			vblkdev->zero_virt = dmam_alloc_coherent(vblkdev->device,
+				max_io_bytes, &vblkdev->zero_dma, GFP_KERNEL);
+		if ((vblkdev->config.blk_config.use_vm_address == 0U) ||
+			(vblkdev->zero_virt != NULL))
+			blk_queue_max_write_zeroes_sectors(vblkdev->queue,
+				max_io_bytes / SECTOR_SIZE);
+	}
+
+	/* Let the block layer only build requests the IOMMU can map to one
+	 * IOVA range, so IOVA requests rarely need the bounce fallback.
+	 */
+	if (vblkdev->config.blk_config.use_vm_address == 1U) {
+		merge_boundary = dma_get_merge_boundary(vblkdev->device);
+		if (merge_boundary != 0U)
+			blk_queue_virt_boundary(vblkdev->queue, merge_boundary);
+
+		/* Otherwise the IOMMU splits mapped segments at 64 KiB */
+		if (dma_set_max_seg_size(vblkdev->device, max_io_bytes) != 0)
+			dev_warn(vblkdev->device,
+				"failed to set max DMA segment size\n");
+	}
 	blk_queue_flag_set(QUEUE_FLAG_NONROT, vblkdev->queue);
 
 	if ((vblkdev->config.blk_config.req_ops_supported & VS_BLK_SECURE_ERASE_OP_F)
@@ -1184,8 +1433,10 @@ static void setup_device(struct vblk_dev *vblkdev)
 		 */
 		blk_queue_flag_set(QUEUE_FLAG_DISCARD, vblkdev->queue);
 #endif
+		/* max_erase_blks_per_io is in device blocks, not sectors */
 		blk_queue_max_discard_sectors(vblkdev->queue,
-			vblkdev->config.blk_config.max_erase_blks_per_io);
+			vblkdev->config.blk_config.max_erase_blks_per_io *
+			(vblkdev->config.blk_config.hardblk_size / SECTOR_SIZE));
 		vblkdev->queue->limits.discard_granularity =
 			vblkdev->config.blk_config.hardblk_size;
 	}
@@ -1276,6 +1527,18 @@ static void setup_device(struct vblk_dev *vblkdev)
 		return;
 	}
 
+	if (device_create_file(disk_to_dev(vblkdev->gd),
+		&dev_attr_mq_stats_ro)) {
+		dev_warn(vblkdev->device, "Error adding mq_stats file!\n");
+		return;
+	}
+
+	if (device_create_file(disk_to_dev(vblkdev->gd),
+		&dev_attr_copy_stats_ro)) {
+		dev_warn(vblkdev->device, "Error adding copy_stats file!\n");
+		return;
+	}
+
 
 #if (IS_ENABLED(CONFIG_TEGRA_HSIERRRPTINJ))
 	if (vblkdev->config.phys_dev == VSC_DEV_EMMC) {
@@ -1331,24 +1594,6 @@ static irqreturn_t ivc_irq_handler(int irq, void *data)
 	return IRQ_HANDLED;
 }
 
-static void bio_request_timeout_callback(struct timer_list *timer)
-{
-	struct vsc_request *req = from_timer(req, timer, timer);
-
-	dev_err(req->vblkdev->device, "Request id %d timed out. curr ctr: %llu sched ctr: %llu\n",
-						req->id, _arch_counter_get_cntvct(), req->time);
-
-}
-
-static void tegra_create_timers(struct vblk_dev *vblkdev)
-{
-	uint32_t i;
-
-	for (i = 0; i < MAX_VSC_REQS; i++)
-		timer_setup(&vblkdev->reqs[i].timer, bio_request_timeout_callback, 0);
-
-}
-
 static int tegra_hv_vblk_probe(struct platform_device *pdev)
 {
 	static struct device_node *vblk_node;
@@ -1421,17 +1666,12 @@ static int tegra_hv_vblk_probe(struct platform_device *pdev)
 	vblkdev->queue_state = VBLK_QUEUE_ACTIVE;
 
 	spin_lock_init(&vblkdev->lock);
-	spin_lock_init(&vblkdev->queue_lock);
 	mutex_init(&vblkdev->ioctl_lock);
 	mutex_init(&vblkdev->ivc_lock);
 
 	INIT_WORK(&vblkdev->init, vblk_init_device);
 	INIT_WORK(&vblkdev->work, vblk_request_work);
-	/* creating and initializing the an internal request list */
-	INIT_LIST_HEAD(&vblkdev->req_list);
-
-	/* Create timers for each request going to storage server*/
-	tegra_create_timers(vblkdev);
+	atomic_set(&vblkdev->need_restart, 0);
 
 	if (devm_request_irq(vblkdev->device, vblkdev->ivck->irq,
 		ivc_irq_handler, 0, "vblk", vblkdev)) {
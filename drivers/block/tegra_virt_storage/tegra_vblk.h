@@ -28,6 +28,13 @@
 
 #define MAX_VSC_REQS 32
 
+/* Request id sent to the server is the hardware queue index and tag */
+#define VBLK_REQ_ID_HCTX_SHIFT	16
+#define VBLK_REQ_ID_TAG_MASK	((1U << VBLK_REQ_ID_HCTX_SHIFT) - 1U)
+
+/* Size of the per request SG table used for IOVA requests */
+#define VBLK_MAX_SEGMENTS	128
+
 struct vblk_ioctl_req {
 	uint32_t ioctl_id;
 	void *ioctl_buf;
@@ -35,9 +42,15 @@ struct vblk_ioctl_req {
 	int32_t status;
 };
 
-struct req_entry {
-	struct list_head list_entry;
-	struct request *req;
+/* Per hardware queue statistics, updated under ivc_lock */
+struct vblk_hw_queue {
+	struct vblk_dev *vblkdev;
+	uint32_t index;
+	atomic_t inflight;
+	uint64_t dispatched;
+	uint64_t completed;
+	uint64_t total_lat_ns;
+	uint64_t max_lat_ns;
 };
 
 struct vsc_request {
@@ -56,6 +69,13 @@ struct vsc_request {
 	/* Timer to track bio request completion*/
 	struct timer_list timer;
 	uint64_t time;
+	/* Hardware queue the request was dispatched from */
+	struct vblk_hw_queue *hwq;
+	uint64_t start_ns;
+	/* Staging buffer of the data, NULL when the server accesses it
+	 * directly through its IOVA
+	 */
+	void *bounce_virt;
 };
 
 enum vblk_queue_state {
@@ -76,7 +96,9 @@ struct vblk_dev {
 	struct request_queue *queue;     /* The device request queue */
 	struct gendisk *gd;              /* The gendisk structure */
 	struct blk_mq_tag_set tag_set;
-	struct list_head req_list;	/* List containing req */
+	struct vblk_hw_queue *hw_queues;
+	uint32_t nr_hw_queues;
+	atomic_t need_restart;		/* A queue_rq ran out of resources */
 	uint32_t ivc_id;
 	uint32_t ivm_id;
 	struct tegra_hv_ivc_cookie *ivck;
@@ -89,13 +111,24 @@ struct vblk_dev {
 	struct device *device;
 	void *shared_buffer;
 	struct mutex ioctl_lock;
-	spinlock_t queue_lock;
-	struct vsc_request reqs[MAX_VSC_REQS];
-	DECLARE_BITMAP(pending_reqs, MAX_VSC_REQS);
 	uint32_t inflight_reqs;
 	uint32_t inflight_ioctl_reqs;
 	uint32_t max_requests;
 	uint32_t max_ioctl_requests;
+	uint32_t max_io_bytes;
+	/* IOVA mode bounce buffers, allocated per request slot on demand */
+	void *bounce_virt[MAX_VSC_REQS];
+	dma_addr_t bounce_dma[MAX_VSC_REQS];
+	/* Data staging counters, updated under ivc_lock */
+	uint64_t zero_copy_bytes;
+	uint64_t bounce_bytes;
+	uint64_t bounce_fallbacks;
+	/* Zeroed buffer the server reads for write zeroes in IOVA mode */
+	void *zero_virt;
+	dma_addr_t zero_dma;
+	/* IVC messages sent for data ops and the bytes they covered */
+	uint64_t ivc_msgs;
+	uint64_t ivc_bytes;
 #if (IS_ENABLED(CONFIG_TEGRA_HSIERRRPTINJ))
 	uint32_t epl_id;
 	uint32_t epl_reporter_id;
@@ -7,6 +7,7 @@
 #include <nvidia/conftest.h>
 
 #include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/file.h>
 #include <linux/host1x-next.h>
 #include <linux/idr.h>
@@ -34,6 +35,7 @@
 #include "dc.h"
 #include "drm.h"
 #include "gem.h"
+#include "submit.h"
 #include "uapi.h"
 
 #define DRIVER_NAME "tegra"
@@ -759,6 +761,8 @@ static const struct drm_ioctl_desc tegra_drm_ioctls[] = {
 			  DRM_RENDER_ALLOW),
 	DRM_IOCTL_DEF_DRV(TEGRA_CHANNEL_SUBMIT, tegra_drm_ioctl_channel_submit,
 			  DRM_RENDER_ALLOW),
+	DRM_IOCTL_DEF_DRV(TEGRA_CHANNEL_SUBMIT_BATCH, tegra_drm_ioctl_channel_submit_batch,
+			  DRM_RENDER_ALLOW),
 	DRM_IOCTL_DEF_DRV(TEGRA_SYNCPOINT_ALLOCATE, tegra_drm_ioctl_syncpoint_allocate,
 			  DRM_RENDER_ALLOW),
 	DRM_IOCTL_DEF_DRV(TEGRA_SYNCPOINT_FREE, tegra_drm_ioctl_syncpoint_free,
@@ -867,16 +871,106 @@ static int tegra_debugfs_iova(struct seq_file *s, void *data)
 	return 0;
 }
 
+static int tegra_debugfs_firewall(struct seq_file *s, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)s->private;
+	struct drm_device *drm = node->minor->dev;
+	struct tegra_drm *tegra = drm->dev_private;
+	struct tegra_drm_client *client;
+	unsigned long class;
+	void *regs;
+
+	seq_printf(s, "cache: %s, %lld hits, %lld misses\n",
+		   READ_ONCE(tegra->fw_cache.enable) ? "enabled" : "disabled",
+		   atomic64_read(&tegra->fw_cache.hits),
+		   atomic64_read(&tegra->fw_cache.misses));
+
+	mutex_lock(&tegra->clients_lock);
+
+	list_for_each_entry(client, &tegra->clients, list) {
+		seq_printf(s, "%s:", dev_name(client->base.dev));
+
+		xa_for_each(&client->fw_classes, class, regs)
+			seq_printf(s, " 0x%lx", class);
+
+		seq_puts(s, "\n");
+	}
+
+	mutex_unlock(&tegra->clients_lock);
+
+	return 0;
+}
+
+static int tegra_debugfs_firewall_bench(struct seq_file *s, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)s->private;
+	struct drm_device *drm = node->minor->dev;
+	struct tegra_drm *tegra = drm->dev_private;
+	struct tegra_drm_client *client;
+
+	mutex_lock(&tegra->clients_lock);
+
+	list_for_each_entry(client, &tegra->clients, list)
+		tegra_drm_fw_bench(client, s);
+
+	mutex_unlock(&tegra->clients_lock);
+
+	return 0;
+}
+
+static int tegra_debugfs_submit_bench(struct seq_file *s, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)s->private;
+	struct drm_device *drm = node->minor->dev;
+	struct tegra_drm *tegra = drm->dev_private;
+	struct tegra_drm_client *client;
+
+	mutex_lock(&tegra->clients_lock);
+
+	list_for_each_entry(client, &tegra->clients, list)
+		tegra_drm_submit_bench(client, s);
+
+	mutex_unlock(&tegra->clients_lock);
+
+	return 0;
+}
+
+static int tegra_debugfs_dep_selftest(struct seq_file *s, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)s->private;
+	struct drm_device *drm = node->minor->dev;
+	struct tegra_drm *tegra = drm->dev_private;
+	struct tegra_drm_client *client;
+
+	mutex_lock(&tegra->clients_lock);
+
+	list_for_each_entry(client, &tegra->clients, list)
+		tegra_drm_dep_selftest(client, s);
+
+	mutex_unlock(&tegra->clients_lock);
+
+	return 0;
+}
+
 static struct drm_info_list tegra_debugfs_list[] = {
 	{ "framebuffers", tegra_debugfs_framebuffers, 0 },
 	{ "iova", tegra_debugfs_iova, 0 },
+	{ "firewall", tegra_debugfs_firewall, 0 },
+	{ "firewall_bench", tegra_debugfs_firewall_bench, 0 },
+	{ "submit_bench", tegra_debugfs_submit_bench, 0 },
+	{ "dep_selftest", tegra_debugfs_dep_selftest, 0 },
 };
 
 static void tegra_debugfs_init(struct drm_minor *minor)
 {
+	struct tegra_drm *tegra = minor->dev->dev_private;
+
 	drm_debugfs_create_files(tegra_debugfs_list,
 				 ARRAY_SIZE(tegra_debugfs_list),
 				 minor->debugfs_root, minor);
+
+	debugfs_create_bool("firewall_cache", 0644, minor->debugfs_root,
+			    &tegra->fw_cache.enable);
 }
 #endif
 
@@ -922,6 +1016,8 @@ int tegra_drm_register_client(struct tegra_drm *tegra,
 	if (!client->shared_channel)
 		return -EBUSY;
 
+	xa_init(&client->fw_classes);
+
 	mutex_lock(&tegra->clients_lock);
 	list_add_tail(&client->list, &tegra->clients);
 	client->drm = tegra;
@@ -941,6 +1037,8 @@ int tegra_drm_unregister_client(struct tegra_drm *tegra,
 	if (client->shared_channel)
 		host1x_channel_put(client->shared_channel);
 
+	tegra_drm_fw_cleanup(client);
+
 	return 0;
 }
 
@@ -62,6 +62,13 @@ struct tegra_drm {
 	unsigned int num_crtcs;
 
 	struct tegra_display_hub *hub;
+
+	/* Firewall validation result cache, toggled through debugfs */
+	struct {
+		bool enable;
+		atomic64_t hits;
+		atomic64_t misses;
+	} fw_cache;
 };
 
 static inline struct host1x *tegra_drm_to_host1x(struct tegra_drm *tegra)
@@ -70,6 +77,8 @@ static inline struct host1x *tegra_drm_to_host1x(struct tegra_drm *tegra)
 }
 
 struct tegra_drm_client;
+struct tegra_drm_dep_queue;
+struct tegra_drm_fw_cache;
 
 struct tegra_drm_context {
 	struct tegra_drm_client *client;
@@ -81,6 +90,9 @@ struct tegra_drm_context {
 	/* Only used by new UAPI. */
 	struct xarray mappings;
 	struct host1x_memory_context *memory_context;
+	struct tegra_drm_dep_queue *deps;
+	struct host1x_gather_pool *gather_pool;
+	struct tegra_drm_fw_cache *fw_cache;
 };
 
 struct tegra_drm_client_ops {
@@ -115,6 +127,9 @@ struct tegra_drm_client {
 	struct tegra_drm *drm;
 	struct host1x_channel *shared_channel;
 
+	/* Firewall address register bitmaps, indexed by class */
+	struct xarray fw_classes;
+
 	/* Set by driver */
 	unsigned int version;
 	const struct tegra_drm_client_ops *ops;
@@ -1,17 +1,71 @@
 // SPDX-License-Identifier: GPL-2.0-only
 /* Copyright (c) 2010-2020 NVIDIA Corporation */
 
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+
 #include "drm.h"
 #include "submit.h"
 #include "uapi.h"
 
+/*
+ * Register offsets encodable by INCR, NONINCR and MASK. Whether one of them
+ * takes an address is looked up in a per-class bitmap built from the
+ * client's is_addr_reg() on first use, so that runs can be scanned without
+ * an indirect call per word. The wide opcodes fall back to is_addr_reg()
+ * above this.
+ */
+#define TEGRA_DRM_FW_NUM_REGS 0x1000
+
+struct tegra_drm_fw_class {
+	DECLARE_BITMAP(addr_regs, TEGRA_DRM_FW_NUM_REGS);
+};
+
+/*
+ * Validation results of recently seen gathers, per context. An entry holds
+ * a copy of the gather so that a hit is an exact match rather than a hash
+ * match; only the address words are checked again, against the mappings
+ * of the new submit.
+ */
+#define TEGRA_DRM_FW_CACHE_SIZE		8
+#define TEGRA_DRM_FW_CACHE_MIN_WORDS	64
+#define TEGRA_DRM_FW_CACHE_MAX_ADDRS	32
+
+struct tegra_drm_fw_cache_entry {
+	u32 *data;
+	u32 words;
+	u32 hash;
+	u32 class_in;
+	u32 class_out;
+	u32 num_addrs;
+	u32 addrs[TEGRA_DRM_FW_CACHE_MAX_ADDRS];
+};
+
+struct tegra_drm_fw_cache {
+	struct tegra_drm_fw_cache_entry entries[TEGRA_DRM_FW_CACHE_SIZE];
+};
+
 struct tegra_drm_firewall {
 	struct tegra_drm_submit_data *submit;
 	struct tegra_drm_client *client;
+	const unsigned long *regs;
 	u32 *data;
+	u32 start;
 	u32 pos;
 	u32 end;
 	u32 class;
+
+	/* Don't use the register bitmaps, for benchmarking. */
+	bool slow;
+
+	/* Offsets of address words relative to start, if recording. */
+	bool record;
+	u32 num_addrs;
+	u32 addrs[TEGRA_DRM_FW_CACHE_MAX_ADDRS];
 };
 
 static int fw_next(struct tegra_drm_firewall *fw, u32 *word)
@@ -24,6 +78,67 @@ static int fw_next(struct tegra_drm_firewall *fw, u32 *word)
 	return 0;
 }
 
+static const unsigned long *fw_class_regs(struct tegra_drm_client *client,
+					  u32 class)
+{
+	struct tegra_drm_fw_class *regs, *old;
+	u32 i;
+
+	regs = xa_load(&client->fw_classes, class);
+	if (regs)
+		return regs->addr_regs;
+
+	regs = kzalloc(sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return NULL;
+
+	for (i = 0; i < TEGRA_DRM_FW_NUM_REGS; i++)
+		if (client->ops->is_addr_reg(client->base.dev, class, i))
+			__set_bit(i, regs->addr_regs);
+
+	old = xa_cmpxchg(&client->fw_classes, class, NULL, regs, GFP_KERNEL);
+	if (old) {
+		kfree(regs);
+		return xa_is_err(old) ? NULL : old->addr_regs;
+	}
+
+	return regs->addr_regs;
+}
+
+void tegra_drm_fw_cleanup(struct tegra_drm_client *client)
+{
+	struct tegra_drm_fw_class *regs;
+	unsigned long class;
+
+	xa_for_each(&client->fw_classes, class, regs)
+		kfree(regs);
+
+	xa_destroy(&client->fw_classes);
+}
+
+static void fw_set_class(struct tegra_drm_firewall *fw, u32 class)
+{
+	fw->class = class;
+
+	/* Without a bitmap every lookup goes through is_addr_reg() */
+	if (fw->client->ops->is_addr_reg && !fw->slow)
+		fw->regs = fw_class_regs(fw->client, class);
+	else
+		fw->regs = NULL;
+}
+
+static bool fw_is_addr_reg(struct tegra_drm_firewall *fw, u32 offset)
+{
+	if (!fw->client->ops->is_addr_reg)
+		return false;
+
+	if (fw->regs && offset < TEGRA_DRM_FW_NUM_REGS)
+		return test_bit(offset, fw->regs);
+
+	return fw->client->ops->is_addr_reg(fw->client->base.dev, fw->class,
+					    offset);
+}
+
 static bool fw_check_addr_valid(struct tegra_drm_firewall *fw, u32 offset)
 {
 	u32 i;
@@ -38,42 +153,92 @@ static bool fw_check_addr_valid(struct tegra_drm_firewall *fw, u32 offset)
 	return false;
 }
 
-static int fw_check_reg(struct tegra_drm_firewall *fw, u32 offset)
+static int fw_check_addr(struct tegra_drm_firewall *fw, u32 pos)
 {
-	bool is_addr;
-	u32 word;
-	int err;
+	if (!fw_check_addr_valid(fw, fw->data[pos]))
+		return -EINVAL;
 
-	err = fw_next(fw, &word);
-	if (err)
-		return err;
+	if (fw->record) {
+		if (fw->num_addrs < TEGRA_DRM_FW_CACHE_MAX_ADDRS)
+			fw->addrs[fw->num_addrs] = pos - fw->start;
 
-	if (!fw->client->ops->is_addr_reg)
-		return 0;
+		fw->num_addrs++;
+	}
 
-	is_addr = fw->client->ops->is_addr_reg(fw->client->base.dev, fw->class,
-					       offset);
+	return 0;
+}
 
-	if (!is_addr)
-		return 0;
+static int fw_check_reg(struct tegra_drm_firewall *fw, u32 offset)
+{
+	u32 pos = fw->pos;
 
-	if (!fw_check_addr_valid(fw, word))
+	if (fw->pos == fw->end)
 		return -EINVAL;
 
-	return 0;
+	fw->pos++;
+
+	if (!fw_is_addr_reg(fw, offset))
+		return 0;
+
+	return fw_check_addr(fw, pos);
 }
 
+/*
+ * Payload runs are consumed in one step. Only the words that land in
+ * address registers are looked at: for INCR these are found by scanning
+ * the class bitmap, for NONINCR either every word or none of them is an
+ * address.
+ */
 static int fw_check_regs_seq(struct tegra_drm_firewall *fw, u32 offset,
 			     u32 count, bool incr)
 {
-	u32 i;
+	unsigned long reg, end;
+	u32 pos = fw->pos, i;
+	int err;
 
-	for (i = 0; i < count; i++) {
-		if (fw_check_reg(fw, offset))
-			return -EINVAL;
+	if (count > fw->end - fw->pos)
+		return -EINVAL;
+
+	fw->pos += count;
+
+	if (!fw->client->ops->is_addr_reg || !count)
+		return 0;
+
+	if (!incr) {
+		if (!fw_is_addr_reg(fw, offset))
+			return 0;
+
+		for (i = 0; i < count; i++) {
+			err = fw_check_addr(fw, pos + i);
+			if (err)
+				return err;
+		}
+
+		return 0;
+	}
 
-		if (incr)
-			offset++;
+	i = 0;
+
+	if (fw->regs && offset < TEGRA_DRM_FW_NUM_REGS) {
+		end = min_t(u64, (u64)offset + count, TEGRA_DRM_FW_NUM_REGS);
+		reg = offset;
+
+		for_each_set_bit_from(reg, fw->regs, end) {
+			err = fw_check_addr(fw, pos + reg - offset);
+			if (err)
+				return err;
+		}
+
+		i = end - offset;
+	}
+
+	for (; i < count; i++) {
+		if (!fw_is_addr_reg(fw, offset + i))
+			continue;
+
+		err = fw_check_addr(fw, pos + i);
+		if (err)
+			return err;
 	}
 
 	return 0;
@@ -95,14 +260,7 @@ static int fw_check_regs_mask(struct tegra_drm_firewall *fw, u32 offset,
 
 static int fw_check_regs_imm(struct tegra_drm_firewall *fw, u32 offset)
 {
-	bool is_addr;
-
-	if (!fw->client->ops->is_addr_reg)
-		return 0;
-
-	is_addr = fw->client->ops->is_addr_reg(fw->client->base.dev, fw->class,
-					       offset);
-	if (is_addr)
+	if (fw_is_addr_reg(fw, offset))
 		return -EINVAL;
 
 	return 0;
@@ -141,26 +299,17 @@ enum {
 	HOST1X_OPCODE_EXTEND    = 0x0e,
 };
 
-int tegra_drm_fw_validate(struct tegra_drm_client *client, u32 *data, u32 start,
-			  u32 words, struct tegra_drm_submit_data *submit,
-			  u32 *job_class)
+static int fw_validate(struct tegra_drm_firewall *fw, u32 *job_class)
 {
-	struct tegra_drm_firewall fw = {
-		.submit = submit,
-		.client = client,
-		.data = data,
-		.pos = start,
-		.end = start+words,
-		.class = *job_class,
-	};
+	struct tegra_drm_client *client = fw->client;
 	bool payload_valid = false;
 	u32 payload;
 	int err;
 
-	while (fw.pos != fw.end) {
+	while (fw->pos != fw->end) {
 		u32 word, opcode, offset, count, mask, class;
 
-		err = fw_next(&fw, &word);
+		err = fw_next(fw, &word);
 		if (err)
 			return err;
 
@@ -171,51 +320,52 @@ int tegra_drm_fw_validate(struct tegra_drm_client *client, u32 *data, u32 start,
 			offset = word >> 16 & 0xfff;
 			mask = word & 0x3f;
 			class = (word >> 6) & 0x3ff;
-			err = fw_check_class(&fw, class);
-			fw.class = class;
+			err = fw_check_class(fw, class);
+			if (!err)
+				fw_set_class(fw, class);
 			*job_class = class;
 			if (!err)
-				err = fw_check_regs_mask(&fw, offset, mask);
+				err = fw_check_regs_mask(fw, offset, mask);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal SETCLASS(offset=0x%x, mask=0x%x, class=0x%x) at word %u",
-					 offset, mask, class, fw.pos-1);
+					 offset, mask, class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_INCR:
 			offset = (word >> 16) & 0xfff;
 			count = word & 0xffff;
-			err = fw_check_regs_seq(&fw, offset, count, true);
+			err = fw_check_regs_seq(fw, offset, count, true);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal INCR(offset=0x%x, count=%u) in class 0x%x at word %u",
-					 offset, count, fw.class, fw.pos-1);
+					 offset, count, fw->class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_NONINCR:
 			offset = (word >> 16) & 0xfff;
 			count = word & 0xffff;
-			err = fw_check_regs_seq(&fw, offset, count, false);
+			err = fw_check_regs_seq(fw, offset, count, false);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal NONINCR(offset=0x%x, count=%u) in class 0x%x at word %u",
-					 offset, count, fw.class, fw.pos-1);
+					 offset, count, fw->class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_MASK:
 			offset = (word >> 16) & 0xfff;
 			mask = word & 0xffff;
-			err = fw_check_regs_mask(&fw, offset, mask);
+			err = fw_check_regs_mask(fw, offset, mask);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal MASK(offset=0x%x, mask=0x%x) in class 0x%x at word %u",
-					 offset, mask, fw.class, fw.pos-1);
+					 offset, mask, fw->class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_IMM:
 			/* IMM cannot reasonably be used to write a pointer */
 			offset = (word >> 16) & 0xfff;
-			err = fw_check_regs_imm(&fw, offset);
+			err = fw_check_regs_imm(fw, offset);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal IMM(offset=0x%x) in class 0x%x at word %u",
-					 offset, fw.class, fw.pos-1);
+					 offset, fw->class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_SETPYLD:
 			payload = word & 0xffff;
@@ -226,26 +376,26 @@ int tegra_drm_fw_validate(struct tegra_drm_client *client, u32 *data, u32 start,
 				return -EINVAL;
 
 			offset = word & 0x3fffff;
-			err = fw_check_regs_seq(&fw, offset, payload, true);
+			err = fw_check_regs_seq(fw, offset, payload, true);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal INCR_W(offset=0x%x) in class 0x%x at word %u",
-					 offset, fw.class, fw.pos-1);
+					 offset, fw->class, fw->pos-1);
 			break;
 		case HOST1X_OPCODE_NONINCR_W:
 			if (!payload_valid)
 				return -EINVAL;
 
 			offset = word & 0x3fffff;
-			err = fw_check_regs_seq(&fw, offset, payload, false);
+			err = fw_check_regs_seq(fw, offset, payload, false);
 			if (err)
 				dev_warn(client->base.dev,
 					 "illegal NONINCR(offset=0x%x) in class 0x%x at word %u",
-					 offset, fw.class, fw.pos-1);
+					 offset, fw->class, fw->pos-1);
 			break;
 		default:
 			dev_warn(client->base.dev, "illegal opcode at word %u",
-				 fw.pos-1);
+				 fw->pos-1);
 			return -EINVAL;
 		}
 
@@ -255,3 +405,287 @@ int tegra_drm_fw_validate(struct tegra_drm_client *client, u32 *data, u32 start,
 
 	return 0;
 }
+
+static void fw_init(struct tegra_drm_firewall *fw, struct tegra_drm_client *client,
+		    struct tegra_drm_submit_data *submit, u32 *data, u32 start,
+		    u32 words, u32 class)
+{
+	/* addrs is only read back up to num_addrs */
+	memset(fw, 0, offsetof(struct tegra_drm_firewall, addrs));
+
+	fw->submit = submit;
+	fw->client = client;
+	fw->data = data;
+	fw->start = start;
+	fw->pos = start;
+	fw->end = start + words;
+
+	fw_set_class(fw, class);
+}
+
+static bool fw_cache_match(struct tegra_drm_fw_cache_entry *entry, u32 *data,
+			   u32 words, u32 class, u32 hash)
+{
+	return entry->data && entry->hash == hash && entry->words == words &&
+	       entry->class_in == class &&
+	       !memcmp(entry->data, data, words * sizeof(u32));
+}
+
+static void fw_cache_store(struct tegra_drm_fw_cache_entry *entry,
+			   struct tegra_drm_firewall *fw, u32 hash,
+			   u32 class_in, u32 class_out)
+{
+	u32 words = fw->end - fw->start;
+
+	if (fw->num_addrs > TEGRA_DRM_FW_CACHE_MAX_ADDRS)
+		return;
+
+	if (entry->words != words) {
+		kvfree(entry->data);
+		entry->words = 0;
+
+		entry->data = kvmalloc_array(words, sizeof(u32), GFP_KERNEL);
+		if (!entry->data)
+			return;
+	}
+
+	memcpy(entry->data, fw->data + fw->start, words * sizeof(u32));
+	memcpy(entry->addrs, fw->addrs, fw->num_addrs * sizeof(u32));
+	entry->words = words;
+	entry->hash = hash;
+	entry->class_in = class_in;
+	entry->class_out = class_out;
+	entry->num_addrs = fw->num_addrs;
+}
+
+static int fw_validate_cached(struct tegra_drm_fw_cache *cache,
+			      struct tegra_drm_firewall *fw, u32 *job_class,
+			      bool *hit)
+{
+	u32 words = fw->end - fw->start, class = *job_class, hash, i;
+	struct tegra_drm_fw_cache_entry *entry;
+	int err;
+
+	hash = jhash2(fw->data + fw->start, words, class);
+	entry = &cache->entries[hash % TEGRA_DRM_FW_CACHE_SIZE];
+
+	*hit = false;
+
+	if (fw_cache_match(entry, fw->data + fw->start, words, class, hash)) {
+		for (i = 0; i < entry->num_addrs; i++)
+			if (!fw_check_addr_valid(fw, fw->data[fw->start + entry->addrs[i]]))
+				break;
+
+		if (i == entry->num_addrs) {
+			*job_class = entry->class_out;
+			*hit = true;
+			return 0;
+		}
+	}
+
+	/* Run the full check, which also reports what is wrong. */
+	fw->record = true;
+
+	err = fw_validate(fw, job_class);
+	if (!err)
+		fw_cache_store(entry, fw, hash, class, *job_class);
+
+	return err;
+}
+
+void tegra_drm_fw_cache_free(struct tegra_drm_fw_cache *cache)
+{
+	unsigned int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < TEGRA_DRM_FW_CACHE_SIZE; i++)
+		kvfree(cache->entries[i].data);
+
+	kfree(cache);
+}
+
+int tegra_drm_fw_validate(struct tegra_drm_context *context, u32 *data,
+			  u32 start, u32 words,
+			  struct tegra_drm_submit_data *submit, u32 *job_class)
+{
+	struct tegra_drm_client *client = context->client;
+	struct tegra_drm *tegra = client->drm;
+	struct tegra_drm_firewall fw;
+	bool hit;
+	int err;
+
+	fw_init(&fw, client, submit, data, start, words, *job_class);
+
+	if (!READ_ONCE(tegra->fw_cache.enable) ||
+	    words < TEGRA_DRM_FW_CACHE_MIN_WORDS)
+		return fw_validate(&fw, job_class);
+
+	/* Protected by fpriv->lock, like the rest of the context */
+	if (!context->fw_cache) {
+		context->fw_cache = kzalloc(sizeof(*context->fw_cache), GFP_KERNEL);
+		if (!context->fw_cache)
+			return fw_validate(&fw, job_class);
+	}
+
+	err = fw_validate_cached(context->fw_cache, &fw, job_class, &hit);
+	if (hit)
+		atomic64_inc(&tegra->fw_cache.hits);
+	else
+		atomic64_inc(&tegra->fw_cache.misses);
+
+	return err;
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Synthetic gather stream for benchmarking: runs of INCR, NONINCR and MASK
+ * writes to the low registers of the client's class, with the address
+ * registers pointing into a single fake mapping.
+ */
+#define FW_BENCH_WORDS	16384
+#define FW_BENCH_LOOPS	64
+#define FW_BENCH_IOVA	0x10000000
+
+static u32 fw_bench_payload(const unsigned long *regs, u32 offset,
+			    struct rnd_state *rnd)
+{
+	if (regs && test_bit(offset, regs))
+		return FW_BENCH_IOVA + (prandom_u32_state(rnd) & 0xfff0);
+
+	return prandom_u32_state(rnd);
+}
+
+static void fw_bench_fill(u32 *data, u32 words, u32 class,
+			  const unsigned long *regs)
+{
+	struct rnd_state rnd;
+	u32 pos = 0, i;
+
+	prandom_seed_state(&rnd, 1);
+
+	data[pos++] = class << 6;
+
+	while (pos + 5 <= words) {
+		u32 r = prandom_u32_state(&rnd);
+		u32 offset = r % 0x200;
+		u32 left = words - pos - 1;
+		u32 count;
+
+		switch (r >> 16 & 3) {
+		case 0:
+		case 1:
+			count = min(1 + (r >> 20) % 32, left);
+			data[pos++] = (HOST1X_OPCODE_INCR << 28) | offset << 16 | count;
+			for (i = 0; i < count; i++)
+				data[pos++] = fw_bench_payload(regs, offset + i, &rnd);
+			break;
+
+		case 2:
+			count = min(1 + (r >> 20) % 64, left);
+			data[pos++] = (HOST1X_OPCODE_NONINCR << 28) | offset << 16 | count;
+			for (i = 0; i < count; i++)
+				data[pos++] = fw_bench_payload(regs, offset, &rnd);
+			break;
+
+		case 3:
+			count = min(4u, left);
+			data[pos++] = (HOST1X_OPCODE_MASK << 28) | offset << 16 |
+				      GENMASK(count - 1, 0) << 2;
+			for (i = 0; i < count; i++)
+				data[pos++] = fw_bench_payload(regs, offset + 2 + i, &rnd);
+			break;
+		}
+	}
+
+	/* Pad with empty INCRs */
+	while (pos < words)
+		data[pos++] = HOST1X_OPCODE_INCR << 28;
+}
+
+static int fw_bench_run(struct tegra_drm_client *client,
+			struct tegra_drm_submit_data *submit, u32 *data,
+			struct tegra_drm_fw_cache *cache, bool slow, u64 *ns)
+{
+	struct tegra_drm_firewall fw;
+	u32 i, class;
+	u64 start;
+	bool hit;
+	int err;
+
+	start = ktime_get_ns();
+
+	for (i = 0; i < FW_BENCH_LOOPS; i++) {
+		class = client->base.class;
+
+		fw_init(&fw, client, submit, data, 0, FW_BENCH_WORDS, class);
+		if (slow) {
+			fw.slow = true;
+			fw_set_class(&fw, class);
+		}
+
+		if (cache)
+			err = fw_validate_cached(cache, &fw, &class, &hit);
+		else
+			err = fw_validate(&fw, &class);
+
+		if (err)
+			return err;
+	}
+
+	*ns = ktime_get_ns() - start;
+
+	return 0;
+}
+
+void tegra_drm_fw_bench(struct tegra_drm_client *client, struct seq_file *s)
+{
+	static const char * const modes[] = { "callback", "bitmap", "cached" };
+	struct tegra_drm_mapping mapping = {
+		.iova = FW_BENCH_IOVA,
+		.iova_end = FW_BENCH_IOVA + SZ_64K - 1,
+	};
+	struct tegra_drm_used_mapping used = { .mapping = &mapping };
+	struct tegra_drm_submit_data submit = {
+		.used_mappings = &used,
+		.num_used_mappings = 1,
+	};
+	const unsigned long *regs = NULL;
+	struct tegra_drm_fw_cache *cache;
+	unsigned int mode;
+	u64 ns;
+	u32 *data;
+	int err;
+
+	data = kvmalloc_array(FW_BENCH_WORDS, sizeof(u32), GFP_KERNEL);
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!data || !cache) {
+		seq_printf(s, "%s: out of memory\n", dev_name(client->base.dev));
+		goto free;
+	}
+
+	if (client->ops->is_addr_reg)
+		regs = fw_class_regs(client, client->base.class);
+
+	fw_bench_fill(data, FW_BENCH_WORDS, client->base.class, regs);
+
+	for (mode = 0; mode < ARRAY_SIZE(modes); mode++) {
+		err = fw_bench_run(client, &submit, data, mode == 2 ? cache : NULL,
+				   mode == 0, &ns);
+		if (err) {
+			seq_printf(s, "%s: %s: rejected (%d)\n",
+				   dev_name(client->base.dev), modes[mode], err);
+			continue;
+		}
+
+		seq_printf(s, "%s: %-8s %llu ps/word\n", dev_name(client->base.dev),
+			   modes[mode],
+			   div_u64(ns * 1000, FW_BENCH_LOOPS * FW_BENCH_WORDS));
+	}
+
+free:
+	tegra_drm_fw_cache_free(cache);
+	kvfree(data);
+}
+#endif
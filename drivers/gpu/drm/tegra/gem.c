@@ -289,7 +289,17 @@ static int tegra_bo_iommu_unmap(struct tegra_drm *tegra, struct tegra_bo *bo)
 	return 0;
 }
 
+/*
+ * Cached mappings hold a reference to the buffer object, drop them when a
+ * handle goes away so that they don't keep it allocated and mapped.
+ */
+static void tegra_bo_close_object(struct drm_gem_object *gem, struct drm_file *file)
+{
+	host1x_bo_uncache_all(&to_tegra_bo(gem)->base);
+}
+
 static const struct drm_gem_object_funcs tegra_gem_object_funcs = {
+	.close = tegra_bo_close_object,
 	.free = tegra_bo_free_object,
 	.export = tegra_gem_prime_export,
 	.vm_ops = &tegra_bo_vm_ops,
@@ -508,9 +518,7 @@ void tegra_bo_free_object(struct drm_gem_object *gem)
 
 	/* remove all mappings of this buffer object from any caches */
 	list_for_each_entry_safe(mapping, tmp, &bo->base.mappings, list) {
-		if (mapping->cache)
-			host1x_bo_unpin(mapping);
-		else
+		if (!host1x_bo_uncache(mapping))
 			dev_err(gem->dev->dev, "mapping %p stale for device %s\n", mapping,
 				dev_name(mapping->dev));
 	}
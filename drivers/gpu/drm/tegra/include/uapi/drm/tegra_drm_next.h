@@ -912,11 +912,26 @@ struct drm_tegra_submit_syncpt {
 	 *
 	 * If the job hangs or times out, not all of the increments may
 	 * get executed.
+	 *
+	 * Not written if DRM_TEGRA_SUBMIT_HELD_BACK is returned in the
+	 * submit's `flags`.
 	 */
 	__u32 value;
 };
 
 #define DRM_TEGRA_SUBMIT_SECONDARY_SYNCPT		(1<<0)
+/*
+ * Only valid in DRM_IOCTL_TEGRA_CHANNEL_SUBMIT_BATCH: the job waits for the
+ * job before it in the batch to complete. If that job is held back for
+ * `syncobj_in`, this one is held back as well and must set `syncobj_out`.
+ */
+#define DRM_TEGRA_SUBMIT_WAIT_PREVIOUS			(1<<1)
+/*
+ * Returned by the kernel, ignored on input: the job was held back and will
+ * be pushed to the channel later. Its syncpoint value isn't known, and its
+ * completion is signalled through `syncobj_out` only.
+ */
+#define DRM_TEGRA_SUBMIT_HELD_BACK			(1<<2)
 
 struct drm_tegra_channel_submit {
 	/**
@@ -974,6 +989,13 @@ struct drm_tegra_channel_submit {
 	 *
 	 * Handle for DRM syncobj that will be waited before submission.
 	 * Ignored if zero.
+	 *
+	 * Syncpoint fences are waited for by the channel. If the fence
+	 * depends on other fences and `syncobj_out` is set, the job is held
+	 * in the kernel until they signal and the submission returns right
+	 * away; the job fails if they don't signal within 10 seconds. Later
+	 * jobs of the channel context are held back behind it to keep them in
+	 * order, or wait for it to be pushed if they don't set `syncobj_out`.
 	 */
 	__u32 syncobj_in;
 
@@ -993,9 +1015,9 @@ struct drm_tegra_channel_submit {
 	struct drm_tegra_submit_syncpt syncpt;
 
 	/**
-	 * @flags: [in]
+	 * @flags: [in,out]
 	 *
-	 * Flags.
+	 * Flags. DRM_TEGRA_SUBMIT_HELD_BACK is set or cleared on return.
 	 */
 	__u32 flags;
 
@@ -1007,6 +1029,45 @@ struct drm_tegra_channel_submit {
 	__u32 secondary_syncpt_id;
 };
 
+#define DRM_TEGRA_SUBMIT_BATCH_MAX			64
+
+struct drm_tegra_channel_submit_batch {
+	/**
+	 * @submits_ptr: [in,out]
+	 *
+	 * Pointer to an array of drm_tegra_channel_submit structures. The
+	 * jobs are submitted in order and the syncpoint value of each
+	 * submitted job is written back.
+	 */
+	__u64 submits_ptr;
+
+	/**
+	 * @num_submits: [in]
+	 *
+	 * Number of elements in the `submits_ptr` array.
+	 */
+	__u32 num_submits;
+
+	/**
+	 * @num_submitted: [out]
+	 *
+	 * Number of jobs that were submitted. All jobs are validated before
+	 * any of them is submitted, so this is zero if one of them is
+	 * invalid. If submission itself fails, the jobs before the failing
+	 * one have been submitted.
+	 */
+	__u32 num_submitted;
+
+	/**
+	 * @flags: [in]
+	 *
+	 * Flags, must be zero.
+	 */
+	__u32 flags;
+
+	__u32 padding;
+};
+
 struct drm_tegra_syncpoint_allocate {
 	/**
 	 * @id: [out]
@@ -1071,6 +1132,7 @@ struct drm_tegra_syncpoint_wait {
 #define DRM_IOCTL_TEGRA_CHANNEL_MAP DRM_IOWR(DRM_COMMAND_BASE + 0x12, struct drm_tegra_channel_map)
 #define DRM_IOCTL_TEGRA_CHANNEL_UNMAP DRM_IOWR(DRM_COMMAND_BASE + 0x13, struct drm_tegra_channel_unmap)
 #define DRM_IOCTL_TEGRA_CHANNEL_SUBMIT DRM_IOWR(DRM_COMMAND_BASE + 0x14, struct drm_tegra_channel_submit)
+#define DRM_IOCTL_TEGRA_CHANNEL_SUBMIT_BATCH DRM_IOWR(DRM_COMMAND_BASE + 0x15, struct drm_tegra_channel_submit_batch)
 
 #define DRM_IOCTL_TEGRA_SYNCPOINT_ALLOCATE DRM_IOWR(DRM_COMMAND_BASE + 0x20, struct drm_tegra_syncpoint_allocate)
 #define DRM_IOCTL_TEGRA_SYNCPOINT_FREE DRM_IOWR(DRM_COMMAND_BASE + 0x21, struct drm_tegra_syncpoint_free)
@@ -9,11 +9,13 @@
 #include <linux/host1x-next.h>
 #include <linux/iommu.h>
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/nospec.h>
 #include <linux/overflow.h>
 #include <linux/pm_runtime.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/sync_file.h>
 
@@ -40,8 +42,10 @@ struct gather_bo {
 	struct kref ref;
 
 	struct device *dev;
+	struct host1x_gather_pool *pool;
 	u32 *gather_data;
 	dma_addr_t gather_data_dma;
+	size_t gather_data_size;
 	size_t gather_data_words;
 };
 
@@ -58,8 +62,12 @@ static void gather_bo_release(struct kref *ref)
 {
 	struct gather_bo *bo = container_of(ref, struct gather_bo, ref);
 
-	dma_free_attrs(bo->dev, bo->gather_data_words * 4, bo->gather_data, bo->gather_data_dma,
-		       0);
+	if (bo->pool)
+		host1x_gather_pool_free(bo->pool, bo->gather_data_size, bo->gather_data,
+					bo->gather_data_dma);
+	else
+		dma_free_attrs(bo->dev, bo->gather_data_size, bo->gather_data,
+			       bo->gather_data_dma, DMA_ATTR_WRITE_COMBINE);
 	kfree(bo);
 }
 
@@ -92,8 +100,9 @@ gather_bo_pin(struct device *dev, struct host1x_bo *bo, enum dma_data_direction
 		goto free;
 	}
 
-	err = dma_get_sgtable(gather->dev, map->sgt, gather->gather_data, gather->gather_data_dma,
-			      gather->gather_data_words * 4);
+	err = dma_get_sgtable_attrs(gather->dev, map->sgt, gather->gather_data,
+				    gather->gather_data_dma, gather->gather_data_words * 4,
+				    DMA_ATTR_WRITE_COMBINE);
 	if (err)
 		goto free_sgt;
 
@@ -187,6 +196,47 @@ static void *alloc_copy_user_array(void __user *from, size_t count, size_t size)
 	return data;
 }
 
+/*
+ * Gather data is only written by the CPU, so the buffers are write-combined.
+ * Without a pool they are allocated directly.
+ */
+static struct gather_bo *gather_bo_create(struct device *dev,
+					  struct host1x_gather_pool *pool,
+					  size_t words)
+{
+	struct gather_bo *bo;
+
+	bo = kzalloc(sizeof(*bo), GFP_KERNEL);
+	if (!bo)
+		return NULL;
+
+	host1x_bo_init(&bo->base, &gather_bo_ops);
+	/* Per-submit copy, caching its mapping would only keep it alive */
+	bo->base.uncached = true;
+	kref_init(&bo->ref);
+	bo->dev = dev;
+	bo->pool = pool;
+	bo->gather_data_size = words * 4;
+
+	if (pool)
+		bo->gather_data = host1x_gather_pool_alloc(pool, &bo->gather_data_size,
+							   &bo->gather_data_dma,
+							   GFP_KERNEL | __GFP_NOWARN);
+	else
+		bo->gather_data = dma_alloc_attrs(dev, bo->gather_data_size,
+						  &bo->gather_data_dma,
+						  GFP_KERNEL | __GFP_NOWARN,
+						  DMA_ATTR_WRITE_COMBINE);
+	if (!bo->gather_data) {
+		kfree(bo);
+		return NULL;
+	}
+
+	bo->gather_data_words = words;
+
+	return bo;
+}
+
 static int submit_copy_gather_data(struct gather_bo **pbo, struct device *dev,
 				   struct tegra_drm_context *context,
 				   struct drm_tegra_channel_submit *args)
@@ -204,33 +254,27 @@ static int submit_copy_gather_data(struct gather_bo **pbo, struct device *dev,
 		return -EINVAL;
 	}
 
-	bo = kzalloc(sizeof(*bo), GFP_KERNEL);
-	if (!bo) {
-		SUBMIT_ERR(context, "failed to allocate memory for bo info");
-		return -ENOMEM;
+	/* Gather buffers are recycled across the submits of a context */
+	if (!context->gather_pool) {
+		context->gather_pool = host1x_gather_pool_create(dev, DMA_ATTR_WRITE_COMBINE);
+		if (!context->gather_pool) {
+			SUBMIT_ERR(context, "failed to allocate gather pool");
+			return -ENOMEM;
+		}
 	}
 
-	host1x_bo_init(&bo->base, &gather_bo_ops);
-	kref_init(&bo->ref);
-	bo->dev = dev;
-
-	bo->gather_data = dma_alloc_attrs(dev, copy_len, &bo->gather_data_dma,
-					  GFP_KERNEL | __GFP_NOWARN, 0);
-	if (!bo->gather_data) {
+	bo = gather_bo_create(dev, context->gather_pool, args->gather_data_words);
+	if (!bo) {
 		SUBMIT_ERR(context, "failed to allocate memory for gather data");
-		kfree(bo);
 		return -ENOMEM;
 	}
 
 	if (copy_from_user(bo->gather_data, u64_to_user_ptr(args->gather_data_ptr), copy_len)) {
 		SUBMIT_ERR(context, "failed to copy gather data from userspace");
-		dma_free_attrs(dev, copy_len, bo->gather_data, bo->gather_data_dma, 0);
-		kfree(bo);
+		gather_bo_put(&bo->base);
 		return -EFAULT;
 	}
 
-	bo->gather_data_words = args->gather_data_words;
-
 	*pbo = bo;
 
 	return 0;
@@ -397,7 +441,7 @@ static int submit_job_add_gather(struct host1x_job *job, struct tegra_drm_contex
 		return -EINVAL;
 	}
 
-	if (tegra_drm_fw_validate(context->client, bo->gather_data, *offset,
+	if (tegra_drm_fw_validate(context, bo->gather_data, *offset,
 				  cmd->words, job_data, class)) {
 		SUBMIT_ERR(context, "job was rejected by firewall");
 		return -EINVAL;
@@ -410,10 +454,387 @@ static int submit_job_add_gather(struct host1x_job *job, struct tegra_drm_contex
 	return 0;
 }
 
+/*
+ * Fences from syncobj_in must not block submission. Syncpoint fences are
+ * turned into syncpoint waits executed by the channel. A job that also
+ * depends on other fences is held back in a per-context queue instead, so
+ * that it doesn't occupy the channel, which may be shared with other
+ * contexts. Fence callbacks mark it ready and a work item pushes it to
+ * the channel. While the queue isn't empty, all new jobs of the context
+ * are held back behind it, and jobs are pushed strictly in queue order.
+ * A job whose fences haven't signalled after SUBMIT_DEP_TIMEOUT is dropped
+ * with an error on its completion fence.
+ *
+ * The syncpoint value of a held back job is only known once it is pushed,
+ * so its completion is reported through syncobj_out.
+ */
+#define SUBMIT_MAX_PREFENCES 16
+#define SUBMIT_DEP_TIMEOUT msecs_to_jiffies(10000)
+
+struct tegra_drm_dep_queue {
+	struct kref ref;
+	spinlock_t lock;
+	struct list_head pending;
+	struct delayed_work work;
+	struct work_struct free_work;
+
+	/* Jobs queued and not pushed yet, protected by lock */
+	unsigned int num_jobs;
+	wait_queue_head_t idle;
+
+	/* Completion fences of held back jobs */
+	spinlock_t fence_lock;
+	u64 fence_context;
+	u64 fence_seqno;
+};
+
+struct submit_dep;
+
+struct submit_dep_cb {
+	struct dma_fence_cb cb;
+	struct dma_fence *fence;
+	struct submit_dep *dep;
+};
+
+struct submit_dep {
+	struct list_head list;
+	struct tegra_drm_dep_queue *queue;
+	struct host1x_job *job;
+	struct dma_fence *done;
+	unsigned long deadline;
+	atomic_t pending;
+	unsigned int num_cbs;
+	struct submit_dep_cb cbs[];
+};
+
+struct submit_done_cb {
+	struct dma_fence_cb cb;
+	struct dma_fence *done;
+};
+
+struct submit_prefences {
+	u32 num_waits;
+	struct {
+		u32 id;
+		u32 threshold;
+	} waits[SUBMIT_MAX_PREFENCES];
+
+	/* Wait for the job pushed before this one in the same batch */
+	bool wait_previous;
+
+	/* References are held on these, one more for the previous job */
+	unsigned int num_foreign;
+	struct dma_fence *foreign[SUBMIT_MAX_PREFENCES + 1];
+};
+
+static void submit_prefences_put(struct submit_prefences *pre)
+{
+	while (pre->num_foreign)
+		dma_fence_put(pre->foreign[--pre->num_foreign]);
+}
+
+static const char *submit_done_get_driver_name(struct dma_fence *fence)
+{
+	return "tegra-drm";
+}
+
+static const char *submit_done_get_timeline_name(struct dma_fence *fence)
+{
+	return "held-back-jobs";
+}
+
+static const struct dma_fence_ops submit_done_ops = {
+	.get_driver_name = submit_done_get_driver_name,
+	.get_timeline_name = submit_done_get_timeline_name,
+};
+
+static void tegra_drm_dep_queue_free(struct work_struct *work)
+{
+	struct tegra_drm_dep_queue *queue =
+		container_of(work, struct tegra_drm_dep_queue, free_work);
+
+	cancel_delayed_work_sync(&queue->work);
+	kfree(queue);
+}
+
+/*
+ * The final reference may be dropped by the queue's own work item, which
+ * must not wait for itself, so the queue is freed from another one.
+ */
+static void tegra_drm_dep_queue_release(struct kref *ref)
+{
+	struct tegra_drm_dep_queue *queue =
+		container_of(ref, struct tegra_drm_dep_queue, ref);
+
+	schedule_work(&queue->free_work);
+}
+
+void tegra_drm_dep_queue_put(struct tegra_drm_dep_queue *queue)
+{
+	if (queue)
+		kref_put(&queue->ref, tegra_drm_dep_queue_release);
+}
+
+static void submit_dep_queue_work(struct work_struct *work);
+
+static struct tegra_drm_dep_queue *submit_dep_queue_alloc(void)
+{
+	struct tegra_drm_dep_queue *queue;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return NULL;
+
+	kref_init(&queue->ref);
+	spin_lock_init(&queue->lock);
+	INIT_LIST_HEAD(&queue->pending);
+	INIT_DELAYED_WORK(&queue->work, submit_dep_queue_work);
+	init_waitqueue_head(&queue->idle);
+	INIT_WORK(&queue->free_work, tegra_drm_dep_queue_free);
+	spin_lock_init(&queue->fence_lock);
+	queue->fence_context = dma_fence_context_alloc(1);
+
+	return queue;
+}
+
+static struct tegra_drm_dep_queue *
+submit_get_dep_queue(struct tegra_drm_context *context)
+{
+	/* Protected by fpriv->lock, like the rest of the context */
+	if (!context->deps)
+		context->deps = submit_dep_queue_alloc();
+
+	return context->deps;
+}
+
+static void submit_done_signal(struct dma_fence *done, int err)
+{
+	if (err)
+		dma_fence_set_error(done, err);
+
+	dma_fence_signal(done);
+}
+
+static void submit_done_hw_signaled(struct dma_fence *fence, struct dma_fence_cb *cb)
+{
+	struct submit_done_cb *done_cb = container_of(cb, struct submit_done_cb, cb);
+
+	submit_done_signal(done_cb->done, fence->error);
+	dma_fence_put(done_cb->done);
+	kfree(done_cb);
+}
+
+/* Signal the completion fence of a pushed job once the job completes */
+static void submit_done_chain(struct dma_fence *done, struct host1x_job *job)
+{
+	struct submit_done_cb *done_cb;
+	struct dma_fence *fence;
+	int err = -ENOMEM;
+
+	done_cb = kzalloc(sizeof(*done_cb), GFP_KERNEL);
+	if (!done_cb)
+		goto fail;
+
+	fence = host1x_fence_create(job->syncpt, job->syncpt_end, true);
+	if (IS_ERR(fence)) {
+		err = PTR_ERR(fence);
+		kfree(done_cb);
+		goto fail;
+	}
+
+	done_cb->done = dma_fence_get(done);
+
+	/* The fence holds its own reference while signalling is enabled */
+	if (dma_fence_add_callback(fence, &done_cb->cb, submit_done_hw_signaled))
+		submit_done_hw_signaled(fence, &done_cb->cb);
+
+	dma_fence_put(fence);
+	return;
+
+fail:
+	submit_done_signal(done, err);
+}
+
+/* Push a held back job or drop it, from the queue's work item */
+static void submit_dep_finish(struct submit_dep *dep)
+{
+	struct tegra_drm_dep_queue *queue = dep->queue;
+	struct host1x_job *job = dep->job;
+	unsigned long flags;
+	unsigned int i;
+	int err;
+
+	/* Once removed, no callback can still be running */
+	for (i = 0; i < dep->num_cbs; i++) {
+		dma_fence_remove_callback(dep->cbs[i].fence, &dep->cbs[i].cb);
+		dma_fence_put(dep->cbs[i].fence);
+	}
+
+	if (atomic_read(&dep->pending) == 0)
+		err = host1x_job_submit(job);
+	else
+		err = -ETIMEDOUT;
+
+	if (err) {
+		dev_err_ratelimited(job->client->dev,
+				    "failed to submit held back job: %d\n", err);
+		host1x_job_unpin(job);
+		submit_done_signal(dep->done, err);
+	} else {
+		submit_done_chain(dep->done, job);
+	}
+
+	spin_lock_irqsave(&queue->lock, flags);
+	if (--queue->num_jobs == 0)
+		wake_up_all(&queue->idle);
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	dma_fence_put(dep->done);
+	host1x_job_put(job);
+	kfree(dep);
+
+	tegra_drm_dep_queue_put(queue);
+}
+
+static void submit_dep_queue_work(struct work_struct *work)
+{
+	struct tegra_drm_dep_queue *queue =
+		container_of(to_delayed_work(work), struct tegra_drm_dep_queue, work);
+	struct submit_dep *dep, *tmp;
+	unsigned long flags;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&queue->lock, flags);
+
+	/* Release jobs in order, up to the first one still waiting */
+	while ((dep = list_first_entry_or_null(&queue->pending, struct submit_dep, list))) {
+		if (atomic_read(&dep->pending) &&
+		    time_before(jiffies, dep->deadline)) {
+			/* It keeps the queue alive until this runs again */
+			queue_delayed_work(system_wq, &queue->work, dep->deadline - jiffies);
+			break;
+		}
+
+		list_move_tail(&dep->list, &done);
+	}
+
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	/* May drop the last references to the queue */
+	list_for_each_entry_safe(dep, tmp, &done, list)
+		submit_dep_finish(dep);
+}
+
+static void submit_dep_signaled(struct dma_fence *fence, struct dma_fence_cb *cb)
+{
+	struct submit_dep_cb *dep_cb = container_of(cb, struct submit_dep_cb, cb);
+	struct submit_dep *dep = dep_cb->dep;
+
+	/* The work item removes all callbacks before the job is freed */
+	if (atomic_dec_and_test(&dep->pending))
+		mod_delayed_work(system_wq, &dep->queue->work, 0);
+}
+
+/*
+ * Hold back @job until the fences in @pre have signalled and the jobs
+ * queued before it have been pushed, taking over the references to the
+ * fences. Returns the job's completion fence.
+ */
+static struct dma_fence *submit_dep_queue_job(struct tegra_drm_dep_queue *queue,
+					      struct host1x_job *job,
+					      struct submit_prefences *pre)
+{
+	struct dma_fence *done;
+	struct submit_dep *dep;
+	unsigned long flags;
+	unsigned int i;
+
+	dep = kzalloc(struct_size(dep, cbs, pre->num_foreign), GFP_KERNEL);
+	if (!dep)
+		return ERR_PTR(-ENOMEM);
+
+	dep->done = kzalloc(sizeof(*dep->done), GFP_KERNEL);
+	if (!dep->done) {
+		kfree(dep);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	spin_lock_irqsave(&queue->fence_lock, flags);
+	dma_fence_init(dep->done, &submit_done_ops, &queue->fence_lock,
+		       queue->fence_context, ++queue->fence_seqno);
+	spin_unlock_irqrestore(&queue->fence_lock, flags);
+
+	kref_get(&queue->ref);
+	dep->queue = queue;
+	dep->job = host1x_job_get(job);
+	dep->deadline = jiffies + SUBMIT_DEP_TIMEOUT;
+	/* Held until all callbacks are installed */
+	atomic_set(&dep->pending, pre->num_foreign + 1);
+
+	for (i = 0; i < pre->num_foreign; i++) {
+		dep->cbs[i].dep = dep;
+		dep->cbs[i].fence = pre->foreign[i];
+
+		if (dma_fence_add_callback(pre->foreign[i], &dep->cbs[i].cb, submit_dep_signaled))
+			atomic_dec(&dep->pending);
+	}
+
+	dep->num_cbs = pre->num_foreign;
+	pre->num_foreign = 0;
+
+	/* The work item may free the job as soon as it is queued */
+	done = dma_fence_get(dep->done);
+
+	spin_lock_irqsave(&queue->lock, flags);
+	list_add_tail(&dep->list, &queue->pending);
+	queue->num_jobs++;
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	/* Run the work for the deadline, or now if everything has signalled */
+	if (atomic_dec_and_test(&dep->pending))
+		mod_delayed_work(system_wq, &queue->work, 0);
+	else
+		queue_delayed_work(system_wq, &queue->work, SUBMIT_DEP_TIMEOUT);
+
+	return done;
+}
+
+static void submit_resolve_prefences(struct dma_fence *fence, struct submit_prefences *pre)
+{
+	struct dma_fence **fences = &fence;
+	unsigned int i, num_fences = 1;
+
+	if (dma_fence_is_array(fence)) {
+		struct dma_fence_array *array = to_dma_fence_array(fence);
+
+		/* Too many to track one by one, depend on the array itself */
+		if (array->num_fences <= SUBMIT_MAX_PREFENCES) {
+			fences = array->fences;
+			num_fences = array->num_fences;
+		}
+	}
+
+	for (i = 0; i < num_fences; i++) {
+		u32 id, threshold;
+
+		if (dma_fence_is_signaled(fences[i]))
+			continue;
+
+		if (host1x_fence_extract(fences[i], &id, &threshold) == 0) {
+			pre->waits[pre->num_waits].id = id;
+			pre->waits[pre->num_waits].threshold = threshold;
+			pre->num_waits++;
+		} else {
+			pre->foreign[pre->num_foreign++] = dma_fence_get(fences[i]);
+		}
+	}
+}
+
 static struct host1x_job *
 submit_create_job(struct tegra_drm_context *context, struct gather_bo *bo,
 		  struct drm_tegra_channel_submit *args, struct tegra_drm_submit_data *job_data,
-		  struct xarray *syncpoints, struct drm_tegra_submit_cmd *cmds)
+		  struct xarray *syncpoints, struct drm_tegra_submit_cmd *cmds,
+		  struct submit_prefences *pre)
 {
 	u32 i, gather_offset = 0, class;
 	bool first_gather = true;
@@ -424,7 +845,7 @@ submit_create_job(struct tegra_drm_context *context, struct gather_bo *bo,
 	/* Set initial class for firewall. */
 	class = context->client->base.class;
 
-	needed_cmds = args->num_cmds;
+	needed_cmds = args->num_cmds + pre->num_waits + pre->wait_previous;
 	if (job_data->timestamps.virt) {
 		/* Space for TSP method commands */
 		err = check_add_overflow(needed_cmds, (u32)2U, &needed_cmds);
@@ -450,6 +871,13 @@ submit_create_job(struct tegra_drm_context *context, struct gather_bo *bo,
 	job->class = context->client->base.class;
 	job->serialize = true;
 
+	if (pre->wait_previous)
+		host1x_job_add_wait_previous(job, class);
+
+	for (i = 0; i < pre->num_waits; i++)
+		host1x_job_add_wait(job, pre->waits[i].id, pre->waits[i].threshold,
+				    false, class);
+
 	for (i = 0; i < args->num_cmds; i++) {
 		struct drm_tegra_submit_cmd *cmd = &cmds[i];
 
@@ -578,67 +1006,206 @@ static int submit_init_profiling(struct tegra_drm_context *context,
 	return 0;
 }
 
-int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
-				   struct drm_file *file)
+/*
+ * Job submission will need to temporarily change stream ID, so need to
+ * tell it what to change it back to.
+ */
+static u32 submit_fallback_streamid(struct device *dev)
+{
+#ifdef CONFIG_IOMMU_API
+	struct iommu_fwspec *spec = dev_iommu_fwspec_get(dev);
+
+	if (spec && spec->num_ids > 0)
+		return spec->ids[0] & 0xffff;
+#endif
+	return 0x7f;
+}
+
+static atomic_t next_job_id = ATOMIC_INIT(1);
+
+/* A job of a submit, from being prepared until it is pushed or held back */
+struct submit_job {
+	struct drm_tegra_channel_submit *args;
+	struct tegra_drm_context *context;
+	struct drm_syncobj *syncobj;
+	struct submit_prefences pre;
+	struct drm_tegra_submit_cmd *cmds;
+	struct host1x_job *job;
+	/* Set for jobs held back in the dependency queue */
+	bool held;
+	bool submitted;
+	/* Completion fence of a held back job */
+	struct dma_fence *done;
+	/* Queue to wait for before retrying, for a job that can't be held */
+	struct tegra_drm_dep_queue *drain;
+	u32 job_id;
+	u64 timestamp;
+};
+
+/*
+ * Look up the syncobjs of a job. Called without fpriv->lock, as fences of
+ * a job that can't be held back are waited for here.
+ */
+static int submit_job_get_fences(struct drm_file *file, struct submit_job *sj)
 {
+	struct drm_tegra_channel_submit *args = sj->args;
+	struct submit_prefences *pre = &sj->pre;
+	unsigned int i;
+	int err;
+
+	if (args->syncobj_in) {
+		struct dma_fence *fence;
+
+		err = drm_syncobj_find_fence(file, args->syncobj_in, 0, 0, &fence);
+		if (err) {
+			pr_err_ratelimited("%s: %s: invalid syncobj_in '%#x'", __func__,
+					   current->comm, args->syncobj_in);
+			return err;
+		}
+
+		submit_resolve_prefences(fence, pre);
+		dma_fence_put(fence);
+	}
+
+	if (args->syncobj_out) {
+		sj->syncobj = drm_syncobj_find(file, args->syncobj_out);
+		if (!sj->syncobj) {
+			pr_err_ratelimited("%s: %s: invalid syncobj_out '%#x'", __func__,
+					   current->comm, args->syncobj_out);
+			return -ENOENT;
+		}
+	}
+
+	/*
+	 * A held back job can only report its completion through syncobj_out.
+	 * Without one, wait for the fences here so that the returned syncpoint
+	 * value stays valid.
+	 */
+	if (pre->num_foreign && !sj->syncobj) {
+		for (i = 0; i < pre->num_foreign; i++) {
+			long timeout = dma_fence_wait_timeout(pre->foreign[i], true,
+							      msecs_to_jiffies(10000));
+
+			if (timeout <= 0) {
+				err = timeout ?: -ETIMEDOUT;
+				pr_err_ratelimited("%s: %s: wait for syncobj_in failed: %d",
+						   __func__, current->comm, err);
+				return err;
+			}
+		}
+
+		submit_prefences_put(pre);
+	}
+
+	return 0;
+}
+
+/* Whether a job of @context before @index in the batch is held back */
+static bool submit_batch_holds(const struct submit_job *jobs, unsigned int index,
+			       const struct tegra_drm_context *context)
+{
+	unsigned int i;
+
+	for (i = 0; i < index; i++)
+		if (jobs[i].context == context && jobs[i].held)
+			return true;
+
+	return false;
+}
+
+/*
+ * Wait without fpriv->lock until the jobs held back in @queue have been
+ * pushed, for a job that must be pushed after them but can't be held.
+ */
+static int submit_wait_drained(struct tegra_drm_dep_queue *queue)
+{
+	long timeout;
+
+	timeout = wait_event_interruptible_timeout(queue->idle, !READ_ONCE(queue->num_jobs),
+						   SUBMIT_DEP_TIMEOUT);
+	tegra_drm_dep_queue_put(queue);
+
+	if (timeout < 0)
+		return timeout;
+
+	return timeout ? 0 : -ETIMEDOUT;
+}
+
+/*
+ * Validate job @index of @jobs, map its buffers and pin it, without pushing
+ * it to the channel. The jobs before it belong to the same batch. Called
+ * with fpriv->lock held.
+ */
+static int submit_job_prepare(struct drm_device *drm, struct drm_file *file,
+			      struct submit_job *jobs, unsigned int index)
+{
+	const struct submit_job *prev = index ? &jobs[index - 1] : NULL;
+	u32 flags = DRM_TEGRA_SUBMIT_SECONDARY_SYNCPT | DRM_TEGRA_SUBMIT_HELD_BACK;
 	struct tegra_drm_file *fpriv = file->driver_priv;
-	struct drm_tegra_channel_submit *args = data;
-	static atomic_t next_job_id = ATOMIC_INIT(1);
+	struct submit_job *sj = &jobs[index];
+	struct drm_tegra_channel_submit *args = sj->args;
+	struct submit_prefences *pre = &sj->pre;
 	struct tegra_drm_submit_data *job_data;
-	struct drm_tegra_submit_cmd *cmds;
-	struct drm_syncobj *syncobj = NULL;
 	struct tegra_drm_context *context;
+	bool wait_previous, behind;
 	struct host1x_job *job;
 	struct gather_bo *bo;
-	u64 timestamp;
-	u32 i, job_id;
+	u32 i;
 	int err;
 
-	mutex_lock(&fpriv->lock);
-
 	context = xa_load(&fpriv->contexts, args->context);
 	if (!context) {
-		mutex_unlock(&fpriv->lock);
 		pr_err_ratelimited("%s: %s: invalid channel context '%#x'", __func__,
 				   current->comm, args->context);
 		return -EINVAL;
 	}
 
-	if (args->flags & ~(DRM_TEGRA_SUBMIT_SECONDARY_SYNCPT)) {
+	sj->context = context;
+
+	if (prev)
+		flags |= DRM_TEGRA_SUBMIT_WAIT_PREVIOUS;
+
+	if (args->flags & ~flags) {
 		SUBMIT_ERR(context, "invalid flags '%#x'", args->flags);
-		goto unlock;
+		return -EINVAL;
 	}
 
-	if (args->syncobj_in) {
-		struct dma_fence *fence;
+	wait_previous = args->flags & DRM_TEGRA_SUBMIT_WAIT_PREVIOUS;
 
-		err = drm_syncobj_find_fence(file, args->syncobj_in, 0, 0, &fence);
-		if (err) {
-			SUBMIT_ERR(context, "invalid syncobj_in '%#x'", args->syncobj_in);
-			goto unlock;
-		}
+	/* Nothing can be waited for here, the jobs before it aren't queued yet */
+	if (!sj->syncobj && ((wait_previous && prev->held) ||
+			     submit_batch_holds(jobs, index, context))) {
+		SUBMIT_ERR(context, "job behind a held back job needs syncobj_out");
+		return -EINVAL;
+	}
 
-		err = dma_fence_wait_timeout(fence, true, msecs_to_jiffies(10000));
-		dma_fence_put(fence);
-		if (err) {
-			SUBMIT_ERR(context, "wait for syncobj_in timed out");
-			goto unlock;
-		}
+	/*
+	 * Only jobs submitted under fpriv->lock are added to the queue, so it
+	 * can't become busy before this job is pushed.
+	 */
+	behind = context->deps && READ_ONCE(context->deps->num_jobs);
+	if (behind && !sj->syncobj) {
+		kref_get(&context->deps->ref);
+		sj->drain = context->deps;
+		return -EBUSY;
 	}
 
-	if (args->syncobj_out) {
-		syncobj = drm_syncobj_find(file, args->syncobj_out);
-		if (!syncobj) {
-			SUBMIT_ERR(context, "invalid syncobj_out '%#x'", args->syncobj_out);
-			err = -ENOENT;
-			goto unlock;
-		}
+	/* Keep the jobs of a context in order behind those held back */
+	sj->held = pre->num_foreign || behind || (wait_previous && prev->held) ||
+		   submit_batch_holds(jobs, index, context);
+
+	/* A job pushed with the previous one waits for it in the channel */
+	pre->wait_previous = wait_previous && !sj->held;
+
+	if (sj->held && !submit_get_dep_queue(context)) {
+		SUBMIT_ERR(context, "failed to allocate dependency queue");
+		return -ENOMEM;
 	}
 
 	/* Allocate gather BO and copy gather words in. */
 	err = submit_copy_gather_data(&bo, drm->dev, context, args);
 	if (err)
-		goto unlock;
+		return err;
 
 	job_data = kzalloc(sizeof(*job_data), GFP_KERNEL);
 	if (!job_data) {
@@ -649,8 +1216,8 @@ int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
 
 	/* Initialize data for tracing / profiling */
 	if (IS_ENABLED(CONFIG_TRACING)) {
-		job_id = atomic_fetch_inc(&next_job_id);
-		job_data->id = job_id;
+		sj->job_id = atomic_fetch_inc(&next_job_id);
+		job_data->id = sj->job_id;
 
 		err = submit_init_profiling(context, job_data);
 		if (err)
@@ -663,19 +1230,20 @@ int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
 		goto free_job_data;
 
 	/* Copy submit commands from userspace. */
-	cmds = alloc_copy_user_array(u64_to_user_ptr(args->cmds_ptr), args->num_cmds,
-				     sizeof(*cmds));
-	if (IS_ERR(cmds)) {
+	sj->cmds = alloc_copy_user_array(u64_to_user_ptr(args->cmds_ptr), args->num_cmds,
+					 sizeof(*sj->cmds));
+	if (IS_ERR(sj->cmds)) {
 		SUBMIT_ERR(context, "failed to copy cmds array from userspace");
-		err = PTR_ERR(cmds);
+		err = PTR_ERR(sj->cmds);
+		sj->cmds = NULL;
 		goto free_job_data;
 	}
 
 	/* Allocate host1x_job and add gathers and waits to it. */
-	job = submit_create_job(context, bo, args, job_data, &fpriv->syncpoints, cmds);
+	job = submit_create_job(context, bo, args, job_data, &fpriv->syncpoints, sj->cmds, pre);
 	if (IS_ERR(job)) {
 		err = PTR_ERR(job);
-		goto free_cmds;
+		goto free_job_data;
 	}
 
 	/* Map gather data for Host1x. */
@@ -708,21 +1276,8 @@ int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
 			host1x_memory_context_get(job->memory_context);
 		}
 	} else if (context->client->ops->get_streamid_offset) {
-#ifdef CONFIG_IOMMU_API
-		struct iommu_fwspec *spec;
-
-		/*
-		 * Job submission will need to temporarily change stream ID,
-		 * so need to tell it what to change it back to.
-		 */
-		spec = dev_iommu_fwspec_get(context->client->base.dev);
-		if (spec && spec->num_ids > 0)
-			job->engine_fallback_streamid = spec->ids[0] & 0xffff;
-		else
-			job->engine_fallback_streamid = 0x7f;
-#else
-		job->engine_fallback_streamid = 0x7f;
-#endif
+		job->engine_fallback_streamid =
+			submit_fallback_streamid(context->client->base.dev);
 	}
 
 	/* Boot engine, if necessary. */
@@ -738,94 +1293,636 @@ int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
 	job->release = release_job;
 	job->timeout = 10000;
 
-	/*
-	 * job_data is now part of job reference counting, so don't release
-	 * it from here.
-	 */
-	job_data = NULL;
+	/* job_data is now part of job reference counting. */
+	sj->job = job;
+	gather_bo_put(&bo->base);
 
-	/* Engine timestamps run at 32 times CNTVCT */
-	if (IS_ENABLED(CONFIG_TRACING))
-		timestamp = arch_timer_read_counter();
+	return 0;
 
-	/* Submit job to hardware. */
-	err = host1x_job_submit(job);
-	if (err) {
-		SUBMIT_ERR(context, "host1x job submission failed: %d", err);
-		goto unpin_job;
+put_memory_context:
+	if (job->memory_context)
+		host1x_memory_context_put(job->memory_context);
+unpin_job:
+	host1x_job_unpin(job);
+put_job:
+	host1x_job_put(job);
+free_job_data:
+	if (job_data->timestamps.virt)
+		dma_free_coherent(job_data->timestamps.dev, 256, job_data->timestamps.virt,
+				  job_data->timestamps.iova);
+
+	if (job_data->used_mappings) {
+		for (i = 0; i < job_data->num_used_mappings; i++)
+			tegra_drm_mapping_put(job_data->used_mappings[i].mapping);
+
+		kfree(job_data->used_mappings);
+	}
+
+	kfree(job_data);
+put_bo:
+	gather_bo_put(&bo->base);
+
+	return err;
+}
+
+/*
+ * Hand a prepared job to the dependency queue. A job waiting on the
+ * previous one depends on its completion, which is known by now.
+ */
+static int submit_job_hold(struct submit_job *sj, const struct submit_job *prev)
+{
+	struct submit_prefences *pre = &sj->pre;
+	struct dma_fence *done;
+
+	if (sj->args->flags & DRM_TEGRA_SUBMIT_WAIT_PREVIOUS) {
+		struct dma_fence *fence;
+
+		if (prev->held)
+			fence = dma_fence_get(prev->done);
+		else
+			fence = host1x_fence_create(prev->job->syncpt, prev->job->syncpt_end,
+						    true);
+		if (IS_ERR(fence))
+			return PTR_ERR(fence);
+
+		pre->foreign[pre->num_foreign++] = fence;
+	}
+
+	done = submit_dep_queue_job(sj->context->deps, sj->job, pre);
+	if (IS_ERR(done)) {
+		SUBMIT_ERR(sj->context, "failed to hold back job: %d", (int)PTR_ERR(done));
+		return PTR_ERR(done);
+	}
+
+	sj->done = done;
+	sj->submitted = true;
+
+	return 0;
+}
+
+/* Return postfences of a submitted job to userspace. */
+static int submit_job_complete(struct submit_job *sj)
+{
+	struct drm_tegra_channel_submit *args = sj->args;
+	struct host1x_job *job = sj->job;
+	int err = 0;
+	u32 i;
+
+	/* Pushed from the queue, the syncpoint value isn't known yet */
+	if (sj->held) {
+		args->flags |= DRM_TEGRA_SUBMIT_HELD_BACK;
+		drm_syncobj_replace_fence(sj->syncobj, sj->done);
+		return 0;
 	}
 
-	/* Return postfences to userspace and add fences to DMA reservations. */
+	args->flags &= ~DRM_TEGRA_SUBMIT_HELD_BACK;
+
 	args->syncpt.value = job->syncpt_end;
 
-	if (syncobj) {
+	if (sj->syncobj) {
 		struct dma_fence *fence = host1x_fence_create(job->syncpt, job->syncpt_end, true);
 		if (IS_ERR(fence)) {
 			err = PTR_ERR(fence);
-			SUBMIT_ERR(context, "failed to create postfence: %d", err);
+			SUBMIT_ERR(sj->context, "failed to create postfence: %d", err);
+			fence = NULL;
 		}
 
-		drm_syncobj_replace_fence(syncobj, fence);
+		drm_syncobj_replace_fence(sj->syncobj, fence);
+		dma_fence_put(fence);
 	}
 
 	if (IS_ENABLED(CONFIG_TRACING)) {
+		struct tegra_drm_client *client = sj->context->client;
 		u32 num_prefences = 0;
 
 		for (i = 0; i < args->num_cmds; i++) {
-			struct drm_tegra_submit_cmd *cmd = &cmds[i];
+			struct drm_tegra_submit_cmd *cmd = &sj->cmds[i];
 
 			if (cmd->type == DRM_TEGRA_SUBMIT_CMD_WAIT_SYNCPT)
 				num_prefences++;
 		}
 
-		trace_job_submit(
-			context->client->base.dev, context->client->base.class,
-			job_id, num_prefences + 1, timestamp);
+		trace_job_submit(client->base.dev, client->base.class,
+				 sj->job_id, num_prefences + 1, sj->timestamp);
 
 		for (i = 0; i < args->num_cmds; i++) {
-			struct drm_tegra_submit_cmd *cmd = &cmds[i];
+			struct drm_tegra_submit_cmd *cmd = &sj->cmds[i];
 
 			if (cmd->type != DRM_TEGRA_SUBMIT_CMD_WAIT_SYNCPT)
 				continue;
 
-			trace_job_prefence(job_id, cmd->wait_syncpt.id, cmd->wait_syncpt.value);
+			trace_job_prefence(sj->job_id, cmd->wait_syncpt.id,
+					   cmd->wait_syncpt.value);
 		}
 
-		trace_job_postfence(job_id, host1x_syncpt_id(job->syncpt), job->syncpt_end);
+		trace_job_postfence(sj->job_id, host1x_syncpt_id(job->syncpt), job->syncpt_end);
 	}
 
-	goto put_job;
+	return err;
+}
 
-put_memory_context:
-	if (job->memory_context)
-		host1x_memory_context_put(job->memory_context);
-unpin_job:
-	host1x_job_unpin(job);
-put_job:
-	host1x_job_put(job);
-free_cmds:
-	kvfree(cmds);
-free_job_data:
-	if (job_data) {
-		if (job_data->timestamps.virt)
-			dma_free_coherent(job_data->timestamps.dev, 256, job_data->timestamps.virt,
-					  job_data->timestamps.iova);
+static void submit_job_cleanup(struct submit_job *sj)
+{
+	if (sj->job) {
+		if (!sj->submitted)
+			host1x_job_unpin(sj->job);
 
-		if (job_data->used_mappings) {
-			for (i = 0; i < job_data->num_used_mappings; i++)
-				tegra_drm_mapping_put(job_data->used_mappings[i].mapping);
+		host1x_job_put(sj->job);
+	}
+
+	dma_fence_put(sj->done);
+	kvfree(sj->cmds);
+	submit_prefences_put(&sj->pre);
+
+	if (sj->syncobj)
+		drm_syncobj_put(sj->syncobj);
+}
 
-			kfree(job_data->used_mappings);
+int tegra_drm_ioctl_channel_submit(struct drm_device *drm, void *data,
+				   struct drm_file *file)
+{
+	struct tegra_drm_file *fpriv = file->driver_priv;
+	struct submit_job sj;
+	int err;
+
+retry:
+	sj = (struct submit_job){ .args = data };
+
+	err = submit_job_get_fences(file, &sj);
+	if (err)
+		goto cleanup;
+
+	mutex_lock(&fpriv->lock);
+
+	err = submit_job_prepare(drm, file, &sj, 0);
+	if (err)
+		goto unlock;
+
+	if (sj.held) {
+		err = submit_job_hold(&sj, NULL);
+		if (err)
+			goto unlock;
+	} else {
+		/* Engine timestamps run at 32 times CNTVCT */
+		if (IS_ENABLED(CONFIG_TRACING))
+			sj.timestamp = arch_timer_read_counter();
+
+		/* Submit job to hardware. */
+		err = host1x_job_submit(sj.job);
+		if (err) {
+			SUBMIT_ERR(sj.context, "host1x job submission failed: %d", err);
+			goto unlock;
 		}
 
-		kfree(job_data);
+		sj.submitted = true;
 	}
-put_bo:
-	gather_bo_put(&bo->base);
+
+	err = submit_job_complete(&sj);
+
 unlock:
-	if (syncobj)
-		drm_syncobj_put(syncobj);
+	mutex_unlock(&fpriv->lock);
+cleanup:
+	submit_job_cleanup(&sj);
+
+	if (sj.drain) {
+		err = submit_wait_drained(sj.drain);
+		if (!err)
+			goto retry;
+	}
+
+	return err;
+}
+
+/*
+ * Push consecutive jobs that aren't held back with one call, which takes
+ * the submit lock of each channel once. Returns the number pushed.
+ */
+static unsigned int submit_push_jobs(struct submit_job *jobs, unsigned int num_jobs,
+				     struct host1x_job **hjobs, int *err)
+{
+	unsigned int i, num_pushed;
+
+	for (i = 0; i < num_jobs && !jobs[i].held; i++)
+		hjobs[i] = jobs[i].job;
+
+	/* Engine timestamps run at 32 times CNTVCT */
+	if (IS_ENABLED(CONFIG_TRACING)) {
+		u64 timestamp = arch_timer_read_counter();
+
+		for (i = 0; i < num_jobs && !jobs[i].held; i++)
+			jobs[i].timestamp = timestamp;
+	}
+
+	*err = host1x_job_submit_batch(hjobs, i, &num_pushed);
+	if (*err)
+		SUBMIT_ERR(jobs[num_pushed].context, "host1x job submission failed: %d", *err);
+
+	for (i = 0; i < num_pushed; i++)
+		jobs[i].submitted = true;
+
+	return num_pushed;
+}
+
+/*
+ * All jobs of a batch are validated and pinned before any of them is
+ * pushed, so that the channels are only locked for the pushes themselves.
+ */
+int tegra_drm_ioctl_channel_submit_batch(struct drm_device *drm, void *data,
+					 struct drm_file *file)
+{
+	struct drm_tegra_channel_submit_batch *args = data;
+	struct tegra_drm_file *fpriv = file->driver_priv;
+	struct drm_tegra_channel_submit *submits;
+	struct tegra_drm_dep_queue *drain;
+	struct host1x_job **hjobs;
+	struct submit_job *jobs;
+	unsigned int i;
+	int err = 0;
+
+	args->num_submitted = 0;
+
+	if (args->flags || args->padding)
+		return -EINVAL;
+
+	if (args->num_submits == 0 || args->num_submits > DRM_TEGRA_SUBMIT_BATCH_MAX)
+		return -EINVAL;
+
+	submits = alloc_copy_user_array(u64_to_user_ptr(args->submits_ptr), args->num_submits,
+					sizeof(*submits));
+	if (IS_ERR(submits))
+		return PTR_ERR(submits);
+
+	jobs = kcalloc(args->num_submits, sizeof(*jobs), GFP_KERNEL);
+	hjobs = kcalloc(args->num_submits, sizeof(*hjobs), GFP_KERNEL);
+	if (!jobs || !hjobs) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+retry:
+	memset(jobs, 0, args->num_submits * sizeof(*jobs));
+	drain = NULL;
+
+	for (i = 0; i < args->num_submits; i++) {
+		jobs[i].args = &submits[i];
+
+		err = submit_job_get_fences(file, &jobs[i]);
+		if (err)
+			goto cleanup;
+	}
 
+	mutex_lock(&fpriv->lock);
+
+	for (i = 0; i < args->num_submits; i++) {
+		err = submit_job_prepare(drm, file, jobs, i);
+		if (err) {
+			drain = jobs[i].drain;
+			goto unlock;
+		}
+	}
+
+	/*
+	 * A held back job interrupts a run of pushed jobs, so that a job is
+	 * never pushed if one before it failed to be held back.
+	 */
+	for (i = 0; i < args->num_submits; ) {
+		if (jobs[i].held) {
+			err = submit_job_hold(&jobs[i], i ? &jobs[i - 1] : NULL);
+			if (err)
+				break;
+
+			i++;
+		} else {
+			i += submit_push_jobs(&jobs[i], args->num_submits - i, hjobs, &err);
+			if (err)
+				break;
+		}
+	}
+
+	args->num_submitted = i;
+
+	for (i = 0; i < args->num_submitted; i++) {
+		int ret = submit_job_complete(&jobs[i]);
+
+		if (ret && !err)
+			err = ret;
+	}
+
+unlock:
 	mutex_unlock(&fpriv->lock);
+cleanup:
+	/* Jobs that weren't looked at are still zeroed */
+	for (i = 0; i < args->num_submits; i++)
+		submit_job_cleanup(&jobs[i]);
+
+	/* Nothing was submitted, so the whole batch can be retried */
+	if (drain) {
+		err = submit_wait_drained(drain);
+		if (!err)
+			goto retry;
+	}
+
+	/* Return the syncpoint values of the jobs that were submitted */
+	if (args->num_submitted &&
+	    copy_to_user(u64_to_user_ptr(args->submits_ptr), submits,
+			 args->num_submitted * sizeof(*submits)))
+		err = -EFAULT;
+
+free:
+	kfree(hjobs);
+	kfree(jobs);
+	kvfree(submits);
+
+	return err;
+}
+
+#ifdef CONFIG_DEBUG_FS
+#define SUBMIT_BENCH_WORDS	256
+#define SUBMIT_BENCH_LOOPS	1024
+
+/*
+ * The CPU side of a channel submit: gather copy, job setup, pinning and
+ * unpinning. Nothing is pushed to the channel.
+ */
+static int submit_bench_run(struct tegra_drm_client *client,
+			    struct host1x_gather_pool *pool, const u32 *data,
+			    u64 *ns)
+{
+	struct device *dev = client->base.dev;
+	struct host1x_job *job;
+	struct gather_bo *bo;
+	unsigned int i;
+	u64 start;
+	int err;
+
+	start = ktime_get_ns();
+
+	for (i = 0; i < SUBMIT_BENCH_LOOPS; i++) {
+		bo = gather_bo_create(dev, pool, SUBMIT_BENCH_WORDS);
+		if (!bo)
+			return -ENOMEM;
+
+		memcpy(bo->gather_data, data, SUBMIT_BENCH_WORDS * 4);
+
+		job = host1x_job_alloc(client->shared_channel, 1, 0, true);
+		if (!job) {
+			gather_bo_put(&bo->base);
+			return -ENOMEM;
+		}
+
+		job->client = &client->base;
+		job->class = client->base.class;
+		host1x_job_add_gather(job, &bo->base, SUBMIT_BENCH_WORDS, 0);
+
+		err = host1x_job_pin(job, dev);
+		if (!err)
+			host1x_job_unpin(job);
+
+		host1x_job_put(job);
+		gather_bo_put(&bo->base);
+
+		if (err)
+			return err;
+	}
+
+	*ns = ktime_get_ns() - start;
+
+	return 0;
+}
+
+void tegra_drm_submit_bench(struct tegra_drm_client *client, struct seq_file *s)
+{
+	struct host1x_gather_pool *pool;
+	u64 direct_ns, pooled_ns;
+	unsigned int i;
+	u32 *data;
+	int err;
+
+	pool = host1x_gather_pool_create(client->base.dev, DMA_ATTR_WRITE_COMBINE);
+	data = kmalloc_array(SUBMIT_BENCH_WORDS, sizeof(u32), GFP_KERNEL);
+	if (!pool || !data) {
+		seq_printf(s, "%s: out of memory\n", dev_name(client->base.dev));
+		goto free;
+	}
+
+	/* INCR opcodes of no words */
+	for (i = 0; i < SUBMIT_BENCH_WORDS; i++)
+		data[i] = 0x1 << 28;
+
+	err = submit_bench_run(client, NULL, data, &direct_ns);
+	if (!err)
+		err = submit_bench_run(client, pool, data, &pooled_ns);
+	if (err) {
+		seq_printf(s, "%s: failed (%d)\n", dev_name(client->base.dev), err);
+		goto free;
+	}
+
+	seq_printf(s, "%s: direct %llu submits/s, pooled %llu submits/s\n",
+		   dev_name(client->base.dev),
+		   div64_u64((u64)SUBMIT_BENCH_LOOPS * NSEC_PER_SEC, direct_ns ?: 1),
+		   div64_u64((u64)SUBMIT_BENCH_LOOPS * NSEC_PER_SEC, pooled_ns ?: 1));
+
+free:
+	kfree(data);
+	host1x_gather_pool_put(pool);
+}
+
+#define DEP_TEST_JOBS		8
+#define DEP_TEST_DELAY_MS	100
+
+/* Freed by the default dma_fence release, so base must come first */
+struct dep_test_upstream {
+	struct dma_fence base;
+	spinlock_t lock;
+	struct delayed_work work;
+};
+
+static void dep_test_upstream_signal(struct work_struct *work)
+{
+	struct dep_test_upstream *up =
+		container_of(to_delayed_work(work), struct dep_test_upstream, work);
+
+	dma_fence_signal(&up->base);
+}
+
+/*
+ * Queue a chain of jobs behind a foreign fence that signals after
+ * @delay_ms, each job depending on the previous one. Returns the longest
+ * time a job took to queue and the time until the chain completed.
+ */
+static int dep_test_run(struct tegra_drm_client *client, struct host1x_channel *channel,
+			struct host1x_syncpt *sp, unsigned int delay_ms,
+			u64 *queue_ns, u64 *chain_ns)
+{
+	struct device *dev = client->base.dev;
+	struct tegra_drm_dep_queue *queue;
+	struct submit_prefences pre = { 0 };
+	struct dep_test_upstream *up;
+	struct dma_fence *prev, *done;
+	struct host1x_job *job;
+	struct gather_bo *bo;
+	u64 start, begin;
+	unsigned int i, j;
+	int err = 0;
+
+	queue = submit_dep_queue_alloc();
+	up = kzalloc(sizeof(*up), GFP_KERNEL);
+	if (!queue || !up) {
+		tegra_drm_dep_queue_put(queue);
+		kfree(up);
+		return -ENOMEM;
+	}
+
+	spin_lock_init(&up->lock);
+	dma_fence_init(&up->base, &submit_done_ops, &up->lock, dma_fence_context_alloc(1), 1);
+	INIT_DELAYED_WORK(&up->work, dep_test_upstream_signal);
+	prev = dma_fence_get(&up->base);
+
+	*queue_ns = 0;
+	begin = ktime_get_ns();
+	schedule_delayed_work(&up->work, msecs_to_jiffies(delay_ms));
+
+	for (i = 0; i < DEP_TEST_JOBS; i++) {
+		bo = gather_bo_create(dev, NULL, SUBMIT_BENCH_WORDS);
+		if (!bo) {
+			err = -ENOMEM;
+			break;
+		}
+
+		/* INCR opcodes of no words */
+		for (j = 0; j < SUBMIT_BENCH_WORDS; j++)
+			bo->gather_data[j] = 0x1 << 28;
+
+		job = host1x_job_alloc(channel, 1, 0, true);
+		if (!job) {
+			gather_bo_put(&bo->base);
+			err = -ENOMEM;
+			break;
+		}
+
+		job->client = &client->base;
+		job->class = client->base.class;
+		job->syncpt = host1x_syncpt_get(sp);
+		job->serialize = true;
+		job->timeout = 10000;
+		host1x_job_add_gather(job, &bo->base, SUBMIT_BENCH_WORDS, 0);
+
+		if (client->ops->get_streamid_offset) {
+			err = client->ops->get_streamid_offset(client,
+							       &job->engine_streamid_offset);
+			job->engine_fallback_streamid = submit_fallback_streamid(dev);
+		}
+
+		/* Pinning takes the job's reference to the gather */
+		if (!err)
+			err = host1x_job_pin(job, dev);
+		gather_bo_put(&bo->base);
+		if (err) {
+			host1x_job_put(job);
+			break;
+		}
+
+		pre.foreign[0] = dma_fence_get(prev);
+		pre.num_foreign = 1;
+
+		start = ktime_get_ns();
+		done = submit_dep_queue_job(queue, job, &pre);
+		*queue_ns = max(*queue_ns, ktime_get_ns() - start);
+
+		if (IS_ERR(done)) {
+			submit_prefences_put(&pre);
+			host1x_job_unpin(job);
+			host1x_job_put(job);
+			err = PTR_ERR(done);
+			break;
+		}
+
+		host1x_job_put(job);
+		dma_fence_put(prev);
+		prev = done;
+	}
+
+	/*
+	 * Jobs fail after SUBMIT_DEP_TIMEOUT and the upstream fence signals
+	 * in any case, so this returns.
+	 */
+	dma_fence_wait(prev, false);
+	*chain_ns = ktime_get_ns() - begin;
+	if (prev->error && !err)
+		err = prev->error;
+
+	flush_delayed_work(&up->work);
+	dma_fence_put(prev);
+	dma_fence_put(&up->base);
+	tegra_drm_dep_queue_put(queue);
+
 	return err;
 }
+
+/*
+ * Submit latency of jobs held back behind a foreign fence must not depend
+ * on how long the fence takes to signal.
+ */
+void tegra_drm_dep_selftest(struct tegra_drm_client *client, struct seq_file *s)
+{
+	struct host1x *host1x = dev_get_drvdata(client->base.host->parent);
+	u64 queue_ns[2], chain_ns[2];
+	struct host1x_channel *channel;
+	struct host1x_syncpt *sp;
+	const char *result;
+	int err;
+
+	if (client->shared_channel)
+		channel = host1x_channel_get(client->shared_channel);
+	else
+		channel = host1x_channel_request(&client->base);
+	if (!channel) {
+		seq_printf(s, "%s: no channel\n", dev_name(client->base.dev));
+		return;
+	}
+
+	sp = host1x_syncpt_alloc(host1x, HOST1X_SYNCPT_CLIENT_MANAGED, "tegra-drm-dep-test");
+	if (!sp) {
+		seq_printf(s, "%s: no syncpoint\n", dev_name(client->base.dev));
+		goto put_channel;
+	}
+
+	err = pm_runtime_resume_and_get(client->base.dev);
+	if (err < 0) {
+		seq_printf(s, "%s: power up failed (%d)\n", dev_name(client->base.dev), err);
+		goto put_syncpt;
+	}
+
+	err = dep_test_run(client, channel, sp, 0, &queue_ns[0], &chain_ns[0]);
+	if (!err)
+		err = dep_test_run(client, channel, sp, DEP_TEST_DELAY_MS, &queue_ns[1],
+				   &chain_ns[1]);
+
+	pm_runtime_mark_last_busy(client->base.dev);
+	pm_runtime_put_autosuspend(client->base.dev);
+
+	if (err) {
+		seq_printf(s, "%s: failed (%d)\n", dev_name(client->base.dev), err);
+		goto put_syncpt;
+	}
+
+	/* Queueing must take a small fraction of the upstream delay */
+	if (queue_ns[1] * 10 < DEP_TEST_DELAY_MS * NSEC_PER_MSEC &&
+	    chain_ns[1] >= DEP_TEST_DELAY_MS * NSEC_PER_MSEC)
+		result = "ok";
+	else
+		result = "FAIL";
+
+	seq_printf(s, "%s: %u jobs, upstream 0 ms: queue %llu ns chain %llu us, "
+		   "upstream %u ms: queue %llu ns chain %llu us: %s\n",
+		   dev_name(client->base.dev), DEP_TEST_JOBS,
+		   queue_ns[0], div_u64(chain_ns[0], NSEC_PER_USEC),
+		   DEP_TEST_DELAY_MS, queue_ns[1], div_u64(chain_ns[1], NSEC_PER_USEC),
+		   result);
+
+put_syncpt:
+	host1x_syncpt_put(sp);
+put_channel:
+	host1x_channel_put(channel);
+}
+#endif
@@ -21,8 +21,19 @@ struct tegra_drm_submit_data {
 	} timestamps;
 };
 
-int tegra_drm_fw_validate(struct tegra_drm_client *client, u32 *data, u32 start,
-			  u32 words, struct tegra_drm_submit_data *submit,
-			  u32 *job_class);
+struct tegra_drm_dep_queue;
+struct tegra_drm_fw_cache;
+struct seq_file;
+
+void tegra_drm_dep_queue_put(struct tegra_drm_dep_queue *queue);
+
+int tegra_drm_fw_validate(struct tegra_drm_context *context, u32 *data,
+			  u32 start, u32 words,
+			  struct tegra_drm_submit_data *submit, u32 *job_class);
+void tegra_drm_fw_cache_free(struct tegra_drm_fw_cache *cache);
+void tegra_drm_fw_cleanup(struct tegra_drm_client *client);
+void tegra_drm_fw_bench(struct tegra_drm_client *client, struct seq_file *s);
+void tegra_drm_submit_bench(struct tegra_drm_client *client, struct seq_file *s);
+void tegra_drm_dep_selftest(struct tegra_drm_client *client, struct seq_file *s);
 
 #endif
@@ -10,6 +10,7 @@
 #include <drm/drm_utils.h>
 
 #include "drm.h"
+#include "submit.h"
 #include "uapi.h"
 
 static void tegra_drm_mapping_release(struct kref *ref)
@@ -17,6 +18,8 @@ static void tegra_drm_mapping_release(struct kref *ref)
 	struct tegra_drm_mapping *mapping =
 		container_of(ref, struct tegra_drm_mapping, ref);
 
+	/* Don't let the client's cache keep the buffer mapped once unmapped */
+	host1x_bo_uncache(mapping->map);
 	host1x_bo_unpin(mapping->map);
 	host1x_bo_put(mapping->bo);
 
@@ -41,6 +44,10 @@ static void tegra_drm_channel_context_close(struct tegra_drm_context *context)
 
 	xa_destroy(&context->mappings);
 
+	tegra_drm_dep_queue_put(context->deps);
+	host1x_gather_pool_put(context->gather_pool);
+	tegra_drm_fw_cache_free(context->fw_cache);
+
 	host1x_channel_put(context->channel);
 
 	kfree(context);
@@ -234,8 +241,10 @@ int tegra_drm_ioctl_channel_map(struct drm_device *drm, void *data, struct drm_f
 		goto put_gem;
 	}
 
+	/* Mappings for a memory context's device can't share the client's cache */
 	mapping->map = host1x_bo_pin(tegra_drm_context_get_memory_device(context),
-				     mapping->bo, direction, NULL);
+				     mapping->bo, direction,
+				     context->memory_context ? NULL : &context->client->base.cache);
 	if (IS_ERR(mapping->map)) {
 		err = PTR_ERR(mapping->map);
 		goto put_gem;
@@ -8,10 +8,12 @@
 #include <linux/dma-mapping.h>
 #include <linux/host1x-next.h>
 #include <linux/of.h>
+#include <linux/rcupdate.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/of_device.h>
 #include <linux/version.h>
+#include <linux/wait_bit.h>
 
 #include "bus.h"
 #include "dev.h"
@@ -911,21 +913,145 @@ unlock:
 }
 EXPORT_SYMBOL(host1x_client_resume);
 
+struct host1x_bo_cache_stats host1x_bo_cache_stats;
+u32 host1x_bo_cache_max = 1024;
+
+static unsigned long host1x_bo_cache_key(struct host1x_bo *bo,
+					 enum dma_data_direction dir)
+{
+	return (unsigned long)bo ^ dir;
+}
+
+static struct host1x_bo_mapping *
+host1x_bo_cache_lookup(struct host1x_bo_cache *cache, struct host1x_bo *bo,
+		       enum dma_data_direction dir)
+{
+	struct host1x_bo_mapping *mapping;
+
+	rcu_read_lock();
+
+	hash_for_each_possible_rcu(cache->index, mapping, node,
+				   host1x_bo_cache_key(bo, dir)) {
+		if (mapping->bo == bo && mapping->direction == dir &&
+		    kref_get_unless_zero(&mapping->ref)) {
+			if (!READ_ONCE(mapping->referenced))
+				WRITE_ONCE(mapping->referenced, true);
+
+			rcu_read_unlock();
+			return mapping;
+		}
+	}
+
+	rcu_read_unlock();
+
+	return NULL;
+}
+
+static void host1x_bo_unpin_work(struct work_struct *work)
+{
+	struct host1x_bo_mapping *mapping =
+		container_of(to_rcu_work(work), struct host1x_bo_mapping, rwork);
+	struct host1x_bo_cache *cache = mapping->cache;
+
+	mapping->bo->ops->unpin(mapping);
+
+	if (atomic_dec_and_test(&cache->deferred))
+		wake_up_var(&cache->deferred);
+}
+
+/* Called with cache->lock held for mappings that have been in a cache. */
+static void __host1x_bo_unpin(struct kref *ref)
+{
+	struct host1x_bo_mapping *mapping = to_host1x_bo_mapping(ref);
+	struct host1x_bo_cache *cache = mapping->cache;
+
+	/*
+	 * When the last reference of the mapping goes away, make sure to remove the mapping from
+	 * the cache.
+	 */
+	if (mapping->cached) {
+		hash_del_rcu(&mapping->node);
+		list_del(&mapping->entry);
+		mapping->cached = false;
+		cache->count--;
+	}
+
+	spin_lock(&mapping->bo->lock);
+	list_del(&mapping->list);
+	spin_unlock(&mapping->bo->lock);
+
+	/* Lockless lookups may still be looking at a mapping from a cache */
+	if (cache) {
+		atomic_inc(&cache->deferred);
+		INIT_RCU_WORK(&mapping->rwork, host1x_bo_unpin_work);
+		queue_rcu_work(system_wq, &mapping->rwork);
+	} else {
+		mapping->bo->ops->unpin(mapping);
+	}
+}
+
+static void host1x_bo_cache_remove(struct host1x_bo_cache *cache,
+				   struct host1x_bo_mapping *mapping)
+{
+	hash_del_rcu(&mapping->node);
+	list_del(&mapping->entry);
+	mapping->cached = false;
+	cache->count--;
+
+	/* Drop the cache's reference, users may still hold the mapping */
+	kref_put(&mapping->ref, __host1x_bo_unpin);
+}
+
+/*
+ * Evict mappings in LRU order until the cache is within its limit. Mappings
+ * looked up since they were last considered are moved to the back instead,
+ * which avoids taking the lock to reorder the list on every lookup.
+ */
+static void host1x_bo_cache_evict(struct host1x_bo_cache *cache)
+{
+	u32 max = READ_ONCE(host1x_bo_cache_max);
+	struct host1x_bo_mapping *mapping;
+
+	while (max && cache->count > max) {
+		mapping = list_first_entry(&cache->mappings, struct host1x_bo_mapping, entry);
+
+		if (READ_ONCE(mapping->referenced)) {
+			WRITE_ONCE(mapping->referenced, false);
+			list_move_tail(&mapping->entry, &cache->mappings);
+			continue;
+		}
+
+		host1x_bo_cache_remove(cache, mapping);
+		atomic64_inc(&host1x_bo_cache_stats.evictions);
+	}
+}
+
 struct host1x_bo_mapping *host1x_bo_pin(struct device *dev, struct host1x_bo *bo,
 					enum dma_data_direction dir,
 					struct host1x_bo_cache *cache)
 {
 	struct host1x_bo_mapping *mapping;
 
+	if (bo->uncached)
+		cache = NULL;
+
 	if (cache) {
+		mapping = host1x_bo_cache_lookup(cache, bo, dir);
+		if (mapping) {
+			atomic64_inc(&host1x_bo_cache_stats.hits);
+			return mapping;
+		}
+
 		mutex_lock(&cache->lock);
 
-		list_for_each_entry(mapping, &cache->mappings, entry) {
-			if (mapping->bo == bo && mapping->direction == dir) {
-				kref_get(&mapping->ref);
-				goto unlock;
-			}
+		/* Another thread may have added the mapping in the meantime */
+		mapping = host1x_bo_cache_lookup(cache, bo, dir);
+		if (mapping) {
+			atomic64_inc(&host1x_bo_cache_stats.hits);
+			goto unlock;
 		}
+
+		atomic64_inc(&host1x_bo_cache_stats.misses);
 	}
 
 	mapping = bo->ops->pin(dev, bo, dir);
@@ -939,11 +1065,17 @@ struct host1x_bo_mapping *host1x_bo_pin(struct device *dev, struct host1x_bo *bo
 	if (cache) {
 		INIT_LIST_HEAD(&mapping->entry);
 		mapping->cache = cache;
+		mapping->cached = true;
+		mapping->referenced = false;
 
 		list_add_tail(&mapping->entry, &cache->mappings);
+		hash_add_rcu(cache->index, &mapping->node, host1x_bo_cache_key(bo, dir));
+		cache->count++;
 
 		/* bump reference count to track the copy in the cache */
 		kref_get(&mapping->ref);
+
+		host1x_bo_cache_evict(cache);
 	}
 
 unlock:
@@ -954,34 +1086,96 @@ unlock:
 }
 EXPORT_SYMBOL(host1x_bo_pin);
 
-static void __host1x_bo_unpin(struct kref *ref)
+static void __host1x_bo_unpin_cached(struct kref *ref)
 {
 	struct host1x_bo_mapping *mapping = to_host1x_bo_mapping(ref);
+	struct host1x_bo_cache *cache = mapping->cache;
 
-	/*
-	 * When the last reference of the mapping goes away, make sure to remove the mapping from
-	 * the cache.
-	 */
-	if (mapping->cache)
-		list_del(&mapping->entry);
-
-	spin_lock(&mapping->bo->lock);
-	list_del(&mapping->list);
-	spin_unlock(&mapping->bo->lock);
-
-	mapping->bo->ops->unpin(mapping);
+	__host1x_bo_unpin(ref);
+	mutex_unlock(&cache->lock);
 }
 
 void host1x_bo_unpin(struct host1x_bo_mapping *mapping)
 {
 	struct host1x_bo_cache *cache = mapping->cache;
 
+	/* Only the final reference needs the cache lock */
 	if (cache)
-		mutex_lock(&cache->lock);
+		kref_put_mutex(&mapping->ref, __host1x_bo_unpin_cached, &cache->lock);
+	else
+		kref_put(&mapping->ref, __host1x_bo_unpin);
+}
+EXPORT_SYMBOL(host1x_bo_unpin);
 
-	kref_put(&mapping->ref, __host1x_bo_unpin);
+/*
+ * Drop the cache's reference to a mapping if it is still in its cache.
+ * Returns false if the mapping has no cache or was already evicted.
+ */
+bool host1x_bo_uncache(struct host1x_bo_mapping *mapping)
+{
+	struct host1x_bo_cache *cache = mapping->cache;
+	bool cached;
 
-	if (cache)
-		mutex_unlock(&cache->lock);
+	if (!cache)
+		return false;
+
+	mutex_lock(&cache->lock);
+
+	cached = mapping->cached;
+	if (cached)
+		host1x_bo_cache_remove(cache, mapping);
+
+	mutex_unlock(&cache->lock);
+
+	return cached;
 }
-EXPORT_SYMBOL(host1x_bo_unpin);
+EXPORT_SYMBOL(host1x_bo_uncache);
+
+/*
+ * Drop the cache references to all mappings of @bo. Cached mappings hold a
+ * reference to the buffer object, so this must be done when its users are
+ * done with it rather than when it is freed.
+ */
+void host1x_bo_uncache_all(struct host1x_bo *bo)
+{
+	struct host1x_bo_mapping *mapping;
+	bool found;
+
+	do {
+		found = false;
+
+		spin_lock(&bo->lock);
+
+		list_for_each_entry(mapping, &bo->mappings, list) {
+			/* Rechecked under the cache lock */
+			if (READ_ONCE(mapping->cached) && kref_get_unless_zero(&mapping->ref)) {
+				found = true;
+				break;
+			}
+		}
+
+		spin_unlock(&bo->lock);
+
+		if (found) {
+			host1x_bo_uncache(mapping);
+			host1x_bo_unpin(mapping);
+		}
+	} while (found);
+}
+EXPORT_SYMBOL(host1x_bo_uncache_all);
+
+void host1x_bo_cache_destroy(struct host1x_bo_cache *cache)
+{
+	struct host1x_bo_mapping *mapping, *tmp;
+
+	mutex_lock(&cache->lock);
+
+	list_for_each_entry_safe(mapping, tmp, &cache->mappings, entry)
+		host1x_bo_cache_remove(cache, mapping);
+
+	mutex_unlock(&cache->lock);
+
+	wait_var_event(&cache->deferred, !atomic_read(&cache->deferred));
+	mutex_destroy(&cache->lock);
+}
+EXPORT_SYMBOL(host1x_bo_cache_destroy);
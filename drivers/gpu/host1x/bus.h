@@ -12,6 +12,17 @@ struct host1x;
 
 extern struct bus_type host1x_bus_type;
 
+struct host1x_bo_cache_stats {
+	atomic64_t hits;
+	atomic64_t misses;
+	atomic64_t evictions;
+};
+
+extern struct host1x_bo_cache_stats host1x_bo_cache_stats;
+
+/* Maximum number of mappings per cache, 0 for no limit */
+extern u32 host1x_bo_cache_max;
+
 int host1x_register(struct host1x *host1x);
 int host1x_unregister(struct host1x *host1x);
 
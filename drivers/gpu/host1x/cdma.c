@@ -14,6 +14,7 @@
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
 #include <linux/kfifo.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/version.h>
 #include <trace/events/host1x.h>
@@ -160,11 +161,13 @@ static void host1x_pushbuffer_push(struct push_buffer *pb, u32 op1, u32 op2)
  */
 static void host1x_pushbuffer_pop(struct push_buffer *pb, unsigned int slots)
 {
-	/* Advance the next write position */
-	pb->fence += slots * 8;
+	unsigned int fence = pb->fence + slots * 8;
 
-	if (pb->fence >= pb->size)
-		pb->fence -= pb->size;
+	if (fence >= pb->size)
+		fence -= pb->size;
+
+	/* Advance the next write position; read locklessly by the producer */
+	WRITE_ONCE(pb->fence, fence);
 }
 
 /*
@@ -172,14 +175,105 @@ static void host1x_pushbuffer_pop(struct push_buffer *pb, unsigned int slots)
  */
 static u32 host1x_pushbuffer_space(struct push_buffer *pb)
 {
-	unsigned int fence = pb->fence;
+	unsigned int fence = READ_ONCE(pb->fence);
 
-	if (pb->fence < pb->pos)
+	if (fence < pb->pos)
 		fence += pb->size;
 
 	return (fence - pb->pos) / 8;
 }
 
+/*
+ * Waiters on cdma->wq say what they are waiting for, and are only woken
+ * by update_cdma_locked() once that has happened. This way a producer
+ * that needs a few slots is not woken for every completed job, and
+ * multiple waiters don't take turns sleeping on a single event.
+ */
+struct cdma_waiter {
+	struct wait_queue_entry wait;
+	enum cdma_event event;
+	unsigned int needed;
+};
+
+struct cdma_wake_key {
+	unsigned int space;
+	bool idle;
+};
+
+static int cdma_wake_function(struct wait_queue_entry *wait, unsigned int mode,
+			      int sync, void *key)
+{
+	struct cdma_waiter *waiter = container_of(wait, struct cdma_waiter, wait);
+	struct cdma_wake_key *wake = key;
+
+	if (waiter->event == CDMA_EVENT_SYNC_QUEUE_EMPTY && !wake->idle)
+		return 0;
+
+	if (waiter->event == CDMA_EVENT_PUSH_BUFFER_SPACE &&
+	    wake->space < waiter->needed)
+		return 0;
+
+	return autoremove_wake_function(wait, mode, sync, key);
+}
+
+static bool cdma_event_done(struct host1x_cdma *cdma, enum cdma_event event,
+			    unsigned int needed)
+{
+	if (event == CDMA_EVENT_SYNC_QUEUE_EMPTY)
+		return list_empty(&cdma->sync_queue);
+
+	return host1x_pushbuffer_space(&cdma->push_buffer) >= needed;
+}
+
+/*
+ * Sleep once until the event may have happened. If @locked, the cdma lock
+ * is held by the caller and dropped while sleeping. Returns the time spent
+ * asleep in nanoseconds.
+ */
+static u64 cdma_sleep(struct host1x_cdma *cdma, enum cdma_event event,
+		      unsigned int needed, bool locked)
+{
+	struct cdma_waiter waiter = {
+		.event = event,
+		.needed = needed,
+	};
+	u64 start;
+
+	init_wait_func(&waiter.wait, cdma_wake_function);
+	prepare_to_wait(&cdma->wq, &waiter.wait, TASK_UNINTERRUPTIBLE);
+
+	if (cdma_event_done(cdma, event, needed)) {
+		finish_wait(&cdma->wq, &waiter.wait);
+		return 0;
+	}
+
+	start = ktime_get_ns();
+
+	if (locked)
+		mutex_unlock(&cdma->lock);
+
+	schedule();
+
+	if (locked)
+		mutex_lock(&cdma->lock);
+
+	finish_wait(&cdma->wq, &waiter.wait);
+
+	return ktime_get_ns() - start;
+}
+
+/*
+ * Must be called with the cdma lock held.
+ */
+static void cdma_account_wait(struct host1x_cdma *cdma, u64 ns)
+{
+	struct host1x_cdma_stats *stats = &cdma->stats;
+
+	stats->waits++;
+	stats->wait_ns += ns;
+	stats->wait_max_ns = max(stats->wait_max_ns, ns);
+}
+
 /*
  * Sleep (if necessary) until the requested event happens
  *   - CDMA_EVENT_SYNC_QUEUE_EMPTY : sync queue is completely empty.
@@ -215,19 +309,7 @@ unsigned int host1x_cdma_wait_locked(struct host1x_cdma *cdma,
 		trace_host1x_wait_cdma(dev_name(cdma_to_channel(cdma)->dev),
 				       event);
 
-		/* If somebody has managed to already start waiting, yield */
-		if (cdma->event != CDMA_EVENT_NONE) {
-			mutex_unlock(&cdma->lock);
-			schedule();
-			mutex_lock(&cdma->lock);
-			continue;
-		}
-
-		cdma->event = event;
-
-		mutex_unlock(&cdma->lock);
-		wait_for_completion(&cdma->complete);
-		mutex_lock(&cdma->lock);
+		cdma_account_wait(cdma, cdma_sleep(cdma, event, 1, true));
 	}
 
 	return 0;
@@ -255,22 +337,59 @@ static int host1x_cdma_wait_pushbuffer_space(struct host1x *host1x,
 
 		host1x_hw_cdma_flush(host1x, cdma);
 
-		/* If somebody has managed to already start waiting, yield */
-		if (cdma->event != CDMA_EVENT_NONE) {
-			mutex_unlock(&cdma->lock);
-			schedule();
-			mutex_lock(&cdma->lock);
-			continue;
-		}
+		cdma_account_wait(cdma, cdma_sleep(cdma,
+						   CDMA_EVENT_PUSH_BUFFER_SPACE,
+						   needed, true));
+	}
 
-		cdma->event = CDMA_EVENT_PUSH_BUFFER_SPACE;
+	return 0;
+}
 
-		mutex_unlock(&cdma->lock);
-		wait_for_completion(&cdma->complete);
-		mutex_lock(&cdma->lock);
+/*
+ * Upper bound of the push buffer slots used by a job: three for a wide
+ * push including padding, and two of those for a wait with its setclass.
+ * Capped at half the push buffer so that a big job can start pushing
+ * before the channel is fully drained; pushes beyond the reservation
+ * still wait for space as they go.
+ */
+static unsigned int host1x_cdma_job_slots(struct host1x_job *job)
+{
+	unsigned int i, slots = 24;
+
+	for (i = 0; i < job->num_cmds; i++) {
+		if (job->cmds[i].type == HOST1X_JOB_CMD_WAIT)
+			slots += 6;
+		else if (job->cmds[i].type == HOST1X_JOB_CMD_GATHER)
+			slots += 3;
+		else
+			slots += 1;
+
+		if (slots >= HOST1X_PUSHBUFFER_SLOTS / 2)
+			return HOST1X_PUSHBUFFER_SLOTS / 2;
 	}
 
-	return 0;
+	return slots;
+}
+
+/*
+ * Wait for the push buffer space needed by a job before taking the cdma
+ * lock, so that update_cdma_locked() can retire jobs and free space while
+ * the producer sleeps. Only the submitter holding the channel's submit
+ * lock pushes, so the space can only grow until it takes the cdma lock.
+ */
+static u64 host1x_cdma_reserve(struct host1x_cdma *cdma, unsigned int needed)
+{
+	u64 ns = 0;
+
+	while (host1x_pushbuffer_space(&cdma->push_buffer) < needed) {
+		trace_host1x_wait_cdma(dev_name(cdma_to_channel(cdma)->dev),
+				       CDMA_EVENT_PUSH_BUFFER_SPACE);
+
+		ns += cdma_sleep(cdma, CDMA_EVENT_PUSH_BUFFER_SPACE, needed,
+				 false);
+	}
+
+	return ns;
 }
 /*
  * Start timer that tracks the time spent by the job.
@@ -315,6 +434,7 @@ static void stop_cdma_timer_locked(struct host1x_cdma *cdma)
  */
 static void update_cdma_locked(struct host1x_cdma *cdma)
 {
+	struct cdma_wake_key key;
 	bool signal = false;
 	struct host1x_job *job, *n;
 
@@ -347,22 +467,20 @@ static void update_cdma_locked(struct host1x_cdma *cdma)
 			struct push_buffer *pb = &cdma->push_buffer;
 
 			host1x_pushbuffer_pop(pb, job->num_slots);
-
-			if (cdma->event == CDMA_EVENT_PUSH_BUFFER_SPACE)
-				signal = true;
+			signal = true;
 		}
 
 		list_del(&job->list);
 		host1x_job_put(job);
 	}
 
-	if (cdma->event == CDMA_EVENT_SYNC_QUEUE_EMPTY &&
-	    list_empty(&cdma->sync_queue))
+	if (list_empty(&cdma->sync_queue))
 		signal = true;
 
-	if (signal) {
-		cdma->event = CDMA_EVENT_NONE;
-		complete(&cdma->complete);
+	if (signal && wq_has_sleeper(&cdma->wq)) {
+		key.space = host1x_pushbuffer_space(&cdma->push_buffer);
+		key.idle = list_empty(&cdma->sync_queue);
+		__wake_up(&cdma->wq, TASK_NORMAL, 0, &key);
 	}
 }
 
@@ -513,12 +631,11 @@ int host1x_cdma_init(struct host1x_cdma *cdma)
 	int err;
 
 	mutex_init(&cdma->lock);
-	init_completion(&cdma->complete);
+	init_waitqueue_head(&cdma->wq);
 	INIT_WORK(&cdma->update_work, cdma_update_work);
 
 	INIT_LIST_HEAD(&cdma->sync_queue);
 
-	cdma->event = CDMA_EVENT_NONE;
 	cdma->running = false;
 	cdma->torndown = false;
 
@@ -554,9 +671,15 @@ int host1x_cdma_deinit(struct host1x_cdma *cdma)
 int host1x_cdma_begin(struct host1x_cdma *cdma, struct host1x_job *job)
 {
 	struct host1x *host1x = cdma_to_host1x(cdma);
+	u64 wait_ns;
+
+	wait_ns = host1x_cdma_reserve(cdma, host1x_cdma_job_slots(job));
 
 	mutex_lock(&cdma->lock);
 
+	if (wait_ns)
+		cdma_account_wait(cdma, wait_ns);
+
 	/*
 	 * Check if syncpoint was locked due to previous job timeout.
 	 * This needs to be done within the cdma lock to avoid a race
@@ -583,7 +706,8 @@ int host1x_cdma_begin(struct host1x_cdma *cdma, struct host1x_job *job)
 	if (!cdma->running)
 		host1x_hw_cdma_start(host1x, cdma);
 
-	cdma->slots_free = 0;
+	/* Hand the reserved space to host1x_cdma_push() */
+	cdma->slots_free = host1x_pushbuffer_space(&cdma->push_buffer);
 	cdma->slots_used = 0;
 	cdma->first_get = cdma->push_buffer.pos;
 
@@ -674,9 +798,17 @@ void host1x_cdma_end(struct host1x_cdma *cdma,
 {
 	struct host1x *host1x = cdma_to_host1x(cdma);
 	bool idle = list_empty(&cdma->sync_queue);
+	struct host1x_cdma_stats *stats = &cdma->stats;
+	u32 used;
 
 	host1x_hw_cdma_flush(host1x, cdma);
 
+	used = HOST1X_PUSHBUFFER_SLOTS - 1 -
+	       host1x_pushbuffer_space(&cdma->push_buffer);
+	stats->submits++;
+	stats->occupancy_sum += used;
+	stats->occupancy_max = max(stats->occupancy_max, used);
+
 	job->first_get = cdma->first_get;
 	job->num_slots = cdma->slots_used;
 	host1x_job_get(job);
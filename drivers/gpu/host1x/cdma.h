@@ -9,8 +9,8 @@
 #define __HOST1X_CDMA_H
 
 #include <linux/sched.h>
-#include <linux/completion.h>
 #include <linux/list.h>
+#include <linux/wait.h>
 #include <linux/workqueue.h>
 
 struct host1x_syncpt;
@@ -57,10 +57,19 @@ enum cdma_event {
 	CDMA_EVENT_PUSH_BUFFER_SPACE	/* wait for space in push buffer */
 };
 
+struct host1x_cdma_stats {
+	u64 submits;			/* jobs pushed */
+	u64 waits;			/* times a producer had to sleep */
+	u64 wait_ns;			/* total time spent sleeping */
+	u64 wait_max_ns;		/* longest single sleep */
+	u64 occupancy_sum;		/* used slots, summed over submits */
+	u32 occupancy_max;		/* most slots used after a submit */
+};
+
 struct host1x_cdma {
 	struct mutex lock;		/* controls access to shared state */
-	struct completion complete;	/* signalled when event occurs */
-	enum cdma_event event;		/* event that complete is waiting for */
+	wait_queue_head_t wq;		/* waiters for space or idle */
+	struct host1x_cdma_stats stats;	/* protected by lock */
 	unsigned int slots_used;	/* pb slots used in current submit */
 	unsigned int slots_free;	/* pb slots free in current submit */
 	unsigned int first_get;		/* DMAGET value, where submit begins */
@@ -44,6 +44,24 @@ int host1x_job_submit(struct host1x_job *job)
 }
 EXPORT_SYMBOL(host1x_job_submit);
 
+/**
+ * host1x_job_submit_batch() - Submit jobs in order
+ * @jobs: jobs to submit
+ * @num_jobs: number of jobs
+ * @num_submitted: returns the number of jobs submitted
+ *
+ * The submit lock of a channel is taken once for consecutive jobs on it.
+ * Submission stops at the first job that fails.
+ */
+int host1x_job_submit_batch(struct host1x_job **jobs, unsigned int num_jobs,
+			    unsigned int *num_submitted)
+{
+	struct host1x *host = dev_get_drvdata(jobs[0]->channel->dev->parent);
+
+	return host1x_hw_channel_submit_batch(host, jobs, num_jobs, num_submitted);
+}
+EXPORT_SYMBOL(host1x_job_submit_batch);
+
 struct host1x_channel *host1x_channel_get(struct host1x_channel *channel)
 {
 	kref_get(&channel->refcount);
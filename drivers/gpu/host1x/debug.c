@@ -9,10 +9,12 @@
 #include <linux/debugfs.h>
 #include <linux/pm_runtime.h>
 #include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/uaccess.h>
 
 #include <linux/io.h>
 
+#include "bus.h"
 #include "dev.h"
 #include "debug.h"
 #include "channel.h"
@@ -77,8 +79,6 @@ static int show_channel(struct host1x_channel *ch, void *data, bool show_fifo)
 
 static void show_syncpts(struct host1x *m, struct output *o, bool show_all)
 {
-	unsigned long irqflags;
-	struct list_head *pos;
 	unsigned int i;
 	int err;
 
@@ -91,12 +91,7 @@ static void show_syncpts(struct host1x *m, struct output *o, bool show_all)
 	for (i = 0; i < host1x_syncpt_nb_pts(m); i++) {
 		u32 max = host1x_syncpt_read_max(m->syncpt + i);
 		u32 min = host1x_syncpt_load(m->syncpt + i);
-		unsigned int waiters = 0;
-
-		spin_lock_irqsave(&m->syncpt[i].fences.lock, irqflags);
-		list_for_each(pos, &m->syncpt[i].fences.list)
-			waiters++;
-		spin_unlock_irqrestore(&m->syncpt[i].fences.lock, irqflags);
+		unsigned int waiters = host1x_intr_fence_count(m->syncpt + i);
 
 		if (!kref_read(&m->syncpt[i].ref))
 			continue;
@@ -189,6 +184,205 @@ static const struct file_operations host1x_debug_fops = {
 	.release = single_release,
 };
 
+static void show_wait_hist(struct seq_file *s, const char *name,
+			   atomic64_t *hist)
+{
+	unsigned int i;
+
+	seq_printf(s, "%s:\n", name);
+	for (i = 0; i < HOST1X_SYNCPT_WAIT_HIST_BUCKETS; i++)
+		seq_printf(s, "  %s%8lu us: %llu\n",
+			   i == HOST1X_SYNCPT_WAIT_HIST_BUCKETS - 1 ? ">=" : "< ",
+			   i == HOST1X_SYNCPT_WAIT_HIST_BUCKETS - 1 ? 1UL << i :
+			   2UL << i, (u64)atomic64_read(&hist[i]));
+}
+
+static int host1x_debug_syncpt_wait_show(struct seq_file *s, void *unused)
+{
+	struct host1x *m = s->private;
+	struct host1x_syncpt_wait_stats *stats = &m->wait_stats;
+	unsigned int i;
+
+	seq_printf(s, "spin hits: %llu\n", (u64)atomic64_read(&stats->spin_hits));
+	seq_printf(s, "sleeps: %llu\n", (u64)atomic64_read(&stats->sleeps));
+	seq_printf(s, "timeouts: %llu\n", (u64)atomic64_read(&stats->timeouts));
+	seq_printf(s, "spin time: %llu ns\n", (u64)atomic64_read(&stats->spin_ns));
+
+	show_wait_hist(s, "wait latency", stats->wait_hist);
+	show_wait_hist(s, "wake latency", stats->wake_hist);
+
+	seq_puts(s, "average wait latency:\n");
+	for (i = 0; i < host1x_syncpt_nb_pts(m); i++) {
+		u32 avg = READ_ONCE(m->syncpt[i].wait_ewma_ns);
+
+		if (avg)
+			seq_printf(s, "  id %u (%s): %u ns\n", i,
+				   m->syncpt[i].name ?: "", avg);
+	}
+
+	return 0;
+}
+
+static int host1x_debug_syncpt_wait_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host1x_debug_syncpt_wait_show, inode->i_private);
+}
+
+static const struct file_operations host1x_debug_syncpt_wait_fops = {
+	.open = host1x_debug_syncpt_wait_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int host1x_debug_cdma_show(struct seq_file *s, void *unused)
+{
+	struct host1x *m = s->private;
+	unsigned int i;
+
+	for (i = 0; i < m->info->nb_channels; i++) {
+		struct host1x_channel *ch = host1x_channel_get_index(m, i);
+		struct host1x_cdma_stats stats;
+
+		if (!ch)
+			continue;
+
+		mutex_lock(&ch->cdma.lock);
+		stats = ch->cdma.stats;
+		mutex_unlock(&ch->cdma.lock);
+
+		seq_printf(s, "channel %u (%s):\n", i, dev_name(ch->dev));
+		seq_printf(s, "  submits: %llu\n", stats.submits);
+		seq_printf(s, "  waits: %llu, %llu ns total, %llu ns max\n",
+			   stats.waits, stats.wait_ns, stats.wait_max_ns);
+		seq_printf(s, "  occupancy: %llu slots average, %u max\n",
+			   stats.submits ?
+				div64_u64(stats.occupancy_sum, stats.submits) : 0,
+			   stats.occupancy_max);
+
+		host1x_channel_put(ch);
+	}
+
+	return 0;
+}
+
+static int host1x_debug_cdma_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host1x_debug_cdma_show, inode->i_private);
+}
+
+static const struct file_operations host1x_debug_cdma_fops = {
+	.open = host1x_debug_cdma_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int host1x_debug_gather_pool_show(struct seq_file *s, void *unused)
+{
+	struct host1x_gather_pool_stats *stats = &host1x_gather_pool_stats;
+	u64 hits = atomic64_read(&stats->hits);
+	u64 misses = atomic64_read(&stats->misses);
+
+	seq_printf(s, "hits: %llu\n", hits);
+	seq_printf(s, "misses: %llu\n", misses);
+	seq_printf(s, "hit rate: %llu%%\n",
+		   hits + misses ? div64_u64(hits * 100, hits + misses) : 0);
+	seq_printf(s, "recycled: %llu\n", (u64)atomic64_read(&stats->recycled));
+	seq_printf(s, "freed: %llu\n", (u64)atomic64_read(&stats->freed));
+
+	return 0;
+}
+
+static int host1x_debug_gather_pool_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host1x_debug_gather_pool_show, inode->i_private);
+}
+
+static const struct file_operations host1x_debug_gather_pool_fops = {
+	.open = host1x_debug_gather_pool_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int host1x_debug_bo_cache_show(struct seq_file *s, void *unused)
+{
+	struct host1x_bo_cache_stats *stats = &host1x_bo_cache_stats;
+
+	seq_printf(s, "hits: %llu\n", (u64)atomic64_read(&stats->hits));
+	seq_printf(s, "misses: %llu\n", (u64)atomic64_read(&stats->misses));
+	seq_printf(s, "evictions: %llu\n", (u64)atomic64_read(&stats->evictions));
+
+	return 0;
+}
+
+static int host1x_debug_bo_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host1x_debug_bo_cache_show, inode->i_private);
+}
+
+static const struct file_operations host1x_debug_bo_cache_fops = {
+	.open = host1x_debug_bo_cache_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static u32 fence_selftest_count;
+static u64 fence_selftest_ns;
+static int fence_selftest_err;
+
+static int host1x_fence_selftest_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&debug_lock);
+	seq_printf(s, "fences: %u time: %llu ns result: %d\n",
+		   fence_selftest_count, fence_selftest_ns,
+		   fence_selftest_err);
+	mutex_unlock(&debug_lock);
+
+	return 0;
+}
+
+static int host1x_fence_selftest_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host1x_fence_selftest_show, inode->i_private);
+}
+
+/* Write "<count> [seed]" to run the fence queue stress test */
+static ssize_t host1x_fence_selftest_write(struct file *file,
+					   const char __user *user_buf,
+					   size_t count, loff_t *ppos)
+{
+	unsigned int nr, seed = 0;
+	char buf[32];
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &nr, &seed) < 1 || !nr || nr > SZ_1M)
+		return -EINVAL;
+
+	mutex_lock(&debug_lock);
+	fence_selftest_count = nr;
+	fence_selftest_err = host1x_intr_fence_selftest(nr, seed,
+							&fence_selftest_ns);
+	mutex_unlock(&debug_lock);
+
+	return count;
+}
+
+static const struct file_operations host1x_fence_selftest_fops = {
+	.open = host1x_fence_selftest_open,
+	.read = seq_read,
+	.write = host1x_fence_selftest_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static void host1x_debugfs_init(struct host1x *host1x)
 {
 	struct dentry *de = debugfs_create_dir("tegra-host1x", NULL);
@@ -205,6 +399,24 @@ static void host1x_debugfs_init(struct host1x *host1x)
 	debugfs_create_u32("trace_cmdbuf", S_IRUGO|S_IWUSR, de,
 			   &host1x_debug_trace_cmdbuf);
 
+	debugfs_create_file("fence_selftest", S_IRUGO|S_IWUSR, de, host1x,
+			    &host1x_fence_selftest_fops);
+
+	debugfs_create_file("syncpt_wait", S_IRUGO, de, host1x,
+			    &host1x_debug_syncpt_wait_fops);
+	debugfs_create_file("cdma", S_IRUGO, de, host1x,
+			    &host1x_debug_cdma_fops);
+	debugfs_create_file("gather_pool", S_IRUGO, de, host1x,
+			    &host1x_debug_gather_pool_fops);
+	debugfs_create_file("bo_cache", S_IRUGO, de, host1x,
+			    &host1x_debug_bo_cache_fops);
+	debugfs_create_u32("bo_cache_max", S_IRUGO|S_IWUSR, de,
+			   &host1x_bo_cache_max);
+	debugfs_create_u32("syncpt_wait_spin_max_us", S_IRUGO|S_IWUSR, de,
+			   &host1x->wait_stats.spin_max_us);
+	debugfs_create_u32("syncpt_wait_poll_ns", S_IRUGO|S_IWUSR, de,
+			   &host1x->wait_stats.poll_ns);
+
 	host1x_hw_debug_init(host1x, de);
 
 	debugfs_create_u32("force_timeout_pid", S_IRUGO|S_IWUSR, de,
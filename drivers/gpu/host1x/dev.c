@@ -1010,8 +1010,9 @@ static int host1x_remove(struct platform_device *pdev)
 	host1x_syncpt_deinit(host);
 	host1x_memory_context_list_free(&host->context_list);
 	host1x_channel_list_free(&host->channel_list);
-	host1x_iommu_exit(host);
+	host1x_gather_pool_put(host->gather_pool);
 	host1x_bo_cache_destroy(&host->cache);
+	host1x_iommu_exit(host);
 
 	return 0;
 }
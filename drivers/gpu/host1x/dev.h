@@ -33,6 +33,8 @@ struct host1x_channel_ops {
 	int (*init)(struct host1x_channel *channel, struct host1x *host,
 		    unsigned int id);
 	int (*submit)(struct host1x_job *job);
+	int (*submit_batch)(struct host1x_job **jobs, unsigned int num_jobs,
+			    unsigned int *num_submitted);
 };
 
 struct host1x_cdma_ops {
@@ -185,6 +187,7 @@ struct host1x {
 	struct host1x_syncpt *nop_sp;
 
 	struct mutex syncpt_mutex;
+	struct host1x_syncpt_wait_stats wait_stats;
 
 	struct host1x_channel_list channel_list;
 	struct host1x_memory_context_list context_list;
@@ -203,6 +206,9 @@ struct host1x {
 	struct device_dma_parameters dma_parms;
 
 	struct host1x_bo_cache cache;
+
+	/* Firewall copies of gathers, created on first use */
+	struct host1x_gather_pool *gather_pool;
 };
 
 void host1x_common_writel(struct host1x *host1x, u32 v, u32 r);
@@ -327,6 +333,14 @@ static inline int host1x_hw_channel_submit(struct host1x *host,
 	return host->channel_op->submit(job);
 }
 
+static inline int host1x_hw_channel_submit_batch(struct host1x *host,
+						 struct host1x_job **jobs,
+						 unsigned int num_jobs,
+						 unsigned int *num_submitted)
+{
+	return host->channel_op->submit_batch(jobs, num_jobs, num_submitted);
+}
+
 static inline void host1x_hw_cdma_start(struct host1x *host,
 					struct host1x_cdma *cdma)
 {
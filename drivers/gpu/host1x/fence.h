@@ -6,6 +6,8 @@
 #ifndef HOST1X_FENCE_H
 #define HOST1X_FENCE_H
 
+#include <linux/rbtree.h>
+
 struct host1x_syncpt_fence {
 	struct dma_fence base;
 
@@ -17,12 +19,19 @@ struct host1x_syncpt_fence {
 
 	struct delayed_work timeout_work;
 
-	struct list_head list;
+	/* Node in host1x_fence_list::tree, cleared when not queued */
+	struct rb_node node;
 };
 
+/*
+ * Pending fences of a syncpoint ordered by threshold. Thresholds are
+ * compared modulo 2^32, so all queued thresholds must lie within 2^31
+ * of each other, as they do for any valid wait.
+ */
 struct host1x_fence_list {
 	spinlock_t lock;
-	struct list_head list;
+	struct rb_root_cached tree;
+	unsigned int count;
 };
 
 void host1x_fence_signal(struct host1x_syncpt_fence *fence, ktime_t ts);
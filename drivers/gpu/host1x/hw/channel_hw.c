@@ -317,7 +317,32 @@ static void job_complete_callback(struct dma_fence *fence, struct dma_fence_cb *
 	complete(&job->fence_cb_done);
 }
 
-static int channel_submit(struct host1x_job *job)
+/*
+ * Waits on the previous job of a batch can only be resolved once that job
+ * has been pushed and its syncpoint end value is known.
+ */
+static int resolve_wait_previous(struct host1x_job *job, struct host1x_job *prev)
+{
+	unsigned int i;
+
+	for (i = 0; i < job->num_cmds; i++) {
+		struct host1x_job_wait *wait = &job->cmds[i].wait;
+
+		if (job->cmds[i].type != HOST1X_JOB_CMD_WAIT || !wait->previous)
+			continue;
+
+		if (!prev)
+			return -EINVAL;
+
+		wait->id = prev->syncpt->id;
+		wait->threshold = prev->syncpt_end;
+	}
+
+	return 0;
+}
+
+/* Called with the submit lock of the job's channel held */
+static int channel_submit_locked(struct host1x_job *job, struct host1x_job *prev)
 {
 	struct host1x_channel *ch = job->channel;
 	struct host1x_syncpt *sp = job->syncpt;
@@ -333,8 +358,7 @@ static int channel_submit(struct host1x_job *job)
 	/* before error checks, return current max */
 	prev_max = job->syncpt_end = host1x_syncpt_read_max(sp);
 
-	/* get submit lock */
-	err = mutex_lock_interruptible(&ch->submitlock);
+	err = resolve_wait_previous(job, prev);
 	if (err)
 		return err;
 
@@ -346,10 +370,8 @@ static int channel_submit(struct host1x_job *job)
 
 	/* begin a CDMA submit */
 	err = host1x_cdma_begin(&ch->cdma, job);
-	if (err) {
-		mutex_unlock(&ch->submitlock);
+	if (err)
 		return err;
-	}
 
 	channel_program_cdma(job);
 	syncval = host1x_syncpt_read_max(sp);
@@ -371,8 +393,6 @@ static int channel_submit(struct host1x_job *job)
 
 	trace_host1x_channel_submitted(dev_name(ch->dev), prev_max, syncval);
 
-	mutex_unlock(&ch->submitlock);
-
 	if (err == -ENOENT)
 		host1x_cdma_update(&ch->cdma);
 	else
@@ -381,6 +401,62 @@ static int channel_submit(struct host1x_job *job)
 	return 0;
 }
 
+static int channel_submit(struct host1x_job *job)
+{
+	struct host1x_channel *ch = job->channel;
+	int err;
+
+	/* get submit lock */
+	err = mutex_lock_interruptible(&ch->submitlock);
+	if (err)
+		return err;
+
+	err = channel_submit_locked(job, NULL);
+
+	mutex_unlock(&ch->submitlock);
+
+	return err;
+}
+
+static int channel_submit_batch(struct host1x_job **jobs, unsigned int num_jobs,
+				unsigned int *num_submitted)
+{
+	struct host1x_channel *ch = NULL;
+	unsigned int i;
+	int err = 0;
+
+	*num_submitted = 0;
+
+	for (i = 0; i < num_jobs; i++) {
+		struct host1x_job *job = jobs[i];
+
+		/* Keep the submit lock across consecutive jobs on a channel */
+		if (job->channel != ch) {
+			if (ch)
+				mutex_unlock(&ch->submitlock);
+
+			ch = job->channel;
+
+			err = mutex_lock_interruptible(&ch->submitlock);
+			if (err) {
+				ch = NULL;
+				break;
+			}
+		}
+
+		err = channel_submit_locked(job, i ? jobs[i - 1] : NULL);
+		if (err)
+			break;
+
+		(*num_submitted)++;
+	}
+
+	if (ch)
+		mutex_unlock(&ch->submitlock);
+
+	return err;
+}
+
 static int host1x_channel_init(struct host1x_channel *ch, struct host1x *dev,
 			       unsigned int index)
 {
@@ -395,4 +471,5 @@ static int host1x_channel_init(struct host1x_channel *ch, struct host1x *dev,
 static const struct host1x_channel_ops host1x_channel_ops = {
 	.init = host1x_channel_init,
 	.submit = channel_submit,
+	.submit_batch = channel_submit_batch,
 };
@@ -9,9 +9,11 @@
 #include <linux/device.h>
 #include <linux/dma-direction.h>
 #include <linux/dma-fence.h>
+#include <linux/hashtable.h>
 #include <linux/spinlock.h>
 #include <linux/timekeeping.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 enum host1x_class {
 	HOST1X_CLASS_HOST1X = 0x1,
@@ -43,30 +45,36 @@ u64 host1x_get_dma_mask(struct host1x *host1x);
 
 /**
  * struct host1x_bo_cache - host1x buffer object cache
- * @mappings: list of mappings
- * @lock: synchronizes accesses to the list of mappings
+ * @index: mappings hashed by buffer object and direction, looked up under RCU
+ * @mappings: list of mappings, least recently added or used first
+ * @lock: synchronizes updates of the index and the list of mappings
+ * @count: number of mappings in the cache
+ * @deferred: number of evicted mappings waiting for an RCU grace period
  *
- * Note that entries are not periodically evicted from this cache and instead need to be
- * explicitly released. This is used primarily for DRM/KMS where the cache's reference is
- * released when the last reference to a buffer object represented by a mapping in this
- * cache is dropped.
+ * The cache keeps a reference to each of its mappings. Mappings are either
+ * explicitly released, which is used primarily for DRM/KMS where the cache's
+ * reference is released when the last reference to a buffer object
+ * represented by a mapping in this cache is dropped, or evicted in LRU
+ * order once the cache grows past its size limit.
  */
 struct host1x_bo_cache {
+	DECLARE_HASHTABLE(index, 8);
 	struct list_head mappings;
 	struct mutex lock;
+	unsigned int count;
+	atomic_t deferred;
 };
 
 static inline void host1x_bo_cache_init(struct host1x_bo_cache *cache)
 {
+	hash_init(cache->index);
 	INIT_LIST_HEAD(&cache->mappings);
 	mutex_init(&cache->lock);
+	cache->count = 0;
+	atomic_set(&cache->deferred, 0);
 }
 
-static inline void host1x_bo_cache_destroy(struct host1x_bo_cache *cache)
-{
-	/* XXX warn if not empty? */
-	mutex_destroy(&cache->lock);
-}
+void host1x_bo_cache_destroy(struct host1x_bo_cache *cache);
 
 /**
  * struct host1x_client_ops - host1x client operations
@@ -154,6 +162,12 @@ struct host1x_bo_mapping {
 
 	struct host1x_bo_cache *cache;
 	struct list_head entry;
+	struct hlist_node node;
+	/* Protected by cache->lock */
+	bool cached;
+	/* Set on lookup, gives the mapping a second chance on eviction */
+	bool referenced;
+	struct rcu_work rwork;
 };
 
 static inline struct host1x_bo_mapping *to_host1x_bo_mapping(struct kref *ref)
@@ -175,6 +189,8 @@ struct host1x_bo {
 	const struct host1x_bo_ops *ops;
 	struct list_head mappings;
 	spinlock_t lock;
+	/* Short-lived buffer, never kept in a mapping cache */
+	bool uncached;
 };
 
 static inline void host1x_bo_init(struct host1x_bo *bo,
@@ -183,6 +199,7 @@ static inline void host1x_bo_init(struct host1x_bo *bo,
 	INIT_LIST_HEAD(&bo->mappings);
 	spin_lock_init(&bo->lock);
 	bo->ops = ops;
+	bo->uncached = false;
 }
 
 static inline struct host1x_bo *host1x_bo_get(struct host1x_bo *bo)
@@ -199,6 +216,8 @@ struct host1x_bo_mapping *host1x_bo_pin(struct device *dev, struct host1x_bo *bo
 					enum dma_data_direction dir,
 					struct host1x_bo_cache *cache);
 void host1x_bo_unpin(struct host1x_bo_mapping *map);
+bool host1x_bo_uncache(struct host1x_bo_mapping *map);
+void host1x_bo_uncache_all(struct host1x_bo *bo);
 
 static inline void *host1x_bo_mmap(struct host1x_bo *bo)
 {
@@ -265,6 +284,8 @@ struct host1x_channel *host1x_channel_get(struct host1x_channel *channel);
 void host1x_channel_stop(struct host1x_channel *channel);
 void host1x_channel_put(struct host1x_channel *channel);
 int host1x_job_submit(struct host1x_job *job);
+int host1x_job_submit_batch(struct host1x_job **jobs, unsigned int num_jobs,
+			    unsigned int *num_submitted);
 
 /*
  * host1x job
@@ -375,10 +396,22 @@ struct host1x_job {
 struct host1x_job *host1x_job_alloc(struct host1x_channel *ch,
 				    u32 num_cmdbufs, u32 num_relocs,
 				    bool skip_firewall);
+/* Pool of DMA buffers for command stream copies */
+struct host1x_gather_pool;
+
+struct host1x_gather_pool *host1x_gather_pool_create(struct device *dev,
+						     unsigned long attrs);
+void host1x_gather_pool_put(struct host1x_gather_pool *pool);
+void *host1x_gather_pool_alloc(struct host1x_gather_pool *pool, size_t *size,
+			       dma_addr_t *dma, gfp_t gfp);
+void host1x_gather_pool_free(struct host1x_gather_pool *pool, size_t size,
+			     void *virt, dma_addr_t dma);
+
 void host1x_job_add_gather(struct host1x_job *job, struct host1x_bo *bo,
 			   unsigned int words, unsigned int offset);
 void host1x_job_add_wait(struct host1x_job *job, u32 id, u32 thresh,
 			 bool relative, u32 next_class);
+void host1x_job_add_wait_previous(struct host1x_job *job, u32 next_class);
 void host1x_job_add_reg_write(struct host1x_job *job, u32 reg, u32 value);
 struct host1x_job *host1x_job_get(struct host1x_job *job);
 void host1x_job_put(struct host1x_job *job);
@@ -6,35 +6,91 @@
  */
 
 #include <linux/clk.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
 
 #include "dev.h"
 #include "fence.h"
 #include "intr.h"
 
-static void host1x_intr_add_fence_to_list(struct host1x_fence_list *list,
-					  struct host1x_syncpt_fence *fence)
+static inline bool host1x_fence_before(u32 a, u32 b)
 {
-	struct host1x_syncpt_fence *fence_in_list;
+	return (s32)(a - b) < 0;
+}
+
+static inline bool host1x_fence_expired(u32 value, u32 threshold)
+{
+	return ((value - threshold) & 0x80000000U) == 0U;
+}
+
+static void host1x_fence_list_init(struct host1x_fence_list *list)
+{
+	list->tree = RB_ROOT_CACHED;
+	list->count = 0;
+}
 
-	list_for_each_entry_reverse(fence_in_list, &list->list, list) {
-		if ((s32)(fence_in_list->threshold - fence->threshold) <= 0) {
-			/* Fence in list is before us, we can insert here */
-			list_add(&fence->list, &fence_in_list->list);
-			return;
+static void host1x_fence_list_add(struct host1x_fence_list *list,
+				  struct host1x_syncpt_fence *fence)
+{
+	struct rb_node **link = &list->tree.rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	bool leftmost = true;
+
+	while (*link) {
+		struct host1x_syncpt_fence *entry;
+
+		parent = *link;
+		entry = rb_entry(parent, struct host1x_syncpt_fence, node);
+
+		/* Equal thresholds go after existing ones, keeping FIFO order */
+		if (host1x_fence_before(fence->threshold, entry->threshold)) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = false;
 		}
 	}
 
-	/* Add as first in list */
-	list_add(&fence->list, &list->list);
+	rb_link_node(&fence->node, parent, link);
+	rb_insert_color_cached(&fence->node, &list->tree, leftmost);
+	list->count++;
 }
 
-static void host1x_intr_update_hw_state(struct host1x *host, struct host1x_syncpt *sp)
+static void host1x_fence_list_del(struct host1x_fence_list *list,
+				  struct host1x_syncpt_fence *fence)
 {
-	struct host1x_syncpt_fence *fence;
+	rb_erase_cached(&fence->node, &list->tree);
+	RB_CLEAR_NODE(&fence->node);
+	list->count--;
+}
+
+static struct host1x_syncpt_fence *
+host1x_fence_list_first(struct host1x_fence_list *list)
+{
+	struct rb_node *node = rb_first_cached(&list->tree);
+
+	return node ? rb_entry(node, struct host1x_syncpt_fence, node) : NULL;
+}
+
+/* Dequeue the earliest fence if it has expired at @value */
+static struct host1x_syncpt_fence *
+host1x_fence_list_pop_expired(struct host1x_fence_list *list, u32 value)
+{
+	struct host1x_syncpt_fence *fence = host1x_fence_list_first(list);
+
+	if (!fence || !host1x_fence_expired(value, fence->threshold))
+		return NULL;
 
-	if (!list_empty(&sp->fences.list)) {
-		fence = list_first_entry(&sp->fences.list, struct host1x_syncpt_fence, list);
+	host1x_fence_list_del(list, fence);
 
+	return fence;
+}
+
+static void host1x_intr_update_hw_state(struct host1x *host, struct host1x_syncpt *sp)
+{
+	struct host1x_syncpt_fence *fence = host1x_fence_list_first(&sp->fences);
+
+	if (fence) {
 		host1x_hw_intr_set_syncpt_threshold(host, sp->id, fence->threshold);
 		host1x_hw_intr_enable_syncpt_intr(host, sp->id);
 	} else {
@@ -45,27 +101,32 @@ static void host1x_intr_update_hw_state(struct host1x *host, struct host1x_syncp
 void host1x_intr_add_fence_locked(struct host1x *host, struct host1x_syncpt_fence *fence)
 {
 	struct host1x_fence_list *fence_list = &fence->sp->fences;
+	struct host1x_syncpt_fence *first = host1x_fence_list_first(fence_list);
 
-	INIT_LIST_HEAD(&fence->list);
+	host1x_fence_list_add(fence_list, fence);
 
-	host1x_intr_add_fence_to_list(fence_list, fence);
-	host1x_intr_update_hw_state(host, fence->sp);
+	/* Only a new earliest fence changes the programmed threshold */
+	if (!first || host1x_fence_before(fence->threshold, first->threshold))
+		host1x_intr_update_hw_state(host, fence->sp);
 }
 
 bool host1x_intr_remove_fence(struct host1x *host, struct host1x_syncpt_fence *fence)
 {
 	struct host1x_fence_list *fence_list = &fence->sp->fences;
 	unsigned long irqflags;
+	bool was_first;
 
 	spin_lock_irqsave(&fence_list->lock, irqflags);
 
-	if (list_empty(&fence->list)) {
+	if (RB_EMPTY_NODE(&fence->node)) {
 		spin_unlock_irqrestore(&fence_list->lock, irqflags);
 		return false;
 	}
 
-	list_del_init(&fence->list);
-	host1x_intr_update_hw_state(host, fence->sp);
+	was_first = host1x_fence_list_first(fence_list) == fence;
+	host1x_fence_list_del(fence_list, fence);
+	if (was_first)
+		host1x_intr_update_hw_state(host, fence->sp);
 
 	spin_unlock_irqrestore(&fence_list->lock, irqflags);
 
@@ -75,22 +136,15 @@ bool host1x_intr_remove_fence(struct host1x *host, struct host1x_syncpt_fence *f
 void host1x_intr_handle_interrupt(struct host1x *host, unsigned int id, ktime_t ts)
 {
 	struct host1x_syncpt *sp = &host->syncpt[id];
-	struct host1x_syncpt_fence *fence, *tmp;
+	struct host1x_syncpt_fence *fence;
 	unsigned int value;
 
 	value = host1x_syncpt_load(sp);
 
 	spin_lock(&sp->fences.lock);
 
-	list_for_each_entry_safe(fence, tmp, &sp->fences.list, list) {
-		if (((value - fence->threshold) & 0x80000000U) != 0U) {
-			/* Fence is not yet expired, we are done */
-			break;
-		}
-
-		list_del_init(&fence->list);
+	while ((fence = host1x_fence_list_pop_expired(&sp->fences, value)))
 		host1x_fence_signal(fence, ts);
-	}
 
 	/* Re-enable interrupt if necessary */
 	host1x_intr_update_hw_state(host, sp);
@@ -98,6 +152,87 @@ void host1x_intr_handle_interrupt(struct host1x *host, unsigned int id, ktime_t
 	spin_unlock(&sp->fences.lock);
 }
 
+unsigned int host1x_intr_fence_count(struct host1x_syncpt *sp)
+{
+	unsigned long irqflags;
+	unsigned int count;
+
+	spin_lock_irqsave(&sp->fences.lock, irqflags);
+	count = sp->fences.count;
+	spin_unlock_irqrestore(&sp->fences.lock, irqflags);
+
+	return count;
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Stress the fence queue against a mocked syncpoint value: queue @count
+ * fences starting just below the 32-bit wrap, cancel about a tenth of
+ * them and expire the rest by advancing the value in random steps. Each
+ * expired fence must be due and in threshold order.
+ */
+int host1x_intr_fence_selftest(unsigned int count, u32 seed, u64 *ns)
+{
+	struct host1x_syncpt_fence *fences, *fence;
+	struct host1x_fence_list list;
+	unsigned int i, live, expired = 0;
+	struct rnd_state rnd;
+	u32 value, last;
+	u64 start;
+	int err = 0;
+
+	if (!count)
+		return -EINVAL;
+
+	fences = vzalloc(array_size(count, sizeof(*fences)));
+	if (!fences)
+		return -ENOMEM;
+
+	prandom_seed_state(&rnd, seed);
+	host1x_fence_list_init(&list);
+	value = 0U - count;
+	last = value;
+
+	start = ktime_get_ns();
+
+	for (i = 0; i < count; i++) {
+		fences[i].threshold = value + 1 + prandom_u32_state(&rnd) % (2 * count);
+		host1x_fence_list_add(&list, &fences[i]);
+	}
+
+	live = count;
+	for (i = 0; i < count; i++) {
+		if (prandom_u32_state(&rnd) % 10)
+			continue;
+		host1x_fence_list_del(&list, &fences[i]);
+		live--;
+	}
+
+	while (list.count) {
+		value += 1 + prandom_u32_state(&rnd) % 64;
+
+		while ((fence = host1x_fence_list_pop_expired(&list, value))) {
+			if (!host1x_fence_expired(value, fence->threshold) ||
+			    host1x_fence_before(fence->threshold, last)) {
+				err = -EINVAL;
+				goto out;
+			}
+			last = fence->threshold;
+			expired++;
+		}
+	}
+
+	if (expired != live)
+		err = -EINVAL;
+
+out:
+	*ns = ktime_get_ns() - start;
+	vfree(fences);
+
+	return err;
+}
+#endif
+
 int host1x_intr_init(struct host1x *host)
 {
 	unsigned int id;
@@ -108,7 +243,7 @@ int host1x_intr_init(struct host1x *host)
 		struct host1x_syncpt *syncpt = &host->syncpt[id];
 
 		spin_lock_init(&syncpt->fences.lock);
-		INIT_LIST_HEAD(&syncpt->fences.list);
+		host1x_fence_list_init(&syncpt->fences);
 	}
 
 	return 0;
@@ -8,9 +8,11 @@
 #ifndef __HOST1X_INTR_H
 #define __HOST1X_INTR_H
 
+#include <linux/errno.h>
 #include <linux/timekeeping.h>
 
 struct host1x;
+struct host1x_syncpt;
 struct host1x_syncpt_fence;
 
 /* Initialize host1x sync point interrupt */
@@ -31,4 +33,18 @@ void host1x_intr_add_fence_locked(struct host1x *host, struct host1x_syncpt_fenc
 
 bool host1x_intr_remove_fence(struct host1x *host, struct host1x_syncpt_fence *fence);
 
+/* Number of fences waiting on the sync point */
+unsigned int host1x_intr_fence_count(struct host1x_syncpt *sp);
+
+#ifdef CONFIG_DEBUG_FS
+/* Fence queue stress test, see intr.c */
+int host1x_intr_fence_selftest(unsigned int count, u32 seed, u64 *ns);
+#else
+static inline int host1x_intr_fence_selftest(unsigned int count, u32 seed,
+					     u64 *ns)
+{
+	return -ENODEV;
+}
+#endif
+
 #endif
@@ -144,6 +144,20 @@ void host1x_job_add_wait(struct host1x_job *job, u32 id, u32 thresh,
 }
 EXPORT_SYMBOL(host1x_job_add_wait);
 
+/*
+ * Wait for the job submitted before @job by host1x_job_submit_batch(),
+ * whose syncpoint value is only known once it has been pushed.
+ */
+void host1x_job_add_wait_previous(struct host1x_job *job, u32 next_class)
+{
+	struct host1x_job_cmd *cmd = &job->cmds[job->num_cmds++];
+
+	cmd->type = HOST1X_JOB_CMD_WAIT;
+	cmd->wait.next_class = next_class;
+	cmd->wait.previous = true;
+}
+EXPORT_SYMBOL(host1x_job_add_wait_previous);
+
 void host1x_job_add_reg_write(struct host1x_job *job, u32 reg, u32 value)
 {
 	struct host1x_job_cmd *cmd = &job->cmds[job->num_cmds++];
@@ -197,7 +211,7 @@ static unsigned int pin_job(struct host1x *host, struct host1x_job *job)
 			goto unpin;
 		}
 
-		map = host1x_bo_pin(dev, bo, direction, NULL);
+		map = host1x_bo_pin(dev, bo, direction, &client->cache);
 		if (IS_ERR(map)) {
 			err = PTR_ERR(map);
 			goto unpin;
@@ -244,7 +258,7 @@ static unsigned int pin_job(struct host1x *host, struct host1x_job *job)
 			goto unpin;
 		}
 
-		map = host1x_bo_pin(host->dev, g->bo, DMA_TO_DEVICE, NULL);
+		map = host1x_bo_pin(host->dev, g->bo, DMA_TO_DEVICE, &host->cache);
 		if (IS_ERR(map)) {
 			err = PTR_ERR(map);
 			goto unpin;
@@ -425,12 +439,27 @@ static int check_mask(struct host1x_firewall *fw)
 	return 0;
 }
 
+/* Consume a payload run that contains no address registers. */
+static int skip_words(struct host1x_firewall *fw, u32 count)
+{
+	if (count > fw->words)
+		return -EINVAL;
+
+	fw->words -= count;
+	fw->offset += count;
+
+	return 0;
+}
+
 static int check_incr(struct host1x_firewall *fw)
 {
 	u32 count = fw->count;
 	u32 reg = fw->reg;
 	int ret;
 
+	if (!fw->job->is_addr_reg)
+		return skip_words(fw, count);
+
 	while (count) {
 		if (fw->words == 0)
 			return -EINVAL;
@@ -453,6 +482,11 @@ static int check_nonincr(struct host1x_firewall *fw)
 	u32 count = fw->count;
 	int ret;
 
+	/* All words go to the same register, so one lookup covers the run */
+	if (!fw->job->is_addr_reg ||
+	    !fw->job->is_addr_reg(fw->dev, fw->class, fw->reg))
+		return skip_words(fw, count);
+
 	while (count) {
 		if (fw->words == 0)
 			return -EINVAL;
@@ -537,9 +571,154 @@ out:
 	return err;
 }
 
-static inline int copy_gathers(struct device *host, struct host1x_job *job,
+struct host1x_gather_pool_stats host1x_gather_pool_stats;
+
+static int host1x_gather_pool_class(size_t size)
+{
+	int order = get_order(size);
+
+	return order < HOST1X_GATHER_POOL_CLASSES ? order : -1;
+}
+
+struct host1x_gather_pool *host1x_gather_pool_create(struct device *dev,
+						     unsigned long attrs)
+{
+	struct host1x_gather_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	kref_init(&pool->ref);
+	spin_lock_init(&pool->lock);
+	pool->dev = dev;
+	pool->attrs = attrs;
+
+	return pool;
+}
+EXPORT_SYMBOL(host1x_gather_pool_create);
+
+static void host1x_gather_pool_release(struct kref *ref)
+{
+	struct host1x_gather_pool *pool =
+		container_of(ref, struct host1x_gather_pool, ref);
+	unsigned int i, j;
+
+	for (i = 0; i < HOST1X_GATHER_POOL_CLASSES; i++) {
+		for (j = 0; j < pool->classes[i].num; j++)
+			dma_free_attrs(pool->dev, PAGE_SIZE << i,
+				       pool->classes[i].bufs[j].virt,
+				       pool->classes[i].bufs[j].dma, pool->attrs);
+	}
+
+	kfree(pool);
+}
+
+void host1x_gather_pool_put(struct host1x_gather_pool *pool)
+{
+	if (pool)
+		kref_put(&pool->ref, host1x_gather_pool_release);
+}
+EXPORT_SYMBOL(host1x_gather_pool_put);
+
+/**
+ * host1x_gather_pool_alloc() - get a DMA buffer for gather words
+ * @pool: pool to take the buffer from
+ * @size: requested size, updated to the size of the returned buffer
+ * @dma: return location for the DMA address
+ * @gfp: allocation flags used when the pool is empty
+ *
+ * Buffers up to the largest size class are recycled by
+ * host1x_gather_pool_free(). Each buffer holds a reference to the pool.
+ */
+void *host1x_gather_pool_alloc(struct host1x_gather_pool *pool, size_t *size,
+			       dma_addr_t *dma, gfp_t gfp)
+{
+	int class = host1x_gather_pool_class(*size);
+	void *virt = NULL;
+
+	if (class >= 0) {
+		spin_lock(&pool->lock);
+		if (pool->classes[class].num) {
+			unsigned int i = --pool->classes[class].num;
+
+			virt = pool->classes[class].bufs[i].virt;
+			*dma = pool->classes[class].bufs[i].dma;
+		}
+		spin_unlock(&pool->lock);
+
+		*size = PAGE_SIZE << class;
+	}
+
+	if (virt) {
+		atomic64_inc(&host1x_gather_pool_stats.hits);
+	} else {
+		atomic64_inc(&host1x_gather_pool_stats.misses);
+
+		virt = dma_alloc_attrs(pool->dev, *size, dma, gfp, pool->attrs);
+		if (!virt)
+			return NULL;
+	}
+
+	kref_get(&pool->ref);
+
+	return virt;
+}
+EXPORT_SYMBOL(host1x_gather_pool_alloc);
+
+void host1x_gather_pool_free(struct host1x_gather_pool *pool, size_t size,
+			     void *virt, dma_addr_t dma)
+{
+	int class = host1x_gather_pool_class(size);
+	bool recycled = false;
+
+	if (class >= 0 && size == PAGE_SIZE << class) {
+		spin_lock(&pool->lock);
+		if (pool->classes[class].num < HOST1X_GATHER_POOL_DEPTH) {
+			unsigned int i = pool->classes[class].num++;
+
+			pool->classes[class].bufs[i].virt = virt;
+			pool->classes[class].bufs[i].dma = dma;
+			recycled = true;
+		}
+		spin_unlock(&pool->lock);
+	}
+
+	if (recycled) {
+		atomic64_inc(&host1x_gather_pool_stats.recycled);
+	} else {
+		atomic64_inc(&host1x_gather_pool_stats.freed);
+		dma_free_attrs(pool->dev, size, virt, dma, pool->attrs);
+	}
+
+	host1x_gather_pool_put(pool);
+}
+EXPORT_SYMBOL(host1x_gather_pool_free);
+
+static struct host1x_gather_pool *host1x_gather_pool_get_host(struct host1x *host)
+{
+	struct host1x_gather_pool *pool = READ_ONCE(host->gather_pool);
+
+	if (pool)
+		return pool;
+
+	pool = host1x_gather_pool_create(host->dev, DMA_ATTR_WRITE_COMBINE);
+	if (!pool)
+		return NULL;
+
+	/* Lost a race with another submit */
+	if (cmpxchg(&host->gather_pool, NULL, pool)) {
+		host1x_gather_pool_put(pool);
+		pool = host->gather_pool;
+	}
+
+	return pool;
+}
+
+static inline int copy_gathers(struct host1x *host, struct host1x_job *job,
 			       struct device *dev)
 {
+	struct host1x_gather_pool *pool;
 	struct host1x_firewall fw;
 	size_t size = 0;
 	size_t offset = 0;
@@ -562,22 +741,18 @@ static inline int copy_gathers(struct device *host, struct host1x_job *job,
 		size += g->words * sizeof(u32);
 	}
 
-	/*
-	 * Try a non-blocking allocation from a higher priority pools first,
-	 * as awaiting for the allocation here is a major performance hit.
-	 */
-	job->gather_copy_mapped = dma_alloc_wc(host, size, &job->gather_copy,
-					       GFP_NOWAIT);
-
-	/* the higher priority allocation failed, try the generic-blocking */
-	if (!job->gather_copy_mapped)
-		job->gather_copy_mapped = dma_alloc_wc(host, size,
-						       &job->gather_copy,
-						       GFP_KERNEL);
-	if (!job->gather_copy_mapped)
+	pool = host1x_gather_pool_get_host(host);
+	if (!pool)
 		return -ENOMEM;
 
+	/* Recycled buffers keep the allocator off the submit path */
 	job->gather_copy_size = size;
+	job->gather_copy_mapped = host1x_gather_pool_alloc(pool, &job->gather_copy_size,
+							   &job->gather_copy, GFP_KERNEL);
+	if (!job->gather_copy_mapped) {
+		job->gather_copy_size = 0;
+		return -ENOMEM;
+	}
 
 	for (i = 0; i < job->num_cmds; i++) {
 		struct host1x_job_gather *g;
@@ -623,7 +798,7 @@ int host1x_job_pin(struct host1x_job *job, struct device *dev)
 		goto out;
 
 	if (job->enable_firewall) {
-		err = copy_gathers(host->dev, job, dev);
+		err = copy_gathers(host, job, dev);
 		if (err)
 			goto out;
 	}
@@ -686,9 +861,11 @@ void host1x_job_unpin(struct host1x_job *job)
 
 	job->num_unpins = 0;
 
-	if (job->gather_copy_size)
-		dma_free_wc(host->dev, job->gather_copy_size,
-			    job->gather_copy_mapped, job->gather_copy);
+	if (job->gather_copy_size) {
+		host1x_gather_pool_free(host->gather_pool, job->gather_copy_size,
+					job->gather_copy_mapped, job->gather_copy);
+		job->gather_copy_size = 0;
+	}
 }
 EXPORT_SYMBOL(host1x_job_unpin);
 
@@ -23,6 +23,8 @@ struct host1x_job_wait {
 	u32 threshold;
 	u32 next_class;
 	bool relative;
+	/* Resolved to the end of the previous job of the batch on submit */
+	bool previous;
 };
 
 struct host1x_job_reg_write {
@@ -50,6 +52,34 @@ struct host1x_job_unpin_data {
 	struct host1x_bo_mapping *map;
 };
 
+/* Gather buffers are recycled in power of two classes from PAGE_SIZE */
+#define HOST1X_GATHER_POOL_CLASSES	5
+#define HOST1X_GATHER_POOL_DEPTH	16
+
+struct host1x_gather_pool {
+	struct kref ref;
+	struct device *dev;
+	unsigned long attrs;
+	spinlock_t lock;
+
+	struct {
+		unsigned int num;
+		struct {
+			void *virt;
+			dma_addr_t dma;
+		} bufs[HOST1X_GATHER_POOL_DEPTH];
+	} classes[HOST1X_GATHER_POOL_CLASSES];
+};
+
+struct host1x_gather_pool_stats {
+	atomic64_t hits;
+	atomic64_t misses;
+	atomic64_t recycled;
+	atomic64_t freed;
+};
+
+extern struct host1x_gather_pool_stats host1x_gather_pool_stats;
+
 /*
  * Dump contents of job to debug output.
  */
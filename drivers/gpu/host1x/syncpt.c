@@ -9,6 +9,7 @@
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dma-fence.h>
+#include <linux/log2.h>
 #include <linux/slab.h>
 #include <linux/timekeeping.h>
 
@@ -229,6 +230,52 @@ int host1x_syncpt_incr(struct host1x_syncpt *sp)
 }
 EXPORT_SYMBOL(host1x_syncpt_incr);
 
+/* Weight of a new sample in the wait latency average, as a shift */
+#define HOST1X_SYNCPT_WAIT_EWMA_SHIFT	3
+
+static void host1x_syncpt_wait_hist(atomic64_t *hist, s64 ns)
+{
+	u64 us = ns > 0 ? div_u64(ns, NSEC_PER_USEC) : 0;
+	unsigned int bucket = us ? ilog2(us) : 0;
+
+	bucket = min_t(unsigned int, bucket, HOST1X_SYNCPT_WAIT_HIST_BUCKETS - 1);
+	atomic64_inc(&hist[bucket]);
+}
+
+static void host1x_syncpt_wait_done(struct host1x_syncpt *sp, s64 ns)
+{
+	s64 avg = READ_ONCE(sp->wait_ewma_ns);
+
+	ns = clamp_t(s64, ns, 1, U32_MAX);
+	if (avg)
+		avg += (ns - avg) >> HOST1X_SYNCPT_WAIT_EWMA_SHIFT;
+	else
+		avg = ns;
+
+	/* Racing waiters may lose an update, which the average tolerates */
+	WRITE_ONCE(sp->wait_ewma_ns, avg);
+	host1x_syncpt_wait_hist(sp->host->wait_stats.wait_hist, ns);
+}
+
+/*
+ * Spin for a bit over the usual completion latency of the syncpoint, so
+ * that short jobs do not pay for a fence and an interrupt. Syncpoints that
+ * usually take longer than the spin limit go to sleep right away.
+ */
+static u64 host1x_syncpt_spin_budget(struct host1x_syncpt *sp)
+{
+	u64 max = (u64)READ_ONCE(sp->host->wait_stats.spin_max_us) * NSEC_PER_USEC;
+	u64 avg = READ_ONCE(sp->wait_ewma_ns);
+
+	if (!avg)
+		return min_t(u64, 50 * NSEC_PER_USEC, max);
+
+	if (avg > max)
+		return 0;
+
+	return min(avg + avg / 2, max);
+}
+
 /**
  * host1x_syncpt_wait_ts() - wait for a syncpoint to reach a given value
  * @sp: host1x syncpoint
@@ -240,18 +287,23 @@ EXPORT_SYMBOL(host1x_syncpt_incr);
 int host1x_syncpt_wait_ts(struct host1x_syncpt *sp, u32 thresh, long timeout, u32 *value,
 			  ktime_t *ts)
 {
+	struct host1x_syncpt_wait_stats *stats = &sp->host->wait_stats;
 	struct dma_fence *fence;
-	ktime_t spin_timeout, time;
+	ktime_t start, spin_timeout, time;
+	bool first = true;
+	u32 poll_ns;
 	long wait_err;
 
 	if (timeout < 0)
 		timeout = LONG_MAX;
 
 	/*
-	 * Even 1 jiffy is longer than 50us, so assume timeout is over 50us
-	 * always except for polls (timeout=0)
+	 * Even 1 jiffy is longer than the spin limit, so assume timeout is
+	 * always longer than the spin budget except for polls (timeout=0)
 	 */
-	spin_timeout = ktime_add_us(ktime_get(), timeout > 0 ? 50 : 0);
+	start = ktime_get();
+	spin_timeout = ktime_add_ns(start, timeout > 0 ? host1x_syncpt_spin_budget(sp) : 0);
+	poll_ns = READ_ONCE(stats->poll_ns);
 	for (;;) {
 		host1x_hw_syncpt_load(sp->host, sp);
 		time = ktime_get();
@@ -259,16 +311,36 @@ int host1x_syncpt_wait_ts(struct host1x_syncpt *sp, u32 thresh, long timeout, u3
 			*value = host1x_syncpt_load(sp);
 		if (ts)
 			*ts = time;
-		if (host1x_syncpt_is_expired(sp, thresh))
+		if (host1x_syncpt_is_expired(sp, thresh)) {
+			/*
+			 * A threshold that had already passed says nothing
+			 * about the completion latency, keep it out of the
+			 * average.
+			 */
+			if (timeout > 0 && !first) {
+				s64 spun = ktime_to_ns(ktime_sub(time, start));
+
+				atomic64_inc(&stats->spin_hits);
+				atomic64_add(spun, &stats->spin_ns);
+				host1x_syncpt_wait_done(sp, spun);
+			}
 			return 0;
+		}
 		if (ktime_compare(time, spin_timeout) > 0)
 			break;
-		udelay(5);
+		first = false;
+		if (poll_ns)
+			ndelay(poll_ns);
+		else
+			cpu_relax();
 	}
 
 	if (timeout == 0)
 		return -EAGAIN;
 
+	atomic64_inc(&stats->sleeps);
+	atomic64_add(ktime_to_ns(ktime_sub(time, start)), &stats->spin_ns);
+
 	fence = host1x_fence_create(sp, thresh, false);
 	if (IS_ERR(fence))
 		return PTR_ERR(fence);
@@ -282,6 +354,13 @@ int host1x_syncpt_wait_ts(struct host1x_syncpt *sp, u32 thresh, long timeout, u3
 	if (ts)
 		*ts = fence->timestamp;
 
+	if (wait_err > 0 && !fence->error &&
+	    test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &fence->flags)) {
+		host1x_syncpt_wait_done(sp, ktime_to_ns(ktime_sub(fence->timestamp, start)));
+		host1x_syncpt_wait_hist(stats->wake_hist,
+					ktime_to_ns(ktime_sub(ktime_get(), fence->timestamp)));
+	}
+
 	dma_fence_put(fence);
 
 	/*
@@ -290,12 +369,12 @@ int host1x_syncpt_wait_ts(struct host1x_syncpt *sp, u32 thresh, long timeout, u3
 	 * wait completed with 0 jiffies left.
 	 */
 	host1x_hw_syncpt_load(sp->host, sp);
-	if (wait_err == 0 && !host1x_syncpt_is_expired(sp, thresh))
+	if (wait_err == 0 && !host1x_syncpt_is_expired(sp, thresh)) {
+		atomic64_inc(&stats->timeouts);
 		return -EAGAIN;
-	else if (wait_err < 0)
-		return wait_err;
-	else
-		return 0;
+	}
+
+	return wait_err < 0 ? wait_err : 0;
 }
 EXPORT_SYMBOL(host1x_syncpt_wait_ts);
 
@@ -365,6 +444,9 @@ int host1x_syncpt_init(struct host1x *host)
 			syncpt[j].pool = pool;
 	}
 
+	host->wait_stats.spin_max_us = 200;
+	host->wait_stats.poll_ns = 1000;
+
 	mutex_init(&host->syncpt_mutex);
 	host->syncpt = syncpt;
 	host->bases = bases;
@@ -22,6 +22,26 @@ struct host1x;
 /* Reserved for replacing an expired wait with a NOP */
 #define HOST1X_SYNCPT_RESERVED			0
 
+/* Log2 microsecond buckets, the last one collects everything above */
+#define HOST1X_SYNCPT_WAIT_HIST_BUCKETS		16
+
+struct host1x_syncpt_wait_stats {
+	/* Longest spin before sleeping on a fence */
+	u32 spin_max_us;
+	/* Delay between polls while spinning, 0 polls with cpu_relax() */
+	u32 poll_ns;
+
+	atomic64_t spin_hits;
+	atomic64_t sleeps;
+	atomic64_t timeouts;
+	atomic64_t spin_ns;
+
+	/* Wait start to syncpoint completion */
+	atomic64_t wait_hist[HOST1X_SYNCPT_WAIT_HIST_BUCKETS];
+	/* Completion interrupt to sleeping waiter running again */
+	atomic64_t wake_hist[HOST1X_SYNCPT_WAIT_HIST_BUCKETS];
+};
+
 struct host1x_syncpt_base {
 	unsigned int id;
 	bool requested;
@@ -43,6 +63,9 @@ struct host1x_syncpt {
 	/* interrupt data */
 	struct host1x_fence_list fences;
 
+	/* Moving average of wait completion latency, sizes the spin budget */
+	u32 wait_ewma_ns;
+
 	/*
 	 * If a submission incrementing this syncpoint fails, lock it so that
 	 * further submission cannot be made until application has handled the
@@ -10,8 +10,10 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/host1x-next.h>
+#include <linux/mm.h>
 #include <linux/of.h>
 #include <linux/of_platform.h>
+#include <linux/overflow.h>
 #include <linux/slab.h>
 #include <linux/syscalls.h>
 #include <linux/tegra-pcie-edma.h>
@@ -31,6 +33,12 @@
 MODULE_IMPORT_NS(VFS_internal_I_am_really_a_filesystem_and_am_NOT_a_driver);
 #endif
 
+/*
+ * most eDMA descriptors one submission can take: one slot of the eDMA ring
+ * is always kept free to tell a full ring from an empty one.
+ */
+#define MAX_EDMA_DESC_PER_XFER	(NUM_EDMA_DESC - 1)
+
 /* forward declaration.*/
 struct stream_ext_ctx_t;
 struct stream_ext_obj;
@@ -63,6 +71,12 @@ struct copy_request {
 	/* book-keeping for copy completion.*/
 	struct list_head node;
 
+	/*
+	 * copy-requests submitted along with this one in a batch, chained
+	 * via their node. Signalled and reclaimed from this one's callback.
+	 */
+	struct list_head batch_list;
+
 	/*
 	 * back-reference to stream_ext_context, used in eDMA callback.
 	 * to add this copy_request back in free_list for reuse. Also,
@@ -201,6 +215,19 @@ struct stream_ext_ctx_t {
 	/* Intermediate validated and copied user-args for submit-copy ioctl.*/
 	struct copy_req_params cr_params;
 
+	/*
+	 * Batched submit-copy: copied user-args, copy-requests taken from
+	 * free_list and the chained eDMA descriptors for all of them. eDMA
+	 * copies the descriptors into it's ring at submission, therefore one
+	 * set suffices for all outstanding batches. Worst-case allocation:
+	 * (max_copy_requests) and (max_copy_requests * max_flush_ranges),
+	 * the latter capped to what one eDMA submission can take.
+	 */
+	struct nvscic2c_pcie_submit_copy_args *batch_args;
+	struct copy_request **batch_crs;
+	struct tegra_pcie_edma_desc *batch_desc;
+	u64 batch_max_desc;
+
 	/* Async copy: book-keeping copy-requests: free and in-progress.*/
 	struct list_head free_list;
 	/* guard free_list.*/
@@ -261,6 +288,11 @@ static int
 validate_copy_req_params(struct stream_ext_ctx_t *ctx,
 			 struct copy_req_params *params);
 
+static int
+allocate_copy_batch(struct stream_ext_ctx_t *ctx);
+static void
+free_copy_batch(struct stream_ext_ctx_t *ctx);
+
 static int
 fops_mmap(struct file *filep, struct vm_area_struct *vma)
 {
@@ -599,6 +631,7 @@ ioctl_submit_copy_request(struct stream_ext_ctx_t *ctx,
 
 	cr->peer_cpu = pci_client_get_peer_cpu(ctx->pci_client_h);
 	/* generate eDMA descriptors from flush_ranges.*/
+	cr->num_edma_desc = 0;
 	ret = prepare_edma_desc(ctx->drv_mode, &ctx->cr_params, cr->edma_desc,
 				&cr->num_edma_desc);
 	if (ret) {
@@ -626,6 +659,126 @@ reclaim_cr:
 	return ret;
 }
 
+/* implement NVSCIC2C_PCIE_IOCTL_SUBMIT_COPY_REQUESTS ioctl call. */
+static int
+ioctl_submit_copy_requests(struct stream_ext_ctx_t *ctx,
+			   struct nvscic2c_pcie_submit_copy_batch_args *args)
+{
+	int ret = 0;
+	u64 i = 0, num_cr = 0, num_desc = 0;
+	struct copy_request *cr = NULL;
+	edma_xfer_status_t edma_status = EDMA_XFER_FAIL_INVAL_INPUTS;
+	enum nvscic2c_pcie_link link = NVSCIC2C_PCIE_LINK_DOWN;
+
+	link = pci_client_query_link_status(ctx->pci_client_h);
+	if (link != NVSCIC2C_PCIE_LINK_UP)
+		return -ENOLINK;
+
+	if (WARN_ON(!args->num_copy_requests ||
+		    args->num_copy_requests > ctx->cr_limits.max_copy_requests))
+		return -EINVAL;
+
+	/* copy user-supplied array of submit-copy args.*/
+	if (copy_from_user(ctx->batch_args,
+			   (void __user *)args->copy_requests,
+			   (args->num_copy_requests * sizeof(*ctx->batch_args))))
+		return -EFAULT;
+
+	/* the whole chain must fit in one eDMA submission.*/
+	for (i = 0; i < args->num_copy_requests; i++) {
+		if (ctx->batch_args[i].num_flush_ranges >
+		    ctx->cr_limits.max_flush_ranges)
+			return -EINVAL;
+		num_desc += ctx->batch_args[i].num_flush_ranges;
+	}
+	if (num_desc > ctx->batch_max_desc) {
+		pr_err("(%s): batch of (%llu) flush ranges exceeds (%llu)\n",
+		       ctx->ep_name, num_desc, ctx->batch_max_desc);
+		return -E2BIG;
+	}
+	num_desc = 0;
+
+	/* get all the copy-requests from the free list at once.*/
+	mutex_lock(&ctx->free_lock);
+	for (i = 0; i < args->num_copy_requests; i++) {
+		if (list_empty(&ctx->free_list))
+			break;
+		cr = list_first_entry(&ctx->free_list, struct copy_request,
+				      node);
+		list_del(&cr->node);
+		ctx->batch_crs[i] = cr;
+	}
+	if (i < args->num_copy_requests) {
+		/* not enough outstanding copy-requests available.*/
+		while (i--)
+			list_add(&ctx->batch_crs[i]->node, &ctx->free_list);
+		mutex_unlock(&ctx->free_lock);
+		return -EAGAIN;
+	}
+	mutex_unlock(&ctx->free_lock);
+
+	/*
+	 * parse, validate and cache handles of each copy request as for a
+	 * single submit-copy and append their eDMA descriptors to one chain.
+	 */
+	for (num_cr = 0; num_cr < args->num_copy_requests; num_cr++) {
+		cr = ctx->batch_crs[num_cr];
+
+		ret = copy_args_from_user(ctx, &ctx->batch_args[num_cr],
+					  &ctx->cr_params);
+		if (ret)
+			goto reclaim_cr;
+
+		ret = validate_copy_req_params(ctx, &ctx->cr_params);
+		if (ret)
+			goto reclaim_cr;
+
+		ret = cache_copy_request_handles(&ctx->cr_params, cr);
+		if (ret)
+			goto reclaim_cr;
+
+		cr->peer_cpu = pci_client_get_peer_cpu(ctx->pci_client_h);
+		ret = prepare_edma_desc(ctx->drv_mode, &ctx->cr_params,
+					ctx->batch_desc, &num_desc);
+		if (ret) {
+			release_copy_request_handles(cr);
+			goto reclaim_cr;
+		}
+	}
+
+	/* completion of the chain is notified for the first copy-request.*/
+	cr = ctx->batch_crs[0];
+	for (i = 1; i < args->num_copy_requests; i++)
+		list_add_tail(&ctx->batch_crs[i]->node, &cr->batch_list);
+
+	/* schedule asynchronous eDMA.*/
+	atomic_inc(&ctx->transfer_count);
+	edma_status = schedule_edma_xfer(ctx->edma_h, (void *)cr, num_desc,
+					 ctx->batch_desc);
+	if (edma_status != EDMA_XFER_SUCCESS) {
+		/* eDMA ring held by in-flight transfers, user may retry.*/
+		if (edma_status == EDMA_XFER_FAIL_NOMEM)
+			ret = -EAGAIN;
+		else
+			ret = -EIO;
+		atomic_dec(&ctx->transfer_count);
+		INIT_LIST_HEAD(&cr->batch_list);
+		goto reclaim_cr;
+	}
+
+	return ret;
+
+reclaim_cr:
+	for (i = 0; i < num_cr; i++)
+		release_copy_request_handles(ctx->batch_crs[i]);
+
+	mutex_lock(&ctx->free_lock);
+	for (i = 0; i < args->num_copy_requests; i++)
+		list_add_tail(&ctx->batch_crs[i]->node, &ctx->free_list);
+	mutex_unlock(&ctx->free_lock);
+	return ret;
+}
+
 /* implement NVSCIC2C_PCIE_IOCTL_MAX_COPY_REQUESTS ioctl call. */
 static int
 ioctl_set_max_copy_requests(struct stream_ext_ctx_t *ctx,
@@ -658,6 +811,13 @@ ioctl_set_max_copy_requests(struct stream_ext_ctx_t *ctx,
 		goto clean_up;
 	}
 
+	/* allocate the book-keeping for batched submit-copy.*/
+	ret = allocate_copy_batch(ctx);
+	if (ret) {
+		pr_err("Failed to allocate submit-copy batch\n");
+		goto clean_up;
+	}
+
 	/* allocate the maximum outstanding copy requests we can have.*/
 	for (i = 0; i < ctx->cr_limits.max_copy_requests; i++) {
 		cr = NULL;
@@ -683,6 +843,7 @@ clean_up:
 	}
 	mutex_unlock(&ctx->free_lock);
 
+	free_copy_batch(ctx);
 	free_copy_req_params(&ctx->cr_params);
 
 	return ret;
@@ -724,6 +885,11 @@ stream_extension_ioctl(void *stream_ext_h, unsigned int cmd, void *args)
 			((struct stream_ext_ctx_t *)ctx,
 			 (struct nvscic2c_pcie_submit_copy_args *)args);
 		break;
+	case NVSCIC2C_PCIE_IOCTL_SUBMIT_COPY_REQUESTS:
+		ret = ioctl_submit_copy_requests
+			((struct stream_ext_ctx_t *)ctx,
+			 (struct nvscic2c_pcie_submit_copy_batch_args *)args);
+		break;
 	case NVSCIC2C_PCIE_IOCTL_MAX_COPY_REQUESTS:
 		ret = ioctl_set_max_copy_requests
 			((struct stream_ext_ctx_t *)ctx,
@@ -816,6 +982,7 @@ stream_extension_deinit(void **stream_ext_h)
 		free_copy_request(&cr);
 	}
 	mutex_unlock(&ctx->free_lock);
+	free_copy_batch(ctx);
 	free_copy_req_params(&ctx->cr_params);
 	mutex_destroy(&ctx->free_lock);
 
@@ -958,12 +1125,17 @@ callback_edma_xfer(void *priv, edma_xfer_status_t status,
 		   struct tegra_pcie_edma_desc *desc)
 {
 	struct copy_request *cr = (struct copy_request *)priv;
+	struct copy_request *bcr = NULL;
 
 	mutex_lock(&cr->ctx->free_lock);
-	/* increment post fences: local and remote.*/
+	/* increment post fences: local and remote, in submission order.*/
 	if (status == EDMA_XFER_SUCCESS) {
 		signal_remote_post_fences(cr);
 		signal_local_post_fences(cr);
+		list_for_each_entry(bcr, &cr->batch_list, node) {
+			signal_remote_post_fences(bcr);
+			signal_local_post_fences(bcr);
+		}
 	} else {
 		/* eDMA xfer failed, Update eDMA error and notify user. */
 		(void)pci_client_set_edma_error(cr->ctx->pci_client_h,
@@ -973,9 +1145,12 @@ callback_edma_xfer(void *priv, edma_xfer_status_t status,
 
 	/* releases the references of the cubmit-copy handles.*/
 	release_copy_request_handles(cr);
+	list_for_each_entry(bcr, &cr->batch_list, node)
+		release_copy_request_handles(bcr);
 
-	/* reclaim the copy_request for reuse.*/
+	/* reclaim the copy_request(s) for reuse.*/
 	list_add_tail(&cr->node, &cr->ctx->free_list);
+	list_splice_tail_init(&cr->batch_list, &cr->ctx->free_list);
 	mutex_unlock(&cr->ctx->free_lock);
 
 	if (atomic_dec_and_test(&cr->ctx->transfer_count))
@@ -988,33 +1163,49 @@ prepare_edma_desc(enum drv_mode_t drv_mode, struct copy_req_params *params,
 {
 	u32 i = 0;
 	int ret = 0;
-	u32 iter = 0;
+	u64 iter = *num_desc;
+	dma_addr_t src = 0, dst = 0;
 	struct file *filep = NULL;
 	struct stream_ext_obj *stream_obj = NULL;
 	struct nvscic2c_pcie_flush_range *flush_range = NULL;
+	struct tegra_pcie_edma_desc *prev = NULL;
 
-	*num_desc = 0;
+	/*
+	 * descriptors are appended from (*num_desc) onwards. A flush_range
+	 * contiguous with the previous descriptor at both source and
+	 * destination extends it instead of taking one more descriptor.
+	 */
 	for (i = 0; i < params->num_flush_ranges; i++) {
 		flush_range = &params->flush_ranges[i];
 
 		filep = fget(flush_range->src_handle);
 		stream_obj = filep->private_data;
-		desc[iter].src = (stream_obj->vmap.iova + flush_range->offset);
+		src = (stream_obj->vmap.iova + flush_range->offset);
 		fput(filep);
 
 		filep = fget(flush_range->dst_handle);
 		stream_obj = filep->private_data;
 		if (drv_mode == DRV_MODE_EPC)
-			desc[iter].dst = stream_obj->aper;
+			dst = stream_obj->aper;
 		else
-			desc[iter].dst = stream_obj->vmap.iova;
-		desc[iter].dst += flush_range->offset;
+			dst = stream_obj->vmap.iova;
+		dst += flush_range->offset;
 		fput(filep);
 
+		prev = iter ? &desc[iter - 1] : NULL;
+		if (prev && (prev->src + prev->sz) == src &&
+		    (prev->dst + prev->sz) == dst &&
+		    ((u64)prev->sz + flush_range->size) <= U32_MAX) {
+			prev->sz += flush_range->size;
+			continue;
+		}
+
+		desc[iter].src = src;
+		desc[iter].dst = dst;
 		desc[iter].sz = flush_range->size;
 		iter++;
 	}
-	*num_desc += iter;
+	*num_desc = iter;
 	return ret;
 }
 
@@ -1385,6 +1576,7 @@ allocate_copy_request(struct stream_ext_ctx_t *ctx,
 		goto err;
 	}
 	cr->ctx = ctx;
+	INIT_LIST_HEAD(&cr->batch_list);
 
 	/* flush range has two handles: src, dst + all possible post_fences.*/
 	cr->handles = kzalloc((sizeof(*cr->handles) *
@@ -1506,3 +1698,52 @@ err:
 	free_copy_req_params(params);
 	return ret;
 }
+
+static void
+free_copy_batch(struct stream_ext_ctx_t *ctx)
+{
+	kvfree(ctx->batch_desc);
+	ctx->batch_desc = NULL;
+	kvfree(ctx->batch_crs);
+	ctx->batch_crs = NULL;
+	kvfree(ctx->batch_args);
+	ctx->batch_args = NULL;
+}
+
+static int
+allocate_copy_batch(struct stream_ext_ctx_t *ctx)
+{
+	int ret = 0;
+
+	/*
+	 * worst-case allocation: all outstanding copy requests in one batch,
+	 * but no more descriptors than one eDMA submission can take.
+	 */
+	ctx->batch_max_desc = min_t(u64, MAX_EDMA_DESC_PER_XFER,
+				    array_size(ctx->cr_limits.max_copy_requests,
+					       ctx->cr_limits.max_flush_ranges));
+
+	ctx->batch_args = kvcalloc(ctx->cr_limits.max_copy_requests,
+				   sizeof(*ctx->batch_args), GFP_KERNEL);
+	if (WARN_ON(!ctx->batch_args)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ctx->batch_crs = kvcalloc(ctx->cr_limits.max_copy_requests,
+				  sizeof(*ctx->batch_crs), GFP_KERNEL);
+	if (WARN_ON(!ctx->batch_crs)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ctx->batch_desc = kvcalloc(ctx->batch_max_desc,
+				   sizeof(*ctx->batch_desc), GFP_KERNEL);
+	if (WARN_ON(!ctx->batch_desc)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	return ret;
+err:
+	free_copy_batch(ctx);
+	return ret;
+}
@@ -12,6 +12,9 @@
 #include <linux/of.h>
 #include <soc/tegra/fuse.h>
 #include <soc/tegra/virt/hv-ivc.h>
+#ifdef ETHER_XDP
+#include <net/xdp_sock_drv.h>
+#endif
 
 /**
  * @brief ether_get_free_timestamp_node - get free node for timestmap info for SKB
@@ -1765,11 +1768,13 @@ static void ether_napi_enable(struct ether_priv_data *pdata)
  * @param[in] pdata: Ethernet private data
  * @param[in] rx_buf_len: Receive buffer length
  * @param[in] resv_buf_virt_addr: Reservered virtual buffer
+ * @param[in] chan: DMA Rx channel number
  */
 static void ether_free_rx_skbs(struct osi_rx_swcx *rx_swcx,
 			       struct ether_priv_data *pdata,
 			       unsigned int rx_buf_len,
-			       void *resv_buf_virt_addr)
+			       void *resv_buf_virt_addr,
+			       unsigned int chan)
 {
 	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
 	struct osi_rx_swcx *prx_swcx = NULL;
@@ -1781,6 +1786,11 @@ static void ether_free_rx_skbs(struct osi_rx_swcx *rx_swcx,
 		if (prx_swcx->buf_virt_addr != NULL) {
 			if (resv_buf_virt_addr != prx_swcx->buf_virt_addr) {
 #ifdef ETHER_PAGE_POOL
+#ifdef ETHER_XDP
+				if (pdata->xsk_pool[chan])
+					xsk_buff_free(prx_swcx->buf_virt_addr);
+				else
+#endif
 				page_pool_put_full_page(pdata->page_pool,
 							prx_swcx->buf_virt_addr,
 							false);
@@ -1816,10 +1826,13 @@ static void free_rx_dma_resources(struct osi_dma_priv_data *osi_dma,
 		rx_ring = osi_dma->rx_ring[i];
 
 		if (rx_ring != NULL) {
+#ifdef ETHER_XDP
+			ether_xdp_rxq_deinit(pdata, i);
+#endif
 			if (rx_ring->rx_swcx != NULL) {
 				ether_free_rx_skbs(rx_ring->rx_swcx, pdata,
 						   osi_dma->rx_buf_len,
-						   pdata->resv_buf_virt_addr);
+						   pdata->resv_buf_virt_addr, i);
 				kfree(rx_ring->rx_swcx);
 			}
 
@@ -1909,12 +1922,14 @@ err_rx_desc:
  *
  * @param[in] pdata: OSD private data.
  * @param[in] rx_ring: rxring data structure.
+ * @param[in] chan: DMA Rx channel number.
  *
  * @retval 0 on success
  * @retval "negative value" on failure.
  */
 static int ether_allocate_rx_buffers(struct ether_priv_data *pdata,
-				     struct osi_rx_ring *rx_ring)
+				     struct osi_rx_ring *rx_ring,
+				     unsigned int chan)
 {
 #ifndef ETHER_PAGE_POOL
 	unsigned int rx_buf_len = pdata->osi_dma->rx_buf_len;
@@ -1932,6 +1947,24 @@ static int ether_allocate_rx_buffers(struct ether_priv_data *pdata,
 
 		rx_swcx = rx_ring->rx_swcx + i;
 
+#ifdef ETHER_XDP
+		if (pdata->xsk_pool[chan]) {
+			struct xdp_buff *xdp;
+
+			xdp = xsk_buff_alloc(pdata->xsk_pool[chan]);
+			if (!xdp) {
+				/* Rest of the ring is filled on the Rx path */
+				rx_swcx->buf_virt_addr = pdata->resv_buf_virt_addr;
+				rx_swcx->buf_phy_addr = pdata->resv_buf_phy_addr;
+				continue;
+			}
+
+			rx_swcx->buf_virt_addr = xdp;
+			rx_swcx->buf_phy_addr = xsk_buff_xdp_get_dma(xdp);
+			continue;
+		}
+
+#endif
 #ifdef ETHER_PAGE_POOL
 		page = page_pool_dev_alloc_pages(pdata->page_pool);
 		if (!page) {
@@ -1940,7 +1973,7 @@ static int ether_allocate_rx_buffers(struct ether_priv_data *pdata,
 			return -ENOMEM;
 		}
 
-		dma_addr = page_pool_get_dma_addr(page);
+		dma_addr = ether_rx_page_dma_addr(page);
 		rx_swcx->buf_virt_addr = page;
 #else
 		skb = __netdev_alloc_skb_ip_align(pdata->ndev, rx_buf_len,
@@ -1984,13 +2017,23 @@ static int ether_page_pool_create(struct ether_priv_data *pdata)
 	unsigned int num_pages;
 	int ret = 0;
 
-	pp_params.flags = PP_FLAG_DMA_MAP;
+	/* Leave room for headroom and skb_shared_info around the buffer */
+	pp_params.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
 	pp_params.pool_size = osi_dma->rx_buf_len;
-	num_pages = DIV_ROUND_UP(osi_dma->rx_buf_len, PAGE_SIZE);
+	num_pages = DIV_ROUND_UP(ETHER_RX_HEADROOM + osi_dma->rx_buf_len +
+				 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)),
+				 PAGE_SIZE);
 	pp_params.order = ilog2(roundup_pow_of_two(num_pages));
 	pp_params.nid = dev_to_node(pdata->dev);
 	pp_params.dev = pdata->dev;
 	pp_params.dma_dir = DMA_FROM_DEVICE;
+#ifdef ETHER_XDP
+	/* XDP_TX sends pages back out without remapping them */
+	if (pdata->xdp_prog)
+		pp_params.dma_dir = DMA_BIDIRECTIONAL;
+#endif
+	pp_params.offset = ETHER_RX_HEADROOM;
+	pp_params.max_len = osi_dma->rx_buf_len;
 
 	pdata->page_pool = page_pool_create(&pp_params);
 	if (IS_ERR(pdata->page_pool)) {
@@ -2043,10 +2086,17 @@ static int ether_allocate_rx_dma_resources(struct osi_dma_priv_data *osi_dma,
 			}
 
 			ret = ether_allocate_rx_buffers(pdata,
-							osi_dma->rx_ring[chan]);
+							osi_dma->rx_ring[chan],
+							chan);
+			if (ret < 0) {
+				goto exit;
+			}
+#ifdef ETHER_XDP
+			ret = ether_xdp_rxq_init(pdata, chan);
 			if (ret < 0) {
 				goto exit;
 			}
+#endif
 		}
 	}
 
@@ -2294,6 +2344,9 @@ static int ether_allocate_dma_resources(struct ether_priv_data *pdata)
 		goto error_alloc;
 	}
 
+	/* Rx rings of AF_XDP channels point at it until user space fills them */
+	pdata->resv_buf_virt_addr = (void *)skb;
+
 	ret = ether_allocate_tx_dma_resources(osi_dma, pdata->dev);
 	if (ret != 0) {
 		goto error_alloc;
@@ -2305,8 +2358,6 @@ static int ether_allocate_dma_resources(struct ether_priv_data *pdata)
 		goto error_alloc;
 	}
 
-	pdata->resv_buf_virt_addr = (void *)skb;
-
 	return ret;
 
 error_alloc:
@@ -2711,6 +2762,9 @@ static int ether_open(struct net_device *dev)
 		goto err_hw_init;
 	}
 
+#ifdef ETHER_DIM
+	ether_dim_init(pdata);
+#endif
 	/* Enable napi before requesting irq to be ready to handle it */
 	ether_napi_enable(pdata);
 
@@ -2993,6 +3047,17 @@ static int ether_close(struct net_device *ndev)
 	osi_hw_dma_deinit(pdata->osi_dma);
 
 	ether_napi_disable(pdata);
+#ifdef ETHER_DIM
+	ether_dim_deinit(pdata);
+#endif
+
+	/* Packets left on the rings are never completed, reset BQL state */
+	for (i = 0; i < pdata->osi_dma->num_dma_chans; i++) {
+		chan = pdata->osi_dma->dma_chans[i];
+		pdata->tx_napi[chan]->bql_pkts = 0U;
+		pdata->tx_napi[chan]->bql_bytes = 0U;
+		netdev_tx_reset_queue(netdev_get_tx_queue(ndev, i));
+	}
 
 	/* free DMA resources after DMA stop */
 	free_dma_resources(pdata);
@@ -3369,6 +3434,167 @@ static unsigned short ether_select_queue(struct net_device *dev,
 	return txqueue_select;
 }
 
+#ifdef ETHER_DIM
+/**
+ * @brief Apply the Rx moderation profile picked by DIM
+ *
+ * Algorithm: Store the profile period as the delay before the channel is
+ * polled again with its Rx interrupt left masked.
+ *
+ * @param[in] work: DIM work of the Rx channel.
+ */
+static void ether_rx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct ether_rx_napi *rx_napi = container_of(dim, struct ether_rx_napi,
+						     dim);
+	struct dim_cq_moder moder;
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	WRITE_ONCE(rx_napi->dim_usecs, moder.usec);
+	dim->state = DIM_START_MEASURE;
+}
+
+/**
+ * @brief Apply the Tx moderation profile picked by DIM
+ *
+ * Algorithm: Use the profile period, within the supported tx-usecs range,
+ * as the Tx coalescing timer of the channel.
+ *
+ * @param[in] work: DIM work of the Tx channel.
+ */
+static void ether_tx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct ether_tx_napi *tx_napi = container_of(dim, struct ether_tx_napi,
+						     dim);
+	struct dim_cq_moder moder;
+
+	moder = net_dim_get_tx_moderation(dim->mode, dim->profile_ix);
+	WRITE_ONCE(tx_napi->dim_usecs,
+		   clamp_t(unsigned int, moder.usec,
+			   ETHER_MIN_TX_COALESCE_USEC,
+			   ETHER_MAX_TX_COALESCE_USEC));
+	dim->state = DIM_START_MEASURE;
+}
+
+/**
+ * @brief Feed one NAPI poll worth of traffic to DIM
+ *
+ * @param[in] dim: DIM state of the channel.
+ * @param[in] events: Poll counter of the channel.
+ * @param[in] pkts: Packet counter of the channel.
+ * @param[in] bytes: Byte counter of the channel.
+ */
+static void ether_dim_sample(struct dim *dim, u16 events, u64 pkts, u64 bytes)
+{
+	struct dim_sample sample = {};
+
+	dim_update_sample(events, pkts, bytes, &sample);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	net_dim(dim, &sample);
+#else
+	net_dim(dim, sample);
+#endif
+}
+
+/**
+ * @brief Poll an Rx channel whose interrupt is held off by DIM
+ *
+ * @param[in] data: Rx DIM timer of the channel.
+ *
+ * @retval HRTIMER_NORESTART always
+ */
+static enum hrtimer_restart ether_rx_dim_hrtimer(struct hrtimer *data)
+{
+	struct ether_rx_napi *rx_napi = container_of(data, struct ether_rx_napi,
+						     dim_timer);
+
+	if (likely(napi_schedule_prep(&rx_napi->napi)))
+		__napi_schedule_irqoff(&rx_napi->napi);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Reset DIM state of all channels
+ *
+ * Algorithm: Start every channel in interrupt mode for Rx and with the
+ * configured tx-usecs for Tx, DIM adjusts both once traffic flows.
+ *
+ * @param[in] pdata: OSD private data.
+ */
+static void ether_dim_init(struct ether_priv_data *pdata)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct ether_tx_napi *tx_napi;
+	struct ether_rx_napi *rx_napi;
+	unsigned int chan;
+	unsigned int i;
+
+	for (i = 0; i < osi_dma->num_dma_chans; i++) {
+		chan = osi_dma->dma_chans[i];
+		rx_napi = pdata->rx_napi[chan];
+		tx_napi = pdata->tx_napi[chan];
+
+		memset(&rx_napi->dim, 0, sizeof(rx_napi->dim));
+		INIT_WORK(&rx_napi->dim.work, ether_rx_dim_work);
+		rx_napi->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_CQE;
+		rx_napi->dim_usecs = 0U;
+		rx_napi->dim_pkts = 0U;
+		rx_napi->dim_bytes = 0U;
+		rx_napi->dim_events = 0U;
+
+		memset(&tx_napi->dim, 0, sizeof(tx_napi->dim));
+		INIT_WORK(&tx_napi->dim.work, ether_tx_dim_work);
+		tx_napi->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_CQE;
+		tx_napi->dim_usecs = osi_dma->tx_usecs;
+		tx_napi->dim_pkts = 0U;
+		tx_napi->dim_bytes = 0U;
+		tx_napi->dim_events = 0U;
+	}
+}
+
+/**
+ * @brief Stop DIM activity of all channels
+ *
+ * @param[in] pdata: OSD private data.
+ *
+ * @note NAPI must be disabled.
+ */
+static void ether_dim_deinit(struct ether_priv_data *pdata)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	unsigned int chan;
+	unsigned int i;
+
+	for (i = 0; i < osi_dma->num_dma_chans; i++) {
+		chan = osi_dma->dma_chans[i];
+		hrtimer_cancel(&pdata->rx_napi[chan]->dim_timer);
+		cancel_work_sync(&pdata->rx_napi[chan]->dim.work);
+		cancel_work_sync(&pdata->tx_napi[chan]->dim.work);
+	}
+}
+#endif /* ETHER_DIM */
+
+/**
+ * @brief Returns the Tx coalescing timer period of a channel
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] tx_napi: Tx NAPI instance of the channel.
+ *
+ * @returns Timer period in nanoseconds.
+ */
+static inline u64 ether_tx_usecs_ns(struct ether_priv_data *pdata,
+				    struct ether_tx_napi *tx_napi)
+{
+#ifdef ETHER_DIM
+	if (pdata->use_adaptive_tx == OSI_ENABLE)
+		return (u64)READ_ONCE(tx_napi->dim_usecs) * NSEC_PER_USEC;
+#endif
+	return (u64)pdata->osi_dma->tx_usecs * NSEC_PER_USEC;
+}
+
 /**
  * @brief Network layer hook for data transmission.
  *
@@ -3391,6 +3617,9 @@ static int ether_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	unsigned int qinx = skb_get_queue_mapping(skb);
 	unsigned int chan = osi_dma->dma_chans[qinx];
 	struct osi_tx_ring *tx_ring = osi_dma->tx_ring[chan];
+	struct netdev_queue *txq = netdev_get_tx_queue(ndev, qinx);
+	struct ether_xtra_stat_counters *xstats = &pdata->xstats;
+	unsigned int len = skb->len;
 #ifdef OSI_ERR_DEBUG
 	unsigned int cur_tx_idx = tx_ring->cur_tx_idx;
 #endif
@@ -3408,9 +3637,17 @@ static int ether_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 		return NETDEV_TX_OK;
 	}
 
+	/* Account before the doorbell, Tx completion may run right after it */
+	netdev_tx_sent_queue(txq, len);
+
 	ret = osi_hw_transmit(osi_dma, chan);
 #ifdef OSI_ERR_DEBUG
 	if (ret < 0) {
+		/*
+		 * BQL completion belongs to the Tx NAPI completer only, the
+		 * bytes of a corrupted skb stay queued until ether_close()
+		 * resets the queue.
+		 */
 		INCR_TX_DESC_INDEX(cur_tx_idx, count);
 		ether_tx_swcx_rollback(pdata, tx_ring, cur_tx_idx, count);
 		netdev_err(ndev, "%s() dropping corrupted skb\n", __func__);
@@ -3419,18 +3656,36 @@ static int ether_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	}
 #endif
 
+	xstats->tx_pkt_n[chan] =
+		osi_update_stats_counter(xstats->tx_pkt_n[chan], 1UL);
+
 	if (ether_avail_txdesc_cnt(osi_dma, tx_ring) <= ETHER_TX_DESC_THRESHOLD) {
 		netif_stop_subqueue(ndev, qinx);
 		netdev_dbg(ndev, "Tx ring[%d] insufficient desc.\n", chan);
 	}
 
+	/* The last packet of a batch arms the Tx coalescing timer */
+	if (netdev_xmit_more() && !netif_xmit_stopped(txq)) {
+		xstats->tx_xmit_more_n[chan] =
+			osi_update_stats_counter(xstats->tx_xmit_more_n[chan],
+						 1UL);
+		return NETDEV_TX_OK;
+	}
+
+	/*
+	 * osi_hw_transmit() still writes the tail pointer for every packet,
+	 * this only measures how well the stack batches.
+	 */
+	xstats->tx_batch_end_n[chan] =
+		osi_update_stats_counter(xstats->tx_batch_end_n[chan], 1UL);
+
 	if (osi_dma->use_tx_usecs == OSI_ENABLE &&
 	    atomic_read(&pdata->tx_napi[chan]->tx_usecs_timer_armed) ==
 			OSI_DISABLE) {
 		atomic_set(&pdata->tx_napi[chan]->tx_usecs_timer_armed,
 			   OSI_ENABLE);
 		hrtimer_start(&pdata->tx_napi[chan]->tx_usecs_timer,
-			      osi_dma->tx_usecs * NSEC_PER_USEC,
+			      ether_tx_usecs_ns(pdata, pdata->tx_napi[chan]),
 			      HRTIMER_MODE_REL);
 	}
 	return NETDEV_TX_OK;
@@ -4034,6 +4289,14 @@ static int ether_change_mtu(struct net_device *ndev, int new_mtu)
 		return -EBUSY;
 	}
 
+#ifdef ETHER_XDP
+	if (pdata->xdp_prog && new_mtu > ETHER_XDP_MAX_MTU) {
+		netdev_err(pdata->ndev, "MTU greater than %lu is not supported with XDP\n",
+			   ETHER_XDP_MAX_MTU);
+		return -EINVAL;
+	}
+#endif
+
 	if ((new_mtu > OSI_MTU_SIZE_9000) &&
 	    (osi_dma->num_dma_chans != 1U)) {
 		netdev_err(pdata->ndev,
@@ -4273,6 +4536,11 @@ static const struct net_device_ops ether_netdev_ops = {
 	.ndo_vlan_rx_kill_vid = ether_vlan_rx_kill_vid,
 #endif /* ETHER_VLAN_VID_SUPPORT */
 	.ndo_setup_tc = ether_setup_tc,
+#ifdef ETHER_XDP
+	.ndo_bpf = ether_xdp_bpf,
+	.ndo_xdp_xmit = ether_xdp_xmit,
+	.ndo_xsk_wakeup = ether_xsk_wakeup,
+#endif
 };
 
 /**
@@ -4301,8 +4569,29 @@ static int ether_napi_poll_rx(struct napi_struct *napi, int budget)
 
 	received = osi_process_rx_completions(osi_dma, chan, budget,
 					      &more_data_avail);
+#ifdef ETHER_XDP
+	ether_xdp_finalize(rx_napi);
+#endif
 	if (received < budget) {
 		napi_complete(napi);
+#ifdef ETHER_DIM
+		if (pdata->use_adaptive_rx == OSI_ENABLE) {
+			rx_napi->dim_events++;
+			ether_dim_sample(&rx_napi->dim, rx_napi->dim_events,
+					 rx_napi->dim_pkts, rx_napi->dim_bytes);
+			/* Under load, poll again later instead of re-enabling
+			 * the interrupt for every burst. An empty poll falls
+			 * back to interrupt mode so idle channels stay quiet.
+			 */
+			if (received > 0 && READ_ONCE(rx_napi->dim_usecs) > 1U) {
+				hrtimer_start(&rx_napi->dim_timer,
+					      (u64)rx_napi->dim_usecs *
+					      NSEC_PER_USEC,
+					      HRTIMER_MODE_REL);
+				return received;
+			}
+		}
+#endif
 		raw_spin_lock_irqsave(&pdata->rlock, flags);
 		osi_handle_dma_intr(osi_dma, chan,
 				    OSI_DMA_CH_RX_INTR,
@@ -4337,6 +4626,23 @@ static int ether_napi_poll_tx(struct napi_struct *napi, int budget)
 	int processed;
 
 	processed = osi_process_tx_completions(osi_dma, chan, budget);
+	if (tx_napi->bql_pkts != 0U) {
+		netdev_tx_completed_queue(netdev_get_tx_queue(pdata->ndev,
+							      tx_napi->qinx),
+					  tx_napi->bql_pkts,
+					  tx_napi->bql_bytes);
+#ifdef ETHER_DIM
+		tx_napi->dim_pkts += tx_napi->bql_pkts;
+		tx_napi->dim_bytes += tx_napi->bql_bytes;
+#endif
+		tx_napi->bql_pkts = 0U;
+		tx_napi->bql_bytes = 0U;
+	}
+#ifdef ETHER_XDP
+	/* Keep polling while AF_XDP descriptors are left to send */
+	if (!ether_xsk_xmit(pdata, chan, budget))
+		processed = budget;
+#endif
 
 	/* re-arm the timer if tx ring is not empty */
 	if (!osi_txring_empty(osi_dma, chan) &&
@@ -4344,12 +4650,19 @@ static int ether_napi_poll_tx(struct napi_struct *napi, int budget)
 	    atomic_read(&tx_napi->tx_usecs_timer_armed) == OSI_DISABLE) {
 		atomic_set(&tx_napi->tx_usecs_timer_armed, OSI_ENABLE);
 		hrtimer_start(&tx_napi->tx_usecs_timer,
-			      osi_dma->tx_usecs * NSEC_PER_USEC,
+			      ether_tx_usecs_ns(pdata, tx_napi),
 			      HRTIMER_MODE_REL);
 	}
 
 	if (processed < budget) {
 		napi_complete(napi);
+#ifdef ETHER_DIM
+		if (pdata->use_adaptive_tx == OSI_ENABLE) {
+			tx_napi->dim_events++;
+			ether_dim_sample(&tx_napi->dim, tx_napi->dim_events,
+					 tx_napi->dim_pkts, tx_napi->dim_bytes);
+		}
+#endif
 		raw_spin_lock_irqsave(&pdata->rlock, flags);
 		osi_handle_dma_intr(osi_dma, chan,
 				    OSI_DMA_CH_TX_INTR,
@@ -4413,6 +4726,7 @@ static int ether_alloc_napi(struct ether_priv_data *pdata)
 
 		pdata->tx_napi[chan]->pdata = pdata;
 		pdata->tx_napi[chan]->chan = chan;
+		pdata->tx_napi[chan]->qinx = i;
 #if defined(NV_NETIF_NAPI_ADD_WEIGHT_PRESENT) /* Linux v6.1 */
 		netif_napi_add_weight(ndev, &pdata->tx_napi[chan]->napi,
 			       ether_napi_poll_tx, 64);
@@ -6517,6 +6831,7 @@ static int ether_probe(struct platform_device *pdev)
 	pdata = netdev_priv(ndev);
 	pdata->dev = &pdev->dev;
 	pdata->ndev = ndev;
+	pdata->rx_copybreak = ETHER_RX_COPYBREAK_DEFAULT;
 	platform_set_drvdata(pdev, ndev);
 
 	pdata->osi_core = osi_core;
@@ -6619,6 +6934,12 @@ static int ether_probe(struct platform_device *pdev)
 
 	ndev->netdev_ops = &ether_netdev_ops;
 	ether_set_ethtool_ops(ndev);
+#if defined(ETHER_XDP) && (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0))
+	xdp_set_features_flag(ndev, NETDEV_XDP_ACT_BASIC |
+			      NETDEV_XDP_ACT_REDIRECT |
+			      NETDEV_XDP_ACT_NDO_XMIT |
+			      NETDEV_XDP_ACT_XSK_ZEROCOPY);
+#endif
 
 	ret = ether_alloc_napi(pdata);
 	if (ret < 0) {
@@ -6635,6 +6956,12 @@ static int ether_probe(struct platform_device *pdev)
 			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 		pdata->tx_napi[chan]->tx_usecs_timer.function =
 			ether_tx_usecs_hrtimer;
+#ifdef ETHER_DIM
+		hrtimer_init(&pdata->rx_napi[chan]->dim_timer,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		pdata->rx_napi[chan]->dim_timer.function =
+			ether_rx_dim_hrtimer;
+#endif
 	}
 
 	ret = register_netdev(ndev);
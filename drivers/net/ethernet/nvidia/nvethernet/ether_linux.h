@@ -45,6 +45,15 @@
 #endif
 #define ETHER_PAGE_POOL
 #endif
+#if defined(ETHER_PAGE_POOL) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0))
+#include <net/xdp.h>
+#define ETHER_XDP
+#endif
+#if IS_ENABLED(CONFIG_DIMLIB)
+#include <linux/dim.h>
+#define ETHER_DIM
+#endif
 #include <osi_core.h>
 #include <osi_dma.h>
 #include <mmc.h>
@@ -275,6 +284,23 @@ static inline bool valid_tx_len(unsigned int length)
 #define ETHER_TX_DESC_THRESHOLD	(MAX_SKB_FRAGS + ETHER_TX_MAX_SPLIT + 2)
 
 #define ETHER_TX_MAX_FRAME(x)	((x) / ETHER_TX_DESC_THRESHOLD)
+
+/**
+ * @brief Headroom left in front of the DMA buffer of Rx page pool pages, so
+ * that an skb can be built around the received data without copying it.
+ * With XDP the headroom also has to fit what BPF programs may push.
+ */
+#ifdef ETHER_XDP
+#define ETHER_RX_HEADROOM	XDP_PACKET_HEADROOM
+#else
+#define ETHER_RX_HEADROOM	NET_SKB_PAD
+#endif
+
+/**
+ * @brief Default length up to which received packets are copied into a
+ * freshly allocated skb instead of taking over the page pool page.
+ */
+#define ETHER_RX_COPYBREAK_DEFAULT	256U
 /**
  *@brief Returns count of available transmit descriptors
  *
@@ -294,6 +320,54 @@ static inline int ether_avail_txdesc_cnt(struct osi_dma_priv_data *osi_dma,
 		(osi_dma->tx_ring_sz - 1));
 }
 
+#ifdef ETHER_PAGE_POOL
+/**
+ * @brief Returns the DMA address handed to the MAC for an Rx page
+ *
+ * Algorithm: Skip ETHER_RX_HEADROOM bytes from the start of the page pool
+ * page so the packet can later be wrapped by an skb in place.
+ *
+ * @param[in] page: Page pool page.
+ *
+ * @returns DMA address of the Rx buffer within the page.
+ */
+static inline dma_addr_t ether_rx_page_dma_addr(struct page *page)
+{
+	return page_pool_get_dma_addr(page) + ETHER_RX_HEADROOM;
+}
+#endif
+
+#ifdef ETHER_XDP
+/**
+ * @addtogroup XDP helper macros
+ *
+ * @brief Tx buffer tags and XDP verdicts used by the driver.
+ *
+ * Tx software contexts normally carry the skb of the packet. Buffers queued
+ * from XDP are tagged in the low bits of buf_virt_addr so that Tx completion
+ * knows how to release them. AF_XDP descriptors have no kernel buffer, the
+ * DMA channel is stored in place of the pointer instead.
+ * @{
+ */
+#define ETHER_TX_BUF_SKB		0UL
+#define ETHER_TX_BUF_XDP_XMIT		1UL
+#define ETHER_TX_BUF_XDP_TX		2UL
+#define ETHER_TX_BUF_XSK		3UL
+#define ETHER_TX_BUF_TYPE_MASK		3UL
+#define ETHER_TX_BUF_XSK_CHAN_SHIFT	2U
+
+#define ETHER_XDP_PASS			0U
+#define ETHER_XDP_CONSUMED		OSI_BIT(0)
+#define ETHER_XDP_TX			OSI_BIT(1)
+#define ETHER_XDP_REDIRECT		OSI_BIT(2)
+
+/* Largest MTU for which a received frame fits in a single page buffer */
+#define ETHER_XDP_MAX_MTU	(PAGE_SIZE - ETHER_RX_HEADROOM - \
+				 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) - \
+				 ETH_HLEN - ETH_FCS_LEN - (2 * VLAN_HLEN))
+/** @} */
+#endif
+
 /**
  * @brief Timer to trigger Work queue periodically which read HW counters
  * and store locally. If data is at line rate, 2^32 entry get will filled in
@@ -327,6 +401,24 @@ struct ether_tx_napi {
 	struct hrtimer tx_usecs_timer;
 	/** SW timer flag associated with transmit channel */
 	atomic_t tx_usecs_timer_armed;
+	/** Netdev Tx queue index mapped to the channel */
+	unsigned int qinx;
+	/** Packets completed in the current poll, for byte queue limits */
+	unsigned int bql_pkts;
+	/** Bytes completed in the current poll, for byte queue limits */
+	unsigned int bql_bytes;
+#ifdef ETHER_DIM
+	/** Dynamic interrupt moderation state of the channel */
+	struct dim dim;
+	/** Tx coalescing timer period picked by DIM */
+	unsigned int dim_usecs;
+	/** Packets completed on the channel, sampled by DIM */
+	u64 dim_pkts;
+	/** Bytes completed on the channel, sampled by DIM */
+	u64 dim_bytes;
+	/** NAPI polls of the channel, sampled by DIM */
+	u16 dim_events;
+#endif
 };
 
 /**
@@ -339,6 +431,22 @@ struct ether_rx_napi {
 	struct ether_priv_data *pdata;
 	/** NAPI instance associated with transmit channel */
 	struct napi_struct napi;
+	/** XDP verdicts of the current poll which need a flush */
+	unsigned int xdp_flags;
+#ifdef ETHER_DIM
+	/** Dynamic interrupt moderation state of the channel */
+	struct dim dim;
+	/** Delay before polling again with the Rx interrupt left masked */
+	unsigned int dim_usecs;
+	/** Timer polling the channel while the Rx interrupt is masked */
+	struct hrtimer dim_timer;
+	/** Packets received on the channel, sampled by DIM */
+	u64 dim_pkts;
+	/** Bytes received on the channel, sampled by DIM */
+	u64 dim_bytes;
+	/** NAPI polls of the channel, sampled by DIM */
+	u16 dim_events;
+#endif
 };
 
 /**
@@ -409,10 +517,34 @@ struct ether_timestamp_skb_list {
 struct ether_xtra_stat_counters {
 	/** rx skb allocation failure count */
 	nveu64_t re_alloc_rxbuf_failed[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of packets copied below copybreak */
+	nveu64_t rx_copybreak_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of XDP_PASS verdicts */
+	nveu64_t rx_xdp_pass_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of XDP_DROP verdicts */
+	nveu64_t rx_xdp_drop_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of XDP_TX verdicts */
+	nveu64_t rx_xdp_tx_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of XDP_REDIRECT verdicts */
+	nveu64_t rx_xdp_redirect_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** RX per channel count of aborted or failed XDP actions */
+	nveu64_t rx_xdp_err_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel count of frames queued through ndo_xdp_xmit */
+	nveu64_t tx_xdp_xmit_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel count of AF_XDP zero-copy descriptors sent */
+	nveu64_t tx_xsk_n[OSI_MGBE_MAX_NUM_QUEUES];
 	/** TX per channel interrupt count */
 	nveu64_t tx_normal_irq_n[OSI_MGBE_MAX_NUM_QUEUES];
 	/** TX per channel SW timer callback count */
 	nveu64_t tx_usecs_swtimer_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel count of skbs handed to the DMA */
+	nveu64_t tx_pkt_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel count of skbs queued with xmit_more set */
+	nveu64_t tx_xmit_more_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel count of packets ending an xmit_more batch */
+	nveu64_t tx_batch_end_n[OSI_MGBE_MAX_NUM_QUEUES];
+	/** TX per channel batch ends per thousand packets, on stats read */
+	nveu64_t tx_batch_end_permille[OSI_MGBE_MAX_NUM_QUEUES];
 	/** RX per channel interrupt count */
 	nveu64_t rx_normal_irq_n[OSI_MGBE_MAX_NUM_QUEUES];
 	/** link connect count */
@@ -575,6 +707,20 @@ struct ether_priv_data {
 #ifdef ETHER_PAGE_POOL
 	/** Pointer to page pool */
 	struct page_pool *page_pool;
+#endif
+	/** Rx packets up to this length are copied instead of built in place */
+	unsigned int rx_copybreak;
+	/** Rx interrupt moderation driven by DIM (adaptive-rx) */
+	unsigned int use_adaptive_rx;
+	/** Tx coalescing timer driven by DIM (adaptive-tx) */
+	unsigned int use_adaptive_tx;
+#ifdef ETHER_XDP
+	/** XDP program attached to the interface */
+	struct bpf_prog *xdp_prog;
+	/** XDP Rx queue info per DMA channel */
+	struct xdp_rxq_info xdp_rxq[OSI_MGBE_MAX_NUM_CHANS];
+	/** AF_XDP zero-copy buffer pool bound to a DMA channel */
+	struct xsk_buff_pool *xsk_pool[OSI_MGBE_MAX_NUM_CHANS];
 #endif
 #ifdef CONFIG_DEBUG_FS
 	/** Debug fs directory pointer */
@@ -774,6 +920,147 @@ static inline int ether_selftest_get_count(struct ether_priv_data *pdata)
 }
 #endif /* CONFIG_NVETHERNET_SELFTESTS */
 
+#ifdef ETHER_XDP
+/**
+ * @brief ether_xdp_rxq_init - Register XDP Rx queue info of a DMA channel
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA Rx channel number.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+int ether_xdp_rxq_init(struct ether_priv_data *pdata, unsigned int chan);
+
+/**
+ * @brief ether_xdp_rxq_deinit - Unregister XDP Rx queue info of a channel
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA Rx channel number.
+ */
+void ether_xdp_rxq_deinit(struct ether_priv_data *pdata, unsigned int chan);
+
+/**
+ * @brief ether_xdp_rx - Run the XDP program on a received page pool buffer
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] rx_napi: Rx NAPI instance of the channel.
+ * @param[in] page: Page pool page holding the packet.
+ * @param[in,out] offset: Offset of the packet data within the page.
+ * @param[in,out] len: Packet length.
+ *
+ * @retval ETHER_XDP_PASS if the packet has to go to the stack
+ * @retval other ETHER_XDP_* verdicts if XDP consumed the page.
+ */
+unsigned int ether_xdp_rx(struct ether_priv_data *pdata,
+			  struct ether_rx_napi *rx_napi, struct page *page,
+			  unsigned int *offset, unsigned int *len);
+
+/**
+ * @brief ether_xsk_rx - Handle a packet received into an AF_XDP buffer
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] rx_napi: Rx NAPI instance of the channel.
+ * @param[in] xdp: AF_XDP buffer holding the packet.
+ * @param[in] len: Packet length.
+ *
+ * @retval skb holding a copy of the packet for XDP_PASS
+ * @retval NULL if XDP consumed or dropped the buffer.
+ */
+struct sk_buff *ether_xsk_rx(struct ether_priv_data *pdata,
+			     struct ether_rx_napi *rx_napi,
+			     struct xdp_buff *xdp, unsigned int len);
+
+/**
+ * @brief ether_xdp_finalize - Flush XDP work queued by an Rx NAPI poll
+ *
+ * @param[in] rx_napi: Rx NAPI instance of the channel.
+ */
+void ether_xdp_finalize(struct ether_rx_napi *rx_napi);
+
+/**
+ * @brief ether_xdp_tx_complete - Release a Tx buffer queued from XDP
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] buf: Tagged Tx software context buffer pointer.
+ */
+void ether_xdp_tx_complete(struct ether_priv_data *pdata, void *buf);
+
+/**
+ * @brief ether_xsk_xmit - Transmit pending AF_XDP zero-copy descriptors
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA Tx channel number.
+ * @param[in] budget: Maximum number of descriptors to send.
+ *
+ * @retval true if the AF_XDP Tx ring was drained
+ * @retval false if more descriptors are pending.
+ */
+bool ether_xsk_xmit(struct ether_priv_data *pdata, unsigned int chan,
+		    int budget);
+
+/**
+ * @brief ether_xdp_xmit - ndo_xdp_xmit hook of the driver
+ *
+ * @param[in] ndev: Network device.
+ * @param[in] n: Number of frames.
+ * @param[in] frames: XDP frames to transmit.
+ * @param[in] flags: XDP_XMIT_* flags.
+ *
+ * @retval number of frames queued on success
+ * @retval negative value on failure.
+ */
+int ether_xdp_xmit(struct net_device *ndev, int n,
+		   struct xdp_frame **frames, u32 flags);
+
+/**
+ * @brief ether_xdp_bpf - ndo_bpf hook of the driver
+ *
+ * @param[in] ndev: Network device.
+ * @param[in] bpf: XDP command.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+int ether_xdp_bpf(struct net_device *ndev, struct netdev_bpf *bpf);
+
+/**
+ * @brief ether_xsk_wakeup - ndo_xsk_wakeup hook of the driver
+ *
+ * @param[in] ndev: Network device.
+ * @param[in] queue_id: Queue the AF_XDP socket is bound to.
+ * @param[in] flags: XDP_WAKEUP_* flags.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+int ether_xsk_wakeup(struct net_device *ndev, u32 queue_id, u32 flags);
+
+/**
+ * @brief ether_xdp_test_xmit - Send an skb through the XDP transmit path
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] skb: Packet to send, always consumed.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+int ether_xdp_test_xmit(struct ether_priv_data *pdata, struct sk_buff *skb);
+
+/**
+ * @brief ether_xdp_test_verdict - Attach a program returning a fixed action
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] act: XDP action to return, or negative to detach the program.
+ *
+ * @note Only for selftests, with no user program attached and RTNL held.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+int ether_xdp_test_verdict(struct ether_priv_data *pdata, int act);
+#endif /* ETHER_XDP */
+
 /**
  * @brief ether_assign_osd_ops - Assigns OSD ops for OSI
  *
@@ -163,6 +163,86 @@ static const struct ether_stats ether_gstrings_stats[] = {
 	ETHER_EXTRA_STAT(re_alloc_rxbuf_failed[7]),
 	ETHER_EXTRA_STAT(re_alloc_rxbuf_failed[8]),
 	ETHER_EXTRA_STAT(re_alloc_rxbuf_failed[9]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[0]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[1]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[2]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[3]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[4]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[5]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[6]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[7]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[8]),
+	ETHER_EXTRA_STAT(rx_copybreak_n[9]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[0]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[1]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[2]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[3]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[4]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[5]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[6]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[7]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[8]),
+	ETHER_EXTRA_STAT(rx_xdp_pass_n[9]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[0]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[1]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[2]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[3]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[4]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[5]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[6]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[7]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[8]),
+	ETHER_EXTRA_STAT(rx_xdp_drop_n[9]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[0]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[1]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[2]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[3]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[4]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[5]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[6]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[7]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[8]),
+	ETHER_EXTRA_STAT(rx_xdp_tx_n[9]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[0]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[1]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[2]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[3]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[4]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[5]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[6]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[7]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[8]),
+	ETHER_EXTRA_STAT(rx_xdp_redirect_n[9]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[0]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[1]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[2]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[3]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[4]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[5]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[6]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[7]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[8]),
+	ETHER_EXTRA_STAT(rx_xdp_err_n[9]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[0]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[1]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[2]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[3]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[4]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[5]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[6]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[7]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[8]),
+	ETHER_EXTRA_STAT(tx_xdp_xmit_n[9]),
+	ETHER_EXTRA_STAT(tx_xsk_n[0]),
+	ETHER_EXTRA_STAT(tx_xsk_n[1]),
+	ETHER_EXTRA_STAT(tx_xsk_n[2]),
+	ETHER_EXTRA_STAT(tx_xsk_n[3]),
+	ETHER_EXTRA_STAT(tx_xsk_n[4]),
+	ETHER_EXTRA_STAT(tx_xsk_n[5]),
+	ETHER_EXTRA_STAT(tx_xsk_n[6]),
+	ETHER_EXTRA_STAT(tx_xsk_n[7]),
+	ETHER_EXTRA_STAT(tx_xsk_n[8]),
+	ETHER_EXTRA_STAT(tx_xsk_n[9]),
 
 
 	/* Tx/Rx IRQ Events */
@@ -186,6 +266,46 @@ static const struct ether_stats ether_gstrings_stats[] = {
 	ETHER_EXTRA_STAT(tx_usecs_swtimer_n[7]),
 	ETHER_EXTRA_STAT(tx_usecs_swtimer_n[8]),
 	ETHER_EXTRA_STAT(tx_usecs_swtimer_n[9]),
+	ETHER_EXTRA_STAT(tx_pkt_n[0]),
+	ETHER_EXTRA_STAT(tx_pkt_n[1]),
+	ETHER_EXTRA_STAT(tx_pkt_n[2]),
+	ETHER_EXTRA_STAT(tx_pkt_n[3]),
+	ETHER_EXTRA_STAT(tx_pkt_n[4]),
+	ETHER_EXTRA_STAT(tx_pkt_n[5]),
+	ETHER_EXTRA_STAT(tx_pkt_n[6]),
+	ETHER_EXTRA_STAT(tx_pkt_n[7]),
+	ETHER_EXTRA_STAT(tx_pkt_n[8]),
+	ETHER_EXTRA_STAT(tx_pkt_n[9]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[0]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[1]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[2]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[3]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[4]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[5]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[6]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[7]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[8]),
+	ETHER_EXTRA_STAT(tx_xmit_more_n[9]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[0]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[1]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[2]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[3]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[4]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[5]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[6]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[7]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[8]),
+	ETHER_EXTRA_STAT(tx_batch_end_n[9]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[0]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[1]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[2]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[3]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[4]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[5]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[6]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[7]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[8]),
+	ETHER_EXTRA_STAT(tx_batch_end_permille[9]),
 	ETHER_EXTRA_STAT(rx_normal_irq_n[0]),
 	ETHER_EXTRA_STAT(rx_normal_irq_n[1]),
 	ETHER_EXTRA_STAT(rx_normal_irq_n[2]),
@@ -486,6 +606,31 @@ static const struct ether_stats ether_tstrings_stats[] = {
 #endif /* OSI_STRIPPED_LIB */
 };
 
+/**
+ * @brief Refresh the Tx batch end per packet ratio of every channel
+ *
+ * Algorithm: Report xmit_more batch ends per thousand transmitted skbs,
+ * so that the batching done by the stack shows up in ethtool -S.
+ *
+ * @param[in] pdata: OSD private data.
+ */
+static void ether_update_batch_ratio(struct ether_priv_data *pdata)
+{
+	struct ether_xtra_stat_counters *xstats = &pdata->xstats;
+	unsigned int i;
+
+	for (i = 0; i < OSI_MGBE_MAX_NUM_QUEUES; i++) {
+		if (xstats->tx_pkt_n[i] == 0UL) {
+			xstats->tx_batch_end_permille[i] = 0UL;
+			continue;
+		}
+
+		xstats->tx_batch_end_permille[i] =
+			div64_u64(xstats->tx_batch_end_n[i] * 1000ULL,
+				  xstats->tx_pkt_n[i]);
+	}
+}
+
 /**
  * @brief This function is invoked by kernel when user requests to get the
  *  extended statistics about the device.
@@ -542,6 +687,7 @@ static void ether_get_ethtool_stats(struct net_device *dev,
 				     (*(u32 *)p);
 		}
 
+		ether_update_batch_ratio(pdata);
 		for (i = 0; i < ETHER_EXTRA_STAT_LEN; i++) {
 			char *p = (char *)pdata +
 				  ether_gstrings_stats[i].stat_offset;
@@ -932,7 +1078,9 @@ static int ether_set_coalesce(struct net_device *dev,
 	/* Check for not supported parameters  */
 	if ((ec->rx_coalesce_usecs_irq) ||
 	    (ec->rx_max_coalesced_frames_irq) || (ec->tx_coalesce_usecs_irq) ||
+#ifndef ETHER_DIM
 	    (ec->use_adaptive_rx_coalesce) || (ec->use_adaptive_tx_coalesce) ||
+#endif
 	    (ec->pkt_rate_low) || (ec->rx_coalesce_usecs_low) ||
 	    (ec->rx_max_coalesced_frames_low) || (ec->tx_coalesce_usecs_high) ||
 	    (ec->tx_max_coalesced_frames_low) || (ec->pkt_rate_high) ||
@@ -1033,6 +1181,20 @@ static int ether_set_coalesce(struct net_device *dev,
 	netdev_err(dev, "RX COALESCING FRAMES is %s\n", osi_dma->use_rx_frames ?
 		   "ENABLED" : "DISABLED");
 
+#ifdef ETHER_DIM
+	/* Adaptive Tx only retunes the tx-usecs timer period */
+	if (ec->use_adaptive_tx_coalesce &&
+	    osi_dma->use_tx_usecs == OSI_DISABLE) {
+		netdev_err(dev, "invalid settings : tx-usecs must be enabled"
+			   " along with adaptive-tx\n");
+		return -EINVAL;
+	}
+	pdata->use_adaptive_rx = ec->use_adaptive_rx_coalesce ?
+				 OSI_ENABLE : OSI_DISABLE;
+	pdata->use_adaptive_tx = ec->use_adaptive_tx_coalesce ?
+				 OSI_ENABLE : OSI_DISABLE;
+#endif
+
 	osi_dma->rx_riwt = ec->rx_coalesce_usecs;
 	osi_dma->rx_frames = ec->rx_max_coalesced_frames;
 	osi_dma->tx_usecs = ec->tx_coalesce_usecs;
@@ -1073,6 +1235,10 @@ static int ether_get_coalesce(struct net_device *dev,
 	ec->rx_max_coalesced_frames = osi_dma->rx_frames;
 	ec->tx_coalesce_usecs = osi_dma->tx_usecs;
 	ec->tx_max_coalesced_frames = osi_dma->tx_frames;
+#ifdef ETHER_DIM
+	ec->use_adaptive_rx_coalesce = pdata->use_adaptive_rx;
+	ec->use_adaptive_tx_coalesce = pdata->use_adaptive_tx;
+#endif
 
 	return 0;
 }
@@ -1595,6 +1761,36 @@ static void ether_set_msglevel(struct net_device *ndev, u32 level)
 }
 #endif /* OSI_STRIPPED_LIB */
 
+static int ether_get_tunable(struct net_device *ndev,
+			     const struct ethtool_tunable *tuna, void *data)
+{
+	struct ether_priv_data *pdata = netdev_priv(ndev);
+
+	switch (tuna->id) {
+	case ETHTOOL_RX_COPYBREAK:
+		*(u32 *)data = pdata->rx_copybreak;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int ether_set_tunable(struct net_device *ndev,
+			     const struct ethtool_tunable *tuna,
+			     const void *data)
+{
+	struct ether_priv_data *pdata = netdev_priv(ndev);
+
+	switch (tuna->id) {
+	case ETHTOOL_RX_COPYBREAK:
+		/* Takes effect from the next received packet */
+		WRITE_ONCE(pdata->rx_copybreak, *(const u32 *)data);
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 /**
  * @brief Set of ethtool operations
  */
@@ -1607,9 +1803,16 @@ static const struct ethtool_ops ether_ethtool_ops = {
 	.get_ethtool_stats = ether_get_ethtool_stats,
 	.get_sset_count = ether_get_sset_count,
 	.get_coalesce = ether_get_coalesce,
+#ifdef ETHER_DIM
+	.supported_coalesce_params = (ETHTOOL_COALESCE_USECS |
+		ETHTOOL_COALESCE_MAX_FRAMES | ETHTOOL_COALESCE_USE_ADAPTIVE),
+#else
 	.supported_coalesce_params = (ETHTOOL_COALESCE_USECS |
 		ETHTOOL_COALESCE_MAX_FRAMES),
+#endif
 	.set_coalesce = ether_set_coalesce,
+	.get_tunable = ether_get_tunable,
+	.set_tunable = ether_set_tunable,
 #ifndef OSI_STRIPPED_LIB
 	.get_wol = ether_get_wol,
 	.set_wol = ether_set_wol,
@@ -1,7 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-only
 /* Copyright (c) 2019-2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved */
 
+#include <nvidia/conftest.h>
+
 #include "ether_linux.h"
+#ifdef ETHER_XDP
+#include <net/xdp_sock_drv.h>
+#endif
 
 /**
  * @brief ether_get_free_tx_ts_node - get free node for pending SKB
@@ -240,6 +245,33 @@ static inline int ether_alloc_skb(struct ether_priv_data *pdata,
 	}
 
 #else
+#ifdef ETHER_XDP
+	if (pdata->xsk_pool[chan]) {
+		struct xsk_buff_pool *pool = pdata->xsk_pool[chan];
+		struct xdp_buff *xdp = xsk_buff_alloc(pool);
+
+		if (!xdp) {
+			/* Let user space know the fill ring ran dry */
+			if (xsk_uses_need_wakeup(pool))
+				xsk_set_rx_need_wakeup(pool);
+			rx_swcx->buf_virt_addr = pdata->resv_buf_virt_addr;
+			rx_swcx->buf_phy_addr = pdata->resv_buf_phy_addr;
+			rx_swcx->flags |= OSI_RX_SWCX_BUF_VALID;
+			val = pdata->xstats.re_alloc_rxbuf_failed[chan];
+			pdata->xstats.re_alloc_rxbuf_failed[chan] =
+				osi_update_stats_counter(val, 1UL);
+			return 0;
+		}
+
+		if (xsk_uses_need_wakeup(pool))
+			xsk_clear_rx_need_wakeup(pool);
+		rx_swcx->buf_virt_addr = xdp;
+		rx_swcx->buf_phy_addr = xsk_buff_xdp_get_dma(xdp);
+		rx_swcx->flags |= OSI_RX_SWCX_BUF_VALID;
+		return 0;
+	}
+
+#endif
 	rx_swcx->buf_virt_addr = page_pool_dev_alloc_pages(pdata->page_pool);
 	if (!rx_swcx->buf_virt_addr) {
 		dev_err(pdata->dev,
@@ -253,7 +285,7 @@ static inline int ether_alloc_skb(struct ether_priv_data *pdata,
 		return 0;
 	}
 
-	rx_swcx->buf_phy_addr = page_pool_get_dma_addr(rx_swcx->buf_virt_addr);
+	rx_swcx->buf_phy_addr = ether_rx_page_dma_addr(rx_swcx->buf_virt_addr);
 #endif
 #ifndef ETHER_PAGE_POOL
 	rx_swcx->buf_virt_addr = skb;
@@ -590,6 +622,75 @@ exit:
 }
 #endif
 
+#ifdef ETHER_PAGE_POOL
+/**
+ * @brief Wrap a received page pool buffer into an skb.
+ *
+ * Algorithm:
+ * 1) Packets up to the copybreak length are copied into a new skb and the
+ * page is recycled right away, which keeps small packets from pinning a
+ * whole page in socket queues.
+ * 2) Larger packets get an skb built around the page itself. The skb is
+ * marked for recycling so the page goes back to the pool when the stack
+ * frees it.
+ *
+ * @param[in] pdata: OSD private data structure.
+ * @param[in] rx_napi: Rx NAPI instance of the channel.
+ * @param[in] page: Page pool page holding the packet.
+ * @param[in] offset: Offset of the packet data within the page.
+ * @param[in] len: Packet length.
+ * @param[in] chan: DMA Rx channel number.
+ *
+ * @retval skb on success
+ * @retval NULL on failure, the page is still owned by the caller.
+ */
+static struct sk_buff *ether_rx_page_to_skb(struct ether_priv_data *pdata,
+					    struct ether_rx_napi *rx_napi,
+					    struct page *page,
+					    unsigned int offset,
+					    unsigned int len,
+					    unsigned int chan)
+{
+	void *data = page_address(page);
+	struct sk_buff *skb;
+	unsigned long val;
+
+	if (len <= READ_ONCE(pdata->rx_copybreak)) {
+		skb = napi_alloc_skb(&rx_napi->napi, len);
+		if (unlikely(!skb))
+			return NULL;
+
+		skb_copy_to_linear_data(skb, data + offset, len);
+		skb_put(skb, len);
+		page_pool_recycle_direct(pdata->page_pool, page);
+
+		val = pdata->xstats.rx_copybreak_n[chan];
+		pdata->xstats.rx_copybreak_n[chan] =
+			osi_update_stats_counter(val, 1UL);
+		return skb;
+	}
+
+#if defined(NV_SKB_MARK_FOR_RECYCLE_HAS_SKB_ARG_ONLY) /* Linux v5.15 */
+	skb = napi_build_skb(data, PAGE_SIZE << pdata->page_pool->p.order);
+	if (unlikely(!skb))
+		return NULL;
+
+	skb_mark_for_recycle(skb);
+#else
+	skb = build_skb(data, PAGE_SIZE << pdata->page_pool->p.order);
+	if (unlikely(!skb))
+		return NULL;
+
+	/* The page leaves the pool and is freed with the skb */
+	page_pool_release_page(pdata->page_pool, page);
+#endif
+	skb_reserve(skb, offset);
+	skb_put(skb, len);
+
+	return skb;
+}
+#endif
+
 /**
  * @brief Handover received packet to network stack.
  *
@@ -618,6 +719,8 @@ static void osd_receive_packet(void *priv, struct osi_rx_ring *rx_ring,
 	struct ether_rx_napi *rx_napi = pdata->rx_napi[chan];
 #ifdef ETHER_PAGE_POOL
 	struct page *page = (struct page *)rx_swcx->buf_virt_addr;
+	unsigned int offset = ETHER_RX_HEADROOM;
+	unsigned int len = rx_pkt_cx->pkt_len;
 	struct sk_buff *skb = NULL;
 #else
 	struct sk_buff *skb = (struct sk_buff *)rx_swcx->buf_virt_addr;
@@ -647,8 +750,26 @@ static void osd_receive_packet(void *priv, struct osi_rx_ring *rx_ring,
 	if (likely((rx_pkt_cx->flags & OSI_PKT_CX_VALID) ==
 		   OSI_PKT_CX_VALID)) {
 #ifdef ETHER_PAGE_POOL
-		skb = netdev_alloc_skb_ip_align(pdata->ndev,
-						rx_pkt_cx->pkt_len);
+		/* The pool maps pages bidirectionally while XDP is attached */
+		dma_sync_single_for_cpu(pdata->dev, dma_addr,
+					rx_pkt_cx->pkt_len,
+					page_pool_get_dma_dir(pdata->page_pool));
+#ifdef ETHER_XDP
+		if (pdata->xsk_pool[chan]) {
+			skb = ether_xsk_rx(pdata, rx_napi,
+					   rx_swcx->buf_virt_addr,
+					   rx_pkt_cx->pkt_len);
+			if (!skb)
+				goto done;
+		} else if (ether_xdp_rx(pdata, rx_napi, page, &offset,
+					&len) != ETHER_XDP_PASS) {
+			goto done;
+		}
+
+		if (!skb)
+#endif
+		skb = ether_rx_page_to_skb(pdata, rx_napi, page, offset, len,
+					   chan);
 		if (unlikely(!skb)) {
 			pdata->ndev->stats.rx_dropped++;
 			dev_err(pdata->dev,
@@ -657,13 +778,6 @@ static void osd_receive_packet(void *priv, struct osi_rx_ring *rx_ring,
 			page_pool_recycle_direct(pdata->page_pool, page);
 			return;
 		}
-
-		dma_sync_single_for_cpu(pdata->dev, dma_addr,
-					rx_pkt_cx->pkt_len, DMA_FROM_DEVICE);
-		skb_copy_to_linear_data(skb, page_address(page),
-					rx_pkt_cx->pkt_len);
-		skb_put(skb, rx_pkt_cx->pkt_len);
-		page_pool_recycle_direct(pdata->page_pool, page);
 #else
 		skb_put(skb, rx_pkt_cx->pkt_len);
 #endif
@@ -717,15 +831,24 @@ static void osd_receive_packet(void *priv, struct osi_rx_ring *rx_ring,
 		ndev->stats.rx_fifo_errors = osi_core->mmc.mmc_rx_fifo_overflow;
 		ndev->stats.rx_errors++;
 #ifdef ETHER_PAGE_POOL
+#ifdef ETHER_XDP
+		if (pdata->xsk_pool[chan])
+			xsk_buff_free(rx_swcx->buf_virt_addr);
+		else
+#endif
 		page_pool_recycle_direct(pdata->page_pool, page);
 #endif
 		dev_kfree_skb_any(skb);
 	}
 
-#ifdef ETHER_NVGRO
+#if defined(ETHER_NVGRO) || defined(ETHER_XDP)
 done:
 #endif
 	ndev->stats.rx_packets++;
+#ifdef ETHER_DIM
+	rx_napi->dim_pkts++;
+	rx_napi->dim_bytes += rx_pkt_cx->pkt_len;
+#endif
 	rx_swcx->buf_virt_addr = NULL;
 	rx_swcx->buf_phy_addr = 0;
 	/* mark packet is processed */
@@ -768,6 +891,21 @@ static void osd_transmit_complete(void *priv, const struct osi_tx_swcx *swcx,
 
 	ndev->stats.tx_bytes += len;
 
+#ifdef ETHER_XDP
+	switch ((unsigned long)swcx->buf_virt_addr & ETHER_TX_BUF_TYPE_MASK) {
+	case ETHER_TX_BUF_SKB:
+		break;
+	case ETHER_TX_BUF_XDP_XMIT:
+		dma_unmap_single(pdata->dev, dmaaddr, len, DMA_TO_DEVICE);
+		fallthrough;
+	default:
+		/* XDP_TX pages and AF_XDP frames keep their own mapping */
+		ether_xdp_tx_complete(pdata, swcx->buf_virt_addr);
+		ndev->stats.tx_packets++;
+		return;
+	}
+#endif
+
 	if ((txdone_pkt_cx->flags & OSI_TXDONE_CX_TS) == OSI_TXDONE_CX_TS) {
 		memset(&shhwtstamp, 0, sizeof(struct skb_shared_hwtstamps));
 		shhwtstamp.hwtstamp = ns_to_ktime(txdone_pkt_cx->ns);
@@ -803,6 +941,9 @@ static void osd_transmit_complete(void *priv, const struct osi_tx_swcx *swcx,
 		}
 
 		ndev->stats.tx_packets++;
+		/* Reported to BQL once per Tx NAPI poll */
+		pdata->tx_napi[chan]->bql_pkts++;
+		pdata->tx_napi[chan]->bql_bytes += skb->len;
 		if ((txdone_pkt_cx->flags & OSI_TXDONE_CX_TS_DELAYED) ==
 		    OSI_TXDONE_CX_TS_DELAYED) {
 			add_skb_node(pdata, skb, txdone_pkt_cx->pktid);
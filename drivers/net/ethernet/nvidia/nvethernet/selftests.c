@@ -15,6 +15,8 @@ struct ether_packet_ctxt {
 #else
 	unsigned char *dst;
 #endif
+	/** Transmit through the XDP transmit path instead of the stack */
+	bool xdp;
 };
 
 /**
@@ -205,7 +207,8 @@ out:
  * Algorithm:
  * 1) It registers Rx handler with network type for specifc packet type.
  * 2) Gets a SKB with UDP/Ethernet headers updated
- * 3) Transmits packet with dev_queue_xmit().
+ * 3) Transmits packet with dev_queue_xmit(), or through the driver XDP
+ * transmit path when requested by the packet context.
  *
  * @param[in] pdata: Ethernet OSD private data
  * @param[in] ctxt: Ethernet packet context
@@ -241,7 +244,18 @@ static int ether_test_loopback(struct ether_priv_data *pdata,
 	}
 
 	skb_set_queue_mapping(skb, 0);
+#ifdef ETHER_XDP
+	if (ctxt->xdp) {
+		/* No checksum offload on the XDP path, send without one */
+		udp_hdr(skb)->check = 0;
+		skb->ip_summed = CHECKSUM_NONE;
+		ret = ether_xdp_test_xmit(pdata, skb);
+	} else {
+		ret = dev_queue_xmit(skb);
+	}
+#else
 	ret = dev_queue_xmit(skb);
+#endif
 	if (ret)
 		goto cleanup;
 
@@ -299,6 +313,141 @@ static int ether_test_phy_loopback(struct ether_priv_data *pdata)
 	return ether_test_loopback(pdata, &ctxt);
 }
 
+/**
+ * @brief ether_test_xdp_loopback - Ethernet selftest for XDP Tx in MAC loopback
+ *
+ * Algorithm: Sends the test packet as an XDP frame, the same way
+ * ndo_xdp_xmit queues redirected frames, and expects it back on the Rx path.
+ *
+ * @param[in] pdata: Ethernet OSD private data
+ *
+ * @retval zero on success
+ * @retval negative value on failure.
+ */
+static int ether_test_xdp_loopback(struct ether_priv_data *pdata)
+{
+#ifdef ETHER_XDP
+	struct ether_packet_ctxt ctxt = { };
+
+	/* An attached program may consume the looped back packet */
+	if (READ_ONCE(pdata->xdp_prog))
+		return -EOPNOTSUPP;
+
+	ctxt.dst = pdata->ndev->dev_addr;
+	ctxt.xdp = true;
+	return ether_test_loopback(pdata, &ctxt);
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+#ifdef ETHER_XDP
+/**
+ * @brief ether_test_xdp_count - Sum a per channel XDP counter
+ *
+ * @param[in] pdata: Ethernet OSD private data
+ * @param[in] counters: Per channel counters
+ *
+ * @retval Sum over the DMA channels in use
+ */
+static nveu64_t ether_test_xdp_count(struct ether_priv_data *pdata,
+				     const nveu64_t *counters)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	nveu64_t count = 0;
+	unsigned int i;
+
+	for (i = 0; i < osi_dma->num_dma_chans; i++)
+		count += READ_ONCE(counters[osi_dma->dma_chans[i]]);
+
+	return count;
+}
+#endif
+
+/**
+ * @brief ether_test_xdp_verdicts - Ethernet selftest for XDP Rx verdicts
+ *
+ * Algorithm:
+ * 1) Attach a program returning a fixed action, which restarts the
+ * interface, so MAC loopback is enabled again.
+ * 2) Loop back the test packet and check that only XDP_PASS hands it to
+ * the stack, and that the counter of the verdict moves.
+ * 3) Swap the program in place for the next action and finally detach it.
+ *
+ * XDP_TX frames keep bouncing in loopback until the next program drops
+ * them. XDP_REDIRECT has no target set by the program, so the frame must
+ * be dropped and accounted as an error.
+ *
+ * @param[in] pdata: Ethernet OSD private data
+ *
+ * @retval zero on success
+ * @retval negative value on failure.
+ */
+static int ether_test_xdp_verdicts(struct ether_priv_data *pdata)
+{
+#ifdef ETHER_XDP
+	struct ether_xtra_stat_counters *xstats = &pdata->xstats;
+	const struct {
+		u32 act;
+		const nveu64_t *counters;
+		bool rx;
+	} verdicts[] = {
+		{ XDP_PASS, xstats->rx_xdp_pass_n, true },
+		{ XDP_DROP, xstats->rx_xdp_drop_n, false },
+		{ XDP_TX, xstats->rx_xdp_tx_n, false },
+		{ XDP_REDIRECT, xstats->rx_xdp_err_n, false },
+	};
+	struct ether_packet_ctxt ctxt = { };
+	struct osi_ioctl ioctl_data = { };
+	nveu64_t count;
+	unsigned int i;
+	int ret = 0, err;
+
+	if (READ_ONCE(pdata->xdp_prog) || !pdata->osi_core ||
+	    pdata->ndev->mtu > ETHER_XDP_MAX_MTU)
+		return -EOPNOTSUPP;
+
+	ctxt.dst = pdata->ndev->dev_addr;
+	ioctl_data.cmd = OSI_CMD_MAC_LB;
+	ioctl_data.arg1_u32 = OSI_ENABLE;
+
+	for (i = 0; i < ARRAY_SIZE(verdicts); i++) {
+		ret = ether_xdp_test_verdict(pdata, verdicts[i].act);
+		if (ret < 0)
+			break;
+
+		ret = osi_handle_ioctl(pdata->osi_core, &ioctl_data);
+		if (ret < 0)
+			break;
+
+		count = ether_test_xdp_count(pdata, verdicts[i].counters);
+		ret = ether_test_loopback(pdata, &ctxt);
+		if (verdicts[i].rx ? (ret != 0) : (ret != -ETIMEDOUT)) {
+			netdev_err(pdata->ndev, "XDP verdict %u: loopback %d\n",
+				   verdicts[i].act, ret);
+			ret = -1;
+			break;
+		}
+
+		if (ether_test_xdp_count(pdata, verdicts[i].counters) == count) {
+			netdev_err(pdata->ndev, "XDP verdict %u not accounted\n",
+				   verdicts[i].act);
+			ret = -1;
+			break;
+		}
+		ret = 0;
+	}
+
+	err = ether_xdp_test_verdict(pdata, -1);
+	if (err == 0)
+		err = osi_handle_ioctl(pdata->osi_core, &ioctl_data);
+
+	return ret ? ret : err;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
 /**
  * @brief ether_test_mmc_counters - Ethernet selftest for MMC Counters
  *
@@ -368,6 +517,14 @@ static const struct ether_test {
 		.name = "MMC Counters		",
 		.lb = ETHER_LOOPBACK_MAC,
 		.fn = ether_test_mmc_counters,
+	}, {
+		.name = "XDP Tx Loopback		",
+		.lb = ETHER_LOOPBACK_MAC,
+		.fn = ether_test_xdp_loopback,
+	}, {
+		.name = "XDP Rx Verdicts		",
+		.lb = ETHER_LOOPBACK_MAC,
+		.fn = ether_test_xdp_verdicts,
 	},
 };
 
@@ -0,0 +1,832 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Copyright (c) 2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved */
+
+/*
+ * XDP and AF_XDP support.
+ *
+ * Native XDP runs in the Rx completion path on the page pool buffers, before
+ * an skb is built. All verdicts are supported:
+ * - XDP_PASS hands the (possibly modified) buffer to the regular skb path.
+ * - XDP_DROP recycles the page straight into the page pool.
+ * - XDP_TX queues the page on the Tx ring of the same DMA channel, reusing
+ *   the page pool DMA mapping. The pool maps pages bidirectionally while a
+ *   program is attached.
+ * - XDP_REDIRECT is flushed once per NAPI poll.
+ *
+ * AF_XDP zero-copy binds a UMEM to the Tx/Rx DMA channel pair behind a
+ * queue id. Binding or unbinding a pool restarts the interface, as changing
+ * the ring size does, and the Rx ring of that channel is then filled from
+ * the UMEM instead of the page pool. AF_XDP Tx descriptors are sent from
+ * the Tx NAPI poll of the channel, which ndo_xsk_wakeup schedules.
+ *
+ * Per channel verdict and transmit counters are reported by ethtool -S.
+ */
+
+#include <nvidia/conftest.h>
+
+#include "ether_linux.h"
+
+#ifdef ETHER_XDP
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <linux/filter.h>
+#include <net/xdp_sock_drv.h>
+
+/**
+ * @brief Returns the netdev Tx queue index which maps to a DMA channel
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA channel number.
+ *
+ * @returns Tx queue index.
+ */
+static unsigned int ether_xdp_chan_to_qinx(struct ether_priv_data *pdata,
+					   unsigned int chan)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	unsigned int i;
+
+	for (i = 0; i < osi_dma->num_dma_chans; i++) {
+		if (osi_dma->dma_chans[i] == chan)
+			return i;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Queue one XDP frame on a DMA channel Tx ring
+ *
+ * Algorithm:
+ * 1) Frames coming from ndo_xdp_xmit are mapped for the device. XDP_TX
+ * frames live in a page pool page whose mapping is reused.
+ * 2) Fill a single descriptor software context tagged with the buffer
+ * type and hand it to OSI.
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA Tx channel number.
+ * @param[in] xdpf: XDP frame.
+ * @param[in] ndo_xmit: Frame comes from ndo_xdp_xmit.
+ *
+ * @note Caller must hold the Tx queue lock of the channel.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+static int ether_xdp_xmit_frame(struct ether_priv_data *pdata,
+				unsigned int chan, struct xdp_frame *xdpf,
+				bool ndo_xmit)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct osi_tx_ring *tx_ring = osi_dma->tx_ring[chan];
+	struct osi_tx_pkt_cx *tx_pkt_cx = &tx_ring->tx_pkt_cx;
+	struct osi_tx_swcx *tx_swcx;
+	unsigned long type;
+	struct page *page;
+	dma_addr_t dma;
+	int ret;
+
+	/* Leave room for a worst case skb so that xmit never sees a full ring */
+	if (ether_avail_txdesc_cnt(osi_dma, tx_ring) <= ETHER_TX_DESC_THRESHOLD)
+		return -EBUSY;
+
+	tx_swcx = tx_ring->tx_swcx + tx_ring->cur_tx_idx;
+	if (unlikely(tx_swcx->len))
+		return -EBUSY;
+
+	if (ndo_xmit) {
+		dma = dma_map_single(pdata->dev, xdpf->data, xdpf->len,
+				     DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(pdata->dev, dma)))
+			return -ENOMEM;
+		type = ETHER_TX_BUF_XDP_XMIT;
+	} else {
+		page = virt_to_head_page(xdpf->data);
+		dma = page_pool_get_dma_addr(page) + sizeof(*xdpf) +
+		      xdpf->headroom;
+		dma_sync_single_for_device(pdata->dev, dma, xdpf->len,
+					   DMA_BIDIRECTIONAL);
+		type = ETHER_TX_BUF_XDP_TX;
+	}
+
+	memset(tx_pkt_cx, 0, sizeof(*tx_pkt_cx));
+	tx_pkt_cx->flags |= OSI_PKT_CX_LEN;
+	tx_pkt_cx->payload_len = xdpf->len;
+	tx_pkt_cx->desc_cnt = 1;
+
+	tx_swcx->buf_phy_addr = dma;
+	tx_swcx->flags &= ~OSI_PKT_CX_PAGED_BUF;
+	tx_swcx->len = xdpf->len;
+	tx_swcx->buf_virt_addr = (void *)((unsigned long)xdpf | type);
+
+	ret = osi_hw_transmit(osi_dma, chan);
+	if (unlikely(ret < 0)) {
+		if (ndo_xmit)
+			dma_unmap_single(pdata->dev, dma, xdpf->len,
+					 DMA_TO_DEVICE);
+		tx_swcx->buf_virt_addr = NULL;
+		tx_swcx->buf_phy_addr = 0;
+		tx_swcx->len = 0;
+		tx_swcx->flags = 0;
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Queue an XDP frame on a DMA channel under its Tx queue lock
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA channel number.
+ * @param[in] xdpf: XDP frame.
+ * @param[in] ndo_xmit: Frame needs its own DMA mapping.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure, the frame is not consumed.
+ */
+static int ether_xdp_tx_frame(struct ether_priv_data *pdata,
+			      unsigned int chan, struct xdp_frame *xdpf,
+			      bool ndo_xmit)
+{
+	struct netdev_queue *txq;
+	int ret;
+
+	txq = netdev_get_tx_queue(pdata->ndev,
+				  ether_xdp_chan_to_qinx(pdata, chan));
+
+	__netif_tx_lock(txq, smp_processor_id());
+	ret = ether_xdp_xmit_frame(pdata, chan, xdpf, ndo_xmit);
+	__netif_tx_unlock(txq);
+
+	return ret;
+}
+
+/**
+ * @brief Account an XDP verdict in the per channel counters
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] chan: DMA Rx channel number.
+ * @param[in] act: XDP action, or XDP_ABORTED for failed actions.
+ */
+static void ether_xdp_account(struct ether_priv_data *pdata,
+			      unsigned int chan, u32 act)
+{
+	struct ether_xtra_stat_counters *xstats = &pdata->xstats;
+
+	switch (act) {
+	case XDP_PASS:
+		xstats->rx_xdp_pass_n[chan] =
+			osi_update_stats_counter(xstats->rx_xdp_pass_n[chan],
+						 1UL);
+		break;
+	case XDP_DROP:
+		xstats->rx_xdp_drop_n[chan] =
+			osi_update_stats_counter(xstats->rx_xdp_drop_n[chan],
+						 1UL);
+		break;
+	case XDP_TX:
+		xstats->rx_xdp_tx_n[chan] =
+			osi_update_stats_counter(xstats->rx_xdp_tx_n[chan],
+						 1UL);
+		break;
+	case XDP_REDIRECT:
+		xstats->rx_xdp_redirect_n[chan] =
+			osi_update_stats_counter(xstats->rx_xdp_redirect_n[chan],
+						 1UL);
+		break;
+	default:
+		xstats->rx_xdp_err_n[chan] =
+			osi_update_stats_counter(xstats->rx_xdp_err_n[chan],
+						 1UL);
+		break;
+	}
+}
+
+/**
+ * @brief Report an invalid or aborted XDP action
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] prog: XDP program.
+ * @param[in] act: XDP action.
+ */
+static void ether_xdp_exception(struct ether_priv_data *pdata,
+				struct bpf_prog *prog, u32 act)
+{
+	if (act != XDP_ABORTED) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		bpf_warn_invalid_xdp_action(pdata->ndev, prog, act);
+#else
+		bpf_warn_invalid_xdp_action(act);
+#endif
+	}
+	trace_xdp_exception(pdata->ndev, prog, act);
+}
+
+unsigned int ether_xdp_rx(struct ether_priv_data *pdata,
+			  struct ether_rx_napi *rx_napi, struct page *page,
+			  unsigned int *offset, unsigned int *len)
+{
+	struct bpf_prog *prog = READ_ONCE(pdata->xdp_prog);
+	unsigned int chan = rx_napi->chan;
+	void *hard_start = page_address(page);
+	struct xdp_frame *xdpf;
+	struct xdp_buff xdp;
+	u32 act;
+
+	if (!prog)
+		return ETHER_XDP_PASS;
+
+	xdp_init_buff(&xdp, PAGE_SIZE << pdata->page_pool->p.order,
+		      &pdata->xdp_rxq[chan]);
+	xdp_prepare_buff(&xdp, hard_start, *offset, *len, false);
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		*offset = xdp.data - hard_start;
+		*len = xdp.data_end - xdp.data;
+		ether_xdp_account(pdata, chan, act);
+		return ETHER_XDP_PASS;
+	case XDP_TX:
+		xdpf = xdp_convert_buff_to_frame(&xdp);
+		if (unlikely(!xdpf) ||
+		    ether_xdp_tx_frame(pdata, chan, xdpf, false) < 0)
+			goto err;
+		ether_xdp_account(pdata, chan, act);
+		return ETHER_XDP_TX;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(pdata->ndev, &xdp, prog) < 0)
+			goto err;
+		rx_napi->xdp_flags |= ETHER_XDP_REDIRECT;
+		ether_xdp_account(pdata, chan, act);
+		return ETHER_XDP_REDIRECT;
+	default:
+		ether_xdp_exception(pdata, prog, act);
+		goto err;
+	case XDP_ABORTED:
+		ether_xdp_exception(pdata, prog, act);
+		goto err;
+	case XDP_DROP:
+		ether_xdp_account(pdata, chan, act);
+		page_pool_recycle_direct(pdata->page_pool, page);
+		return ETHER_XDP_CONSUMED;
+	}
+
+err:
+	ether_xdp_account(pdata, chan, XDP_ABORTED);
+	page_pool_recycle_direct(pdata->page_pool, page);
+	return ETHER_XDP_CONSUMED;
+}
+
+struct sk_buff *ether_xsk_rx(struct ether_priv_data *pdata,
+			     struct ether_rx_napi *rx_napi,
+			     struct xdp_buff *xdp, unsigned int len)
+{
+	struct bpf_prog *prog = READ_ONCE(pdata->xdp_prog);
+	unsigned int chan = rx_napi->chan;
+	struct xdp_frame *xdpf;
+	struct sk_buff *skb;
+	u32 act = XDP_PASS;
+
+	xdp->data_end = xdp->data + len;
+
+	if (prog)
+		act = bpf_prog_run_xdp(prog, xdp);
+
+	switch (act) {
+	case XDP_PASS:
+		/* UMEM frames belong to user space, copy them for the stack */
+		len = xdp->data_end - xdp->data;
+		skb = napi_alloc_skb(&rx_napi->napi, len);
+		if (unlikely(!skb))
+			goto err;
+
+		skb_copy_to_linear_data(skb, xdp->data, len);
+		skb_put(skb, len);
+		xsk_buff_free(xdp);
+		ether_xdp_account(pdata, chan, act);
+		return skb;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(pdata->ndev, xdp, prog) < 0)
+			goto err;
+		rx_napi->xdp_flags |= ETHER_XDP_REDIRECT;
+		ether_xdp_account(pdata, chan, act);
+		return NULL;
+	case XDP_TX:
+		/* Converting a zero-copy buffer copies it and frees the buffer */
+		xdpf = xdp_convert_buff_to_frame(xdp);
+		if (unlikely(!xdpf))
+			goto err;
+		if (ether_xdp_tx_frame(pdata, chan, xdpf, true) < 0) {
+			xdp_return_frame(xdpf);
+			ether_xdp_account(pdata, chan, XDP_ABORTED);
+			return NULL;
+		}
+		ether_xdp_account(pdata, chan, act);
+		return NULL;
+	default:
+		ether_xdp_exception(pdata, prog, act);
+		goto err;
+	case XDP_ABORTED:
+		ether_xdp_exception(pdata, prog, act);
+		goto err;
+	case XDP_DROP:
+		ether_xdp_account(pdata, chan, act);
+		xsk_buff_free(xdp);
+		return NULL;
+	}
+
+err:
+	ether_xdp_account(pdata, chan, XDP_ABORTED);
+	xsk_buff_free(xdp);
+	return NULL;
+}
+
+void ether_xdp_finalize(struct ether_rx_napi *rx_napi)
+{
+	if (rx_napi->xdp_flags & ETHER_XDP_REDIRECT)
+		xdp_do_flush();
+
+	rx_napi->xdp_flags = 0;
+}
+
+void ether_xdp_tx_complete(struct ether_priv_data *pdata, void *buf)
+{
+	unsigned long addr = (unsigned long)buf;
+	struct xsk_buff_pool *pool;
+	unsigned int chan;
+
+	switch (addr & ETHER_TX_BUF_TYPE_MASK) {
+	case ETHER_TX_BUF_XDP_XMIT:
+	case ETHER_TX_BUF_XDP_TX:
+		xdp_return_frame((struct xdp_frame *)
+				 (addr & ~ETHER_TX_BUF_TYPE_MASK));
+		break;
+	case ETHER_TX_BUF_XSK:
+		chan = addr >> ETHER_TX_BUF_XSK_CHAN_SHIFT;
+		pool = READ_ONCE(pdata->xsk_pool[chan]);
+		if (pool)
+			xsk_tx_completed(pool, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+bool ether_xsk_xmit(struct ether_priv_data *pdata, unsigned int chan,
+		    int budget)
+{
+	struct xsk_buff_pool *pool = READ_ONCE(pdata->xsk_pool[chan]);
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct osi_tx_ring *tx_ring = osi_dma->tx_ring[chan];
+	struct osi_tx_pkt_cx *tx_pkt_cx = &tx_ring->tx_pkt_cx;
+	struct osi_tx_swcx *tx_swcx;
+	struct netdev_queue *txq;
+	struct xdp_desc desc;
+	bool drained = true;
+	unsigned long val;
+	unsigned int sent = 0;
+	dma_addr_t dma;
+
+	if (!pool)
+		return true;
+
+	txq = netdev_get_tx_queue(pdata->ndev,
+				  ether_xdp_chan_to_qinx(pdata, chan));
+
+	__netif_tx_lock(txq, smp_processor_id());
+	while (budget-- > 0) {
+		if (ether_avail_txdesc_cnt(osi_dma, tx_ring) <=
+		    ETHER_TX_DESC_THRESHOLD) {
+			drained = false;
+			break;
+		}
+
+		tx_swcx = tx_ring->tx_swcx + tx_ring->cur_tx_idx;
+		if (unlikely(tx_swcx->len)) {
+			drained = false;
+			break;
+		}
+
+		if (!xsk_tx_peek_desc(pool, &desc))
+			break;
+
+		dma = xsk_buff_raw_get_dma(pool, desc.addr);
+		xsk_buff_raw_dma_sync_for_device(pool, dma, desc.len);
+
+		memset(tx_pkt_cx, 0, sizeof(*tx_pkt_cx));
+		tx_pkt_cx->flags |= OSI_PKT_CX_LEN;
+		tx_pkt_cx->payload_len = desc.len;
+		tx_pkt_cx->desc_cnt = 1;
+
+		tx_swcx->buf_phy_addr = dma;
+		tx_swcx->flags &= ~OSI_PKT_CX_PAGED_BUF;
+		tx_swcx->len = desc.len;
+		tx_swcx->buf_virt_addr = (void *)
+			(((unsigned long)chan << ETHER_TX_BUF_XSK_CHAN_SHIFT) |
+			 ETHER_TX_BUF_XSK);
+
+		if (unlikely(osi_hw_transmit(osi_dma, chan) < 0)) {
+			tx_swcx->buf_virt_addr = NULL;
+			tx_swcx->buf_phy_addr = 0;
+			tx_swcx->len = 0;
+			tx_swcx->flags = 0;
+			break;
+		}
+		sent++;
+	}
+	if (budget < 0)
+		drained = false;
+	__netif_tx_unlock(txq);
+
+	if (sent) {
+		xsk_tx_release(pool);
+		val = pdata->xstats.tx_xsk_n[chan];
+		pdata->xstats.tx_xsk_n[chan] =
+			osi_update_stats_counter(val, sent);
+	}
+
+	if (xsk_uses_need_wakeup(pool))
+		xsk_set_tx_need_wakeup(pool);
+
+	return drained;
+}
+
+int ether_xdp_xmit(struct net_device *ndev, int n,
+		   struct xdp_frame **frames, u32 flags)
+{
+	struct ether_priv_data *pdata = netdev_priv(ndev);
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct netdev_queue *txq;
+	unsigned int qinx, chan;
+	unsigned long val;
+	int i;
+
+	if (unlikely(!netif_running(ndev) || !netif_carrier_ok(ndev)))
+		return -ENETDOWN;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	qinx = smp_processor_id() % osi_dma->num_dma_chans;
+	chan = osi_dma->dma_chans[qinx];
+	txq = netdev_get_tx_queue(ndev, qinx);
+
+	__netif_tx_lock(txq, smp_processor_id());
+	for (i = 0; i < n; i++) {
+		if (ether_xdp_xmit_frame(pdata, chan, frames[i], true) < 0)
+			break;
+	}
+	__netif_tx_unlock(txq);
+
+	val = pdata->xstats.tx_xdp_xmit_n[chan];
+	pdata->xstats.tx_xdp_xmit_n[chan] =
+		osi_update_stats_counter(val, (unsigned long)i);
+
+	return i;
+}
+
+/**
+ * @brief Restart a running interface around a ring configuration change
+ *
+ * @param[in] ndev: Network device.
+ * @param[in] stop: Stop the interface when true, start it otherwise.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+static int ether_xdp_restart(struct net_device *ndev, bool stop)
+{
+	if (!netif_running(ndev))
+		return 0;
+
+	if (stop)
+		return ndev->netdev_ops->ndo_stop(ndev);
+
+	return ndev->netdev_ops->ndo_open(ndev);
+}
+
+/**
+ * @brief Attach or detach the XDP program
+ *
+ * Algorithm: The page pool maps pages bidirectionally only while a program
+ * is attached, so the interface is restarted when XDP gets enabled or
+ * disabled. Replacing one program with another is done in place.
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] prog: New XDP program or NULL.
+ * @param[in] extack: Netlink extended ack.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+static int ether_xdp_setup_prog(struct ether_priv_data *pdata,
+				struct bpf_prog *prog,
+				struct netlink_ext_ack *extack)
+{
+	struct net_device *ndev = pdata->ndev;
+	bool need_restart = !!pdata->xdp_prog != !!prog;
+	struct bpf_prog *old_prog;
+	int ret = 0;
+
+	if (prog && ndev->mtu > ETHER_XDP_MAX_MTU) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large for XDP");
+		return -EOPNOTSUPP;
+	}
+
+	if (need_restart) {
+		ret = ether_xdp_restart(ndev, true);
+		if (ret < 0)
+			return ret;
+	}
+
+	old_prog = xchg(&pdata->xdp_prog, prog);
+
+	if (need_restart) {
+		ret = ether_xdp_restart(ndev, false);
+		if (ret < 0) {
+			/* The core drops its reference to the new program */
+			xchg(&pdata->xdp_prog, old_prog);
+			if (ether_xdp_restart(ndev, false) < 0)
+				netdev_err(ndev, "failed to restart after XDP setup\n");
+			return ret;
+		}
+	}
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+/**
+ * @brief Bind or unbind an AF_XDP buffer pool to a queue
+ *
+ * Algorithm:
+ * 1) Map the UMEM for the device on bind.
+ * 2) Restart the interface so that the Rx ring of the channel gets refilled
+ * from the pool, or from the page pool again on unbind.
+ *
+ * @param[in] pdata: OSD private data.
+ * @param[in] pool: Buffer pool or NULL to unbind.
+ * @param[in] queue_id: Queue index, which selects the DMA channel.
+ *
+ * @retval 0 on success
+ * @retval negative value on failure.
+ */
+static int ether_xsk_pool_setup(struct ether_priv_data *pdata,
+				struct xsk_buff_pool *pool, u16 queue_id)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct net_device *ndev = pdata->ndev;
+	struct xsk_buff_pool *old_pool;
+	unsigned int chan;
+	int ret;
+
+	if (queue_id >= osi_dma->num_dma_chans)
+		return -EINVAL;
+
+	chan = osi_dma->dma_chans[queue_id];
+	old_pool = pdata->xsk_pool[chan];
+
+	if (pool) {
+		if (old_pool)
+			return -EBUSY;
+
+		if (osi_dma->rx_buf_len > xsk_pool_get_rx_frame_size(pool)) {
+			netdev_err(ndev, "AF_XDP frame size %u below Rx buffer length %u\n",
+				   xsk_pool_get_rx_frame_size(pool),
+				   osi_dma->rx_buf_len);
+			return -EINVAL;
+		}
+
+		ret = xsk_pool_dma_map(pool, pdata->dev, 0);
+		if (ret < 0)
+			return ret;
+	} else if (!old_pool) {
+		return -EINVAL;
+	}
+
+	ret = ether_xdp_restart(ndev, true);
+	if (ret < 0)
+		goto unmap;
+
+	WRITE_ONCE(pdata->xsk_pool[chan], pool);
+	ret = ether_xdp_restart(ndev, false);
+	if (ret < 0) {
+		/* The xsk core frees a pool that failed to bind */
+		WRITE_ONCE(pdata->xsk_pool[chan], old_pool);
+		if (ether_xdp_restart(ndev, false) < 0)
+			netdev_err(ndev, "failed to restart after AF_XDP setup\n");
+		goto unmap;
+	}
+
+	if (!pool)
+		xsk_pool_dma_unmap(old_pool, 0);
+
+	return 0;
+
+unmap:
+	if (pool)
+		xsk_pool_dma_unmap(pool, 0);
+
+	return ret;
+}
+
+int ether_xdp_bpf(struct net_device *ndev, struct netdev_bpf *bpf)
+{
+	struct ether_priv_data *pdata = netdev_priv(ndev);
+
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return ether_xdp_setup_prog(pdata, bpf->prog, bpf->extack);
+	case XDP_SETUP_XSK_POOL:
+		return ether_xsk_pool_setup(pdata, bpf->xsk.pool,
+					    bpf->xsk.queue_id);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+int ether_xsk_wakeup(struct net_device *ndev, u32 queue_id, u32 flags)
+{
+	struct ether_priv_data *pdata = netdev_priv(ndev);
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct napi_struct *napi;
+	unsigned int chan;
+
+	if (!netif_running(ndev) || !netif_carrier_ok(ndev))
+		return -ENETDOWN;
+
+	if (queue_id >= osi_dma->num_dma_chans)
+		return -EINVAL;
+
+	chan = osi_dma->dma_chans[queue_id];
+	if (!READ_ONCE(pdata->xsk_pool[chan]))
+		return -ENXIO;
+
+	if (flags & XDP_WAKEUP_RX) {
+		napi = &pdata->rx_napi[chan]->napi;
+		if (!napi_if_scheduled_mark_missed(napi))
+			napi_schedule(napi);
+	}
+
+	if (flags & XDP_WAKEUP_TX) {
+		napi = &pdata->tx_napi[chan]->napi;
+		if (!napi_if_scheduled_mark_missed(napi))
+			napi_schedule(napi);
+	}
+
+	return 0;
+}
+
+int ether_xdp_rxq_init(struct ether_priv_data *pdata, unsigned int chan)
+{
+	struct xsk_buff_pool *pool = pdata->xsk_pool[chan];
+	struct xdp_rxq_info *rxq = &pdata->xdp_rxq[chan];
+	int ret;
+
+	ret = xdp_rxq_info_reg(rxq, pdata->ndev, chan,
+			       pdata->rx_napi[chan]->napi.napi_id);
+	if (ret < 0)
+		return ret;
+
+	if (pool) {
+		ret = xdp_rxq_info_reg_mem_model(rxq, MEM_TYPE_XSK_BUFF_POOL,
+						 NULL);
+		if (ret == 0)
+			xsk_pool_set_rxq_info(pool, rxq);
+	} else {
+		ret = xdp_rxq_info_reg_mem_model(rxq, MEM_TYPE_PAGE_POOL,
+						 pdata->page_pool);
+	}
+
+	if (ret < 0)
+		xdp_rxq_info_unreg(rxq);
+
+	return ret;
+}
+
+void ether_xdp_rxq_deinit(struct ether_priv_data *pdata, unsigned int chan)
+{
+	if (xdp_rxq_info_is_reg(&pdata->xdp_rxq[chan]))
+		xdp_rxq_info_unreg(&pdata->xdp_rxq[chan]);
+}
+
+int ether_xdp_test_xmit(struct ether_priv_data *pdata, struct sk_buff *skb)
+{
+	struct osi_dma_priv_data *osi_dma = pdata->osi_dma;
+	struct xdp_rxq_info rxq = { };
+	struct xdp_frame *xdpf;
+	struct xdp_buff xdp;
+	struct page *page;
+	int ret;
+
+	if (skb->len > PAGE_SIZE - XDP_PACKET_HEADROOM -
+		       SKB_DATA_ALIGN(sizeof(struct skb_shared_info))) {
+		ret = -EINVAL;
+		goto free_skb;
+	}
+
+	page = dev_alloc_page();
+	if (!page) {
+		ret = -ENOMEM;
+		goto free_skb;
+	}
+
+	/* Frame memory goes back to the page allocator on Tx completion */
+	rxq.dev = pdata->ndev;
+	rxq.mem.type = MEM_TYPE_PAGE_ORDER0;
+	xdp_init_buff(&xdp, PAGE_SIZE, &rxq);
+	xdp_prepare_buff(&xdp, page_address(page), XDP_PACKET_HEADROOM,
+			 skb->len, false);
+	skb_copy_bits(skb, 0, xdp.data, skb->len);
+
+	xdpf = xdp_convert_buff_to_frame(&xdp);
+	if (!xdpf) {
+		put_page(page);
+		ret = -ENOMEM;
+		goto free_skb;
+	}
+
+	ret = ether_xdp_tx_frame(pdata, osi_dma->dma_chans[0], xdpf, true);
+	if (ret < 0)
+		xdp_return_frame(xdpf);
+
+free_skb:
+	dev_kfree_skb_any(skb);
+	return ret;
+}
+
+/**
+ * @brief Build an XDP program which returns a fixed action
+ *
+ * Algorithm: The program only loads the action into R0, so it needs
+ * neither the verifier nor any helper call.
+ *
+ * @param[in] act: XDP action to return.
+ *
+ * @returns BPF program or ERR_PTR() on failure.
+ */
+static struct bpf_prog *ether_xdp_test_prog_alloc(u32 act)
+{
+	struct bpf_insn insns[] = {
+		BPF_MOV64_IMM(BPF_REG_0, act),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_prog *prog;
+	int err = 0;
+
+	prog = bpf_prog_alloc(bpf_prog_size(ARRAY_SIZE(insns)), 0);
+	if (!prog)
+		return ERR_PTR(-ENOMEM);
+
+	prog->len = ARRAY_SIZE(insns);
+	prog->type = BPF_PROG_TYPE_XDP;
+	memcpy(prog->insnsi, insns, sizeof(insns));
+
+	prog = bpf_prog_select_runtime(prog, &err);
+	if (err < 0) {
+		bpf_prog_free(prog);
+		return ERR_PTR(err);
+	}
+
+	return prog;
+}
+
+int ether_xdp_test_verdict(struct ether_priv_data *pdata, int act)
+{
+	struct bpf_prog *prog = NULL, *old_prog;
+	bool need_restart;
+	int ret;
+
+	if (act >= 0) {
+		prog = ether_xdp_test_prog_alloc(act);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	need_restart = !!pdata->xdp_prog != !!prog;
+	if (need_restart) {
+		ret = ether_xdp_restart(pdata->ndev, true);
+		if (ret < 0) {
+			if (prog)
+				bpf_prog_free(prog);
+			return ret;
+		}
+	}
+
+	/* Test programs are not reference counted, free once unused */
+	old_prog = xchg(&pdata->xdp_prog, prog);
+	if (old_prog) {
+		synchronize_net();
+		bpf_prog_free(old_prog);
+	}
+
+	if (need_restart)
+		return ether_xdp_restart(pdata->ndev, false);
+
+	return 0;
+}
+#endif /* ETHER_XDP */
@@ -34,6 +34,7 @@ bool nvmap_convert_iovmm_to_carveout;
 
 u32 nvmap_max_handle_count;
 u64 nvmap_big_page_allocs;
+u64 nvmap_huge_page_allocs;
 u64 nvmap_total_page_allocs;
 
 /* handles may be arbitrarily large (16+MiB), and any handle allocated from
@@ -475,7 +476,8 @@ static int alloc_colored(u32 nr_pages,
 }
 
 static int handle_page_alloc(struct nvmap_client *client,
-			     struct nvmap_handle *h, bool contiguous)
+			     struct nvmap_handle *h, bool contiguous,
+			     struct nvmap_page_reserve *rsv)
 {
 	size_t size = h->size;
 	size_t nr_page = size >> PAGE_SHIFT;
@@ -483,6 +485,7 @@ static int handle_page_alloc(struct nvmap_client *client,
 	struct page **pages;
 	gfp_t gfp = GFP_NVMAP | __GFP_ZERO;
 #ifdef CONFIG_ARM64_4K_PAGES
+	int bp_start;
 #ifdef NVMAP_CONFIG_PAGE_POOLS
 	int pages_per_big_pg = NVMAP_PP_BIG_PAGE_SIZE >> PAGE_SHIFT;
 #else
@@ -521,11 +524,46 @@ static int handle_page_alloc(struct nvmap_client *client,
 			pages[i] = nth_page(page, i);
 
 	} else {
+		/* Use pages set aside for a batch allocation first */
+		if (rsv) {
+			page_index = min_t(size_t, nr_page, rsv->nr - rsv->next);
+			memcpy(pages, &rsv->pages[rsv->next],
+			       page_index * sizeof(*pages));
+			rsv->next += page_index;
+		}
 #ifdef CONFIG_ARM64_4K_PAGES
+		/*
+		 * PMD sized chunks first, so that the fault handler can map
+		 * each of them in one go.
+		 */
+		if ((h->userflags & NVMAP_HANDLE_HUGE_PAGES) && !page_index) {
+			int pages_per_huge_pg = PMD_SIZE >> PAGE_SHIFT;
+			gfp_t gfp_no_reclaim = (gfp | __GFP_NOMEMALLOC |
+					__GFP_NOWARN) & ~__GFP_RECLAIM;
+
+			for (i = 0; nr_page - i >= pages_per_huge_pg;
+			     i += pages_per_huge_pg) {
+				struct page *page;
+				int idx;
+
+				page = nvmap_alloc_pages_exact(gfp_no_reclaim,
+						PMD_SIZE, true, h->numa_id);
+				if (!page)
+					break;
+
+				for (idx = 0; idx < pages_per_huge_pg; idx++)
+					pages[i + idx] = nth_page(page, idx);
+				nvmap_clean_cache(&pages[i], pages_per_huge_pg);
+			}
+			page_index = i;
+			nvmap_huge_page_allocs += i;
+		}
+		bp_start = page_index;
 #ifdef NVMAP_CONFIG_PAGE_POOLS
 		/* Get as many big pages from the pool as possible. */
-		page_index = nvmap_page_pool_alloc_lots_bp(&nvmap_dev->pool, pages,
-							nr_page, true, h->numa_id);
+		page_index += nvmap_page_pool_alloc_lots_bp(&nvmap_dev->pool,
+					&pages[page_index], nr_page - page_index,
+					true, h->numa_id);
 		pages_per_big_pg = nvmap_dev->pool.pages_per_big_pg;
 #endif
 		/* Try to allocate big pages from page allocator */
@@ -549,7 +587,7 @@ static int handle_page_alloc(struct nvmap_client *client,
 				pages[i + idx] = nth_page(page, idx);
 			nvmap_clean_cache(&pages[i], pages_per_big_pg);
 		}
-		nvmap_big_page_allocs += page_index;
+		nvmap_big_page_allocs += page_index - bp_start;
 #endif /* CONFIG_ARM64_4K_PAGES */
 		if (s_nr_colors <= 1) {
 #ifdef NVMAP_CONFIG_PAGE_POOLS
@@ -678,7 +716,8 @@ static bool nvmap_cpu_map_is_allowed(struct nvmap_handle *handle)
 }
 
 static void alloc_handle(struct nvmap_client *client,
-			 struct nvmap_handle *h, unsigned int type)
+			 struct nvmap_handle *h, unsigned int type,
+			 struct nvmap_page_reserve *rsv)
 {
 	unsigned int carveout_mask = NVMAP_HEAP_CARVEOUT_MASK;
 	unsigned int iovmm_mask = NVMAP_HEAP_IOVMM;
@@ -772,7 +811,7 @@ static void alloc_handle(struct nvmap_client *client,
 		h->alloc = true;
 	} else if (type & iovmm_mask) {
 		ret = handle_page_alloc(client, h,
-			h->userflags & NVMAP_HANDLE_PHYS_CONTIG);
+			h->userflags & NVMAP_HANDLE_PHYS_CONTIG, rsv);
 		if (ret)
 			return;
 		h->heap_type = NVMAP_HEAP_IOVMM;
@@ -843,12 +882,100 @@ static const unsigned int heap_policy_excl[] = {
 	0,
 };
 
+/*
+ * Take the pages for count allocations of size bytes out of the page pool
+ * in one go. Only done for plain IOVMM allocations, which is the only
+ * path that consumes the reserve. Returns NULL if nothing could be
+ * reserved; the allocations then go through the regular path.
+ */
+struct nvmap_page_reserve *nvmap_page_reserve_get(size_t size, u32 count,
+						  unsigned int heap_mask,
+						  unsigned int flags,
+						  int numa_id)
+{
+#ifdef NVMAP_CONFIG_PAGE_POOLS
+	struct nvmap_page_reserve *rsv;
+	size_t nr_page = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	size_t total = nr_page * count;
+	u32 got = 0;
+
+	if (heap_mask != NVMAP_HEAP_IOVMM ||
+	    (flags & (NVMAP_HANDLE_PHYS_CONTIG | NVMAP_HANDLE_HUGE_PAGES)) ||
+	    nvmap_convert_iovmm_to_carveout || s_nr_colors > 1 ||
+	    !total || total > U32_MAX)
+		return NULL;
+
+	rsv = kzalloc(sizeof(*rsv), GFP_KERNEL);
+	if (!rsv)
+		return NULL;
+
+	rsv->pages = nvmap_altalloc(total * sizeof(*rsv->pages));
+	if (!rsv->pages) {
+		kfree(rsv);
+		return NULL;
+	}
+
+#ifdef CONFIG_ARM64_4K_PAGES
+	/* Big pages only if they can't straddle two handles */
+	if (nvmap_dev->pool.pages_per_big_pg > 1 &&
+	    !(nr_page % nvmap_dev->pool.pages_per_big_pg))
+		got = nvmap_page_pool_alloc_lots_bp(&nvmap_dev->pool,
+					rsv->pages, total, true, numa_id);
+#endif /* CONFIG_ARM64_4K_PAGES */
+	got += nvmap_page_pool_alloc_lots(&nvmap_dev->pool, &rsv->pages[got],
+					  total - got, true, numa_id);
+	if (!got) {
+		nvmap_altfree(rsv->pages, total * sizeof(*rsv->pages));
+		kfree(rsv);
+		return NULL;
+	}
+
+	rsv->nr = got;
+	rsv->size = total;
+	return rsv;
+#else
+	return NULL;
+#endif /* NVMAP_CONFIG_PAGE_POOLS */
+}
+
+/* Give back whatever a batch allocation did not consume. */
+void nvmap_page_reserve_put(struct nvmap_page_reserve *rsv)
+{
+	u32 i = 0;
+
+	if (!rsv)
+		return;
+
+#ifdef NVMAP_CONFIG_PAGE_POOLS
+	if (rsv->next < rsv->nr)
+		i = nvmap_page_pool_fill_lots(&nvmap_dev->pool,
+				&rsv->pages[rsv->next], rsv->nr - rsv->next);
+#endif /* NVMAP_CONFIG_PAGE_POOLS */
+	for (i += rsv->next; i < rsv->nr; i++)
+		__free_page(rsv->pages[i]);
+
+	nvmap_altfree(rsv->pages, rsv->size * sizeof(*rsv->pages));
+	kfree(rsv);
+}
+
 int nvmap_alloc_handle(struct nvmap_client *client,
 		       struct nvmap_handle *h, unsigned int heap_mask,
 		       size_t align,
 		       u8 kind,
 		       unsigned int flags,
 		       unsigned int peer)
+{
+	return nvmap_alloc_handle_reserved(client, h, heap_mask, align, kind,
+					   flags, peer, NULL);
+}
+
+int nvmap_alloc_handle_reserved(struct nvmap_client *client,
+				struct nvmap_handle *h, unsigned int heap_mask,
+				size_t align,
+				u8 kind,
+				unsigned int flags,
+				unsigned int peer,
+				struct nvmap_page_reserve *rsv)
 {
 	const unsigned int *alloc_policy;
 	size_t nr_page;
@@ -937,7 +1064,7 @@ int nvmap_alloc_handle(struct nvmap_client *client,
 			/* iterate possible heaps MSB-to-LSB, since higher-
 			 * priority carveouts will have higher usage masks */
 			heap = 1 << __fls(heap_type);
-			alloc_handle(client, h, heap);
+			alloc_handle(client, h, heap, rsv);
 			heap_type &= ~heap;
 		}
 	}
@@ -1092,7 +1219,8 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 out:
 	NVMAP_TAG_TRACE(trace_nvmap_destroy_handle,
 		NULL, get_current()->pid, 0, NVMAP_TP_ARGS_H(h));
-	kfree(h);
+	/* nvmap_validate_get() may still be looking at h under RCU */
+	kfree_rcu(h, rcu);
 }
 
 void nvmap_free_handle(struct nvmap_client *client,
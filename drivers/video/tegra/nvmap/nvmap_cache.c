@@ -7,7 +7,13 @@
 
 #include <linux/io.h>
 #include <linux/debugfs.h>
+#include <linux/highmem.h>
+#include <linux/moduleparam.h>
 #include <linux/of.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
 #include <linux/version.h>
 #if KERNEL_VERSION(4, 15, 0) > LINUX_VERSION_CODE
 #include <soc/tegra/chip-id.h>
@@ -327,6 +333,204 @@ out:
 	return err;
 }
 
+/*
+ * Cache maintenance planner for the list operation.
+ *
+ * Ranges of page backed handles are translated into physical extents,
+ * sorted and merged across all handles of the batch, and maintained
+ * through the kernel linear map one extent at a time. Pool pages are
+ * mostly handed out in PFN order, so this usually turns a batch of many
+ * page sized operations into a handful of large ones. Pages outside the
+ * linear map are maintained right away through the physical range path.
+ */
+#define NVMAP_CM_PLAN_MIN_EXTENTS	64
+
+struct nvmap_cm_extent {
+	phys_addr_t start;
+	phys_addr_t end;
+};
+
+struct nvmap_cm_plan {
+	struct nvmap_cm_extent *ext;
+	u32 nr;
+	u32 max;
+	u64 nr_in;	/* Extents before merging */
+	u64 bytes;
+};
+
+static bool defer_cache_wb;
+module_param(defer_cache_wb, bool, 0644);
+MODULE_PARM_DESC(defer_cache_wb,
+	"Postpone cache list write backs of page backed handles to the next device map");
+
+static struct {
+	atomic64_t planned;	/* Batches maintained by extent */
+	atomic64_t extents_in;
+	atomic64_t extents_out;
+	atomic64_t bytes;
+	atomic64_t deferred;	/* Write backs postponed */
+	atomic64_t deferred_done;	/* Postponed write backs done at map */
+} cm_stats;
+
+static int nvmap_cm_plan_add(struct nvmap_cm_plan *plan,
+			     phys_addr_t start, phys_addr_t end)
+{
+	struct nvmap_cm_extent *ext;
+	u32 max;
+
+	plan->nr_in++;
+	plan->bytes += end - start;
+
+	/* Cheap merge of ranges that are already in order */
+	if (plan->nr && plan->ext[plan->nr - 1].end == start) {
+		plan->ext[plan->nr - 1].end = end;
+		return 0;
+	}
+
+	if (plan->nr == plan->max) {
+		max = plan->max ? plan->max * 2 : NVMAP_CM_PLAN_MIN_EXTENTS;
+		ext = nvmap_altalloc(max * sizeof(*ext));
+		if (!ext)
+			return -ENOMEM;
+		if (plan->ext) {
+			memcpy(ext, plan->ext, plan->nr * sizeof(*ext));
+			nvmap_altfree(plan->ext, plan->max * sizeof(*ext));
+		}
+		plan->ext = ext;
+		plan->max = max;
+	}
+
+	plan->ext[plan->nr].start = start;
+	plan->ext[plan->nr].end = end;
+	plan->nr++;
+	return 0;
+}
+
+static void nvmap_cm_plan_free(struct nvmap_cm_plan *plan)
+{
+	if (plan->ext)
+		nvmap_altfree(plan->ext, plan->max * sizeof(*plan->ext));
+	plan->ext = NULL;
+	plan->nr = plan->max = 0;
+}
+
+/* Add byte range [start, end) of a page array to the plan */
+static int nvmap_cm_plan_pages(struct nvmap_cm_plan *plan, struct page **pages,
+			       unsigned int op, u64 start, u64 end)
+{
+	int err;
+
+	while (start < end) {
+		struct page *page = nvmap_to_page(pages[start >> PAGE_SHIFT]);
+		u64 next = min_t(u64, (start + PAGE_SIZE) & PAGE_MASK, end);
+		phys_addr_t paddr = page_to_phys(page) + (start & ~PAGE_MASK);
+
+		if (PageHighMem(page) || !virt_addr_valid(phys_to_virt(paddr))) {
+			/* Not in the linear map, do it right away */
+			err = nvmap_cache_maint_phys_range(op, paddr,
+					paddr + next - start, true, false);
+		} else {
+			err = nvmap_cm_plan_add(plan, paddr,
+					paddr + next - start);
+		}
+		if (err)
+			return err;
+		start = next;
+	}
+	return 0;
+}
+
+static int nvmap_cm_extent_cmp(const void *a, const void *b)
+{
+	const struct nvmap_cm_extent *x = a, *y = b;
+
+	if (x->start < y->start)
+		return -1;
+	return x->start > y->start;
+}
+
+/* Sort the extents and merge the ones that touch or overlap */
+static void nvmap_cm_plan_merge(struct nvmap_cm_plan *plan)
+{
+	u32 i, n = 0;
+
+	if (plan->nr < 2)
+		return;
+
+	sort(plan->ext, plan->nr, sizeof(*plan->ext),
+	     nvmap_cm_extent_cmp, NULL);
+
+	for (i = 1; i < plan->nr; i++) {
+		if (plan->ext[i].start <= plan->ext[n].end) {
+			plan->ext[n].end = max(plan->ext[n].end,
+					       plan->ext[i].end);
+			continue;
+		}
+		plan->ext[++n] = plan->ext[i];
+	}
+	plan->nr = n + 1;
+}
+
+/* Only extents of linear mapped pages make it into the plan */
+static void nvmap_cm_plan_exec(struct nvmap_cm_plan *plan, unsigned int op)
+{
+	u32 i;
+
+	for (i = 0; i < plan->nr; i++)
+		inner_cache_maint(op, phys_to_virt(plan->ext[i].start),
+				  plan->ext[i].end - plan->ext[i].start);
+}
+
+/*
+ * Add a handle range to the plan. Carveout handles are physically
+ * contiguous already and may not be in the linear map, so they keep
+ * using the per handle path.
+ */
+static int nvmap_cm_plan_handle(struct nvmap_cm_plan *plan,
+				struct nvmap_handle *h, unsigned int op,
+				u64 start, u64 end)
+{
+	int err;
+
+	if (!h->heap_pgalloc)
+		return __nvmap_do_cache_maint(h->owner, h, start, end, op,
+					      false);
+
+	if (!h->alloc || start >= h->size || end > h->size)
+		return -EFAULT;
+
+	if (!(h->heap_type & nvmap_dev->cpu_access_mask))
+		return -EPERM;
+
+	if (h->flags == NVMAP_HANDLE_UNCACHEABLE ||
+	    h->flags == NVMAP_HANDLE_WRITE_COMBINE || start == end)
+		return 0;
+
+	/* Don't perform cache maint for RO mapped buffers */
+	if (h->from_va && h->is_ro)
+		return 0;
+
+	if (op == NVMAP_CACHE_OP_WB && READ_ONCE(defer_cache_wb) &&
+	    !(h->userflags & NVMAP_HANDLE_CACHE_SYNC)) {
+		atomic_set(&h->wb_deferred, 1);
+		atomic64_inc(&cm_stats.deferred);
+		return 0;
+	}
+
+	if (h->userflags & NVMAP_HANDLE_CACHE_SYNC) {
+		nvmap_handle_mkclean(h, start, end - start);
+		nvmap_zap_handle(h, start, end - start);
+	}
+
+	trace_nvmap_cache_maint(h->owner, h, start, end, op, end - start);
+	err = nvmap_cm_plan_pages(plan, h->pgalloc.pages, op, start, end);
+
+	/* A whole handle WB_INV covers any write back left pending */
+	if (!err && !start && end == h->size)
+		atomic_set(&h->wb_deferred, 0);
+	return err;
+}
+
 /*
  * Perform cache op on the list of memory regions within passed handles.
  * A memory region within handle[i] is identified by offsets[i], sizes[i]
@@ -335,9 +539,8 @@ out:
  * this is done by replacing offsets[i] = 0, sizes[i] = handles[i]->size.
  * So, the input arrays sizes, offsets  are not guaranteed to be read-only
  *
- * This will optimze the op if it can.
- * In the case that all the handles together are larger than the inner cache
- * maint threshold it is possible to just do an entire inner cache flush.
+ * This will optimze the op if it can: the ranges are merged by the planner
+ * above.
  *
  * NOTE: this omits outer cache operations which is fine for ARM64
  */
@@ -345,9 +548,10 @@ static int __nvmap_do_cache_maint_list(struct nvmap_handle **handles,
 				u64 *offsets, u64 *sizes, int op, u32 nr_ops,
 				bool is_32)
 {
+	struct nvmap_cm_plan plan = {0};
 	u32 i;
 	u64 total = 0;
-	u64 thresh = ~0;
+	int err = 0;
 
 	WARN(!IS_ENABLED(CONFIG_ARM64),
 		"cache list operation may not function properly");
@@ -371,49 +575,259 @@ static int __nvmap_do_cache_maint_list(struct nvmap_handle **handles,
 	if (!total)
 		return 0;
 
-	/* Full flush in the case the passed list is bigger than our
-	 * threshold. */
-	if (total >= thresh) {
-		for (i = 0; i < nr_ops; i++) {
-			if (handles[i]->userflags &
-			    NVMAP_HANDLE_CACHE_SYNC) {
-				nvmap_handle_mkclean(handles[i], 0,
-						     handles[i]->size);
-				nvmap_zap_handle(handles[i], 0,
-						 handles[i]->size);
-			}
+	/* Same op mapping as __nvmap_do_cache_maint() */
+	if (op == NVMAP_CACHE_OP_INV)
+		op = NVMAP_CACHE_OP_WB_INV;
+
+	for (i = 0; i < nr_ops; i++) {
+		u32 *offs_32 = (u32 *)offsets, *sizes_32 = (u32 *)sizes;
+		u64 size = is_32 ? sizes_32[i] : sizes[i];
+		u64 offset = is_32 ? offs_32[i] : offsets[i];
+
+		size = size ?: handles[i]->size;
+		offset = offset ?: 0;
+		err = nvmap_cm_plan_handle(&plan, handles[i], op, offset,
+					   offset + size);
+		if (err) {
+			pr_err("cache maint per handle failed [%d]\n", err);
+			goto out;
 		}
+	}
+
+	nvmap_cm_plan_merge(&plan);
+	nvmap_cm_plan_exec(&plan, op);
+
+	atomic64_inc(&cm_stats.planned);
+	atomic64_add(plan.nr_in, &cm_stats.extents_in);
+	atomic64_add(plan.nr, &cm_stats.extents_out);
+	atomic64_add(plan.bytes, &cm_stats.bytes);
+	nvmap_stats_inc(NS_CFLUSH_RQ, plan.bytes);
+	nvmap_stats_inc(NS_CFLUSH_DONE, plan.bytes);
+	trace_nvmap_cache_flush(plan.bytes,
+				nvmap_stats_read(NS_ALLOC),
+				nvmap_stats_read(NS_CFLUSH_RQ),
+				nvmap_stats_read(NS_CFLUSH_DONE));
+out:
+	nvmap_cm_plan_free(&plan);
+	return err;
+}
 
-		nvmap_stats_inc(NS_CFLUSH_RQ, total);
-		nvmap_stats_inc(NS_CFLUSH_DONE, thresh);
-		trace_nvmap_cache_flush(total,
-					nvmap_stats_read(NS_ALLOC),
-					nvmap_stats_read(NS_CFLUSH_RQ),
-					nvmap_stats_read(NS_CFLUSH_DONE));
-	} else {
-		for (i = 0; i < nr_ops; i++) {
-			u32 *offs_32 = (u32 *)offsets, *sizes_32 = (u32 *)sizes;
-			u64 size = is_32 ? sizes_32[i] : sizes[i];
-			u64 offset = is_32 ? offs_32[i] : offsets[i];
-			int err;
-
-			size = size ?: handles[i]->size;
-			offset = offset ?: 0;
-			err = __nvmap_do_cache_maint(handles[i]->owner,
-						     handles[i], offset,
-						     offset + size,
-						     op, false);
-			if (err) {
-				pr_err("cache maint per handle failed [%d]\n",
-						err);
-				return err;
+/*
+ * Called before a handle is mapped to a device. Does the write back that
+ * the cache list operation postponed, if any.
+ */
+void nvmap_cache_maint_flush_deferred(struct nvmap_handle *h)
+{
+	if (!atomic_read(&h->wb_deferred) || !atomic_xchg(&h->wb_deferred, 0))
+		return;
+
+	atomic64_inc(&cm_stats.deferred_done);
+	__nvmap_do_cache_maint(NULL, h, 0, h->size, NVMAP_CACHE_OP_WB, false);
+}
+
+/* Time maintenance of nr_pages scattered pages by each strategy */
+enum {
+	NVMAP_CM_BENCH_PAGE,	/* ioremap per page, the fallback path */
+	NVMAP_CM_BENCH_VMAP,	/* vmap per range, the per handle path */
+	NVMAP_CM_BENCH_PLAN,	/* merged extents through the linear map */
+	NVMAP_CM_BENCH_NR,
+};
+
+static u64 nvmap_cm_bench_one(int strategy, struct page **pages,
+			      u32 nr_ranges, u32 range_pages, u32 *nr_ext)
+{
+	struct nvmap_cm_plan plan = {0};
+	u64 start, ns;
+	u32 i, j;
+	void *va;
+
+	/* Dirty the lines so that every strategy has the same work */
+	for (i = 0; i < nr_ranges * range_pages; i++)
+		memset(page_address(pages[i]), i, PAGE_SIZE);
+
+	start = sched_clock();
+	switch (strategy) {
+	case NVMAP_CM_BENCH_PAGE:
+		for (i = 0; i < nr_ranges * range_pages; i++)
+			nvmap_cache_maint_phys_range(NVMAP_CACHE_OP_WB,
+				page_to_phys(pages[i]),
+				page_to_phys(pages[i]) + PAGE_SIZE, true, false);
+		break;
+	case NVMAP_CM_BENCH_VMAP:
+		for (i = 0; i < nr_ranges; i++) {
+			va = vmap(&pages[i * range_pages], range_pages,
+				  VM_MAP, PAGE_KERNEL);
+			if (!va)
+				return 0;
+			inner_cache_maint(NVMAP_CACHE_OP_WB, va,
+					  range_pages << PAGE_SHIFT);
+			vunmap(va);
+		}
+		break;
+	case NVMAP_CM_BENCH_PLAN:
+		for (i = 0; i < nr_ranges; i++) {
+			j = i * range_pages;
+			if (nvmap_cm_plan_pages(&plan, &pages[j],
+					NVMAP_CACHE_OP_WB, 0,
+					(u64)range_pages << PAGE_SHIFT)) {
+				nvmap_cm_plan_free(&plan);
+				return 0;
 			}
 		}
+		nvmap_cm_plan_merge(&plan);
+		nvmap_cm_plan_exec(&plan, NVMAP_CACHE_OP_WB);
+		*nr_ext = plan.nr;
+		break;
 	}
+	ns = sched_clock() - start;
 
+	nvmap_cm_plan_free(&plan);
+	return ns;
+}
+
+#ifdef CONFIG_DEBUG_FS
+#define NVMAP_CM_BENCH_MAX_PAGES	(SZ_64M >> PAGE_SHIFT)
+
+static DEFINE_MUTEX(cm_bench_lock);
+static u32 cm_bench_ranges, cm_bench_range_pages, cm_bench_extents;
+static u64 cm_bench_ns[NVMAP_CM_BENCH_NR];
+
+/* Write "<nr_ranges> <pages_per_range>" to run the benchmark */
+static ssize_t nvmap_cm_bench_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct page **pages;
+	char str[32];
+	u32 nr_ranges, range_pages, nr, i;
+	ssize_t ret = count;
+	int s;
+
+	if (count >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buf, count))
+		return -EFAULT;
+	str[count] = '\0';
+
+	if (sscanf(str, "%u %u", &nr_ranges, &range_pages) != 2 ||
+	    !nr_ranges || !range_pages ||
+	    nr_ranges > NVMAP_CM_BENCH_MAX_PAGES / range_pages)
+		return -EINVAL;
+
+	nr = nr_ranges * range_pages;
+	pages = nvmap_altalloc(nr * sizeof(*pages));
+	if (!pages)
+		return -ENOMEM;
+
+	/* Single pages, the way the page pool hands them out */
+	for (i = 0; i < nr; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto free_pages;
+		}
+	}
+
+	mutex_lock(&cm_bench_lock);
+	cm_bench_ranges = nr_ranges;
+	cm_bench_range_pages = range_pages;
+	cm_bench_extents = 0;
+	for (s = 0; s < NVMAP_CM_BENCH_NR; s++) {
+		cm_bench_ns[s] = nvmap_cm_bench_one(s, pages, nr_ranges,
+						    range_pages,
+						    &cm_bench_extents);
+	}
+	mutex_unlock(&cm_bench_lock);
+
+free_pages:
+	while (i--)
+		__free_page(pages[i]);
+	nvmap_altfree(pages, nr * sizeof(*pages));
+	return ret;
+}
+
+static int nvmap_cm_bench_show(struct seq_file *s, void *unused)
+{
+	static const char * const names[] = { "page", "vmap", "plan" };
+	u64 bytes;
+	int i;
+
+	mutex_lock(&cm_bench_lock);
+	bytes = ((u64)cm_bench_ranges * cm_bench_range_pages) << PAGE_SHIFT;
+	seq_printf(s, "ranges: %u pages/range: %u merged extents: %u\n",
+		   cm_bench_ranges, cm_bench_range_pages, cm_bench_extents);
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		u64 ns = cm_bench_ns[i];
+
+		if (!ns) {
+			seq_printf(s, "%-6s %12s\n", names[i], "n/a");
+			continue;
+		}
+		seq_printf(s, "%-6s %12llu ns %12llu bytes/s\n", names[i], ns,
+			   div64_u64(bytes * NSEC_PER_SEC, ns));
+	}
+	mutex_unlock(&cm_bench_lock);
+
+	return 0;
+}
+
+static int nvmap_cm_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_cm_bench_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_cm_bench_fops = {
+	.open = nvmap_cm_bench_open,
+	.read = seq_read,
+	.write = nvmap_cm_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int nvmap_cm_stats_show(struct seq_file *s, void *unused)
+{
+	seq_printf(s, "planned batches: %lld\n",
+		   (s64)atomic64_read(&cm_stats.planned));
+	seq_printf(s, "extents in: %lld\n",
+		   (s64)atomic64_read(&cm_stats.extents_in));
+	seq_printf(s, "extents out: %lld\n",
+		   (s64)atomic64_read(&cm_stats.extents_out));
+	seq_printf(s, "bytes: %lld\n",
+		   (s64)atomic64_read(&cm_stats.bytes));
+	seq_printf(s, "deferred wb: %lld\n",
+		   (s64)atomic64_read(&cm_stats.deferred));
+	seq_printf(s, "deferred wb done: %lld\n",
+		   (s64)atomic64_read(&cm_stats.deferred_done));
 	return 0;
 }
 
+static int nvmap_cm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_cm_stats_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_cm_stats_fops = {
+	.open = nvmap_cm_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void nvmap_cache_debugfs_init(struct dentry *nvmap_root)
+{
+	if (IS_ERR_OR_NULL(nvmap_root))
+		return;
+
+	debugfs_create_file("cache_maint_bench", S_IRUGO | S_IWUSR,
+			    nvmap_root, NULL, &nvmap_cm_bench_fops);
+	debugfs_create_file("cache_maint_stats", S_IRUGO, nvmap_root, NULL,
+			    &nvmap_cm_stats_fops);
+}
+#else
+void nvmap_cache_debugfs_init(struct dentry *nvmap_root)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(4, 9, 0))
 static const struct soc_device_attribute tegra194_soc = {
 	.soc_id = "TEGRA194",
@@ -490,6 +490,9 @@ static long nvmap_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case NVMAP_IOC_GET_FD_FOR_RANGE_FROM_LIST:
 		err = nvmap_ioctl_get_fd_from_list(filp, uarg);
 		break;
+	case NVMAP_IOC_ALLOC_BATCH:
+		err = nvmap_ioctl_alloc_batch(filp, uarg);
+		break;
 	default:
 		pr_warn("Unknown NVMAP_IOC = 0x%x\n", cmd);
 	}
@@ -1414,6 +1417,7 @@ int __init nvmap_probe(struct platform_device *pdev)
 	dev->dev_user.fops = &nvmap_user_fops;
 	dev->dev_user.parent = &pdev->dev;
 	dev->handles = RB_ROOT;
+	hash_init(dev->handle_hash);
 	dev->serial_id_counter = 0;
 
 #ifdef NVMAP_CONFIG_PAGE_POOLS
@@ -1462,6 +1466,8 @@ int __init nvmap_probe(struct platform_device *pdev)
 	nvmap_page_pool_debugfs_init(nvmap_dev->debug_root);
 #endif
 	nvmap_stats_init(nvmap_debug_root);
+	nvmap_handle_debugfs_init(nvmap_debug_root);
+	nvmap_cache_debugfs_init(nvmap_debug_root);
 	platform_set_drvdata(pdev, dev);
 
 	e = nvmap_dmabuf_stash_init();
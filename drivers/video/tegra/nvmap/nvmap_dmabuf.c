@@ -10,6 +10,7 @@
 #include <nvidia/conftest.h>
 
 #include <linux/list.h>
+#include <linux/rculist.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/export.h>
@@ -43,10 +44,16 @@ struct nvmap_handle_sgt {
 	enum dma_data_direction dir;
 	struct sg_table *sgt;
 	struct device *dev;
-	struct list_head maps_entry;
+	struct hlist_node maps_entry;
 	struct nvmap_handle_info *owner;
 } ____cacheline_aligned_in_smp;
 
+static inline unsigned long nvmap_sgt_stash_key(struct device *dev,
+						enum dma_data_direction dir)
+{
+	return (unsigned long)dev ^ dir;
+}
+
 static struct kmem_cache *handle_sgt_cache;
 
 /*
@@ -129,11 +136,16 @@ static int nvmap_dmabuf_stash_sgt_locked(struct dma_buf_attachment *attach,
 	nvmap_sgt->sgt = sgt;
 	nvmap_sgt->dev = attach->dev;
 	nvmap_sgt->owner = info;
-	list_add(&nvmap_sgt->maps_entry, &info->maps);
+	hash_add_rcu(info->maps, &nvmap_sgt->maps_entry,
+		     nvmap_sgt_stash_key(attach->dev, dir));
 
 	return 0;
 }
 
+/*
+ * Lockless stash lookup. Stashed entries are only torn down in
+ * nvmap_dmabuf_release(), when no attachment can be mapping anymore.
+ */
 static struct sg_table *nvmap_dmabuf_get_sgt_from_stash(struct dma_buf_attachment *attach,
 							enum dma_data_direction dir)
 {
@@ -141,7 +153,9 @@ static struct sg_table *nvmap_dmabuf_get_sgt_from_stash(struct dma_buf_attachmen
 	struct nvmap_handle_sgt *nvmap_sgt;
 	struct sg_table *sgt = NULL;
 
-	list_for_each_entry(nvmap_sgt, &info->maps, maps_entry) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(info->maps, nvmap_sgt, maps_entry,
+				   nvmap_sgt_stash_key(attach->dev, dir)) {
 		if (nvmap_sgt->dir != dir || nvmap_sgt->dev != attach->dev)
 			continue;
 
@@ -149,21 +163,36 @@ static struct sg_table *nvmap_dmabuf_get_sgt_from_stash(struct dma_buf_attachmen
 		sgt = nvmap_sgt->sgt;
 		break;
 	}
+	rcu_read_unlock();
 
 	return sgt;
 }
 
+#ifdef NVMAP_CONFIG_DEBUG_MAPS
+static void nvmap_dmabuf_add_device_name_locked(struct nvmap_handle_info *info,
+						struct device *dev)
+{
+	char *device_name;
+	u32 heap_type;
+	u64 dma_mask;
+
+	/* Insert device name into the carveout's device name rb tree */
+	heap_type = info->handle->heap_type;
+	device_name = (char *)dev_name(dev);
+	dma_mask = *(dev->dma_mask);
+	if (device_name && !nvmap_is_device_present(device_name, heap_type)) {
+		/* If the device name is not already present in the tree, then only add */
+		nvmap_add_device_name(device_name, dma_mask, heap_type);
+	}
+}
+#endif /* NVMAP_CONFIG_DEBUG_MAPS */
+
 static struct sg_table *nvmap_dmabuf_map_dma_buf(struct dma_buf_attachment *attach,
 						  enum dma_data_direction dir)
 {
 	struct nvmap_handle_info *info = attach->dmabuf->priv;
 	int ents = 0;
 	struct sg_table *sgt = NULL;
-#ifdef NVMAP_CONFIG_DEBUG_MAPS
-	char *device_name = NULL;
-	u32 heap_type;
-	u64 dma_mask;
-#endif /* NVMAP_CONFIG_DEBUG_MAPS */
 	DEFINE_DMA_ATTRS(attrs);
 
 	trace_nvmap_dmabuf_map_dma_buf(attach->dmabuf, attach->dev);
@@ -178,13 +207,33 @@ static struct sg_table *nvmap_dmabuf_map_dma_buf(struct dma_buf_attachment *atta
 		return ERR_PTR(-EACCES);
 
 	nvmap_lru_reset(info->handle);
+	nvmap_cache_maint_flush_deferred(info->handle);
+
+	/* Fast path: an earlier mapping for this device is stashed */
+	sgt = nvmap_dmabuf_get_sgt_from_stash(attach, dir);
+	if (sgt) {
+		atomic_inc(&info->handle->pin);
+		nvmap_stats_inc(NS_STASH_HIT, 1);
+		attach->priv = sgt;
+#ifdef NVMAP_CONFIG_DEBUG_MAPS
+		mutex_lock(&info->maps_lock);
+		nvmap_dmabuf_add_device_name_locked(info, attach->dev);
+		mutex_unlock(&info->maps_lock);
+#endif /* NVMAP_CONFIG_DEBUG_MAPS */
+		return sgt;
+	}
+
 	mutex_lock(&info->maps_lock);
 
 	atomic_inc(&info->handle->pin);
 
+	/* Another mapper may have stashed it while we waited for the lock */
 	sgt = nvmap_dmabuf_get_sgt_from_stash(attach, dir);
-	if (sgt)
+	if (sgt) {
+		nvmap_stats_inc(NS_STASH_HIT, 1);
 		goto cache_hit;
+	}
+	nvmap_stats_inc(NS_STASH_MISS, 1);
 
 	sgt = __nvmap_sg_table(NULL, info->handle);
 	if (IS_ERR(sgt)) {
@@ -216,14 +265,7 @@ cache_hit:
 	attach->priv = sgt;
 
 #ifdef NVMAP_CONFIG_DEBUG_MAPS
-	/* Insert device name into the carveout's device name rb tree */
-	heap_type = info->handle->heap_type;
-	device_name = (char *)dev_name(attach->dev);
-	dma_mask = *(attach->dev->dma_mask);
-	if (device_name && !nvmap_is_device_present(device_name, heap_type)) {
-		/* If the device name is not already present in the tree, then only add */
-		nvmap_add_device_name(device_name, dma_mask, heap_type);
-	}
+	nvmap_dmabuf_add_device_name_locked(info, attach->dev);
 #endif /* NVMAP_CONFIG_DEBUG_MAPS */
 	mutex_unlock(&info->maps_lock);
 	return sgt;
@@ -288,6 +330,8 @@ static void nvmap_dmabuf_release(struct dma_buf *dmabuf)
 {
 	struct nvmap_handle_info *info = dmabuf->priv;
 	struct nvmap_handle_sgt *nvmap_sgt;
+	struct hlist_node *tmp_entry;
+	int bkt;
 
 	trace_nvmap_dmabuf_release(info->handle->owner ?
 				   info->handle->owner->name : "unknown",
@@ -295,13 +339,11 @@ static void nvmap_dmabuf_release(struct dma_buf *dmabuf)
 				   dmabuf);
 
 	mutex_lock(&info->maps_lock);
-	while (!list_empty(&info->maps)) {
-		nvmap_sgt = list_first_entry(&info->maps,
-					     struct nvmap_handle_sgt,
-					     maps_entry);
+	hash_for_each_safe(info->maps, bkt, tmp_entry, nvmap_sgt, maps_entry) {
 		__nvmap_dmabuf_unmap_dma_buf(nvmap_sgt);
-		list_del(&nvmap_sgt->maps_entry);
+		hash_del_rcu(&nvmap_sgt->maps_entry);
 		kmem_cache_free(handle_sgt_cache, nvmap_sgt);
+		nvmap_stats_inc(NS_STASH_EVICT, 1);
 	}
 	mutex_unlock(&info->maps_lock);
 
@@ -456,11 +498,13 @@ int __nvmap_map(struct nvmap_handle *h, struct vm_area_struct *vma)
 	|| (defined(CONFIG_TEGRA_SYSTEM_TYPE_ACK) && (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)))
 	vm_flags_set(vma, VM_SHARED | VM_DONTEXPAND |
 			  VM_DONTDUMP | VM_DONTCOPY |
-			  (h->heap_pgalloc ? 0 : VM_PFNMAP));
+			  (h->heap_pgalloc ? 0 : VM_PFNMAP) |
+			  (nvmap_handle_batch_fault(h) ? VM_MIXEDMAP : 0));
 #else
 	vma->vm_flags |= VM_SHARED | VM_DONTEXPAND |
 			  VM_DONTDUMP | VM_DONTCOPY |
-			  (h->heap_pgalloc ? 0 : VM_PFNMAP);
+			  (h->heap_pgalloc ? 0 : VM_PFNMAP) |
+			  (nvmap_handle_batch_fault(h) ? VM_MIXEDMAP : 0);
 #endif
 	vma->vm_ops = &nvmap_vma_ops;
 	BUG_ON(vma->vm_private_data != NULL);
@@ -616,7 +660,7 @@ struct dma_buf *__nvmap_make_dmabuf(struct nvmap_client *client,
 	}
 	info->handle = handle;
 	info->is_ro = ro_buf;
-	INIT_LIST_HEAD(&info->maps);
+	hash_init(info->maps);
 	mutex_init(&info->maps_lock);
 
 	dmabuf = __dma_buf_export(info, handle->size, ro_buf);
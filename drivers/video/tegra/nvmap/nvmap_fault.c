@@ -7,6 +7,7 @@
 
 #include <trace/events/nvmap.h>
 #include <linux/highmem.h>
+#include <linux/moduleparam.h>
 
 #include "nvmap_priv.h"
 
@@ -165,6 +166,105 @@ static void nvmap_vma_close(struct vm_area_struct *vma)
 	}
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define NVMAP_FAULT_BATCH	32
+
+static uint fault_around_pages = 16;
+module_param(fault_around_pages, uint, 0644);
+MODULE_PARM_DESC(fault_around_pages,
+	"Pages mapped per fault outside of huge page chunks");
+
+/*
+ * Map handle pages [first, last) starting at addr. PTEs that are present
+ * already are skipped. Returns 0 or the first error that isn't -EBUSY.
+ */
+static int nvmap_vma_insert_pages(struct vm_area_struct *vma,
+				  unsigned long addr, struct nvmap_handle *h,
+				  unsigned long first, unsigned long last)
+{
+	struct page *batch[NVMAP_FAULT_BATCH];
+	unsigned long nr, left, i;
+	int err;
+
+	while (first < last) {
+		nr = min_t(unsigned long, last - first, NVMAP_FAULT_BATCH);
+		for (i = 0; i < nr; i++)
+			batch[i] = nvmap_to_page(h->pgalloc.pages[first + i]);
+
+		left = nr;
+		err = vm_insert_pages(vma, addr, batch, &left);
+		if (err && err != -EBUSY)
+			return err;
+
+		/* On -EBUSY step over the page that is mapped already */
+		nr -= err ? left - 1 : 0;
+		first += nr;
+		addr += nr << PAGE_SHIFT;
+	}
+	return 0;
+}
+
+/* Whether pages [first, first + nr) are one naturally aligned chunk */
+static bool nvmap_pages_are_chunk(struct nvmap_handle *h, unsigned long first,
+				  unsigned long nr)
+{
+	unsigned long pfn = page_to_pfn(nvmap_to_page(h->pgalloc.pages[first]));
+	unsigned long i;
+
+	if (!IS_ALIGNED(pfn, nr))
+		return false;
+
+	for (i = 1; i < nr; i++)
+		if (page_to_pfn(nvmap_to_page(h->pgalloc.pages[first + i])) !=
+		    pfn + i)
+			return false;
+	return true;
+}
+
+/*
+ * Populate the PTEs around a fault in one go: the whole PMD sized chunk
+ * when the faulting page is part of one, fault_around_pages otherwise.
+ * Returns VM_FAULT_NOPAGE when the faulting page got mapped, 0 to fall
+ * back to the single page path.
+ */
+static vm_fault_t nvmap_vma_fault_batch(struct vm_area_struct *vma,
+					struct nvmap_handle *h,
+					unsigned long addr, unsigned long idx)
+{
+	unsigned long nr_huge = PMD_SIZE >> PAGE_SHIFT;
+	unsigned long vma_first, vma_last, first, last, nr;
+	bool huge = false;
+
+	/* Handle pages covered by this VMA */
+	vma_first = idx - ((addr - vma->vm_start) >> PAGE_SHIFT);
+	vma_last = min_t(unsigned long, vma_first + vma_pages(vma),
+			 h->size >> PAGE_SHIFT);
+
+	first = ALIGN_DOWN(idx, nr_huge);
+	if ((h->userflags & NVMAP_HANDLE_HUGE_PAGES) &&
+	    first >= vma_first && first + nr_huge <= vma_last &&
+	    nvmap_pages_are_chunk(h, first, nr_huge)) {
+		last = first + nr_huge;
+		huge = true;
+	} else {
+		nr = clamp_t(unsigned long, READ_ONCE(fault_around_pages),
+			     1, nr_huge);
+		nr = rounddown_pow_of_two(nr);
+		first = max(ALIGN_DOWN(idx, nr), vma_first);
+		last = min(ALIGN_DOWN(idx, nr) + nr, vma_last);
+	}
+
+	/* Faulting page first so that a failure can fall back */
+	if (nvmap_vma_insert_pages(vma, addr, h, idx, last))
+		return 0;
+	nvmap_vma_insert_pages(vma, addr - ((idx - first) << PAGE_SHIFT), h,
+			       first, idx);
+
+	nvmap_stats_inc(huge ? NS_MAP_HUGE : NS_MAP_SMALL, 1);
+	return VM_FAULT_NOPAGE;
+}
+#endif
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
 static vm_fault_t nvmap_vma_fault(struct vm_fault *vmf)
 #define vm_insert_pfn vmf_insert_pfn
@@ -233,6 +333,19 @@ static int nvmap_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 					return VM_FAULT_SIGSEGV;
 			}
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+			if ((vma->vm_flags & VM_MIXEDMAP) &&
+			    nvmap_handle_batch_fault(priv->handle)) {
+				vm_fault_t ret = nvmap_vma_fault_batch(vma,
+						priv->handle,
+						(unsigned long)vmf_address,
+						offs);
+
+				if (ret)
+					return ret;
+			}
+#endif
+
 			if (!nvmap_handle_track_dirty(priv->handle))
 				goto finish;
 			mutex_lock(&priv->handle->lock);
@@ -257,8 +370,10 @@ make_dirty:
 		}
 	}
 finish:
-	if (page)
+	if (page) {
 		get_page(page);
+		nvmap_stats_inc(NS_MAP_SMALL, 1);
+	}
 	vmf->page = page;
 	return (page) ? 0 : VM_FAULT_SIGBUS;
 }
@@ -10,9 +10,15 @@
 #include <linux/err.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/rbtree.h>
+#include <linux/rculist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/completion.h>
+#include <linux/sched/clock.h>
 #include <linux/dma-buf.h>
 #include <linux/moduleparam.h>
 #include <linux/nvmap.h>
@@ -76,6 +82,7 @@ void nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h)
 	}
 	rb_link_node(&h->node, parent, p);
 	rb_insert_color(&h->node, &dev->handles);
+	hash_add_rcu(dev->handle_hash, &h->hnode, (unsigned long)h);
 	nvmap_lru_add(h);
 	/*
 	 * Set handle's serial_id to global serial id counter and then update the counter.
@@ -104,35 +111,35 @@ int nvmap_handle_remove(struct nvmap_device *dev, struct nvmap_handle *h)
 
 	nvmap_lru_del(h);
 	rb_erase(&h->node, &dev->handles);
+	hash_del_rcu(&h->hnode);
 
 	spin_unlock(&dev->handle_lock);
 	return 0;
 }
 
-/* Validates that a handle is in the device master tree and that the
- * client has permission to access it. */
+/* Validates that a handle is in the device master table and takes a
+ * reference on it. The lookup is lockless; handles are freed only after
+ * an RCU grace period, and a handle whose last reference is already gone
+ * is treated as not found. */
 struct nvmap_handle *nvmap_validate_get(struct nvmap_handle *id)
 {
-	struct nvmap_handle *h = NULL;
-	struct rb_node *n;
+	struct nvmap_handle *h;
 
-	spin_lock(&nvmap_dev->handle_lock);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(nvmap_dev->handle_hash, h, hnode,
+				   (unsigned long)id) {
+		if (h != id)
+			continue;
 
-	n = nvmap_dev->handles.rb_node;
+		if (!atomic_inc_not_zero(&h->ref))
+			break;
+		rcu_read_unlock();
 
-	while (n) {
-		h = rb_entry(n, struct nvmap_handle, node);
-		if (h == id) {
-			h = nvmap_handle_get(h);
-			spin_unlock(&nvmap_dev->handle_lock);
-			return h;
-		}
-		if (id > h)
-			n = n->rb_right;
-		else
-			n = n->rb_left;
+		NVMAP_TAG_TRACE(trace_nvmap_handle_get, h,
+				atomic_read(&h->ref));
+		return h;
 	}
-	spin_unlock(&nvmap_dev->handle_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -546,3 +553,182 @@ struct nvmap_handle_ref *nvmap_dup_handle_ro(struct nvmap_client *client,
 
 	return ref;
 }
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Handle validation microbenchmark. Writing N to nvmap/validate_bench runs
+ * NVMAP_VALIDATE_BENCH_ITERS lookups of a dummy handle from N threads, once
+ * with the legacy rb-tree walk under handle_lock and once with the RCU hash
+ * lookup. Reading the file reports the last results.
+ */
+#define NVMAP_VALIDATE_BENCH_ITERS	100000
+#define NVMAP_VALIDATE_BENCH_MAX_THREADS	64
+
+struct nvmap_validate_bench {
+	struct nvmap_handle *h;
+	bool use_rbtree;
+	atomic_t running;
+	struct completion done;
+};
+
+static DEFINE_MUTEX(validate_bench_lock);
+static u32 validate_bench_threads;
+static u64 validate_bench_ns[2];
+
+/* The pre-RCU lookup, kept only to compare against in the benchmark */
+static struct nvmap_handle *nvmap_validate_get_rbtree(struct nvmap_handle *id)
+{
+	struct nvmap_handle *h = NULL;
+	struct rb_node *n;
+
+	spin_lock(&nvmap_dev->handle_lock);
+
+	n = nvmap_dev->handles.rb_node;
+
+	while (n) {
+		h = rb_entry(n, struct nvmap_handle, node);
+		if (h == id) {
+			if (!atomic_inc_not_zero(&h->ref))
+				h = NULL;
+			spin_unlock(&nvmap_dev->handle_lock);
+			return h;
+		}
+		if (id > h)
+			n = n->rb_right;
+		else
+			n = n->rb_left;
+	}
+	spin_unlock(&nvmap_dev->handle_lock);
+	return NULL;
+}
+
+static int nvmap_validate_bench_thread(void *arg)
+{
+	struct nvmap_validate_bench *b = arg;
+	struct nvmap_handle *h;
+	int i;
+
+	for (i = 0; i < NVMAP_VALIDATE_BENCH_ITERS; i++) {
+		if (b->use_rbtree)
+			h = nvmap_validate_get_rbtree(b->h);
+		else
+			h = nvmap_validate_get(b->h);
+		if (WARN_ON(h != b->h))
+			break;
+		atomic_dec(&h->ref);
+	}
+
+	if (atomic_dec_and_test(&b->running))
+		complete(&b->done);
+
+	return 0;
+}
+
+static u64 nvmap_validate_bench_run(struct nvmap_handle *h, u32 nr_threads,
+				    bool use_rbtree)
+{
+	struct nvmap_validate_bench b;
+	struct task_struct *task;
+	u64 start;
+	u32 i;
+
+	b.h = h;
+	b.use_rbtree = use_rbtree;
+	atomic_set(&b.running, nr_threads + 1);
+	init_completion(&b.done);
+
+	start = sched_clock();
+	for (i = 0; i < nr_threads; i++) {
+		task = kthread_run(nvmap_validate_bench_thread, &b,
+				   "nvmap-vbench/%u", i);
+		if (IS_ERR(task))
+			atomic_dec(&b.running);
+	}
+	if (!atomic_dec_and_test(&b.running))
+		wait_for_completion(&b.done);
+
+	return sched_clock() - start;
+}
+
+static ssize_t nvmap_validate_bench_write(struct file *file,
+					  const char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct nvmap_handle *h;
+	u32 nr_threads;
+	int ret;
+
+	ret = kstrtou32_from_user(buf, count, 0, &nr_threads);
+	if (ret)
+		return ret;
+	if (!nr_threads || nr_threads > NVMAP_VALIDATE_BENCH_MAX_THREADS)
+		return -EINVAL;
+
+	/* Unallocated dummy handle; debugfs walkers skip it */
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+	atomic_set(&h->ref, 1);
+	INIT_LIST_HEAD(&h->lru);
+	nvmap_handle_add(nvmap_dev, h);
+
+	mutex_lock(&validate_bench_lock);
+	validate_bench_threads = nr_threads;
+	validate_bench_ns[0] = nvmap_validate_bench_run(h, nr_threads, true);
+	validate_bench_ns[1] = nvmap_validate_bench_run(h, nr_threads, false);
+	mutex_unlock(&validate_bench_lock);
+
+	atomic_set(&h->ref, 0);
+	WARN_ON(nvmap_handle_remove(nvmap_dev, h));
+	kfree_rcu(h, rcu);
+
+	return count;
+}
+
+static int nvmap_validate_bench_show(struct seq_file *s, void *unused)
+{
+	static const char * const names[] = { "rbtree", "rcu" };
+	u64 ops;
+	int i;
+
+	mutex_lock(&validate_bench_lock);
+	ops = (u64)validate_bench_threads * NVMAP_VALIDATE_BENCH_ITERS;
+	seq_printf(s, "threads: %u iterations/thread: %u\n",
+		   validate_bench_threads, NVMAP_VALIDATE_BENCH_ITERS);
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		u64 ns = validate_bench_ns[i];
+
+		seq_printf(s, "%-8s %12llu ns %10llu Kops/s\n", names[i], ns,
+			   ns ? div64_u64(ops * 1000000ULL, ns) : 0);
+	}
+	mutex_unlock(&validate_bench_lock);
+
+	return 0;
+}
+
+static int nvmap_validate_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_validate_bench_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_validate_bench_fops = {
+	.open = nvmap_validate_bench_open,
+	.read = seq_read,
+	.write = nvmap_validate_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void nvmap_handle_debugfs_init(struct dentry *nvmap_root)
+{
+	if (IS_ERR_OR_NULL(nvmap_root))
+		return;
+
+	debugfs_create_file("validate_bench", S_IRUGO | S_IWUSR, nvmap_root,
+			    NULL, &nvmap_validate_bench_fops);
+}
+#else
+void nvmap_handle_debugfs_init(struct dentry *nvmap_root)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
@@ -21,6 +21,10 @@
 #include <linux/io.h>
 #include <linux/version.h>
 #include <linux/limits.h>
+#include <linux/bitmap.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 #include <linux/sched/clock.h>
@@ -84,6 +88,666 @@ size_t nvmap_query_heap_size(struct nvmap_heap *heap)
 	return heap->len;
 }
 
+static void nvmap_co_extent_insert_addr(struct nvmap_co_extents *ex,
+					struct nvmap_co_extent *e)
+{
+	struct rb_node **p = &ex->by_addr.rb_node, *parent = NULL;
+	struct nvmap_co_extent *t;
+
+	while (*p) {
+		parent = *p;
+		t = rb_entry(parent, struct nvmap_co_extent, addr_node);
+		if (e->start < t->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&e->addr_node, parent, p);
+	rb_insert_color(&e->addr_node, &ex->by_addr);
+}
+
+static void nvmap_co_extent_insert_size(struct nvmap_co_extents *ex,
+					struct nvmap_co_extent *e)
+{
+	struct rb_node **p = &ex->by_size.rb_node, *parent = NULL;
+	struct nvmap_co_extent *t;
+
+	while (*p) {
+		parent = *p;
+		t = rb_entry(parent, struct nvmap_co_extent, size_node);
+		if (e->len < t->len ||
+		    (e->len == t->len && e->start < t->start))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&e->size_node, parent, p);
+	rb_insert_color(&e->size_node, &ex->by_size);
+}
+
+static void nvmap_co_extent_link(struct nvmap_co_extents *ex,
+				 struct nvmap_co_extent *e)
+{
+	nvmap_co_extent_insert_addr(ex, e);
+	nvmap_co_extent_insert_size(ex, e);
+	ex->nr++;
+}
+
+static void nvmap_co_extent_unlink(struct nvmap_co_extents *ex,
+				   struct nvmap_co_extent *e)
+{
+	rb_erase(&e->addr_node, &ex->by_addr);
+	rb_erase(&e->size_node, &ex->by_size);
+	ex->nr--;
+}
+
+/*
+ * Change the bounds of an extent. The new bounds must not cross a
+ * neighbour, so only the size index needs updating.
+ */
+static void nvmap_co_extent_resize(struct nvmap_co_extents *ex,
+				   struct nvmap_co_extent *e,
+				   unsigned long start, unsigned long len)
+{
+	rb_erase(&e->size_node, &ex->by_size);
+	e->start = start;
+	e->len = len;
+	nvmap_co_extent_insert_size(ex, e);
+}
+
+/* Smallest extent of at least n units */
+static struct nvmap_co_extent *nvmap_co_extent_best(struct nvmap_co_extents *ex,
+						    unsigned long n)
+{
+	struct rb_node *node = ex->by_size.rb_node;
+	struct nvmap_co_extent *best = NULL, *t;
+
+	while (node) {
+		t = rb_entry(node, struct nvmap_co_extent, size_node);
+		if (t->len >= n) {
+			best = t;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return best;
+}
+
+static void nvmap_co_extent_pool_put(struct nvmap_co_extents *ex,
+				     struct nvmap_co_extent *e)
+{
+	e->next = ex->pool;
+	ex->pool = e;
+	ex->nr_pool++;
+}
+
+static struct nvmap_co_extent *
+nvmap_co_extent_pool_get(struct nvmap_co_extents *ex)
+{
+	struct nvmap_co_extent *e = ex->pool;
+
+	if (e) {
+		ex->pool = e->next;
+		ex->nr_pool--;
+	}
+	return e;
+}
+
+/*
+ * Take [pos, pos + n) out of extent e, which must contain it. Consuming a
+ * whole extent puts its node in the pool, splitting one takes a node from
+ * it. The caller refilled the pool, so the node is always there.
+ */
+static void nvmap_co_extent_carve(struct nvmap_co_extents *ex,
+				  struct nvmap_co_extent *e,
+				  unsigned long pos, unsigned long n)
+{
+	unsigned long end = pos + n, e_end = e->start + e->len;
+	struct nvmap_co_extent *tail;
+
+	if (pos == e->start && end == e_end) {
+		nvmap_co_extent_unlink(ex, e);
+		nvmap_co_extent_pool_put(ex, e);
+	} else if (pos == e->start) {
+		nvmap_co_extent_resize(ex, e, end, e_end - end);
+	} else if (end == e_end) {
+		nvmap_co_extent_resize(ex, e, e->start, pos - e->start);
+	} else {
+		/* Split, the tail needs a new node */
+		tail = nvmap_co_extent_pool_get(ex);
+		nvmap_co_extent_resize(ex, e, e->start, pos - e->start);
+		tail->start = end;
+		tail->len = e_end - end;
+		nvmap_co_extent_link(ex, tail);
+	}
+	ex->free -= n;
+	ex->used++;
+}
+
+/*
+ * Nodes for nvmap_co_extents_refill(). The other calls below are made with
+ * the carveout spinlock held and never allocate.
+ */
+struct nvmap_co_extent *nvmap_co_extent_prealloc(gfp_t gfp)
+{
+	struct nvmap_co_extent *list = NULL, *e;
+	int i;
+
+	for (i = 0; i < NVMAP_CO_EXTENT_PREALLOC; i++) {
+		e = kzalloc(sizeof(struct nvmap_co_extent), gfp);
+		if (!e) {
+			nvmap_co_extent_free_list(list);
+			return NULL;
+		}
+		e->next = list;
+		list = e;
+	}
+	return list;
+}
+
+void nvmap_co_extent_free_list(struct nvmap_co_extent *list)
+{
+	struct nvmap_co_extent *e;
+
+	while (list) {
+		e = list;
+		list = e->next;
+		kfree(e);
+	}
+}
+
+int nvmap_co_extents_init(struct nvmap_co_extents *ex, unsigned long units)
+{
+	struct nvmap_co_extent *e;
+
+	ex->by_addr = RB_ROOT;
+	ex->by_size = RB_ROOT;
+	ex->free = 0;
+	ex->nr = 0;
+	ex->used = 0;
+	ex->pool = NULL;
+	ex->nr_pool = 0;
+	if (!units)
+		return 0;
+
+	e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+	e->start = 0;
+	e->len = units;
+	nvmap_co_extent_link(ex, e);
+	ex->free = units;
+	return 0;
+}
+
+void nvmap_co_extents_destroy(struct nvmap_co_extents *ex)
+{
+	struct nvmap_co_extent *e, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(e, tmp, &ex->by_addr, addr_node)
+		kfree(e);
+	nvmap_co_extent_free_list(ex->pool);
+	ex->by_addr = RB_ROOT;
+	ex->by_size = RB_ROOT;
+	ex->free = 0;
+	ex->nr = 0;
+	ex->used = 0;
+	ex->pool = NULL;
+	ex->nr_pool = 0;
+}
+
+/* Move the nodes of a nvmap_co_extent_prealloc() list into the pool */
+void nvmap_co_extents_refill(struct nvmap_co_extents *ex,
+			     struct nvmap_co_extent **list)
+{
+	struct nvmap_co_extent *e;
+
+	while (*list) {
+		e = *list;
+		*list = e->next;
+		nvmap_co_extent_pool_put(ex, e);
+	}
+}
+
+/*
+ * Detach the pool nodes beyond one per allocated range, for the caller to
+ * free with nvmap_co_extent_free_list() once the spinlock is dropped.
+ */
+struct nvmap_co_extent *nvmap_co_extents_trim(struct nvmap_co_extents *ex)
+{
+	struct nvmap_co_extent *list = NULL, *e;
+
+	while (ex->nr_pool > ex->used) {
+		e = nvmap_co_extent_pool_get(ex);
+		e->next = list;
+		list = e;
+	}
+	return list;
+}
+
+/*
+ * Best fit: the smallest extent that holds n units at a position aligned
+ * to align_mask + 1 and not below start. Returns the position or -ENOMEM.
+ */
+long nvmap_co_extents_alloc(struct nvmap_co_extents *ex, unsigned long n,
+			    unsigned long align_mask, unsigned long start)
+{
+	struct nvmap_co_extent *e = nvmap_co_extent_best(ex, n);
+	struct rb_node *node;
+	unsigned long pos;
+
+	while (e) {
+		pos = (max(e->start, start) + align_mask) & ~align_mask;
+		if (pos + n <= e->start + e->len) {
+			nvmap_co_extent_carve(ex, e, pos, n);
+			return pos;
+		}
+		node = rb_next(&e->size_node);
+		e = node ? rb_entry(node, struct nvmap_co_extent, size_node) :
+			   NULL;
+	}
+	return -ENOMEM;
+}
+
+/* Reserve exactly [pos, pos + n); -EBUSY if any of it is in use */
+int nvmap_co_extents_reserve(struct nvmap_co_extents *ex, unsigned long pos,
+			     unsigned long n)
+{
+	struct rb_node *node = ex->by_addr.rb_node;
+	struct nvmap_co_extent *e;
+
+	while (node) {
+		e = rb_entry(node, struct nvmap_co_extent, addr_node);
+		if (pos < e->start) {
+			node = node->rb_left;
+		} else if (pos >= e->start + e->len) {
+			node = node->rb_right;
+		} else {
+			if (pos + n > e->start + e->len)
+				return -EBUSY;
+			nvmap_co_extent_carve(ex, e, pos, n);
+			return 0;
+		}
+	}
+	return -EBUSY;
+}
+
+/*
+ * Take up to n units from the start of the lowest free extent, for
+ * allocations that don't need to be contiguous. Each call but the last of
+ * an allocation consumes a whole extent and so frees its node for the new
+ * range; the last one is covered by the refill.
+ */
+unsigned long nvmap_co_extents_take_low(struct nvmap_co_extents *ex,
+					unsigned long n, unsigned long *pos)
+{
+	struct rb_node *node = rb_first(&ex->by_addr);
+	struct nvmap_co_extent *e;
+
+	if (!node)
+		return 0;
+
+	e = rb_entry(node, struct nvmap_co_extent, addr_node);
+	*pos = e->start;
+	n = min(n, e->len);
+	nvmap_co_extent_carve(ex, e, e->start, n);
+	return n;
+}
+
+/*
+ * Give back [pos, pos + n), merging with free neighbours. A new extent
+ * takes the pool node held for this range. Should the pool be empty
+ * anyway, the units are leaked rather than allocating here.
+ */
+void nvmap_co_extents_release(struct nvmap_co_extents *ex, unsigned long pos,
+			      unsigned long n)
+{
+	struct rb_node *node = ex->by_addr.rb_node;
+	struct nvmap_co_extent *prev = NULL, *next = NULL, *t;
+	unsigned long end = pos + n;
+	bool merge_prev, merge_next;
+
+	while (node) {
+		t = rb_entry(node, struct nvmap_co_extent, addr_node);
+		if (t->start < pos) {
+			prev = t;
+			node = node->rb_right;
+		} else {
+			next = t;
+			node = node->rb_left;
+		}
+	}
+
+	if (WARN_ONCE((prev && prev->start + prev->len > pos) ||
+		      (next && next->start < end),
+		      "freeing free carveout units %lu+%lu\n", pos, n))
+		return;
+
+	merge_prev = prev && prev->start + prev->len == pos;
+	merge_next = next && next->start == end;
+
+	if (merge_prev && merge_next) {
+		nvmap_co_extent_unlink(ex, next);
+		nvmap_co_extent_resize(ex, prev, prev->start,
+				       prev->len + n + next->len);
+		nvmap_co_extent_pool_put(ex, next);
+	} else if (merge_prev) {
+		nvmap_co_extent_resize(ex, prev, prev->start, prev->len + n);
+	} else if (merge_next) {
+		nvmap_co_extent_resize(ex, next, pos, next->len + n);
+	} else {
+		t = nvmap_co_extent_pool_get(ex);
+		if (WARN_ONCE(!t, "no node to free carveout units %lu+%lu\n",
+			      pos, n))
+			return;
+		t->start = pos;
+		t->len = n;
+		nvmap_co_extent_link(ex, t);
+	}
+	ex->free += n;
+	if (ex->used)
+		ex->used--;
+}
+
+unsigned long nvmap_co_extents_largest(struct nvmap_co_extents *ex)
+{
+	struct rb_node *node = rb_last(&ex->by_size);
+
+	return node ? rb_entry(node, struct nvmap_co_extent, size_node)->len : 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+static u32 nvmap_heap_unit_shift(struct nvmap_heap *heap)
+{
+	return heap->is_gpu_co ? PAGE_SHIFT_GRANULE(heap->granule_size) :
+				 PAGE_SHIFT;
+}
+
+/* Per mille of free space that is not part of the largest free extent */
+static unsigned long nvmap_frag_index(unsigned long free, unsigned long largest)
+{
+	return free ? 1000 - div64_u64((u64)largest * 1000, free) : 0;
+}
+
+static int nvmap_heap_fragmentation_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_heap *heap = s->private;
+	struct dma_coherent_mem_replica *mem;
+	unsigned long flags, free, largest, nr;
+	u32 shift = nvmap_heap_unit_shift(heap);
+
+	mem = (struct dma_coherent_mem_replica *)heap->dma_dev->dma_mem;
+	if (!mem)
+		return 0;
+
+	spin_lock_irqsave(&mem->spinlock, flags);
+	free = mem->extents.free;
+	largest = nvmap_co_extents_largest(&mem->extents);
+	nr = mem->extents.nr;
+	spin_unlock_irqrestore(&mem->spinlock, flags);
+
+	seq_printf(s, "free: %llu\n", (u64)free << shift);
+	seq_printf(s, "free extents: %lu\n", nr);
+	seq_printf(s, "largest free extent: %llu\n", (u64)largest << shift);
+	seq_printf(s, "fragmentation index: %lu/1000\n",
+		   nvmap_frag_index(free, largest));
+	return 0;
+}
+
+static int nvmap_heap_fragmentation_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_heap_fragmentation_show,
+			   inode->i_private);
+}
+
+static const struct file_operations nvmap_heap_fragmentation_fops = {
+	.open = nvmap_heap_fragmentation_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Allocation trace replay. A random trace of allocations and frees sized
+ * like carveout traffic is run against a heap sized copy of the old
+ * bitmap first fit and of the extent allocator, and the outcome of both
+ * is reported. The real heap is not touched.
+ */
+#define NVMAP_REPLAY_MAX_OPS	100000
+#define NVMAP_REPLAY_MAX_UNITS	(1UL << 22)
+
+struct nvmap_replay_op {
+	unsigned long n;	/* Units to allocate, 0 for a free */
+	u32 alloc_op;		/* For a free, the op that allocated */
+};
+
+struct nvmap_replay_result {
+	u64 ns;
+	u32 fails;
+	unsigned long free;
+	unsigned long largest;
+};
+
+static DEFINE_MUTEX(replay_lock);
+static u32 replay_seed, replay_ops;
+static unsigned long replay_units;
+static struct nvmap_replay_result replay_res[2];
+
+static int nvmap_replay_gen(struct nvmap_replay_op *ops, u32 nr_ops,
+			    unsigned long units, u32 seed)
+{
+	struct rnd_state rnd;
+	u32 *live, nr_live = 0, i, j;
+	unsigned long max_big = max(units / 64, 1UL);
+
+	live = vmalloc(nr_ops * sizeof(*live));
+	if (!live)
+		return -ENOMEM;
+
+	prandom_seed_state(&rnd, seed);
+	for (i = 0; i < nr_ops; i++) {
+		u32 r = prandom_u32_state(&rnd);
+
+		if (!nr_live || r % 100 < 55) {
+			/* Mostly small blocks, some large ones */
+			if (r % 10 < 7)
+				ops[i].n = 1 + prandom_u32_state(&rnd) % 16;
+			else
+				ops[i].n = 1 + prandom_u32_state(&rnd) % max_big;
+			live[nr_live++] = i;
+		} else {
+			j = prandom_u32_state(&rnd) % nr_live;
+			ops[i].n = 0;
+			ops[i].alloc_op = live[j];
+			live[j] = live[--nr_live];
+		}
+	}
+	vfree(live);
+	return 0;
+}
+
+/* Same alignment as __nvmap_dma_alloc_from_coherent() with the default cap */
+static unsigned long nvmap_replay_align(unsigned long n)
+{
+	int order = get_order(n << PAGE_SHIFT);
+
+	return (1UL << min(order, 8)) - 1;
+}
+
+static unsigned long nvmap_replay_bitmap_largest(unsigned long *map,
+						 unsigned long units)
+{
+	unsigned long start = 0, end, largest = 0;
+
+	while (start < units) {
+		start = find_next_zero_bit(map, units, start);
+		if (start >= units)
+			break;
+		end = find_next_bit(map, units, start);
+		largest = max(largest, end - start);
+		start = end;
+	}
+	return largest;
+}
+
+static void nvmap_replay_run(struct nvmap_replay_op *ops, long *pos, u32 nr_ops,
+			     unsigned long units, bool extents,
+			     struct nvmap_replay_result *res)
+{
+	struct nvmap_co_extents ex;
+	struct nvmap_co_extent *nodes;
+	unsigned long *map = NULL;
+	unsigned long p;
+	u64 start;
+	u32 i;
+
+	memset(res, 0, sizeof(*res));
+	if (extents) {
+		if (nvmap_co_extents_init(&ex, units))
+			return;
+	} else {
+		map = bitmap_zalloc(units, GFP_KERNEL);
+		if (!map)
+			return;
+	}
+
+	start = sched_clock();
+	for (i = 0; i < nr_ops; i++) {
+		if (ops[i].n) {
+			if (extents) {
+				/* As the carveout does, but without the lock */
+				nodes = nvmap_co_extent_prealloc(GFP_KERNEL);
+				if (!nodes)
+					break;
+				nvmap_co_extents_refill(&ex, &nodes);
+				pos[i] = nvmap_co_extents_alloc(&ex, ops[i].n,
+						nvmap_replay_align(ops[i].n),
+						0);
+				nvmap_co_extent_free_list(
+					nvmap_co_extents_trim(&ex));
+			} else {
+				p = bitmap_find_next_zero_area(map, units, 0,
+						ops[i].n,
+						nvmap_replay_align(ops[i].n));
+				pos[i] = p < units ? (long)p : -ENOMEM;
+				if (pos[i] >= 0)
+					bitmap_set(map, p, ops[i].n);
+			}
+			if (pos[i] < 0)
+				res->fails++;
+			continue;
+		}
+
+		/* Frees of allocations that failed are dropped */
+		p = ops[i].alloc_op;
+		if (pos[p] < 0)
+			continue;
+		if (extents)
+			nvmap_co_extents_release(&ex, pos[p], ops[p].n);
+		else
+			bitmap_clear(map, pos[p], ops[p].n);
+	}
+	res->ns = sched_clock() - start;
+
+	if (extents) {
+		res->free = ex.free;
+		res->largest = nvmap_co_extents_largest(&ex);
+		nvmap_co_extents_destroy(&ex);
+	} else {
+		res->largest = nvmap_replay_bitmap_largest(map, units);
+		res->free = units - bitmap_weight(map, units);
+		bitmap_free(map);
+	}
+}
+
+/* Write "<seed> <ops>" to replay a trace */
+static ssize_t nvmap_heap_replay_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct nvmap_heap *heap = file_inode(file)->i_private;
+	struct nvmap_replay_op *ops;
+	unsigned long units;
+	ssize_t ret = count;
+	long *pos;
+	char str[32];
+	u32 seed, nr_ops;
+
+	if (count >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buf, count))
+		return -EFAULT;
+	str[count] = '\0';
+
+	if (sscanf(str, "%u %u", &seed, &nr_ops) != 2 || !nr_ops ||
+	    nr_ops > NVMAP_REPLAY_MAX_OPS)
+		return -EINVAL;
+
+	units = min_t(unsigned long, heap->len >> nvmap_heap_unit_shift(heap),
+		      NVMAP_REPLAY_MAX_UNITS);
+	if (!units)
+		return -EINVAL;
+
+	ops = vzalloc(nr_ops * sizeof(*ops));
+	pos = vzalloc(nr_ops * sizeof(*pos));
+	if (!ops || !pos) {
+		vfree(ops);
+		vfree(pos);
+		return -ENOMEM;
+	}
+
+	if (nvmap_replay_gen(ops, nr_ops, units, seed)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	mutex_lock(&replay_lock);
+	replay_seed = seed;
+	replay_ops = nr_ops;
+	replay_units = units;
+	nvmap_replay_run(ops, pos, nr_ops, units, false, &replay_res[0]);
+	nvmap_replay_run(ops, pos, nr_ops, units, true, &replay_res[1]);
+	mutex_unlock(&replay_lock);
+out:
+	vfree(ops);
+	vfree(pos);
+	return ret;
+}
+
+static int nvmap_heap_replay_show(struct seq_file *s, void *unused)
+{
+	static const char * const names[] = { "first-fit", "best-fit" };
+	int i;
+
+	mutex_lock(&replay_lock);
+	seq_printf(s, "seed: %u ops: %u units: %lu\n", replay_seed,
+		   replay_ops, replay_units);
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		struct nvmap_replay_result *r = &replay_res[i];
+
+		seq_printf(s, "%-10s %10llu ns fails %6u largest %8lu free %8lu frag %4lu/1000\n",
+			   names[i], r->ns, r->fails, r->largest, r->free,
+			   nvmap_frag_index(r->free, r->largest));
+	}
+	mutex_unlock(&replay_lock);
+	return 0;
+}
+
+static int nvmap_heap_replay_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_heap_replay_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_heap_replay_fops = {
+	.open = nvmap_heap_replay_open,
+	.read = seq_read,
+	.write = nvmap_heap_replay_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif /* LINUX_VERSION_CODE */
+
 void nvmap_heap_debugfs_init(struct dentry *heap_root, struct nvmap_heap *heap)
 {
 	if (sizeof(heap->base) == sizeof(u64))
@@ -104,6 +768,12 @@ void nvmap_heap_debugfs_init(struct dentry *heap_root, struct nvmap_heap *heap)
 	else
 		debugfs_create_x32("free_size", S_IRUGO,
 			heap_root, (u32 *)&heap->free_size);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	debugfs_create_file("fragmentation", S_IRUGO, heap_root, heap,
+			    &nvmap_heap_fragmentation_fops);
+	debugfs_create_file("alloc_replay", S_IRUGO | S_IWUSR, heap_root, heap,
+			    &nvmap_heap_replay_fops);
+#endif /* LINUX_VERSION_CODE */
 }
 
 static phys_addr_t nvmap_alloc_mem(struct nvmap_heap *h, size_t len,
@@ -8,10 +8,41 @@
 #ifndef __NVMAP_HEAP_H
 #define __NVMAP_HEAP_H
 
+#include <linux/rbtree.h>
+
 struct device;
 struct nvmap_heap;
 struct nvmap_client;
 
+/*
+ * Free space of a carveout, in allocation units (pages or granules), as a
+ * set of coalesced extents. Indexed by address for coalescing and by
+ * (length, address) for best fit, so that alloc and free are O(log n).
+ *
+ * Freeing a range may need a node for a new extent. Allocations keep one
+ * node per allocated range in a pool, so that free never allocates.
+ */
+struct nvmap_co_extents {
+	struct rb_root by_addr;
+	struct rb_root by_size;
+	unsigned long free;	/* Free units */
+	unsigned long nr;	/* Number of free extents */
+	unsigned long used;	/* Number of allocated ranges */
+	struct nvmap_co_extent *pool;	/* Nodes held for freeing them */
+	unsigned long nr_pool;
+};
+
+struct nvmap_co_extent {
+	struct rb_node addr_node;
+	struct rb_node size_node;
+	unsigned long start;
+	unsigned long len;
+	struct nvmap_co_extent *next;	/* In the pool or a node list */
+};
+
+/* Nodes an allocation must add to the pool beforehand, at most */
+#define NVMAP_CO_EXTENT_PREALLOC	2
+
 struct nvmap_heap_block {
 	phys_addr_t	base;
 	unsigned int	type;
@@ -79,4 +110,21 @@ void nvmap_heap_debugfs_init(struct dentry *heap_root, struct nvmap_heap *heap);
 int nvmap_query_heap_peer(struct nvmap_heap *heap, unsigned int *peer);
 size_t nvmap_query_heap_size(struct nvmap_heap *heap);
 
+struct nvmap_co_extent *nvmap_co_extent_prealloc(gfp_t gfp);
+void nvmap_co_extent_free_list(struct nvmap_co_extent *list);
+int nvmap_co_extents_init(struct nvmap_co_extents *ex, unsigned long units);
+void nvmap_co_extents_destroy(struct nvmap_co_extents *ex);
+void nvmap_co_extents_refill(struct nvmap_co_extents *ex,
+			     struct nvmap_co_extent **list);
+struct nvmap_co_extent *nvmap_co_extents_trim(struct nvmap_co_extents *ex);
+long nvmap_co_extents_alloc(struct nvmap_co_extents *ex, unsigned long n,
+			    unsigned long align_mask, unsigned long start);
+int nvmap_co_extents_reserve(struct nvmap_co_extents *ex, unsigned long pos,
+			     unsigned long n);
+unsigned long nvmap_co_extents_take_low(struct nvmap_co_extents *ex,
+					unsigned long n, unsigned long *pos);
+void nvmap_co_extents_release(struct nvmap_co_extents *ex, unsigned long pos,
+			      unsigned long n);
+unsigned long nvmap_co_extents_largest(struct nvmap_co_extents *ex);
+
 #endif
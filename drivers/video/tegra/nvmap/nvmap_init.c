@@ -359,13 +359,14 @@ static void *__nvmap_dma_alloc_from_coherent(struct device *dev,
 {
 	int order = get_order(size);
 	unsigned long flags;
-	unsigned int count = 0, i = 0, j = 0, k = 0;
-	unsigned int alloc_size;
-	unsigned long align, pageno, page_count, first_pageno;
+	unsigned int count = 0, i = 0, k = 0;
+	unsigned long align, pageno, page_count, first_pageno = 0;
+	unsigned long got, u;
+	struct nvmap_co_extent *nodes, *surplus;
 	void *addr = NULL;
 	struct page **pages = NULL;
 	int do_memset = 0;
-	int *bitmap_nos = NULL;
+	long pos;
 	const char *device_name;
 	bool is_gpu = false;
 	u32 granule_size = 0;
@@ -402,14 +403,14 @@ static void *__nvmap_dma_alloc_from_coherent(struct device *dev,
 	if (!count)
 		return NULL;
 
-	bitmap_nos = vzalloc(count * sizeof(int));
-	if (!bitmap_nos) {
+	/* Extent nodes for this allocation and for freeing it later */
+	nodes = nvmap_co_extent_prealloc(GFP_KERNEL);
+	if (!nodes) {
 		dev_err(dev, "failed to allocate memory\n");
 		return NULL;
 	}
 	if ((mem->flags & DMA_MEMORY_NOMAP) &&
 	    dma_get_attr(DMA_ATTR_ALLOC_SINGLE_PAGES, attrs)) {
-		alloc_size = 1;
 		/* pages contain the array of pages of kernel PAGE_SIZE */
 		if (!is_gpu)
 			pages = nvmap_kvzalloc_pages(count);
@@ -417,14 +418,13 @@ static void *__nvmap_dma_alloc_from_coherent(struct device *dev,
 			pages = nvmap_kvzalloc_pages(count * PAGES_PER_GRANULE(granule_size));
 
 		if (!pages) {
-			kvfree(bitmap_nos);
+			nvmap_co_extent_free_list(nodes);
 			return NULL;
 		}
-	} else {
-		alloc_size = count;
 	}
 
 	spin_lock_irqsave(&mem->spinlock, flags);
+	nvmap_co_extents_refill(&mem->extents, &nodes);
 
 	if (!is_gpu && unlikely(size > ((u64)mem->size << PAGE_SHIFT)))
 		goto err;
@@ -443,30 +443,36 @@ static void *__nvmap_dma_alloc_from_coherent(struct device *dev,
 			align = (1 << order) - 1;
 	}
 
-	while (count) {
-		pageno = bitmap_find_next_zero_area(mem->bitmap, mem->size,
-						    start, alloc_size, align);
-
-		if (pageno >= mem->size)
+	if (pages) {
+		/* Any free units will do, lowest addresses first */
+		if (mem->extents.free < count)
 			goto err;
 
-		if (!i)
-			first_pageno = pageno;
-
-		count -= alloc_size;
-		if (pages) {
-			if (!is_gpu)
-				pages[i++] = pfn_to_page(mem->pfn_base + pageno);
-			else {
-				/* Handle granules */
-				for (k = 0; k < (alloc_size * PAGES_PER_GRANULE(granule_size)); k++)
-					pages[i++] = pfn_to_page(mem->pfn_base + pageno *
-								 PAGES_PER_GRANULE(granule_size) + k);
+		while (count) {
+			got = nvmap_co_extents_take_low(&mem->extents, count,
+							&pageno);
+			if (!i)
+				first_pageno = pageno;
+
+			count -= got;
+			for (u = pageno; u < pageno + got; u++) {
+				if (!is_gpu)
+					pages[i++] = pfn_to_page(mem->pfn_base + u);
+				else {
+					/* Handle granules */
+					for (k = 0; k < PAGES_PER_GRANULE(granule_size); k++)
+						pages[i++] = pfn_to_page(mem->pfn_base + u *
+									 PAGES_PER_GRANULE(granule_size) + k);
+				}
 			}
 		}
+	} else {
+		pos = nvmap_co_extents_alloc(&mem->extents, count, align,
+					     start);
+		if (pos < 0)
+			goto err;
 
-		bitmap_set(mem->bitmap, pageno, alloc_size);
-		bitmap_nos[j++] = pageno;
+		first_pageno = pos;
 	}
 
 	/*
@@ -484,20 +490,19 @@ static void *__nvmap_dma_alloc_from_coherent(struct device *dev,
 		addr = pages;
 	}
 
+	surplus = nvmap_co_extents_trim(&mem->extents);
 	spin_unlock_irqrestore(&mem->spinlock, flags);
+	nvmap_co_extent_free_list(surplus);
 
 	if (do_memset)
 		memset(addr, 0, size);
 
-	kvfree(bitmap_nos);
 	return addr;
 err:
-	while (j--)
-		bitmap_clear(mem->bitmap, bitmap_nos[j], alloc_size);
-
+	surplus = nvmap_co_extents_trim(&mem->extents);
 	spin_unlock_irqrestore(&mem->spinlock, flags);
+	nvmap_co_extent_free_list(surplus);
 	kvfree(pages);
-	kvfree(bitmap_nos);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -551,28 +556,27 @@ void nvmap_dma_free_attrs(struct device *dev, size_t size, void *cpu_addr,
 	if ((mem->flags & DMA_MEMORY_NOMAP) &&
 	    dma_get_attr(DMA_ATTR_ALLOC_SINGLE_PAGES, attrs)) {
 		struct page **pages = cpu_addr;
+		unsigned int step = is_gpu ? PAGES_PER_GRANULE(granule_size) : 1;
+		unsigned int run;
 		int i;
 
-		spin_lock_irqsave(&mem->spinlock, flags);
-		if (!is_gpu) {
-			for (i = 0; i < (size >> PAGE_SHIFT); i++) {
-				pageno = page_to_pfn(pages[i]) - mem->pfn_base;
-				if (WARN_ONCE(pageno > mem->size,
-				      "invalid pageno:%d\n", pageno))
-					continue;
-				bitmap_clear(mem->bitmap, pageno, 1);
-			}
-		} else {
-			for (i = 0; i < (size >> PAGE_SHIFT); i += PAGES_PER_GRANULE(granule_size)) {
-				pageno = (page_to_pfn(pages[i]) - mem->pfn_base) /
-						PAGES_PER_GRANULE(granule_size);
-				if (WARN_ONCE(pageno > mem->size,
-				      "invalid pageno:%d\n", pageno))
-					continue;
-				bitmap_clear(mem->bitmap, pageno, 1);
+		/* Give the units back one contiguous run at a time */
+		for (i = 0; i < (size >> PAGE_SHIFT); i += run * step) {
+			pageno = (page_to_pfn(pages[i]) - mem->pfn_base) / step;
+			if (WARN_ONCE(pageno > mem->size,
+			      "invalid pageno:%d\n", pageno)) {
+				run = 1;
+				continue;
 			}
+			for (run = 1; i + run * step < (size >> PAGE_SHIFT); run++)
+				if ((page_to_pfn(pages[i + run * step]) -
+				     mem->pfn_base) / step != pageno + run)
+					break;
+
+			spin_lock_irqsave(&mem->spinlock, flags);
+			nvmap_co_extents_release(&mem->extents, pageno, run);
+			spin_unlock_irqrestore(&mem->spinlock, flags);
 		}
-		spin_unlock_irqrestore(&mem->spinlock, flags);
 		kvfree(pages);
 		return;
 	}
@@ -599,7 +603,7 @@ void nvmap_dma_free_attrs(struct device *dev, size_t size, void *cpu_addr,
 			count = 1 << get_order(size);
 
 		spin_lock_irqsave(&mem->spinlock, flags);
-		bitmap_clear(mem->bitmap, page, count);
+		nvmap_co_extents_release(&mem->extents, page, count);
 		spin_unlock_irqrestore(&mem->spinlock, flags);
 	}
 }
@@ -609,7 +613,8 @@ void *nvmap_dma_mark_declared_memory_occupied(struct device *dev,
 					dma_addr_t device_addr, size_t size)
 {
 	struct dma_coherent_mem_replica *mem;
-	unsigned long flags, pageno;
+	struct nvmap_co_extent *nodes, *surplus;
+	unsigned long flags;
 	unsigned int alloc_size;
 	int pos;
 
@@ -621,17 +626,24 @@ void *nvmap_dma_mark_declared_memory_occupied(struct device *dev,
 	size += device_addr & ~PAGE_MASK;
 	alloc_size = PAGE_ALIGN(size) >> PAGE_SHIFT;
 
+	nodes = nvmap_co_extent_prealloc(GFP_KERNEL);
+	if (!nodes)
+		return ERR_PTR(-ENOMEM);
+
 	spin_lock_irqsave(&mem->spinlock, flags);
+	nvmap_co_extents_refill(&mem->extents, &nodes);
 	pos = PFN_DOWN(device_addr - mem->device_base);
-	pageno = bitmap_find_next_zero_area(mem->bitmap, mem->size, pos, alloc_size, 0);
-	if (pageno != pos)
+	if (nvmap_co_extents_reserve(&mem->extents, pos, alloc_size))
 		goto error;
-	bitmap_set(mem->bitmap, pageno, alloc_size);
+	surplus = nvmap_co_extents_trim(&mem->extents);
 	spin_unlock_irqrestore(&mem->spinlock, flags);
+	nvmap_co_extent_free_list(surplus);
 	return mem->virt_base + (pos << PAGE_SHIFT);
 
 error:
+	surplus = nvmap_co_extents_trim(&mem->extents);
 	spin_unlock_irqrestore(&mem->spinlock, flags);
+	nvmap_co_extent_free_list(surplus);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -653,7 +665,7 @@ void nvmap_dma_mark_declared_memory_unoccupied(struct device *dev,
 
 	spin_lock_irqsave(&mem->spinlock, flags);
 	pos = PFN_DOWN(device_addr - mem->device_base);
-	bitmap_clear(mem->bitmap, pos, alloc_size);
+	nvmap_co_extents_release(&mem->extents, pos, alloc_size);
 	spin_unlock_irqrestore(&mem->spinlock, flags);
 }
 
@@ -663,7 +675,7 @@ void nvmap_dma_release_coherent_memory(struct dma_coherent_mem_replica *mem)
 		return;
 	if (!(mem->flags & DMA_MEMORY_NOMAP))
 		memunmap(mem->virt_base);
-	kfree(mem->bitmap);
+	nvmap_co_extents_destroy(&mem->extents);
 	kfree(mem);
 }
 
@@ -687,7 +699,6 @@ static int nvmap_dma_init_coherent_memory(
 	struct dma_coherent_mem_replica *dma_mem = NULL;
 	void *mem_base = NULL;
 	int pages;
-	int bitmap_size;
 	int ret;
 
 	if (!size)
@@ -698,8 +709,6 @@ static int nvmap_dma_init_coherent_memory(
 	else
 		pages = size >> PAGE_SHIFT;
 
-	bitmap_size = BITS_TO_LONGS(pages) * sizeof(long);
-
 	if (!(flags & DMA_MEMORY_NOMAP)) {
 		mem_base = memremap(phys_addr, size, MEMREMAP_WC);
 		if (!mem_base)
@@ -712,11 +721,9 @@ static int nvmap_dma_init_coherent_memory(
 		goto err_memunmap;
 	}
 
-	dma_mem->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
-	if (!dma_mem->bitmap) {
-		ret = -ENOMEM;
+	ret = nvmap_co_extents_init(&dma_mem->extents, pages);
+	if (ret)
 		goto err_free_dma_mem;
-	}
 
 	dma_mem->virt_base = mem_base;
 	dma_mem->device_base = device_addr;
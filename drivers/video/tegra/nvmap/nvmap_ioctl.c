@@ -1702,3 +1702,151 @@ free_mem:
 	nvmap_altfree(hs, bytes);
 	return err;
 }
+
+/*
+ * Create, allocate and export num_handles handles of the same size. The
+ * pages for the whole batch are taken out of the page pool up front so the
+ * pool lock is taken once rather than once per handle. Either every handle
+ * is returned to userspace or none is.
+ */
+int nvmap_ioctl_alloc_batch(struct file *filp, void __user *arg)
+{
+	struct nvmap_client *client = filp->private_data;
+	struct nvmap_alloc_batch op;
+	struct nvmap_page_reserve *rsv = NULL;
+	struct nvmap_handle_ref **refs;
+	struct nvmap_handle *h;
+	struct dma_buf *dmabuf;
+	unsigned int page_sz = PAGE_SIZE;
+	u32 granule_size = 0;
+	size_t bytes;
+	u32 *ids;
+	u32 i, nr = 0;
+	int err = 0;
+	int fd;
+
+	if (!client)
+		return -ENODEV;
+
+	if (copy_from_user(&op, arg, sizeof(op)))
+		return -EFAULT;
+
+	if (!op.handles || !op.num_handles ||
+	    op.num_handles > NVMAP_ALLOC_BATCH_MAX || !op.size ||
+	    op.size > SIZE_MAX / op.num_handles)
+		return -EINVAL;
+
+	if (op.align & (op.align - 1))
+		return -EINVAL;
+
+	if (op.numa_nid > MAX_NUMNODES || (op.numa_nid != NUMA_NO_NODE && op.numa_nid < 0)) {
+		pr_err("numa id:%d is invalid\n", op.numa_nid);
+		return -EINVAL;
+	}
+
+	/* Same granule rounding as NVMAP_IOC_ALLOC for the GPU carveout */
+	if (op.heap_mask & NVMAP_HEAP_CARVEOUT_GPU) {
+		for (i = 0; i < nvmap_dev->nr_carveouts; i++)
+			if (nvmap_dev->heaps[i].heap_bit & NVMAP_HEAP_CARVEOUT_GPU)
+				granule_size = nvmap_dev->heaps[i].carveout->granule_size;
+		page_sz = granule_size;
+	}
+
+	if (!is_nvmap_memory_available(op.size * op.num_handles, op.heap_mask))
+		return -ENOMEM;
+
+	bytes = op.num_handles * (sizeof(*refs) + sizeof(*ids));
+	refs = nvmap_altalloc(bytes);
+	if (!refs)
+		return -ENOMEM;
+	ids = (u32 *)(refs + op.num_handles);
+
+	/* user-space handles are aligned to page boundaries, to prevent
+	 * data leakage. */
+	op.align = max_t(size_t, op.align, page_sz);
+	op.flags &= ~NVMAP_HANDLE_KIND_SPECIFIED;
+
+	rsv = nvmap_page_reserve_get(op.size, op.num_handles, op.heap_mask,
+				     op.flags, op.numa_nid);
+
+	for (nr = 0; nr < op.num_handles; nr++) {
+		refs[nr] = nvmap_create_handle(client, op.size, false);
+		if (IS_ERR(refs[nr])) {
+			err = PTR_ERR(refs[nr]);
+			goto rollback;
+		}
+
+		/*
+		 * Hold a dupe so that a racing NVMAP_IOC_FREE on a guessed
+		 * id can't free the handle while the batch is in flight.
+		 */
+		atomic_inc(&refs[nr]->dupes);
+		h = refs[nr]->handle;
+		h->orig_size = op.size;
+		h->numa_id = op.numa_nid;
+		if (granule_size)
+			h->size = ALIGN_GRANULE_SIZE(h->size, granule_size);
+
+		err = nvmap_alloc_handle_reserved(client, h, op.heap_mask,
+						  op.align, 0, op.flags,
+						  NVMAP_IVM_INVALID_PEER, rsv);
+		if (err)
+			goto drop_last;
+
+		if (client->ida) {
+			err = nvmap_id_array_id_alloc(client->ida, &ids[nr],
+						      h->dmabuf);
+			if (err < 0)
+				goto drop_last;
+		} else {
+			/* The fd is only installed once the batch succeeded */
+			fd = nvmap_get_dmabuf_fd(client, h, false);
+			if (fd < 0) {
+				err = fd;
+				goto drop_last;
+			}
+			ids[nr] = fd;
+		}
+	}
+
+	nvmap_page_reserve_put(rsv);
+	rsv = NULL;
+
+	if (copy_to_user((void __user *)(uintptr_t)op.handles, ids,
+			 op.num_handles * sizeof(*ids))) {
+		err = -EFAULT;
+		goto rollback;
+	}
+
+	for (i = 0; i < op.num_handles; i++) {
+		h = refs[i]->handle;
+		dmabuf = h->dmabuf;
+		if (!client->ida)
+			fd_install(ids[i], dmabuf->file);
+		trace_refcount_alloc(h, dmabuf, atomic_read(&h->ref),
+				atomic_long_read(&dmabuf->file->f_count), "RW");
+		atomic_dec(&refs[i]->dupes);
+	}
+	goto out;
+
+drop_last:
+	/* refs[nr] is created but has no id or fd yet */
+	atomic_dec(&refs[nr]->dupes);
+	nvmap_free_handle(client, refs[nr]->handle, false);
+rollback:
+	nvmap_page_reserve_put(rsv);
+	for (i = 0; i < nr; i++) {
+		h = refs[i]->handle;
+		atomic_dec(&refs[i]->dupes);
+		if (client->ida) {
+			nvmap_id_array_id_release(client->ida, ids[i]);
+		} else {
+			put_unused_fd(ids[i]);
+			dma_buf_put(h->dmabuf);
+		}
+		nvmap_free_handle(client, h, false);
+	}
+out:
+	nvmap_altfree(refs, bytes);
+	return err;
+}
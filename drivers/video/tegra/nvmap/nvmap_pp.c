@@ -18,6 +18,9 @@
 #include <linux/debugfs.h>
 #include <linux/freezer.h>
 #include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
 #include <linux/version.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
@@ -33,9 +36,35 @@
 #define PENDING_PAGES_SIZE                (SZ_1M / PAGE_SIZE)
 
 static bool enable_pp = 1;
+static bool enable_pp_mag = 1;
 static u32 pool_size;
 
-static struct task_struct *background_allocator;
+/*
+ * Number of background zeroing threads. 0 picks a default based on the
+ * number of online CPUs at init time.
+ */
+static uint zero_threads;
+module_param(zero_threads, uint, 0444);
+
+/*
+ * When the number of zeroed pages available in the pool drops below this
+ * many pages while there is still work queued, the zeroing threads run at
+ * normal priority instead of MAX_NICE. 0 picks pool->max / 8.
+ */
+static uint zero_low_watermark;
+module_param(zero_low_watermark, uint, 0644);
+
+#define NVMAP_PP_MAX_ZERO_THREADS         8
+
+struct nvmap_pp_zero_worker {
+	struct task_struct *task;
+	bool boosted;
+	/* Pages zeroed in a batch; too big for the stack */
+	struct page *pending[PENDING_PAGES_SIZE];
+};
+
+static struct nvmap_pp_zero_worker *zero_workers;
+static u32 nr_zero_workers;
 static DECLARE_WAIT_QUEUE_HEAD(nvmap_bg_wait);
 
 #ifdef NVMAP_CONFIG_PAGE_POOL_DEBUG
@@ -144,79 +173,145 @@ static inline bool nvmap_bg_should_run(struct nvmap_page_pool *pool)
 	return !list_empty(&pool->zero_list);
 }
 
+static int nvmap_pp_page_cmp(const void *a, const void *b)
+{
+	unsigned long pfn_a = page_to_pfn(*(struct page **)a);
+	unsigned long pfn_b = page_to_pfn(*(struct page **)b);
+
+	if (pfn_a < pfn_b)
+		return -1;
+	return pfn_a > pfn_b ? 1 : 0;
+}
+
+/*
+ * Zero the pages and clean them out of the CPU caches. Cache maintenance is
+ * done once per run of physically contiguous pages rather than per page.
+ */
 static void nvmap_pp_zero_pages(struct page **pages, int nr)
 {
-	int i;
+	int i, run;
 
-	for (i = 0; i < nr; i++) {
+	for (i = 0; i < nr; i++)
 		clear_highpage(pages[i]);
-		nvmap_clean_cache_page(pages[i]);
+
+	for (i = 0; i < nr; i += run) {
+		run = 1;
+		if (!PageHighMem(pages[i]))
+			while (i + run < nr &&
+			       pages[i + run] == nth_page(pages[i], run))
+				run++;
+
+		if (run == 1)
+			nvmap_clean_cache_page(pages[i]);
+		else
+			__clean_dcache_area_poc(page_address(pages[i]),
+						run << PAGE_SHIFT);
 	}
 
 	trace_nvmap_pp_zero_pages(nr);
 }
 
-static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool)
+static inline bool nvmap_pp_zero_should_boost(struct nvmap_page_pool *pool)
+{
+	u32 low_wm = zero_low_watermark ? zero_low_watermark : pool->max / 8;
+
+	return pool->to_zero && pool->count < low_wm;
+}
+
+static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool,
+					      struct nvmap_pp_zero_worker *w)
 {
 	int i;
 	struct page *page;
 	int ret;
-	/*
-	 * Statically declared array of pages to be zeroed in a batch,
-	 * local to this thread but too big for the stack.
-	 */
-	static struct page *pending_zero_pages[PENDING_PAGES_SIZE];
+	u32 batch;
+	u64 start;
 
 	rt_mutex_lock(&pool->lock);
-	for (i = 0; i < PENDING_PAGES_SIZE; i++) {
+	/* Split the queue between the workers so they all get a share */
+	batch = DIV_ROUND_UP(pool->to_zero, nr_zero_workers);
+	batch = clamp_t(u32, batch, 1, PENDING_PAGES_SIZE);
+	for (i = 0; i < batch; i++) {
 		page = get_zero_list_page(pool, false, 0);
 		if (page == NULL)
 			break;
-		pending_zero_pages[i] = page;
+		w->pending[i] = page;
 		pool->under_zero++;
 	}
 	rt_mutex_unlock(&pool->lock);
 
-	nvmap_pp_zero_pages(pending_zero_pages, i);
+	if (!i)
+		return;
+
+	/* Sorting lets contiguous runs be cleaned and refilled as big pages */
+	sort(w->pending, i, sizeof(*w->pending), nvmap_pp_page_cmp, NULL);
+
+	start = sched_clock();
+	nvmap_pp_zero_pages(w->pending, i);
 
 	rt_mutex_lock(&pool->lock);
-	ret = __nvmap_page_pool_fill_lots_locked(pool, pending_zero_pages, i);
+	pool->zero_time_ns += sched_clock() - start;
+	pool->zeroed_pages += i;
+	ret = __nvmap_page_pool_fill_lots_locked(pool, w->pending, i);
 	pool->under_zero -= i;
 	rt_mutex_unlock(&pool->lock);
 
 	trace_nvmap_pp_do_background_zero_pages(ret, i);
 
 	for (; ret < i; ret++)
-		__free_page(pending_zero_pages[ret]);
+		__free_page(w->pending[ret]);
+}
+
+static void nvmap_pp_zero_set_boost(struct nvmap_page_pool *pool,
+				    struct nvmap_pp_zero_worker *w, bool boost)
+{
+	if (w->boosted == boost)
+		return;
+
+	w->boosted = boost;
+	if (boost)
+		pool->zero_boosts++;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
+	set_user_nice(current, boost ? 0 : MAX_NICE);
+#else
+	sched_set_normal(current, boost ? 0 : MAX_NICE);
+#endif
 }
 
 /*
- * This thread fills the page pools with zeroed pages. We avoid releasing the
+ * These threads fill the page pools with zeroed pages. We avoid releasing the
  * pages directly back into the page pools since we would then have to zero
  * them ourselves. Instead it is easier to just reallocate zeroed pages. This
  * happens in the background so that the overhead of allocating zeroed pages is
  * not directly seen by userspace. Of course if the page pools are empty user
- * space will suffer.
+ * space will suffer, so the threads are boosted from MAX_NICE to normal
+ * priority while the zeroed pages are below zero_low_watermark.
  */
 static int nvmap_background_zero_thread(void *arg)
 {
+	struct nvmap_pp_zero_worker *w = arg;
 	struct nvmap_page_pool *pool = &nvmap_dev->pool;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
 	struct sched_param param = { .sched_priority = 0 };
 #endif
 
-	pr_info("PP zeroing thread starting.\n");
+	pr_info("PP zeroing thread %ld starting.\n", (long)(w - zero_workers));
 
 	set_freezable();
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
 	sched_setscheduler(current, SCHED_NORMAL, &param);
+	set_user_nice(current, MAX_NICE);
 #else
 	sched_set_normal(current, MAX_NICE);
 #endif
 
 	while (!kthread_should_stop()) {
-		while (nvmap_bg_should_run(pool))
-			nvmap_pp_do_background_zero_pages(pool);
+		while (nvmap_bg_should_run(pool)) {
+			nvmap_pp_zero_set_boost(pool, w,
+					nvmap_pp_zero_should_boost(pool));
+			nvmap_pp_do_background_zero_pages(pool, w);
+		}
+		nvmap_pp_zero_set_boost(pool, w, false);
 
 		wait_event_freezable(nvmap_bg_wait,
 				nvmap_bg_should_run(pool) ||
@@ -226,6 +321,50 @@ static int nvmap_background_zero_thread(void *arg)
 	return 0;
 }
 
+static void nvmap_pp_zero_workers_stop(void)
+{
+	u32 i;
+
+	if (!zero_workers)
+		return;
+
+	for (i = 0; i < nr_zero_workers; i++)
+		if (!IS_ERR_OR_NULL(zero_workers[i].task))
+			kthread_stop(zero_workers[i].task);
+
+	vfree(zero_workers);
+	zero_workers = NULL;
+	nr_zero_workers = 0;
+}
+
+static int nvmap_pp_zero_workers_start(void)
+{
+	u32 nr = zero_threads;
+	u32 i;
+
+	if (!nr)
+		nr = clamp_t(u32, num_online_cpus() / 2, 1, 4);
+	nr = min_t(u32, nr, NVMAP_PP_MAX_ZERO_THREADS);
+
+	zero_workers = vzalloc(nr * sizeof(*zero_workers));
+	if (!zero_workers)
+		return -ENOMEM;
+	nr_zero_workers = nr;
+
+	for (i = 0; i < nr; i++) {
+		zero_workers[i].task = kthread_run(nvmap_background_zero_thread,
+						   &zero_workers[i],
+						   "nvmap-bz/%u", i);
+		if (IS_ERR(zero_workers[i].task)) {
+			nvmap_pp_zero_workers_stop();
+			return -ENOMEM;
+		}
+	}
+	zero_threads = nr;
+
+	return 0;
+}
+
 #ifdef NVMAP_CONFIG_PAGE_POOL_DEBUG
 static void nvmap_pgcount(struct page *page, bool incr)
 {
@@ -238,7 +377,7 @@ static void nvmap_pgcount(struct page *page, bool incr)
  * of whether the page pools are enabled. This lets one disable the page pools
  * and then free all the memory therein.
  *
- * FIXME: Pages in pending_zero_pages[] can still be unreleased.
+ * FIXME: Pages in a zeroing worker's pending[] can still be unreleased.
  */
 static ulong nvmap_page_pool_free_pages_locked(struct nvmap_page_pool *pool,
 						      ulong nr_pages)
@@ -302,6 +441,128 @@ static ulong nvmap_page_pool_free_pages_locked(struct nvmap_page_pool *pool,
 	return nr_pages;
 }
 
+static inline bool nvmap_pp_mag_usable(struct nvmap_page_pool *pool, u32 nr,
+				       bool use_numa, int numa_id)
+{
+	if (!enable_pp_mag || !pool->mags || nr > NVMAP_PP_MAG_BATCH)
+		return false;
+
+	/* Magazines hold pages from the local node only */
+	return !use_numa || numa_id == NUMA_NO_NODE || numa_id == numa_mem_id();
+}
+
+/*
+ * Release up to nr_pages pages held in the per-CPU magazines back to the
+ * system. Returns the number of pages released.
+ */
+static ulong nvmap_pp_mag_drain(struct nvmap_page_pool *pool, ulong nr_pages)
+{
+	struct nvmap_pp_magazine *mag;
+	struct page *drained[NVMAP_PP_MAG_SIZE];
+	ulong freed = 0;
+	u32 i, n;
+	int cpu;
+
+	if (!pool->mags)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		if (freed >= nr_pages)
+			break;
+
+		mag = per_cpu_ptr(pool->mags, cpu);
+		n = 0;
+		spin_lock(&mag->lock);
+		while (mag->count && freed + n < nr_pages)
+			drained[n++] = mag->pages[--mag->count];
+		mag->drains += n;
+		spin_unlock(&mag->lock);
+
+		atomic_sub(n, &pool->mag_count);
+		for (i = 0; i < n; i++)
+			__free_page(drained[i]);
+		freed += n;
+	}
+
+	return freed;
+}
+
+/*
+ * Serve a small allocation from the local magazine. If the magazine can't
+ * satisfy the whole request, take the remainder plus a refill batch from the
+ * global pool in a single lock round trip. Returns the number of pages placed
+ * into the pages array.
+ */
+static u32 nvmap_pp_mag_alloc(struct nvmap_page_pool *pool,
+			      struct page **pages, u32 nr)
+{
+	struct nvmap_pp_magazine *mag;
+	struct page *batch[NVMAP_PP_MAG_SIZE];
+	u32 ind = 0, got = 0, i = 0, want;
+
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	while (ind < nr && mag->count)
+		pages[ind++] = mag->pages[--mag->count];
+	if (ind == nr)
+		mag->hits++;
+	else
+		mag->misses++;
+	spin_unlock(&mag->lock);
+
+	atomic_sub(ind, &pool->mag_count);
+	if (ind == nr)
+		return ind;
+
+	want = nr - ind + NVMAP_PP_MAG_BATCH;
+
+	rt_mutex_lock(&pool->lock);
+	while (got < want) {
+		struct page *page = get_page_list_page(pool, true, NUMA_NO_NODE);
+
+		if (!page)
+			break;
+#ifdef NVMAP_CONFIG_PAGE_POOL_DEBUG
+		nvmap_pgcount(page, false);
+		BUG_ON(page_count(page) != 1);
+#endif /* NVMAP_CONFIG_PAGE_POOL_DEBUG */
+		batch[got++] = page;
+	}
+	/* Keep the pool size accounting stable while pages are in flight */
+	atomic_add(got, &pool->mag_count);
+	rt_mutex_unlock(&pool->lock);
+
+	while (ind < nr && i < got)
+		pages[ind++] = batch[i++];
+	atomic_sub(i, &pool->mag_count);
+
+	if (i == got)
+		return ind;
+
+	/* We may have migrated; stash the leftovers on whichever CPU we're on */
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	while (i < got && mag->count < NVMAP_PP_MAG_SIZE)
+		mag->pages[mag->count++] = batch[i++];
+	mag->refills++;
+	spin_unlock(&mag->lock);
+
+	if (i < got) {
+		u32 left = got - i;
+		int ret;
+
+		rt_mutex_lock(&pool->lock);
+		atomic_sub(left, &pool->mag_count);
+		ret = __nvmap_page_pool_fill_lots_locked(pool, &batch[i], left);
+		rt_mutex_unlock(&pool->lock);
+
+		for (i += ret; i < got; i++)
+			__free_page(batch[i]);
+	}
+
+	return ind;
+}
+
 /*
  * Alloc a bunch of pages from the page pool. This will alloc as many as it can
  * and return the number of pages allocated. Pages are placed into the passed
@@ -318,6 +579,16 @@ int nvmap_page_pool_alloc_lots(struct nvmap_page_pool *pool,
 	if (!enable_pp || !nr)
 		return 0;
 
+	if (nvmap_pp_mag_usable(pool, nr, use_numa, numa_id)) {
+		ind = nvmap_pp_mag_alloc(pool, pages, nr);
+		if (ind == nr) {
+			pp_alloc_add(pool, ind);
+			pp_hit_add(pool, ind);
+			trace_nvmap_pp_alloc_lots(ind, nr);
+			return ind;
+		}
+	}
+
 	rt_mutex_lock(&pool->lock);
 
 	while (ind < nr) {
@@ -470,12 +741,15 @@ u32 nvmap_page_pool_fill_lots(struct nvmap_page_pool *pool,
 	u32 ret = 0;
 	u32 i;
 	u32 save_to_zero;
+	u32 in_use;
 
 	rt_mutex_lock(&pool->lock);
 
 	save_to_zero = pool->to_zero;
 
-	ret = min(nr, pool->max - pool->count - pool->to_zero - pool->under_zero);
+	in_use = pool->count + pool->to_zero + pool->under_zero +
+		 atomic_read(&pool->mag_count);
+	ret = in_use < pool->max ? min(nr, pool->max - in_use) : 0;
 
 	for (i = 0; i < ret; i++) {
 		/* If page has additonal referecnces, Don't add it into
@@ -510,7 +784,8 @@ ulong nvmap_page_pool_get_unused_pages(void)
 	if (!nvmap_dev)
 		return 0;
 
-	total = nvmap_dev->pool.count + nvmap_dev->pool.to_zero;
+	total = nvmap_dev->pool.count + nvmap_dev->pool.to_zero +
+		atomic_read(&nvmap_dev->pool.mag_count);
 
 	return total;
 }
@@ -526,6 +801,7 @@ int nvmap_page_pool_clear(void)
 	rt_mutex_lock(&pool->lock);
 
 	(void)nvmap_page_pool_free_pages_locked(pool, pool->count + pool->to_zero);
+	(void)nvmap_pp_mag_drain(pool, ULONG_MAX);
 
 	/* For some reason, if an error occured... */
 	if (!list_empty(&pool->page_list) || !list_empty(&pool->zero_list)) {
@@ -550,8 +826,11 @@ static void nvmap_page_pool_resize(struct nvmap_page_pool *pool, u32 size)
 	rt_mutex_lock(&pool->lock);
 
 	curr = nvmap_page_pool_get_unused_pages();
-	if (curr > size)
-		(void)nvmap_page_pool_free_pages_locked(pool, curr - size);
+	if (curr > size) {
+		curr = nvmap_page_pool_free_pages_locked(pool, curr - size);
+		if (curr)
+			(void)nvmap_pp_mag_drain(pool, curr);
+	}
 
 	pr_debug("page pool resized to %d from %d pages\n", size, pool->max);
 	pool->max = size;
@@ -577,6 +856,10 @@ static unsigned long nvmap_page_pool_scan_objects(struct shrinker *shrinker,
 			&nvmap_dev->pool, sc->nr_to_scan);
 	rt_mutex_unlock(&nvmap_dev->pool.lock);
 
+	/* Only raid the per-CPU magazines once the global lists are empty */
+	if (remaining)
+		remaining -= nvmap_pp_mag_drain(&nvmap_dev->pool, remaining);
+
 	return (remaining == sc->nr_to_scan) ? \
 			   SHRINK_STOP : (sc->nr_to_scan - remaining);
 }
@@ -662,6 +945,28 @@ static struct kernel_param_ops enable_pp_ops = {
 
 module_param_cb(enable_page_pools, &enable_pp_ops, &enable_pp, 0644);
 
+static int enable_pp_mag_set(const char *arg, const struct kernel_param *kp)
+{
+	int ret;
+
+	ret = param_set_bool(arg, kp);
+	if (ret)
+		return ret;
+
+	if (!enable_pp_mag && nvmap_dev)
+		(void)nvmap_pp_mag_drain(&nvmap_dev->pool, ULONG_MAX);
+
+	return 0;
+}
+
+static struct kernel_param_ops enable_pp_mag_ops = {
+	.get = param_get_bool,
+	.set = enable_pp_mag_set,
+};
+
+module_param_cb(enable_page_pool_magazines, &enable_pp_mag_ops,
+		&enable_pp_mag, 0644);
+
 static int pool_size_set(const char *arg, const struct kernel_param *kp)
 {
 	int ret = param_set_uint(arg, kp);
@@ -684,6 +989,87 @@ static struct kernel_param_ops pool_size_ops = {
 
 module_param_cb(pool_size, &pool_size_ops, &pool_size, 0644);
 
+static int nvmap_pp_mag_stats_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_page_pool *pool = s->private;
+	struct nvmap_pp_magazine *mag;
+	u64 hits = 0, misses = 0, refills = 0, drains = 0;
+	int cpu;
+
+	if (!pool->mags)
+		return 0;
+
+	seq_printf(s, "%-6s %8s %12s %12s %12s %12s\n", "CPU", "PAGES",
+		   "HITS", "MISSES", "REFILLS", "DRAINS");
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(pool->mags, cpu);
+		spin_lock(&mag->lock);
+		seq_printf(s, "%-6d %8u %12llu %12llu %12llu %12llu\n", cpu,
+			   mag->count, mag->hits, mag->misses, mag->refills,
+			   mag->drains);
+		hits += mag->hits;
+		misses += mag->misses;
+		refills += mag->refills;
+		drains += mag->drains;
+		spin_unlock(&mag->lock);
+	}
+	seq_printf(s, "%-6s %8d %12llu %12llu %12llu %12llu\n", "total",
+		   atomic_read(&pool->mag_count), hits, misses, refills, drains);
+
+	return 0;
+}
+
+static int nvmap_pp_mag_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_pp_mag_stats_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_pp_mag_stats_fops = {
+	.open = nvmap_pp_mag_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int nvmap_pp_zero_stats_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_page_pool *pool = s->private;
+	u64 pages, ns, boosts;
+	u32 to_zero, under_zero;
+
+	rt_mutex_lock(&pool->lock);
+	pages = pool->zeroed_pages;
+	ns = pool->zero_time_ns;
+	boosts = pool->zero_boosts;
+	to_zero = pool->to_zero;
+	under_zero = pool->under_zero;
+	rt_mutex_unlock(&pool->lock);
+
+	seq_printf(s, "threads:        %u\n", nr_zero_workers);
+	seq_printf(s, "queue_depth:    %u\n", to_zero);
+	seq_printf(s, "under_zero:     %u\n", under_zero);
+	seq_printf(s, "zeroed_pages:   %llu\n", pages);
+	seq_printf(s, "zero_time_ns:   %llu\n", ns);
+	/* Aggregate across threads, so it can exceed a single CPU's rate */
+	seq_printf(s, "throughput_MBs: %llu\n",
+		   ns ? div64_u64((pages << PAGE_SHIFT) * 1000, ns) : 0);
+	seq_printf(s, "boosts:         %llu\n", boosts);
+
+	return 0;
+}
+
+static int nvmap_pp_zero_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_pp_zero_stats_show, inode->i_private);
+}
+
+static const struct file_operations nvmap_pp_zero_stats_fops = {
+	.open = nvmap_pp_zero_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 {
 	struct dentry *pp_root;
@@ -701,6 +1087,12 @@ int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 	debugfs_create_u32("page_pool_pages_to_zero",
 			   S_IRUGO, pp_root,
 			   &nvmap_dev->pool.to_zero);
+	debugfs_create_u32("page_pool_pages_under_zero",
+			   S_IRUGO, pp_root,
+			   &nvmap_dev->pool.under_zero);
+	debugfs_create_file("page_pool_zero_stats",
+			   S_IRUGO, pp_root,
+			   &nvmap_dev->pool, &nvmap_pp_zero_stats_fops);
 #ifdef CONFIG_ARM64_4K_PAGES
 	debugfs_create_u32("page_pool_available_big_pages",
 			   S_IRUGO, pp_root,
@@ -711,10 +1103,19 @@ int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 	debugfs_create_u64("total_big_page_allocs",
 			   S_IRUGO, pp_root,
 			   &nvmap_big_page_allocs);
+	debugfs_create_u64("total_huge_page_allocs",
+			   S_IRUGO, pp_root,
+			   &nvmap_huge_page_allocs);
 #endif /* CONFIG_ARM64_4K_PAGES */
 	debugfs_create_u64("total_page_allocs",
 			   S_IRUGO, pp_root,
 			   &nvmap_total_page_allocs);
+	debugfs_create_atomic_t("page_pool_magazine_pages",
+			   S_IRUGO, pp_root,
+			   &nvmap_dev->pool.mag_count);
+	debugfs_create_file("page_pool_magazine_stats",
+			   S_IRUGO, pp_root,
+			   &nvmap_dev->pool, &nvmap_pp_mag_stats_fops);
 
 #ifdef NVMAP_CONFIG_PAGE_POOL_DEBUG
 	debugfs_create_u64("page_pool_allocs",
@@ -738,11 +1139,19 @@ int nvmap_page_pool_init(struct nvmap_device *dev)
 {
 	struct sysinfo info;
 	struct nvmap_page_pool *pool = &dev->pool;
+	int cpu;
 
 	memset(pool, 0x0, sizeof(*pool));
 	rt_mutex_init(&pool->lock);
 	INIT_LIST_HEAD(&pool->page_list);
 	INIT_LIST_HEAD(&pool->zero_list);
+	atomic_set(&pool->mag_count, 0);
+
+	pool->mags = alloc_percpu(struct nvmap_pp_magazine);
+	if (!pool->mags)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pool->mags, cpu)->lock);
 #ifdef CONFIG_ARM64_4K_PAGES
 	INIT_LIST_HEAD(&pool->page_list_bp);
 
@@ -767,10 +1176,10 @@ int nvmap_page_pool_init(struct nvmap_device *dev)
 	pr_info("nvmap page pool size: %u pages (%u MB)\n", pool->max,
 		(pool->max * info.mem_unit) >> 20);
 
-	background_allocator = kthread_run(nvmap_background_zero_thread,
-					    NULL, "nvmap-bz");
-	if (IS_ERR(background_allocator))
+	if (nvmap_pp_zero_workers_start())
 		goto fail;
+	pr_info("nvmap page pool zeroing threads: %u\n", nr_zero_workers);
+
 #if defined(NV_REGISTER_SHRINKER_HAS_FMT_ARG) /* Linux v6.0 */
 	register_shrinker(&nvmap_page_pool_shrinker, "nvmap_pp_shrinker");
 #else
@@ -788,14 +1197,19 @@ int nvmap_page_pool_fini(struct nvmap_device *dev)
 	struct nvmap_page_pool *pool = &dev->pool;
 
 	/*
-	 * if background allocator is not initialzed or not
+	 * if zeroing threads are not initialzed or not
 	 * properly initialized, then shrinker is also not
 	 * registered
 	 */
-	if (!IS_ERR_OR_NULL(background_allocator)) {
+	if (zero_workers) {
 		unregister_shrinker(&nvmap_page_pool_shrinker);
-		kthread_stop(background_allocator);
-		background_allocator = NULL;
+		nvmap_pp_zero_workers_stop();
+	}
+
+	if (pool->mags) {
+		(void)nvmap_pp_mag_drain(pool, ULONG_MAX);
+		free_percpu(pool->mags);
+		pool->mags = NULL;
 	}
 
 	WARN_ON(!list_empty(&pool->page_list));
@@ -18,6 +18,7 @@
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/atomic.h>
+#include <linux/hashtable.h>
 #include <linux/dma-buf.h>
 #include <linux/syscalls.h>
 #include <linux/mm.h>
@@ -145,6 +146,7 @@ void _nvmap_handle_free(struct nvmap_handle *h);
 /* holds max number of handles allocted per process at any time */
 extern u32 nvmap_max_handle_count;
 extern u64 nvmap_big_page_allocs;
+extern u64 nvmap_huge_page_allocs;
 extern u64 nvmap_total_page_allocs;
 
 extern bool nvmap_convert_iovmm_to_carveout;
@@ -224,6 +226,8 @@ struct nvmap_handle_dmabuf_priv {
 
 struct nvmap_handle {
 	struct rb_node node;	/* entry on global handle tree */
+	struct hlist_node hnode;	/* entry on global RCU handle hash */
+	struct rcu_head rcu;
 	atomic_t ref;		/* reference count (i.e., # of duplications) */
 	atomic_t pin;		/* pin count */
 	u32 flags;		/* caching flags */
@@ -244,6 +248,7 @@ struct nvmap_handle {
 	struct list_head vmas;	/* list of all user vma's */
 	atomic_t umap_count;	/* number of outstanding maps from user */
 	atomic_t kmap_count;	/* number of outstanding map from kernel */
+	atomic_t wb_deferred;	/* CPU write back postponed to next device map */
 	atomic_t share_count;	/* number of processes sharing the handle */
 	struct list_head lru;	/* list head to track the lru */
 	struct mutex lock;
@@ -273,9 +278,13 @@ struct nvmap_handle {
 	u64 serial_id;
 };
 
+/* Buckets in the per-dmabuf sg_table stash, keyed by (device, direction) */
+#define NVMAP_STASH_HASH_BITS		3
+
 struct nvmap_handle_info {
 	struct nvmap_handle *handle;
-	struct list_head maps;
+	/* Looked up under RCU; insertion and teardown hold maps_lock */
+	DECLARE_HASHTABLE(maps, NVMAP_STASH_HASH_BITS);
 	struct mutex maps_lock;
 	bool is_ro;
 };
@@ -309,6 +318,26 @@ struct nvmap_handle_ref {
 #ifdef CONFIG_ARM64_4K_PAGES
 #define NVMAP_PP_BIG_PAGE_SIZE           (0x10000)
 #endif /* CONFIG_ARM64_4K_PAGES */
+
+/*
+ * Per-CPU magazine of zeroed pages sitting in front of the global pool.
+ * Requests of up to NVMAP_PP_MAG_BATCH pages are served from the local
+ * magazine without taking pool->lock. The magazine is refilled from the
+ * global pool NVMAP_PP_MAG_BATCH pages at a time.
+ */
+#define NVMAP_PP_MAG_SIZE                (64)
+#define NVMAP_PP_MAG_BATCH               (NVMAP_PP_MAG_SIZE / 2)
+
+struct nvmap_pp_magazine {
+	spinlock_t lock;
+	u32 count;      /* Number of pages in the magazine */
+	struct page *pages[NVMAP_PP_MAG_SIZE];
+	u64 hits;       /* Requests fully served from the magazine */
+	u64 misses;     /* Requests that needed the global pool */
+	u64 refills;    /* Batches moved from the global pool */
+	u64 drains;     /* Pages released by the shrinker/resize */
+};
+
 struct nvmap_page_pool {
 	struct rt_mutex lock;
 	u32 count;      /* Number of pages in the page & dirty list. */
@@ -325,6 +354,11 @@ struct nvmap_page_pool {
 #ifdef CONFIG_ARM64_4K_PAGES
 	struct list_head page_list_bp;
 #endif /* CONFIG_ARM64_4K_PAGES */
+	struct nvmap_pp_magazine __percpu *mags;
+	atomic_t mag_count; /* Number of pages held outside the global lists */
+	u64 zeroed_pages;   /* Pages zeroed by the background threads */
+	u64 zero_time_ns;   /* Time spent zeroing, summed over threads */
+	u64 zero_boosts;    /* Times a zeroing thread was boosted */
 
 #ifdef NVMAP_CONFIG_PAGE_POOL_DEBUG
 	u64 allocs;
@@ -379,8 +413,13 @@ struct nvmap_vma_priv {
 	atomic_t	count;	/* number of processes cloning the VMA */
 };
 
+/* Buckets in the global handle hash used for lockless validation */
+#define NVMAP_HANDLE_HASH_BITS		10
+
 struct nvmap_device {
 	struct rb_root	handles;
+	/* Read under RCU; writers hold handle_lock */
+	DECLARE_HASHTABLE(handle_hash, NVMAP_HANDLE_HASH_BITS);
 	spinlock_t	handle_lock;
 	struct miscdevice dev_user;
 	struct nvmap_carveout_node *heaps;
@@ -484,9 +523,9 @@ struct dma_coherent_mem_replica {
 	int		size;
 #endif
 	int		flags;
-	unsigned long	*bitmap;
 	spinlock_t	spinlock;
 	bool		use_dev_dma_pfn_offset;
+	struct nvmap_co_extents extents;	/* Free units, for allocation */
 };
 
 int nvmap_dma_declare_coherent_memory(struct device *dev, phys_addr_t phys_addr,
@@ -558,6 +597,26 @@ int nvmap_alloc_handle(struct nvmap_client *client,
 		       size_t align, u8 kind,
 		       unsigned int flags, unsigned int peer);
 
+/* Pages set aside for a batch of same-sized allocations */
+struct nvmap_page_reserve {
+	struct page **pages;
+	u32 nr;		/* Number of pages reserved */
+	u32 next;	/* Next unused page */
+	size_t size;	/* Length of the pages array */
+};
+
+struct nvmap_page_reserve *nvmap_page_reserve_get(size_t size, u32 count,
+						  unsigned int heap_mask,
+						  unsigned int flags,
+						  int numa_id);
+void nvmap_page_reserve_put(struct nvmap_page_reserve *rsv);
+
+int nvmap_alloc_handle_reserved(struct nvmap_client *client,
+				struct nvmap_handle *h, unsigned int heap_mask,
+				size_t align, u8 kind,
+				unsigned int flags, unsigned int peer,
+				struct nvmap_page_reserve *rsv);
+
 int nvmap_alloc_handle_from_va(struct nvmap_client *client,
 			       struct nvmap_handle *h,
 			       ulong addr,
@@ -571,6 +630,8 @@ int nvmap_handle_remove(struct nvmap_device *dev, struct nvmap_handle *h);
 
 void nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h);
 
+void nvmap_handle_debugfs_init(struct dentry *nvmap_root);
+
 int is_nvmap_vma(struct vm_area_struct *vma);
 
 int nvmap_get_dmabuf_fd(struct nvmap_client *client, struct nvmap_handle *h,
@@ -597,6 +658,11 @@ int nvmap_cache_maint_phys_range(unsigned int op, phys_addr_t pstart,
 
 int nvmap_do_cache_maint_list(struct nvmap_handle **handles, u64 *offsets,
 			      u64 *sizes, int op, u32 nr_ops, bool is_32);
+
+void nvmap_cache_maint_flush_deferred(struct nvmap_handle *h);
+
+void nvmap_cache_debugfs_init(struct dentry *nvmap_root);
+
 int __nvmap_cache_maint(struct nvmap_client *client,
 			       struct nvmap_cache_op_64 *op);
 
@@ -795,6 +861,20 @@ static inline bool nvmap_handle_track_dirty(struct nvmap_handle *h)
 			       NVMAP_HANDLE_CACHE_SYNC_AT_RESERVE);
 }
 
+/*
+ * Whether faults on user mappings of the handle may populate many PTEs at
+ * once. Needs struct page backed memory and no per page dirty tracking.
+ */
+static inline bool nvmap_handle_batch_fault(struct nvmap_handle *h)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+	return h->heap_pgalloc && h->heap_type == NVMAP_HEAP_IOVMM &&
+	       !h->from_va && !nvmap_handle_track_dirty(h);
+#else
+	return false;
+#endif
+}
+
 struct nvmap_tag_entry *nvmap_search_tag_entry(struct rb_root *root, u32 tag);
 
 int nvmap_define_tag(struct nvmap_device *dev, u32 tag,
@@ -66,6 +66,11 @@ void nvmap_stats_init(struct dentry *nvmap_debug_root)
 		CREATE_DF(ucflush_done, nvmap_stats.stats[NS_UCFLUSH_DONE]);
 		CREATE_DF(kcflush_rq, nvmap_stats.stats[NS_KCFLUSH_RQ]);
 		CREATE_DF(kcflush_done, nvmap_stats.stats[NS_KCFLUSH_DONE]);
+		CREATE_DF(stash_hit, nvmap_stats.stats[NS_STASH_HIT]);
+		CREATE_DF(stash_miss, nvmap_stats.stats[NS_STASH_MISS]);
+		CREATE_DF(stash_evict, nvmap_stats.stats[NS_STASH_EVICT]);
+		CREATE_DF(map_huge, nvmap_stats.stats[NS_MAP_HUGE]);
+		CREATE_DF(map_small, nvmap_stats.stats[NS_MAP_SMALL]);
 		CREATE_DF(total_memory, nvmap_stats.stats[NS_TOTAL]);
 
 		debugfs_create_file("collect", S_IRUGO | S_IWUSR,
@@ -19,6 +19,11 @@ enum nvmap_stats_t {
 	NS_UCFLUSH_DONE,
 	NS_KCFLUSH_RQ,
 	NS_KCFLUSH_DONE,
+	NS_STASH_HIT,
+	NS_STASH_MISS,
+	NS_STASH_EVICT,
+	NS_MAP_HUGE,
+	NS_MAP_SMALL,
 	NS_TOTAL,
 	NS_NUM,
 };
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * Virtual storage IVC message logging to ftrace.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tegra_hv_vblk
+
+#if !defined(_TRACE_TEGRA_HV_VBLK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_TEGRA_HV_VBLK_H
+
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(vblk_ivc_submit,
+	TP_PROTO(uint32_t devnum, uint32_t req_id, uint32_t op,
+		 uint64_t blk_offset, uint32_t num_blks,
+		 uint64_t total_msgs, uint64_t total_bytes),
+
+	TP_ARGS(devnum, req_id, op, blk_offset, num_blks, total_msgs,
+		total_bytes),
+
+	TP_STRUCT__entry(
+		__field(uint32_t, devnum)
+		__field(uint32_t, req_id)
+		__field(uint32_t, op)
+		__field(uint64_t, blk_offset)
+		__field(uint32_t, num_blks)
+		__field(uint64_t, total_msgs)
+		__field(uint64_t, total_bytes)
+		__field(uint64_t, msgs_per_mb)
+	),
+
+	TP_fast_assign(
+		__entry->devnum = devnum;
+		__entry->req_id = req_id;
+		__entry->op = op;
+		__entry->blk_offset = blk_offset;
+		__entry->num_blks = num_blks;
+		__entry->total_msgs = total_msgs;
+		__entry->total_bytes = total_bytes;
+		__entry->msgs_per_mb = (total_bytes >= SZ_1M) ?
+			div64_u64(total_msgs, total_bytes >> 20) : total_msgs;
+	),
+
+	TP_printk("vblkdev%u req_id=0x%x op=%u blk_offset=%llu num_blks=%u msgs=%llu bytes=%llu msgs_per_mb=%llu",
+		__entry->devnum, __entry->req_id, __entry->op,
+		__entry->blk_offset, __entry->num_blks, __entry->total_msgs,
+		__entry->total_bytes, __entry->msgs_per_mb)
+);
+
+TRACE_EVENT(vblk_ivc_complete,
+	TP_PROTO(uint32_t devnum, uint32_t req_id, int32_t status),
+
+	TP_ARGS(devnum, req_id, status),
+
+	TP_STRUCT__entry(
+		__field(uint32_t, devnum)
+		__field(uint32_t, req_id)
+		__field(int32_t, status)
+	),
+
+	TP_fast_assign(
+		__entry->devnum = devnum;
+		__entry->req_id = req_id;
+		__entry->status = status;
+	),
+
+	TP_printk("vblkdev%u req_id=0x%x status=%d",
+		__entry->devnum, __entry->req_id, __entry->status)
+);
+
+#endif /* _TRACE_TEGRA_HV_VBLK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -263,6 +263,22 @@ struct nvmap_fd_for_range_from_list {
 	__s32 fd; /* Sub range Dma Buf fd to be returned*/
 };
 
+#define NVMAP_ALLOC_BATCH_MAX	256
+
+/**
+ * Struct used while creating and allocating a batch of handles
+ */
+struct nvmap_alloc_batch {
+	__u64 size;		/* Size of each handle */
+	__u64 handles;		/* Pointer to __u32[num_handles], returns ids/fds */
+	__u32 num_handles;	/* Number of handles to create */
+	__u32 heap_mask;	/* heaps to allocate from */
+	__u32 flags;		/* wb/wc/uc/iwb etc. */
+	__u32 align;		/* min alignment necessary */
+	__s32 numa_nid;		/* NUMA node id */
+	__u32 reserved;
+};
+
 #define NVMAP_IOC_MAGIC 'N'
 
 /* Creates a new memory handle. On input, the argument is the size of the new
@@ -369,6 +385,10 @@ struct nvmap_fd_for_range_from_list {
 #define NVMAP_IOC_GET_FD_FOR_RANGE_FROM_LIST _IOR(NVMAP_IOC_MAGIC, 107, \
 		struct nvmap_fd_for_range_from_list)
 
-#define NVMAP_IOC_MAXNR (_IOC_NR(NVMAP_IOC_GET_FD_FOR_RANGE_FROM_LIST))
+/* Create, allocate and export a batch of same-sized handles */
+#define NVMAP_IOC_ALLOC_BATCH _IOWR(NVMAP_IOC_MAGIC, 108, \
+		struct nvmap_alloc_batch)
+
+#define NVMAP_IOC_MAXNR (_IOC_NR(NVMAP_IOC_ALLOC_BATCH))
 
 #endif /* __UAPI_LINUX_NVMAP_H */
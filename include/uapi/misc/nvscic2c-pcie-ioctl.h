@@ -187,6 +187,19 @@ struct nvscic2c_pcie_submit_copy_args {
 	__u64 remote_post_fence_values;
 };
 
+/*
+ * @copy_requests: user memory atleast of size:
+ *  num_copy_requests * sizeof(struct nvscic2c_pcie_submit_copy_args)
+ *
+ * All the copy requests are submitted to eDMA as one chained transfer.
+ * num_copy_requests shall not exceed max_copy_requests, and their flush
+ * ranges together shall fit in one eDMA submission (-E2BIG otherwise).
+ */
+struct nvscic2c_pcie_submit_copy_batch_args {
+	__u64 num_copy_requests;
+	__u64 copy_requests;
+};
+
 /**
  * stream extensions - Pass upper limit for the total possible outstanding
  * submit copy requests.
@@ -206,6 +219,7 @@ struct nvscic2c_pcie_max_copy_args {
 union nvscic2c_pcie_ioctl_arg_max_size {
 	struct nvscic2c_pcie_max_copy_args mc;
 	struct nvscic2c_pcie_submit_copy_args cr;
+	struct nvscic2c_pcie_submit_copy_batch_args cb;
 	struct nvscic2c_pcie_free_obj_args fo;
 	struct nvscic2c_pcie_import_obj_args io;
 	struct nvscic2c_pcie_export_obj_args eo;
@@ -268,6 +282,13 @@ union nvscic2c_pcie_ioctl_arg_max_size {
 	_IOW(NVSCIC2C_PCIE_IOCTL_MAGIC, 8,\
 	      struct nvscic2c_pcie_max_copy_args)
 
-#define NVSCIC2C_PCIE_IOCTL_NUMBER_MAX 8
+/**
+ * Submit a batch of Copy requests for transfer in one eDMA submission.
+ */
+#define NVSCIC2C_PCIE_IOCTL_SUBMIT_COPY_REQUESTS \
+	_IOW(NVSCIC2C_PCIE_IOCTL_MAGIC, 9,\
+	      struct nvscic2c_pcie_submit_copy_batch_args)
+
+#define NVSCIC2C_PCIE_IOCTL_NUMBER_MAX 9
 
 #endif /*__UAPI_NVSCIC2C_PCIE_IOCTL_H__*/
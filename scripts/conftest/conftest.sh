@@ -6933,6 +6933,24 @@ compile_test() {
             compile_check_conftest "$CODE" "NV_REQUEST_STRUCT_HAS_COMPLETION_DATA_ARG" "" "types"
         ;;
 
+        skb_mark_for_recycle_has_skb_arg_only)
+            #
+            # Determine if the 'skb_mark_for_recycle' function takes only
+            # the 'skb' argument.
+            #
+            # skb_mark_for_recycle() was added in Linux v5.14 with 'page'
+            # and 'page_pool' arguments, which were dropped in Linux v5.15.
+            # napi_build_skb() is available in both.
+            #
+            CODE="
+            #include <linux/skbuff.h>
+            void conftest_skb_mark_for_recycle_has_skb_arg_only(struct sk_buff *skb) {
+                    skb_mark_for_recycle(skb);
+            }"
+
+            compile_check_conftest "$CODE" "NV_SKB_MARK_FOR_RECYCLE_HAS_SKB_ARG_ONLY" "" "types"
+        ;;
+
         snd_soc_card_jack_new_has_no_snd_soc_jack_pins)
             #
             # Determine if the function snd_soc_card_jack_new() has 'pins' and